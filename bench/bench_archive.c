@@ -0,0 +1,247 @@
+/**
+ * @file bench_archive.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 归档压缩：对比直接保存抓取的协议3数据包与重新压缩为归档的空间和解压吞吐。
+ *          bench_archive -D 抓取目录 [-o 输出目录] [-s 字典大小KB，0为不训练字典] [-q 压缩等级] [-L 解压遍数]
+ *          依次测量：逐个解压原始数据包并切分出消息；不使用字典的归档；用抓取数据训练字典后的归档。
+ *          解压吞吐按解出的消息正文字节计算，取-L遍中最快的一遍，数据已在页缓存中
+ * @version 0.1
+ * @date 2023-02-26
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "brotli/decode.h"
+#include "blive_internal.h"
+#include "msg.h"
+
+
+typedef struct {
+    uint64_t    msgs;
+    uint64_t    bytes;
+    uint64_t    failed;
+    char*       unzip;
+    size_t      capacity;
+} decode_count;
+
+/**
+ * @brief 与接收时相同：数据包逐个解压，再按内层头部切分出消息
+ * 
+ */
+static int frame_decode(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data)
+{
+    decode_count*               count = (decode_count*)usr_data;
+    const blive_msg_header*     wire = (const blive_msg_header*)frame;
+    uint16_t                    header_size = ntohs(wire->header_size);
+    size_t                      decoded = count->capacity;
+    uint32_t                    packet_size = 0;
+
+    if (ntohs(wire->msg_proto) != BLIVE_MSG_PROTO_CMDCOMPRESBROTLI) {
+        count->msgs++;
+        count->bytes += size - header_size;
+        return OK;
+    }
+    while (BrotliDecoderDecompress(size - header_size, (const uint8_t*)frame + header_size, &decoded,
+                                   (uint8_t*)count->unzip) != BROTLI_DECODER_RESULT_SUCCESS) {
+        if (count->capacity >= 64 * 1024 * 1024) {
+            count->failed++;
+            return OK;
+        }
+        count->capacity *= 2;
+        count->unzip = realloc(count->unzip, count->capacity);
+        decoded = count->capacity;
+    }
+    for (size_t pos = 0; pos + sizeof(blive_msg_header) <= decoded; pos += packet_size) {
+        wire = (const blive_msg_header*)(count->unzip + pos);
+        packet_size = ntohl(wire->packet_size);
+        header_size = ntohs(wire->header_size);
+        if (packet_size < header_size || packet_size > decoded - pos) {
+            count->failed++;
+            break;
+        }
+        count->msgs++;
+        count->bytes += packet_size - header_size;
+    }
+    return OK;
+}
+
+static int archive_msg(const blive_archive_msg* msg, void* usr_data)
+{
+    ((decode_count*)usr_data)->msgs++;
+    ((decode_count*)usr_data)->bytes += msg->len;
+    return OK;
+}
+
+/**
+ * @brief 逐个解压原始数据包loops遍，返回最快一遍的耗时
+ * 
+ */
+static double frames_decode(blive_replay* replay, const uint64_t* ids, int room_num, int loops, decode_count* count)
+{
+    double      best = 0;
+    uint64_t    start = 0;
+
+    for (int loop = 0; loop < loops; loop++) {
+        count->msgs = count->bytes = count->failed = 0;
+        start = blive_clock_now_ns();
+        for (int index = 0; index < room_num; index++) {
+            blive_replay_scan(replay, ids[index], frame_decode, count);
+        }
+        start = blive_clock_now_ns() - start;
+        if (loop == 0 || start / 1e9 < best) {
+            best = start / 1e9;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 读取归档loops遍，返回最快一遍的耗时，打开失败时返回负数
+ * 
+ */
+static double archive_decode(const char* path, const char* dict_path, int loops, decode_count* count)
+{
+    blive_archive*  archive = NULL;
+    double          best = 0;
+    uint64_t        start = 0;
+
+    if (blive_archive_open(&archive, path, dict_path) != OK) {
+        return -1;
+    }
+    for (int loop = 0; loop < loops; loop++) {
+        count->msgs = count->bytes = 0;
+        start = blive_clock_now_ns();
+        if (blive_archive_read(archive, 0, archive_msg, count) == ERROR) {
+            count->failed++;
+        }
+        start = blive_clock_now_ns() - start;
+        if (loop == 0 || start / 1e9 < best) {
+            best = start / 1e9;
+        }
+    }
+    blive_archive_close(archive);
+    return best;
+}
+
+static void result_print(const char* name, uint64_t size, uint64_t frame_bytes, double seconds, const decode_count* count)
+{
+    printf("%-12s %10.2f MB  ratio %6.2fx  decode %8.1f MB/s  %10.0f msg/s\n", name, size / 1048576.0,
+           size ? (double)frame_bytes / size : 0, count->bytes / 1048576.0 / seconds, count->msgs / seconds);
+}
+
+int main(int argc, char** argv)
+{
+    int                     opt = 0;
+    const char*             dir = NULL;
+    const char*             out = NULL;
+    char                    plain_path[1024] = {0};
+    char                    dict_path[1024] = {0};
+    char                    dict_archive_path[1024] = {0};
+    int                     dict_kb = 64;
+    int                     quality = 0;
+    int                     loops = 3;
+    int                     dict_size = 0;
+    blive_replay*           replay = NULL;
+    blive_replay_stats      stats = {0};
+    blive_archive_stats     plain = {0};
+    blive_archive_stats     dicted = {0};
+    uint64_t*               ids = NULL;
+    int                     room_num = 0;
+    decode_count            frames = {0};
+    decode_count            count = {0};
+    double                  seconds = 0;
+    uint64_t                start = 0;
+
+    while ((opt = getopt(argc, argv, "D:o:s:q:L:h")) != -1) {
+        switch (opt) {
+        case 'D': dir = optarg; break;
+        case 'o': out = optarg; break;
+        case 's': dict_kb = atoi(optarg); break;
+        case 'q': quality = atoi(optarg); break;
+        case 'L': loops = atoi(optarg); break;
+        default:
+            printf("usage: %s -D capture_dir [-o output_dir] [-s dict_kb, 0 without dictionary] [-q quality] [-L loops]\n",
+                   argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (dir == NULL || dict_kb < 0 || loops < 1) {
+        printf("usage: %s -D capture_dir [-o output_dir] [-s dict_kb] [-q quality] [-L loops]\n", argv[0]);
+        return 1;
+    }
+    if (out == NULL) {
+        out = dir;
+    }
+    snprintf(plain_path, sizeof(plain_path), "%s/bench.arc", out);
+    snprintf(dict_path, sizeof(dict_path), "%s/bench.dict", out);
+    snprintf(dict_archive_path, sizeof(dict_archive_path), "%s/bench-dict.arc", out);
+
+    blive_api_init();
+    if (blive_replay_open(&replay, dir) != OK) {
+        printf("open capture in %s failed\n", dir);
+        return 1;
+    }
+    blive_get_replay_stats(replay, &stats);
+    room_num = stats.rooms;
+    ids = calloc(room_num, sizeof(uint64_t));
+    blive_replay_rooms(replay, ids, room_num);
+    printf("%u room(s), %llu frames, %.2f MB of captured frames\n", stats.rooms, (unsigned long long)stats.frames,
+           stats.bytes / 1048576.0);
+
+    frames.capacity = 64 * 1024;
+    frames.unzip = malloc(frames.capacity);
+    seconds = frames_decode(replay, ids, room_num, loops, &frames);
+    printf("%llu msgs, %.2f MB of message bodies, %llu frame(s) failed to decode\n\n",
+           (unsigned long long)frames.msgs, frames.bytes / 1048576.0, (unsigned long long)frames.failed);
+    result_print("frames", stats.bytes, stats.bytes, seconds, &frames);
+
+    start = blive_clock_now_ns();
+    if (blive_archive_compact(dir, plain_path, NULL, quality, &plain) != OK) {
+        printf("compact %s failed\n", plain_path);
+        return 1;
+    }
+    printf("%-12s compacted %u block(s) in %.2f s, %llu frame(s) skipped\n", "archive", plain.blocks,
+           (blive_clock_now_ns() - start) / 1e9, (unsigned long long)plain.skipped);
+    seconds = archive_decode(plain_path, NULL, loops, &count);
+    result_print("archive", plain.archive_bytes, stats.bytes, seconds, &count);
+    if (count.msgs != frames.msgs || count.bytes != frames.bytes) {
+        printf("mismatch: %llu msgs, %llu bytes\n", (unsigned long long)count.msgs, (unsigned long long)count.bytes);
+    }
+
+    if (dict_kb > 0) {
+        start = blive_clock_now_ns();
+        if ((dict_size = blive_archive_train(dir, dict_kb * 1024, dict_path)) == ERROR) {
+            printf("train dictionary failed\n");
+            return 1;
+        }
+        printf("%-12s trained %d byte(s) in %.2f s\n", "dict", dict_size, (blive_clock_now_ns() - start) / 1e9);
+        start = blive_clock_now_ns();
+        if (blive_archive_compact(dir, dict_archive_path, dict_path, quality, &dicted) != OK) {
+            printf("compact %s failed\n", dict_archive_path);
+            return 1;
+        }
+        printf("%-12s compacted %u block(s) in %.2f s\n", "archive+dict", dicted.blocks,
+               (blive_clock_now_ns() - start) / 1e9);
+        memset(&count, 0, sizeof(count));
+        seconds = archive_decode(dict_archive_path, dict_path, loops, &count);
+        result_print("archive+dict", dicted.archive_bytes, stats.bytes, seconds, &count);
+        printf("%-12s %10.2f MB  ratio %6.2fx  (dictionary counted once)\n", "", (dicted.archive_bytes + dict_size) / 1048576.0,
+               (double)stats.bytes / (dicted.archive_bytes + dict_size));
+        if (count.msgs != frames.msgs || count.bytes != frames.bytes) {
+            printf("mismatch: %llu msgs, %llu bytes\n", (unsigned long long)count.msgs, (unsigned long long)count.bytes);
+        }
+    }
+
+    blive_replay_close(replay);
+    free(frames.unzip);
+    free(ids);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
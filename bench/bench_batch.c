@@ -0,0 +1,125 @@
+/**
+ * @file bench_batch.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 批量回调性能测试：单个数据包内的消息数从1到256，分别测量逐条回调、读取JSON的批量回调、
+ *          只读取原文的批量回调每秒处理的事件数
+ * @version 0.1
+ * @date 2023-02-12
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "msg.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_EVENT_NUM     (256 * 1024)    /*每组测试处理的事件总数*/
+#define BENCH_BATCH_MAX     256
+
+static const char*  danmu_json = "{\"cmd\":\"DANMU_MSG\",\"info\":[[0,1,25,16777215,1676000000000,0,0,\"\",0,0,0,\"\",0,\"{}\",\"{}\"],"
+                                 "\"bench\",[10086,\"bench_user\",0,0,0,10000,1,\"\"],[],[0,0,9868950,\">50000\",0],[\"\",\"\"],0,0,null,"
+                                 "{\"ts\":1676000000,\"ct\":\"0\"},0,0,null,null,0,7]}";
+
+static size_t       handled = 0;
+static size_t       raw_bytes = 0;
+
+static void single_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    handled++;
+}
+
+static void batch_json_handler(blive* entity, blive_event* const* events, size_t count, void* usr_data)
+{
+    for (size_t index = 0; index < count; index++) {
+        blive_event_json(events[index]);
+    }
+    handled += count;
+}
+
+static void batch_raw_handler(blive* entity, blive_event* const* events, size_t count, void* usr_data)
+{
+    size_t  len = 0;
+
+    for (size_t index = 0; index < count; index++) {
+        blive_event_raw(events[index], &len);
+        raw_bytes += len;
+    }
+    handled += count;
+}
+
+/**
+ * @brief 构造一个与服务端格式一致的brotli压缩数据包，包含batch条弹幕消息
+ * 
+ * @param [in] batch 数据包内的消息数
+ * @param [out] header 传出外层数据包头部（主机字节序）
+ * @param [out] body_size 传出压缩后的正文长度
+ * @return char* 压缩后的正文
+ */
+static char* frame_build(int batch, blive_msg_header* header, size_t* body_size)
+{
+    size_t      json_len = strlen(danmu_json);
+    char*       plain = malloc(batch * (sizeof(blive_msg_header) + json_len));
+    size_t      plain_size = 0;
+    char*       compressed = NULL;
+
+    for (int count = 0; count < batch; count++) {
+        blive_msg_header*   inner = (blive_msg_header*)(plain + plain_size);
+
+        memcpy(inner->body, danmu_json, json_len);
+        plain_size += bench_msg_pack(inner, json_len);
+    }
+
+    compressed = bench_frame_compress(plain, plain_size, 5, header, body_size);
+    free(plain);
+    return compressed;
+}
+
+static double bench_run(int batch, blive_batch_handler batch_cb)
+{
+    blive*              entity = NULL;
+    blive_msg_header    header = {0};
+    size_t              body_size = 0;
+    char*               body = frame_build(batch, &header, &body_size);
+    double              begin = 0;
+    double              cost = 0;
+
+    blive_create(&entity, 0, 1000, 0);
+    if (batch_cb != NULL) {
+        blive_set_batch_callback(entity, BLIVE_INFO_BIT(BLIVE_INFO_DANMU_MSG), batch_cb, NULL);
+    } else {
+        blive_set_command_callback(entity, BLIVE_INFO_DANMU_MSG, single_handler, NULL);
+    }
+
+    handled = 0;
+    begin = bench_now_sec();
+    while (handled < BENCH_EVENT_NUM) {
+        blive_packet_process(entity, &header, body, body_size, blive_clock_now_ns());
+    }
+    cost = bench_now_sec() - begin;
+
+    blive_destroy(entity);
+    free(body);
+    return handled / cost;
+}
+
+int main()
+{
+    blive_api_init();
+    printf("%6s %18s %18s %18s\n", "batch", "single (ev/s)", "batch json (ev/s)", "batch raw (ev/s)");
+    for (int batch = 1; batch <= BENCH_BATCH_MAX; batch *= 2) {
+        double  single_rate = bench_run(batch, NULL);
+        double  json_rate = bench_run(batch, batch_json_handler);
+        double  raw_rate = bench_run(batch, batch_raw_handler);
+
+        printf("%6d %18.0f %18.0f %18.0f\n", batch, single_rate, json_rate, raw_rate);
+    }
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
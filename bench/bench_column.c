@@ -0,0 +1,352 @@
+/**
+ * @file bench_column.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 列式事件文件：把抓取中的弹幕、进场与礼物消息写成列式文件，对比逐条从消息原文提取字段与按列读取的查询耗时。
+ *          bench_column -D 抓取目录 [-o 输出目录] [-L 查询遍数]
+ *          查询：粉丝牌等级不低于20的弹幕数；送礼的价格乘数量之和；用户名为user_123的消息数。
+ *          原文查询对内存中的每条消息查找类型并用blive_field_extract提取字段，列式查询用blive_column_scan下推条件，
+ *          耗时取-L遍中最快的一遍，并给出列式查询访问的列块字节数与跳过的行组数
+ * @version 0.1
+ * @date 2023-02-27
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#include "brotli/decode.h"
+#include "blive_internal.h"
+#include "field.h"
+#include "msg.h"
+
+
+#define QUERY_UNAME     "user_123"
+
+static const char*  column_names[BLIVE_COLUMN_MAX] = {
+    "type", "room_id", "wall_ns", "timestamp", "uid", "uname", "medal_name", "medal_level", "user_level",
+    "guard_level", "text", "gift_id", "gift_name", "num", "price", "msg_type",
+};
+
+typedef struct {
+    uint64_t    room_id;
+    uint64_t    wall_ns;
+    size_t      offset;
+    int         len;
+} raw_msg;
+
+/**
+ * @brief 内存中的全部消息正文
+ * 
+ */
+typedef struct {
+    char*       data;
+    size_t      size;
+    size_t      capacity;
+    raw_msg*    msgs;
+    size_t      num;
+    size_t      msg_capacity;
+    char*       unzip;
+    size_t      unzip_capacity;
+    uint64_t    failed;
+} msg_store;
+
+typedef struct {
+    uint64_t    rows;
+    double      sum;
+} query_result;
+
+static void store_add(msg_store* store, uint64_t room_id, uint64_t wall_ns, const char* body, int len)
+{
+    while (store->size + len > store->capacity) {
+        store->capacity = store->capacity ? store->capacity * 2 : 1024 * 1024;
+        store->data = realloc(store->data, store->capacity);
+    }
+    if (store->num == store->msg_capacity) {
+        store->msg_capacity = store->msg_capacity ? store->msg_capacity * 2 : 4096;
+        store->msgs = realloc(store->msgs, sizeof(raw_msg) * store->msg_capacity);
+    }
+    memcpy(store->data + store->size, body, len);
+    store->msgs[store->num].room_id = room_id;
+    store->msgs[store->num].wall_ns = wall_ns;
+    store->msgs[store->num].offset = store->size;
+    store->msgs[store->num].len = len;
+    store->num++;
+    store->size += len;
+}
+
+/**
+ * @brief 解压抓取的数据包，切分出消息保存到内存
+ * 
+ */
+static int frame_load(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data)
+{
+    msg_store*                  store = (msg_store*)usr_data;
+    const blive_msg_header*     wire = (const blive_msg_header*)frame;
+    uint16_t                    header_size = ntohs(wire->header_size);
+    size_t                      decoded = store->unzip_capacity;
+    uint32_t                    packet_size = 0;
+
+    if (ntohl(wire->msg_operate) != BLIVE_MSG_TYPE_COMMAND) {
+        return OK;
+    }
+    if (ntohs(wire->msg_proto) != BLIVE_MSG_PROTO_CMDCOMPRESBROTLI) {
+        store_add(store, room_id, wall_ns, frame + header_size, size - header_size);
+        return OK;
+    }
+    while (BrotliDecoderDecompress(size - header_size, (const uint8_t*)frame + header_size, &decoded,
+                                   (uint8_t*)store->unzip) != BROTLI_DECODER_RESULT_SUCCESS) {
+        if (store->unzip_capacity >= 64 * 1024 * 1024) {
+            store->failed++;
+            return OK;
+        }
+        store->unzip_capacity *= 2;
+        store->unzip = realloc(store->unzip, store->unzip_capacity);
+        decoded = store->unzip_capacity;
+    }
+    for (size_t pos = 0; pos + sizeof(blive_msg_header) <= decoded; pos += packet_size) {
+        wire = (const blive_msg_header*)(store->unzip + pos);
+        packet_size = ntohl(wire->packet_size);
+        header_size = ntohs(wire->header_size);
+        if (packet_size < header_size || packet_size > decoded - pos) {
+            store->failed++;
+            break;
+        }
+        store_add(store, room_id, wall_ns, store->unzip + pos + header_size, packet_size - header_size);
+    }
+    return OK;
+}
+
+static void raw_medal(const msg_store* store, query_result* result)
+{
+    blive_field_value   value = {0};
+    const char*         body = NULL;
+
+    for (size_t i = 0; i < store->num; i++) {
+        body = store->data + store->msgs[i].offset;
+        if (blive_msg_type_lookup(body, store->msgs[i].len) == BLIVE_INFO_DANMU_MSG
+            && blive_field_extract(BLIVE_INFO_DANMU_MSG, body, store->msgs[i].len, BLIVE_FIELD_MEDAL_LEVEL, &value) == OK
+            && value.kind == BLIVE_FIELD_NUMBER && value.number >= 20) {
+            result->rows++;
+        }
+    }
+}
+
+static void raw_gift(const msg_store* store, query_result* result)
+{
+    blive_field_value   price = {0};
+    blive_field_value   num = {0};
+    const char*         body = NULL;
+
+    for (size_t i = 0; i < store->num; i++) {
+        body = store->data + store->msgs[i].offset;
+        if (blive_msg_type_lookup(body, store->msgs[i].len) == BLIVE_INFO_SEND_GIFT
+            && blive_field_extract(BLIVE_INFO_SEND_GIFT, body, store->msgs[i].len, BLIVE_FIELD_PRICE, &price) == OK
+            && blive_field_extract(BLIVE_INFO_SEND_GIFT, body, store->msgs[i].len, BLIVE_FIELD_NUM, &num) == OK
+            && price.kind == BLIVE_FIELD_NUMBER && num.kind == BLIVE_FIELD_NUMBER) {
+            result->rows++;
+            result->sum += price.number * num.number;
+        }
+    }
+}
+
+static void raw_uname(const msg_store* store, query_result* result)
+{
+    blive_field_value   value = {0};
+    const char*         body = NULL;
+    int                 type = 0;
+
+    for (size_t i = 0; i < store->num; i++) {
+        body = store->data + store->msgs[i].offset;
+        type = blive_msg_type_lookup(body, store->msgs[i].len);
+        if ((type == BLIVE_INFO_DANMU_MSG || type == BLIVE_INFO_INTERACT_WORD || type == BLIVE_INFO_SEND_GIFT
+             || type == BLIVE_INFO_COMBO_SEND)
+            && blive_field_extract(type, body, store->msgs[i].len, BLIVE_FIELD_UNAME, &value) == OK
+            && value.kind == BLIVE_FIELD_STRING && value.str_len == sizeof(QUERY_UNAME) - 1
+            && memcmp(value.str, QUERY_UNAME, value.str_len) == 0) {
+            result->rows++;
+        }
+    }
+}
+
+static int batch_count(const blive_column_batch* batch, void* usr_data)
+{
+    ((query_result*)usr_data)->rows += batch->rows;
+    return OK;
+}
+
+static int batch_gift(const blive_column_batch* batch, void* usr_data)
+{
+    const uint64_t*     price = batch->values[BLIVE_COLUMN_PRICE];
+    const uint64_t*     num = batch->values[BLIVE_COLUMN_GIFT_NUM];
+
+    ((query_result*)usr_data)->rows += batch->rows;
+    for (uint32_t i = 0; i < batch->rows; i++) {
+        ((query_result*)usr_data)->sum += (double)price[i] * num[i];
+    }
+    return OK;
+}
+
+/**
+ * @brief 依次执行三个查询loops遍，column为NULL时查询消息原文
+ * 
+ */
+static void query_run(const char* name, const msg_store* store, blive_column_reader* column, int loops)
+{
+    static const blive_column_id    gift_columns[] = {BLIVE_COLUMN_PRICE, BLIVE_COLUMN_GIFT_NUM};
+    blive_column_pred               medal_preds[] = {{BLIVE_COLUMN_TYPE, BLIVE_COLUMN_EQ, BLIVE_INFO_DANMU_MSG, NULL},
+                                                     {BLIVE_COLUMN_MEDAL_LEVEL, BLIVE_COLUMN_GE, 20, NULL}};
+    blive_column_pred               gift_preds[] = {{BLIVE_COLUMN_TYPE, BLIVE_COLUMN_EQ, BLIVE_INFO_SEND_GIFT, NULL}};
+    blive_column_pred               uname_preds[] = {{BLIVE_COLUMN_UNAME, BLIVE_COLUMN_EQ, 0, QUERY_UNAME}};
+    const char*                     queries[] = {"medal>=20", "gift sum", "uname"};
+    query_result                    result = {0};
+    blive_column_stats              before = {0};
+    blive_column_stats              after = {0};
+    double                          best = 0;
+    uint64_t                        start = 0;
+
+    for (int query = 0; query < 3; query++) {
+        for (int loop = 0; loop < loops; loop++) {
+            memset(&result, 0, sizeof(result));
+            blive_get_column_stats(column, &before);
+            start = blive_clock_now_ns();
+            switch (query) {
+            case 0:
+                if (column == NULL) {
+                    raw_medal(store, &result);
+                } else {
+                    blive_column_scan(column, NULL, 0, medal_preds, 2, batch_count, &result);
+                }
+                break;
+            case 1:
+                if (column == NULL) {
+                    raw_gift(store, &result);
+                } else {
+                    blive_column_scan(column, gift_columns, 2, gift_preds, 1, batch_gift, &result);
+                }
+                break;
+            default:
+                if (column == NULL) {
+                    raw_uname(store, &result);
+                } else {
+                    blive_column_scan(column, NULL, 0, uname_preds, 1, batch_count, &result);
+                }
+                break;
+            }
+            start = blive_clock_now_ns() - start;
+            blive_get_column_stats(column, &after);
+            if (loop == 0 || start / 1e9 < best) {
+                best = start / 1e9;
+            }
+        }
+        printf("%-8s %-10s %10llu rows  sum %14.0f  %9.3f ms", name, queries[query], (unsigned long long)result.rows,
+               result.sum, best * 1000);
+        if (column != NULL) {
+            printf("  touched %8.2f MB  skipped %llu/%llu group(s)", (after.touched_bytes - before.touched_bytes) / 1048576.0,
+                   (unsigned long long)(after.skipped_groups - before.skipped_groups),
+                   (unsigned long long)(after.skipped_groups - before.skipped_groups + after.scanned_groups - before.scanned_groups));
+        } else {
+            printf("  touched %8.2f MB", store->size / 1048576.0);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int                     opt = 0;
+    const char*             dir = NULL;
+    const char*             out = NULL;
+    char                    path[1024] = {0};
+    int                     loops = 3;
+    blive_replay*           replay = NULL;
+    blive_replay_stats      stats = {0};
+    uint64_t*               ids = NULL;
+    msg_store               store = {0};
+    blive_column_writer*    writer = NULL;
+    blive_column_reader*    reader = NULL;
+    blive_column_stats      column_stats = {0};
+    uint64_t                rows = 0;
+    uint64_t                typed_bytes = 0;
+    int                     written = 0;
+    uint64_t                start = 0;
+
+    while ((opt = getopt(argc, argv, "D:o:L:h")) != -1) {
+        switch (opt) {
+        case 'D': dir = optarg; break;
+        case 'o': out = optarg; break;
+        case 'L': loops = atoi(optarg); break;
+        default:
+            printf("usage: %s -D capture_dir [-o output_dir] [-L loops]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (dir == NULL || loops < 1) {
+        printf("usage: %s -D capture_dir [-o output_dir] [-L loops]\n", argv[0]);
+        return 1;
+    }
+    if (out == NULL) {
+        out = dir;
+    }
+    snprintf(path, sizeof(path), "%s/bench.col", out);
+
+    blive_api_init();
+    if (blive_replay_open(&replay, dir) != OK) {
+        printf("open capture in %s failed\n", dir);
+        return 1;
+    }
+    blive_get_replay_stats(replay, &stats);
+    ids = calloc(stats.rooms, sizeof(uint64_t));
+    blive_replay_rooms(replay, ids, stats.rooms);
+    store.unzip_capacity = 64 * 1024;
+    store.unzip = malloc(store.unzip_capacity);
+    for (uint32_t index = 0; index < stats.rooms; index++) {
+        blive_replay_scan(replay, ids[index], frame_load, &store);
+    }
+    blive_replay_close(replay);
+    printf("%u room(s), %zu msgs, %.2f MB of message bodies, %llu frame(s) failed to decode\n", stats.rooms, store.num,
+           store.size / 1048576.0, (unsigned long long)store.failed);
+
+    start = blive_clock_now_ns();
+    if (blive_column_create(&writer, path) != OK) {
+        printf("create %s failed\n", path);
+        return 1;
+    }
+    for (size_t i = 0; i < store.num; i++) {
+        written = blive_column_write(writer, store.msgs[i].room_id, store.msgs[i].wall_ns,
+                                     store.data + store.msgs[i].offset, store.msgs[i].len);
+        if (written == ERROR) {
+            printf("write %s failed\n", path);
+            return 1;
+        }
+        rows += written;
+        typed_bytes += written ? store.msgs[i].len : 0;
+    }
+    if (blive_column_finish(writer) != OK || blive_column_open(&reader, path) != OK) {
+        printf("save %s failed\n", path);
+        return 1;
+    }
+    blive_get_column_stats(reader, &column_stats);
+    printf("wrote %llu row(s) in %.2f s, %.2f MB of typed message bodies -> %.2f MB, %llu group(s)\n",
+           (unsigned long long)rows, (blive_clock_now_ns() - start) / 1e9, typed_bytes / 1048576.0,
+           column_stats.file_bytes / 1048576.0, (unsigned long long)column_stats.groups);
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        printf("  %-12s %10.3f MB  %6.2f B/row\n", column_names[column], column_stats.column_bytes[column] / 1048576.0,
+               rows ? (double)column_stats.column_bytes[column] / rows : 0);
+    }
+    printf("\n");
+
+    query_run("json", &store, NULL, loops);
+    query_run("column", &store, reader, loops);
+
+    blive_column_close(reader);
+    free(store.data);
+    free(store.msgs);
+    free(store.unzip);
+    free(ids);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
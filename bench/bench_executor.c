@@ -0,0 +1,113 @@
+/**
+ * @file bench_executor.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 回调执行器性能测试：使用耗时的模拟回调（如写数据库），对比直接执行与执行器执行时接收线程的阻塞时间
+ * @version 0.1
+ * @date 2023-02-04
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blive_internal.h"
+
+
+#define BENCH_ROOM_NUM          8
+#define BENCH_EVENT_PER_ROOM    500
+#define BENCH_HANDLER_US        200     /*模拟回调的耗时*/
+#define BENCH_GIFT_JSON         "{\"cmd\":\"SEND_GIFT\",\"data\":{\"uid\":10086,\"giftName\":\"bench\",\"num\":1,\"price\":100}}"
+
+
+static size_t   handled_count = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void slow_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    usleep(BENCH_HANDLER_US);
+    __atomic_fetch_add(&handled_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 模拟接收线程：依次向各个直播间投递消息，返回接收线程被占用的毫秒数
+ * 
+ * @param [in] rooms 直播间实体列表
+ * @return double
+ */
+static double bench_feed(blive** rooms)
+{
+    double  begin = now_ms();
+
+    for (int seq = 0; seq < BENCH_EVENT_PER_ROOM; seq++) {
+        for (int room = 0; room < BENCH_ROOM_NUM; room++) {
+            blive_event*    event = blive_event_create(BLIVE_INFO_SEND_GIFT, NULL, NULL, 0, cJSON_Parse(BENCH_GIFT_JSON));
+
+            if (rooms[room]->strand != NULL && blive_strand_submit(rooms[room]->strand, event) == OK) {
+                continue;
+            }
+            slow_handler(rooms[room], blive_event_json(event), NULL);
+            blive_event_release(event);
+        }
+    }
+
+    return now_ms() - begin;
+}
+
+static void bench_run(int worker_num)
+{
+    blive*          rooms[BENCH_ROOM_NUM] = {0};
+    blive_executor* exec = NULL;
+    double          feed_ms = 0;
+    double          total_ms = 0;
+    double          begin = 0;
+
+    if (worker_num && blive_executor_create(&exec, worker_num) != OK) {
+        printf("create executor failed\n");
+        return;
+    }
+    for (int room = 0; room < BENCH_ROOM_NUM; room++) {
+        blive_create(&rooms[room], 0, 1000 + room, 0);
+        blive_set_command_callback(rooms[room], BLIVE_INFO_SEND_GIFT, slow_handler, NULL);
+        blive_set_executor(rooms[room], exec);
+    }
+
+    handled_count = 0;
+    begin = now_ms();
+    feed_ms = bench_feed(rooms);
+    for (int room = 0; room < BENCH_ROOM_NUM; room++) {
+        blive_destroy(rooms[room]);     /*销毁时会等待回调执行完毕*/
+    }
+    total_ms = now_ms() - begin;
+
+    printf("%-10s workers=%-3d events=%-6zu recv-thread busy=%9.2f ms (%8.2f us/event)  all handled=%9.2f ms\n",
+           worker_num ? "executor" : "inline", worker_num, handled_count, feed_ms,
+           feed_ms * 1000 / (BENCH_ROOM_NUM * BENCH_EVENT_PER_ROOM), total_ms);
+
+    if (exec != NULL) {
+        blive_executor_destroy(exec);
+    }
+}
+
+int main()
+{
+    int     workers[] = {0, 1, 2, 4, 8};
+
+    blive_api_init();
+    printf("rooms=%d events/room=%d handler=%dus\n", BENCH_ROOM_NUM, BENCH_EVENT_PER_ROOM, BENCH_HANDLER_US);
+    for (int count = 0; count < sizeof(workers) / sizeof(workers[0]); count++) {
+        bench_run(workers[count]);
+    }
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+/**
+ * @file bench_filter.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 过滤性能测试：比较在用户回调中用cJSON过滤，与模块内过滤器在原文上过滤后再分发的吞吐量
+ * @version 0.1
+ * @date 2023-02-15
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "msg.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_BATCH_NUM     256             /*单个数据包内的消息数*/
+#define BENCH_ROUND         400
+#define BENCH_FILTER_EXPR   "type == SEND_GIFT && price > 1000 || type == DANMU_MSG && medal_level >= 20"
+
+static const char*  danmu_fmt = "{\"cmd\":\"DANMU_MSG\",\"info\":[[0,1,25,16777215,1676000000000,0,0,\"\",0,0,0,\"\",0,\"{}\",\"{}\"],"
+                                "\"bench\",[%d,\"bench_user\",0,0,0,10000,1,\"\"],[%d,\"medal\",\"anchor\",1000,9868950],"
+                                "[12,0,9868950,\">50000\",0],[\"\",\"\"],0,0,null,{\"ts\":1676000000,\"ct\":\"0\"},0,0,null,null,0,7]}";
+static const char*  gift_fmt = "{\"cmd\":\"SEND_GIFT\",\"data\":{\"uid\":%d,\"uname\":\"bench_user\",\"giftId\":31036,"
+                               "\"giftName\":\"bench\",\"num\":1,\"price\":%d,\"total_coin\":%d,\"coin_type\":\"gold\","
+                               "\"medal_info\":{\"medal_level\":10,\"medal_name\":\"medal\"}}}";
+
+static size_t       matched = 0;
+
+/**
+ * @brief 在回调中用cJSON实现与BENCH_FILTER_EXPR相同的条件
+ * 
+ */
+static void callback_filter(blive* entity, const cJSON* msg, void* usr_data)
+{
+    cJSON*  item = NULL;
+
+    if ((intptr_t)usr_data == BLIVE_INFO_SEND_GIFT) {
+        item = cJSON_GetObjectItem(cJSON_GetObjectItem(msg, "data"), "price");
+        matched += (item != NULL && item->valuedouble > 1000) ? 1 : 0;
+    } else {
+        item = cJSON_GetArrayItem(cJSON_GetArrayItem(cJSON_GetObjectItem(msg, "info"), 3), 0);
+        matched += (item != NULL && item->valuedouble >= 20) ? 1 : 0;
+    }
+}
+
+static void json_count(blive* entity, const cJSON* msg, void* usr_data)
+{
+    matched++;
+}
+
+static void event_count(blive* entity, const blive_event* event, void* usr_data)
+{
+    matched++;
+}
+
+/**
+ * @brief 构造一个brotli压缩数据包，弹幕与送礼各占一半，约10%的消息满足过滤条件
+ * 
+ */
+static char* frame_build(blive_msg_header* header, size_t* body_size)
+{
+    char*       plain = malloc(BENCH_BATCH_NUM * 1024);
+    size_t      plain_size = 0;
+    char*       compressed = NULL;
+    int         json_len = 0;
+
+    srand(1);
+    for (int count = 0; count < BENCH_BATCH_NUM; count++) {
+        blive_msg_header*   inner = (blive_msg_header*)(plain + plain_size);
+        int                 price = 100 * (rand() % 12);
+
+        if (count % 2) {
+            json_len = sprintf(inner->body, gift_fmt, 10000 + count, price, price);
+        } else {
+            json_len = sprintf(inner->body, danmu_fmt, 10000 + count, rand() % 22);
+        }
+        plain_size += bench_msg_pack(inner, json_len);
+    }
+
+    compressed = bench_frame_compress(plain, plain_size, 5, header, body_size);
+    free(plain);
+    return compressed;
+}
+
+/**
+ * @brief mode 0：回调中过滤；1：过滤器 + JSON回调；2：过滤器 + 事件回调
+ * 
+ */
+static void bench_run(const char* name, int mode, const blive_msg_header* header, char* body, size_t body_size)
+{
+    blive*          entity = NULL;
+    blive_filter*   filter = NULL;
+    double          cost = 0;
+
+    blive_create(&entity, 0, 1000, 0);
+    if (mode == 0) {
+        blive_set_command_callback(entity, BLIVE_INFO_SEND_GIFT, callback_filter, (void*)(intptr_t)BLIVE_INFO_SEND_GIFT);
+        blive_set_command_callback(entity, BLIVE_INFO_DANMU_MSG, callback_filter, (void*)(intptr_t)BLIVE_INFO_DANMU_MSG);
+    } else {
+        blive_filter_compile(&filter, BENCH_FILTER_EXPR);
+        blive_set_filter(entity, filter);
+        if (mode == 1) {
+            blive_set_command_callback(entity, BLIVE_INFO_SEND_GIFT, json_count, NULL);
+            blive_set_command_callback(entity, BLIVE_INFO_DANMU_MSG, json_count, NULL);
+        } else {
+            blive_set_event_callback(entity, BLIVE_INFO_SEND_GIFT, event_count, NULL);
+            blive_set_event_callback(entity, BLIVE_INFO_DANMU_MSG, event_count, NULL);
+        }
+    }
+
+    matched = 0;
+    cost = bench_now_sec();
+    for (int round = 0; round < BENCH_ROUND; round++) {
+        blive_packet_process(entity, header, body, body_size, blive_clock_now_ns());
+    }
+    cost = bench_now_sec() - cost;
+
+    printf("%-28s %12.0f msg/s  matched=%zu\n", name, BENCH_BATCH_NUM * BENCH_ROUND / cost, matched);
+    blive_destroy(entity);
+    blive_filter_destroy(filter);
+}
+
+int main()
+{
+    blive_msg_header    header = {0};
+    size_t              body_size = 0;
+    char*               body = NULL;
+
+    blive_api_init();
+    body = frame_build(&header, &body_size);
+    printf("filter: %s\n", BENCH_FILTER_EXPR);
+    bench_run("filter in callback", 0, &header, body, body_size);
+    bench_run("filter + json callback", 1, &header, body, body_size);
+    bench_run("filter + event callback", 2, &header, body, body_size);
+    free(body);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
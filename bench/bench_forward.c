@@ -0,0 +1,160 @@
+/**
+ * @file bench_forward.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 转发性能测试：比较JSON回调重新序列化转发、事件回调直接复制原文转发，与解压后直接memcpy的吞吐量
+ * @version 0.1
+ * @date 2023-02-13
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "brotli/decode.h"
+
+#include "msg.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_BATCH_NUM     256             /*单个数据包内的消息数*/
+#define BENCH_ROUND         1000
+#define FORWARD_BUF_SIZE    (1024 * 1024)
+
+static const char*  danmu_json = "{\"cmd\":\"DANMU_MSG\",\"info\":[[0,1,25,16777215,1676000000000,0,0,\"\",0,0,0,\"\",0,\"{}\",\"{}\"],"
+                                 "\"bench\",[10086,\"bench_user\",0,0,0,10000,1,\"\"],[],[0,0,9868950,\">50000\",0],[\"\",\"\"],0,0,null,"
+                                 "{\"ts\":1676000000,\"ct\":\"0\"},0,0,null,null,0,7]}";
+
+static char         forward_buf[FORWARD_BUF_SIZE];  /*模拟转发的下游缓冲区*/
+static size_t       forward_len = 0;
+static size_t       forward_total = 0;
+
+static void forward(const char* data, size_t len)
+{
+    if (forward_len + len > FORWARD_BUF_SIZE) {
+        forward_len = 0;
+    }
+    memcpy(forward_buf + forward_len, data, len);
+    forward_len += len;
+    forward_total += len;
+}
+
+static void json_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    char*   text = cJSON_PrintUnformatted(msg);
+
+    forward(text, strlen(text));
+    cJSON_free(text);
+}
+
+static void event_handler(blive* entity, const blive_event* event, void* usr_data)
+{
+    size_t      len = 0;
+    const char* raw = blive_event_raw(event, &len);
+
+    forward(raw, len);
+}
+
+/**
+ * @brief 构造一个与服务端格式一致的brotli压缩数据包，包含BENCH_BATCH_NUM条弹幕消息
+ * 
+ * @param [out] header 传出外层数据包头部（主机字节序）
+ * @param [out] body_size 传出压缩后的正文长度
+ * @param [out] plain_size 传出压缩前的正文长度
+ * @return char* 压缩后的正文
+ */
+static char* frame_build(blive_msg_header* header, size_t* body_size, size_t* plain_size)
+{
+    size_t      json_len = strlen(danmu_json);
+    char*       plain = malloc(BENCH_BATCH_NUM * (sizeof(blive_msg_header) + json_len));
+    char*       compressed = NULL;
+
+    *plain_size = 0;
+    for (int count = 0; count < BENCH_BATCH_NUM; count++) {
+        blive_msg_header*   inner = (blive_msg_header*)(plain + *plain_size);
+
+        memcpy(inner->body, danmu_json, json_len);
+        *plain_size += bench_msg_pack(inner, json_len);
+    }
+
+    compressed = bench_frame_compress(plain, *plain_size, 5, header, body_size);
+    free(plain);
+    return compressed;
+}
+
+/**
+ * @brief 基准：只解压并按消息头复制每条消息，不经过blive的分发
+ * 
+ */
+static double bench_memcpy(const char* body, size_t body_size, size_t plain_size)
+{
+    char*   plain = malloc(plain_size);
+    size_t  decoded = 0;
+    size_t  offset = 0;
+    double  begin = bench_now_sec();
+
+    forward_total = 0;
+    for (int round = 0; round < BENCH_ROUND; round++) {
+        decoded = plain_size;
+        BrotliDecoderDecompress(body_size, (const uint8_t*)body, &decoded, (uint8_t*)plain);
+        for (offset = 0; offset < decoded; offset += ntohl(((blive_msg_header*)(plain + offset))->packet_size)) {
+            forward(plain + offset + sizeof(blive_msg_header),
+                    ntohl(((blive_msg_header*)(plain + offset))->packet_size) - sizeof(blive_msg_header));
+        }
+    }
+    free(plain);
+
+    return forward_total / (bench_now_sec() - begin) / (1024 * 1024);
+}
+
+static double bench_run(const blive_msg_header* header, char* body, size_t body_size, Bool raw)
+{
+    blive*  entity = NULL;
+    double  begin = 0;
+
+    blive_create(&entity, 0, 1000, 0);
+    if (raw) {
+        blive_set_event_callback(entity, BLIVE_INFO_DANMU_MSG, event_handler, NULL);
+    } else {
+        blive_set_command_callback(entity, BLIVE_INFO_DANMU_MSG, json_handler, NULL);
+    }
+
+    forward_total = 0;
+    begin = bench_now_sec();
+    for (int round = 0; round < BENCH_ROUND; round++) {
+        blive_packet_process(entity, header, body, body_size, blive_clock_now_ns());
+    }
+    begin = bench_now_sec() - begin;
+
+    blive_destroy(entity);
+    return forward_total / begin / (1024 * 1024);
+}
+
+int main()
+{
+    blive_msg_header    header = {0};
+    size_t              body_size = 0;
+    size_t              plain_size = 0;
+    char*               body = NULL;
+    double              base = 0;
+    double              rate = 0;
+
+    blive_api_init();
+    body = frame_build(&header, &body_size, &plain_size);
+    printf("batch=%d msgs, %zu bytes compressed to %zu\n", BENCH_BATCH_NUM, plain_size, body_size);
+
+    base = bench_memcpy(body, body_size, plain_size);
+    printf("%-24s %10.1f MB/s\n", "decompress + memcpy", base);
+    rate = bench_run(&header, body, body_size, False);
+    printf("%-24s %10.1f MB/s  (%5.1f%%)\n", "json callback + print", rate, rate * 100 / base);
+    rate = bench_run(&header, body, body_size, True);
+    printf("%-24s %10.1f MB/s  (%5.1f%%)\n", "event callback raw copy", rate, rate * 100 / base);
+
+    free(body);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+/**
+ * @file bench_keywords.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 关键词匹配性能测试：比较逐个关键词strstr与关键词自动机一次扫描在不同关键词数量下的吞吐量
+ * @version 0.1
+ * @date 2023-02-16
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "keyword.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_TEXT_NUM      1024            /*弹幕文本数*/
+#define BENCH_TEXT_LEN      60              /*单条弹幕文本的字节数，约20个汉字*/
+#define BENCH_WORD_LEN      4               /*关键词的字符数*/
+#define BENCH_DURATION      0.5             /*每项测试的最短时长（秒）*/
+
+static const char*  hanzi[] = {"主", "播", "好", "厉", "害", "哈", "礼", "物", "上", "舰", "来", "了", "牛", "呀",
+                               "这", "个", "是", "什", "么", "游", "戏", "打", "卡", "晚", "安", "早", "加", "油"};
+
+static void random_text(char* dst, int chars)
+{
+    dst[0] = '\0';
+    for (int count = 0; count < chars; count++) {
+        strcat(dst, hanzi[rand() % (sizeof(hanzi) / sizeof(hanzi[0]))]);
+    }
+}
+
+static void bench_run(size_t word_num)
+{
+    char**          words = malloc(sizeof(char*) * word_num);
+    uint32_t*       ids = malloc(sizeof(uint32_t) * word_num);
+    char            (*texts)[BENCH_TEXT_LEN + 1] = malloc((BENCH_TEXT_LEN + 1) * BENCH_TEXT_NUM);
+    blive_keywords* kw = NULL;
+    blive_ac*       ac = NULL;
+    uint32_t        found[BLIVE_KEYWORD_TAG_MAX];
+    size_t          strstr_hits = 0;
+    size_t          ac_hits = 0;
+    size_t          strstr_texts = 0;
+    size_t          ac_texts = 0;
+    double          begin = 0;
+    double          strstr_cost = 0;
+    double          ac_cost = 0;
+    double          build_cost = 0;
+
+    srand(word_num);
+    for (size_t count = 0; count < word_num; count++) {
+        words[count] = malloc(BENCH_WORD_LEN * 3 + 1);
+        random_text(words[count], BENCH_WORD_LEN);
+        ids[count] = count;
+    }
+    for (int count = 0; count < BENCH_TEXT_NUM; count++) {
+        random_text(texts[count], BENCH_TEXT_LEN / 3);
+    }
+
+    begin = bench_now_sec();
+    blive_keywords_create(&kw);
+    blive_keywords_update(kw, (const char* const*)words, ids, word_num);
+    build_cost = bench_now_sec() - begin;
+    ac = blive_keywords_acquire(kw);
+
+    begin = bench_now_sec();
+    do {
+        for (int count = 0; count < BENCH_TEXT_NUM; count++) {
+            for (size_t word = 0; word < word_num; word++) {
+                strstr_hits += strstr(texts[count], words[word]) != NULL ? 1 : 0;
+            }
+        }
+        strstr_texts += BENCH_TEXT_NUM;
+    } while ((strstr_cost = bench_now_sec() - begin) < BENCH_DURATION);
+
+    begin = bench_now_sec();
+    do {
+        for (int count = 0; count < BENCH_TEXT_NUM; count++) {
+            ac_hits += blive_ac_match(ac, texts[count], BENCH_TEXT_LEN, found, BLIVE_KEYWORD_TAG_MAX);
+        }
+        ac_texts += BENCH_TEXT_NUM;
+    } while ((ac_cost = bench_now_sec() - begin) < BENCH_DURATION);
+
+    printf("%6ld keywords: strstr %10.0f msg/s  automaton %10.0f msg/s  (%6.0fx, build %.1f ms, hits/msg %.3f vs %.3f)\n",
+           word_num, strstr_texts / strstr_cost, ac_texts / ac_cost, (ac_texts / ac_cost) / (strstr_texts / strstr_cost),
+           build_cost * 1000, (double)strstr_hits / strstr_texts, (double)ac_hits / ac_texts);
+
+    blive_ac_release(ac);
+    blive_keywords_destroy(kw);
+    for (size_t count = 0; count < word_num; count++) {
+        free(words[count]);
+    }
+    free(words);
+    free(ids);
+    free(texts);
+}
+
+int main()
+{
+    size_t  word_nums[] = {10, 100, 1000, 10000, 50000};
+
+    blive_api_init();
+    printf("text=%d bytes, keyword=%d chars\n", BENCH_TEXT_LEN, BENCH_WORD_LEN);
+    for (size_t count = 0; count < sizeof(word_nums) / sizeof(word_nums[0]); count++) {
+        bench_run(word_nums[count]);
+    }
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
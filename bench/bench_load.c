@@ -0,0 +1,475 @@
+/**
+ * @file bench_load.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 压测客户端：通过blive_set_danmu_info_url连接本地的mock_server，同时接入多个直播间，
+ *          统计每秒收到的消息数，以及从服务端生成消息（send_ns）到事件回调的延迟分位数。
+ *          bench_load [-n 直播间数] [-t 秒数] [-d 解码线程数] [-e 执行器线程数，0为不使用]
+ *                     [-u getDanmuInfo地址] [-r 起始直播间id] [-R 最大重连次数]
+ *                     [-s 故障:比例:持续毫秒[:参数]]... [-c 故障注入地址] [-T 恢复超时秒数] [-C 抓取目录]
+ *          指定-s时为场景模式：运行-t秒后依次注入各个故障，记录所有直播间恢复的时间与恢复期间的CPU占用。
+ *          故障为mock_server支持的reset、halfopen、split、authfail、hbdelay，或者在客户端模拟的slow
+ *          （持续时间内选中的直播间每条消息的回调阻塞参数微秒，模拟读取缓慢的客户端）。
+ *          直播间收到故障结束后服务端生成的消息即视为恢复。
+ *          指定-C时所有直播间的数据包抓取到该目录，用于对比抓取对接收延迟的影响。
+ * @version 0.1
+ * @date 2023-02-23
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define LOAD_DEFAULT_URL    "http://127.0.0.1:22431/xlive/web-room/v1/index/getDanmuInfo"
+#define LOAD_TIMER_MAX      4096
+#define LOAD_CONTROL_URL    "http://127.0.0.1:22431/fault"
+#define LOAD_STEP_MAX       16
+
+/**
+ * @brief 场景模式中的一个故障步骤
+ * 
+ */
+typedef struct {
+    char        kind[16];
+    double      fraction;
+    uint64_t    duration_ms;
+    uint64_t    arg;
+} load_step;
+
+/**
+ * @brief 每个直播间的恢复状态，由回调线程写入，场景线程读取
+ * 
+ */
+typedef struct {
+    uint64_t    recovered_ns;           /*第一次收到恢复阈值之后生成的消息的时间*/
+} load_room;
+
+/**
+ * @brief 供blive_establish_connection发送心跳包使用的简单定时器，由一个线程每100毫秒检查一次
+ * 
+ */
+typedef struct {
+    uint64_t            due_ns;
+    blive_schedule_cb   cb;
+    void*               ctx;
+} load_timer;
+
+static struct {
+    pthread_mutex_t     lock;
+    load_timer          timers[LOAD_TIMER_MAX];
+    int                 num;
+    Bool                stop;
+} sched = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t             received = 0;
+static uint64_t             late = 0;                   /*消息中没有send_ns，无法计算延迟*/
+static blive_metric_hist    latency;                    /*send_ns到回调的延迟*/
+static load_room*           rooms = NULL;
+static uint32_t             first_room = 1000;
+static uint64_t             recover_after = 0;          /*非0时，收到send_ns不小于该值的消息视为恢复*/
+static uint64_t             slow_until = 0;             /*模拟读取缓慢的客户端*/
+static double               slow_fraction = 0;
+static uint64_t             slow_us = 0;
+
+static int sched_add(void* sched_entity, size_t millisec, blive_schedule_cb cb, void* cb_context)
+{
+    int     retval = ERROR;
+
+    pthread_mutex_lock(&sched.lock);
+    if (sched.num < LOAD_TIMER_MAX) {
+        sched.timers[sched.num].due_ns = blive_clock_now_ns() + millisec * 1000000ULL;
+        sched.timers[sched.num].cb = cb;
+        sched.timers[sched.num].ctx = cb_context;
+        sched.num++;
+        retval = OK;
+    }
+    pthread_mutex_unlock(&sched.lock);
+    return retval;
+}
+
+static void* sched_routine(void* arg)
+{
+    load_timer  timer = {0};
+    Bool        fired = False;
+
+    while (!__atomic_load_n(&sched.stop, __ATOMIC_RELAXED)) {
+        usleep(100 * 1000);
+        do {
+            fired = False;
+            pthread_mutex_lock(&sched.lock);
+            for (int index = 0; index < sched.num; index++) {
+                if (sched.timers[index].due_ns <= blive_clock_now_ns()) {
+                    timer = sched.timers[index];
+                    sched.timers[index] = sched.timers[--sched.num];
+                    fired = True;
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&sched.lock);
+            /*回调内会重新注册定时器，解锁后再调用*/
+            if (fired) {
+                timer.cb(timer.ctx);
+            }
+        } while (fired);
+    }
+    return NULL;
+}
+
+static void event_handler(blive* entity, const blive_event* event, void* usr_data)
+{
+    size_t          len = 0;
+    const char*     raw = blive_event_raw(event, &len);
+    const char*     send_ns = NULL;
+    uint64_t        now = blive_clock_now_ns();
+    uint64_t        sent = 0;
+    uint64_t        threshold = 0;
+    load_room*      room = NULL;
+
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELAXED);
+    if (raw == NULL || (send_ns = strstr(raw, "\"send_ns\":")) == NULL || send_ns >= raw + len) {
+        __atomic_fetch_add(&late, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    sent = strtoull(send_ns + strlen("\"send_ns\":"), NULL, 10);
+    blive_metrics_hist_add(&latency, now > sent ? now - sent : 0);
+
+    room = &rooms[entity->room_id - first_room];
+    threshold = __atomic_load_n(&recover_after, __ATOMIC_ACQUIRE);
+    if (threshold && sent >= threshold && !__atomic_load_n(&room->recovered_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&room->recovered_ns, now, __ATOMIC_RELAXED);
+    }
+    /*与mock_server相同的选择方式：按直播间号散列*/
+    if (now < __atomic_load_n(&slow_until, __ATOMIC_RELAXED)
+        && (entity->room_id * 2654435761U) % 10000 < slow_fraction * 10000) {
+        usleep(slow_us);
+    }
+}
+
+static size_t inject_reply(char* data, size_t size, size_t nmemb, void* usr_data)
+{
+    char*   reply = (char*)usr_data;
+    size_t  len = strlen(reply);
+    size_t  copy = size * nmemb;
+
+    if (copy > 255 - len) {
+        copy = 255 - len;
+    }
+    memcpy(reply + len, data, copy);
+    return size * nmemb;
+}
+
+/**
+ * @brief 通过mock_server的控制接口注入故障
+ * 
+ * @param [in] control 控制接口地址
+ * @param [in] step 故障步骤
+ * @return uint64_t 故障在服务端生效的时间，失败返回0
+ */
+static uint64_t fault_inject(const char* control, const load_step* step)
+{
+    CURL*       handle = curl_easy_init();
+    char        url[512] = {0};
+    char        reply[256] = {0};
+    const char* applied = NULL;
+    CURLcode    ret = CURLE_OK;
+
+    snprintf(url, sizeof(url), "%s?kind=%s&fraction=%g&duration=%llu&arg=%llu", control, step->kind, step->fraction,
+             (unsigned long long)step->duration_ms, (unsigned long long)step->arg);
+    curl_easy_setopt(handle, CURLOPT_URL, url);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, inject_reply);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, reply);
+    ret = curl_easy_perform(handle);
+    curl_easy_cleanup(handle);
+
+    if (ret != CURLE_OK || (applied = strstr(reply, "\"applied_ns\":")) == NULL) {
+        printf("inject %s failed: %s %s\n", step->kind, curl_easy_strerror(ret), reply);
+        return 0;
+    }
+    return strtoull(applied + strlen("\"applied_ns\":"), NULL, 10);
+}
+
+static int recovery_cmp(const void* a, const void* b)
+{
+    uint64_t    x = *(const uint64_t*)a;
+    uint64_t    y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double rusage_ms(const struct timeval* tv)
+{
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+/**
+ * @brief 执行一个故障步骤：注入后等待所有连接中的直播间恢复或超时，输出恢复时间分布、重连次数与CPU占用。
+ *          恢复时间从故障结束（服务端生效时间加持续时间）算起
+ * 
+ * @param [in] step 故障步骤
+ * @param [in] control 控制接口地址
+ * @param [in] running 各直播间是否在接收
+ * @param [in] room_num 直播间数
+ * @param [in] timeout_s 恢复超时秒数
+ */
+static void scenario_step(const load_step* step, const char* control, const Bool* running, int room_num, int timeout_s)
+{
+    struct rusage   before = {0};
+    struct rusage   after = {0};
+    blive_metrics*  metrics = malloc(sizeof(blive_metrics));
+    uint64_t*       recovery = calloc(room_num, sizeof(uint64_t));
+    uint64_t        reconnects = 0;
+    uint64_t        applied = 0;
+    uint64_t        threshold = 0;
+    uint64_t        finished = 0;
+    uint64_t        at = 0;
+    int             total = 0;
+    int             recovered = 0;
+    double          cpu_ms = 0;
+
+    for (int index = 0; index < room_num; index++) {
+        rooms[index].recovered_ns = 0;
+    }
+    blive_get_metrics(NULL, metrics);
+    reconnects = metrics->counters[BLIVE_METRIC_RECONNECTS];
+    getrusage(RUSAGE_SELF, &before);
+
+    if (!strcmp(step->kind, "slow")) {
+        applied = blive_clock_now_ns();
+        slow_fraction = step->fraction;
+        slow_us = step->arg;
+        __atomic_store_n(&slow_until, applied + step->duration_ms * 1000000ULL, __ATOMIC_RELAXED);
+    } else if ((applied = fault_inject(control, step)) == 0) {
+        goto out;
+    }
+    threshold = applied + step->duration_ms * 1000000ULL;
+    __atomic_store_n(&recover_after, threshold, __ATOMIC_RELEASE);
+
+    /*等待所有仍在运行的直播间恢复*/
+    do {
+        usleep(10 * 1000);
+        recovered = total = 0;
+        for (int index = 0; index < room_num; index++) {
+            total += running[index];
+            recovered += running[index] && __atomic_load_n(&rooms[index].recovered_ns, __ATOMIC_RELAXED) != 0;
+        }
+    } while (recovered < total && blive_clock_now_ns() < threshold + timeout_s * 1000000000ULL);
+    getrusage(RUSAGE_SELF, &after);
+    finished = blive_clock_now_ns();
+    __atomic_store_n(&recover_after, 0, __ATOMIC_RELEASE);
+
+    recovered = 0;
+    for (int index = 0; index < room_num; index++) {
+        if (running[index] && (at = __atomic_load_n(&rooms[index].recovered_ns, __ATOMIC_RELAXED)) != 0) {
+            recovery[recovered++] = at > threshold ? at - threshold : 0;
+        }
+    }
+    qsort(recovery, recovered, sizeof(uint64_t), recovery_cmp);
+    blive_get_metrics(NULL, metrics);
+    cpu_ms = rusage_ms(&after.ru_utime) - rusage_ms(&before.ru_utime)
+             + rusage_ms(&after.ru_stime) - rusage_ms(&before.ru_stime);
+
+    printf("%-8s x%.2f %6llu ms  recovered %d/%d  full %8.1f  p50 %8.1f  p99 %8.1f ms  reconnects %llu  "
+           "cpu %.1f ms (user %.1f sys %.1f, %.0f%% of one core)\n",
+           step->kind, step->fraction, (unsigned long long)step->duration_ms, recovered, total,
+           recovered ? recovery[recovered - 1] / 1e6 : 0, recovered ? recovery[recovered / 2] / 1e6 : 0,
+           recovered ? recovery[(recovered - 1) * 99 / 100] / 1e6 : 0,
+           (unsigned long long)(metrics->counters[BLIVE_METRIC_RECONNECTS] - reconnects), cpu_ms,
+           rusage_ms(&after.ru_utime) - rusage_ms(&before.ru_utime),
+           rusage_ms(&after.ru_stime) - rusage_ms(&before.ru_stime),
+           cpu_ms * 100 / ((finished - applied) / 1e6));
+    fflush(stdout);
+
+out:
+    free(recovery);
+    free(metrics);
+}
+
+static void* perform_routine(void* arg)
+{
+    blive_perform((blive*)arg, -1);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    int                 opt = 0;
+    int                 room_num = 100;
+    int                 seconds = 10;
+    int                 decoder_num = 2;
+    int                 worker_num = 0;
+    int                 max_reconnect = 100;
+    int                 timeout_s = 60;
+    const char*         url = LOAD_DEFAULT_URL;
+    const char*         control = LOAD_CONTROL_URL;
+    const char*         capture_dir = NULL;
+    blive_capture*      cap = NULL;
+    blive_capture_stats cap_stats = {0};
+    load_step           steps[LOAD_STEP_MAX];
+    int                 step_num = 0;
+    blive**             entities = NULL;
+    pthread_t*          tids = NULL;
+    Bool*               running = NULL;
+    pthread_t           sched_tid;
+    blive_decoder*      dec = NULL;
+    blive_executor*     exec = NULL;
+    blive_metrics*      metrics = NULL;
+    blive_metric_hist*  snapshot = NULL;
+    uint64_t            last = 0;
+    uint64_t            start = 0;
+    double              elapsed = 0;
+    int                 connected = 0;
+
+    while ((opt = getopt(argc, argv, "n:t:d:e:u:r:R:s:c:T:C:h")) != -1) {
+        switch (opt) {
+        case 'n': room_num = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'd': decoder_num = atoi(optarg); break;
+        case 'e': worker_num = atoi(optarg); break;
+        case 'u': url = optarg; break;
+        case 'r': first_room = strtoul(optarg, NULL, 10); break;
+        case 'R': max_reconnect = atoi(optarg); break;
+        case 'c': control = optarg; break;
+        case 'T': timeout_s = atoi(optarg); break;
+        case 'C': capture_dir = optarg; break;
+        case 's':
+            memset(&steps[step_num], 0, sizeof(load_step));
+            if (step_num == LOAD_STEP_MAX || sscanf(optarg, "%15[a-z]:%lf:%llu:%llu", steps[step_num].kind,
+                &steps[step_num].fraction, (unsigned long long*)&steps[step_num].duration_ms,
+                (unsigned long long*)&steps[step_num].arg) < 3) {
+                printf("bad step: %s\n", optarg);
+                return 1;
+            }
+            step_num++;
+            break;
+        default:
+            printf("usage: %s [-n rooms] [-t seconds] [-d decoder_threads] [-e executor_workers] [-u url] [-r first_room]\n"
+                   "          [-R max_reconnect] [-s kind:fraction:duration_ms[:arg]]... [-c control_url] [-T timeout_s]\n"
+                   "          [-C capture_dir]\n",
+                   argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    blive_api_init();
+    blive_set_danmu_info_url(url);
+    if (decoder_num > 0) {
+        blive_decoder_create(&dec, decoder_num);
+    }
+    if (worker_num > 0) {
+        blive_executor_create(&exec, worker_num);
+    }
+    if (capture_dir != NULL && blive_capture_create(&cap, capture_dir, 0) != OK) {
+        printf("create capture in %s failed\n", capture_dir);
+        return 1;
+    }
+    pthread_create(&sched_tid, NULL, sched_routine, NULL);
+
+    entities = calloc(room_num, sizeof(blive*));
+    tids = calloc(room_num, sizeof(pthread_t));
+    running = calloc(room_num, sizeof(Bool));
+    rooms = calloc(room_num, sizeof(load_room));
+    start = blive_clock_now_ns();
+    for (int index = 0; index < room_num; index++) {
+        blive_create(&entities[index], 0, first_room + index, max_reconnect);
+        for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+            blive_set_event_callback(entities[index], type, event_handler, NULL);
+        }
+        if (dec != NULL) {
+            blive_set_decoder(entities[index], dec);
+        }
+        if (exec != NULL) {
+            blive_set_executor(entities[index], exec);
+        }
+        if (cap != NULL) {
+            blive_set_capture(entities[index], cap);
+        }
+        if (blive_establish_connection(entities[index], sched_add, NULL) != OK) {
+            printf("room %u connect failed\n", first_room + index);
+            continue;
+        }
+        running[index] = pthread_create(&tids[index], NULL, perform_routine, entities[index]) == 0;
+        connected += running[index];
+    }
+    printf("%d/%d rooms connected, %d decoder thread(s), %d executor worker(s)\n", connected, room_num, decoder_num, worker_num);
+
+    for (int second = 0; second < seconds; second++) {
+        sleep(1);
+        printf("%3ds  %llu msg/s\n", second + 1, (unsigned long long)(__atomic_load_n(&received, __ATOMIC_RELAXED) - last));
+        fflush(stdout);
+        last = __atomic_load_n(&received, __ATOMIC_RELAXED);
+    }
+    for (int index = 0; index < step_num; index++) {
+        scenario_step(&steps[index], control, running, room_num, timeout_s);
+        sleep(1);
+    }
+    elapsed = (blive_clock_now_ns() - start) / 1e9;
+
+    for (int index = 0; index < room_num; index++) {
+        if (running[index]) {
+            blive_force_stop(entities[index]);
+            pthread_join(tids[index], NULL);
+        }
+    }
+    __atomic_store_n(&sched.stop, True, __ATOMIC_RELAXED);
+    pthread_join(sched_tid, NULL);
+
+    /*解码线程与执行器中可能仍有未处理完的数据包，先解除绑定等待处理完毕*/
+    for (int index = 0; index < room_num; index++) {
+        blive_set_decoder(entities[index], NULL);
+        blive_set_executor(entities[index], NULL);
+    }
+
+    metrics = malloc(sizeof(blive_metrics));
+    snapshot = calloc(1, sizeof(blive_metric_hist));
+    blive_metrics_hist_load(snapshot, &latency);
+    blive_get_metrics(NULL, metrics);
+    printf("received %llu msgs (%.0f msg/s), %llu without send_ns, %llu frames, %.2f MB\n",
+           (unsigned long long)received, received / elapsed, (unsigned long long)late,
+           (unsigned long long)metrics->counters[BLIVE_METRIC_RECV_FRAMES],
+           metrics->counters[BLIVE_METRIC_RECV_BYTES] / 1048576.0);
+    bench_quantile_print("latency", snapshot);
+    bench_quantile_print("recv", &metrics->stages[BLIVE_METRIC_STAGE_RECV]);
+    bench_quantile_print("unzip", &metrics->stages[BLIVE_METRIC_STAGE_UNZIP]);
+    bench_quantile_print("parse", &metrics->stages[BLIVE_METRIC_STAGE_PARSE]);
+    bench_quantile_print("handler", &metrics->stages[BLIVE_METRIC_STAGE_HANDLER]);
+    if (cap != NULL) {
+        blive_get_capture_stats(cap, &cap_stats);
+        printf("captured %llu frames, %.2f MB in %llu segment(s), %llu dropped\n", (unsigned long long)cap_stats.frames,
+               cap_stats.bytes / 1048576.0, (unsigned long long)cap_stats.segments, (unsigned long long)cap_stats.dropped);
+    }
+
+    for (int index = 0; index < room_num; index++) {
+        blive_close_connection(entities[index]);
+        blive_destroy(entities[index]);
+    }
+    if (cap != NULL) {
+        blive_capture_destroy(cap);
+    }
+    if (exec != NULL) {
+        blive_executor_destroy(exec);
+    }
+    if (dec != NULL) {
+        blive_decoder_destroy(dec);
+    }
+    free(snapshot);
+    free(metrics);
+    free(rooms);
+    free(running);
+    free(tids);
+    free(entities);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * @file bench_log.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 日志性能测试：测量同步与异步模式下调用线程每次打印日志的耗时，以及等级关闭、被限流时的耗时。
+ *          运行时将stderr重定向到文件，如 ./bench_log 2>bench_log.txt
+ * @version 0.1
+ * @date 2023-02-17
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "blive_internal.h"
+
+
+#define BENCH_LOG_NUM       2000        /*每个线程每轮打印的日志数，不超过日志队列的容量*/
+#define BENCH_ROUND         200         /*轮与轮之间等待写出，测量的是突发日志的耗时*/
+#define BENCH_MAX_THREADS   8
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+static void* log_routine(void* arg)
+{
+    double* cost = (double*)arg;
+    double  begin = 0;
+
+    for (int round = 0; round < BENCH_ROUND; round++) {
+        begin = now_ns();
+        for (int count = 0; count < BENCH_LOG_NUM; count++) {
+            blive_logi("msg info type: [%s] %d/%d", "弹幕", count, BENCH_LOG_NUM);
+        }
+        *cost += now_ns() - begin;
+        blive_log_flush();
+    }
+
+    return NULL;
+}
+
+static void bench_run(const char* name, int thread_num)
+{
+    pthread_t   tids[BENCH_MAX_THREADS];
+    double      costs[BENCH_MAX_THREADS] = {0};
+    double      total = 0;
+    double      begin = now_ns();
+
+    for (int count = 0; count < thread_num; count++) {
+        pthread_create(&tids[count], NULL, log_routine, &costs[count]);
+    }
+    for (int count = 0; count < thread_num; count++) {
+        pthread_join(tids[count], NULL);
+        total += costs[count];
+    }
+    blive_log_flush();
+
+    printf("%-12s %d thread(s): %7.1f ns/log in caller, %7.1f ns/log wall clock\n", name, thread_num,
+           total / ((double)thread_num * BENCH_LOG_NUM * BENCH_ROUND),
+           (now_ns() - begin) / ((double)thread_num * BENCH_LOG_NUM * BENCH_ROUND));
+}
+
+int main()
+{
+    int thread_nums[] = {1, 4};
+
+    blive_api_init();
+    for (size_t count = 0; count < sizeof(thread_nums) / sizeof(thread_nums[0]); count++) {
+        blive_log_set_level(BLIVE_LOG_SUBSYS_CORE, BLIVE_LOG_INFO);
+        blive_log_set_rate_limit(0, 0);
+        blive_log_set_async(False);
+        bench_run("sync", thread_nums[count]);
+        blive_log_set_async(True);
+        bench_run("async", thread_nums[count]);
+
+        /*同一调用处的日志风暴，令牌用完后只剩限流检查的开销*/
+        blive_log_set_rate_limit(20, 100);
+        bench_run("rate-limited", thread_nums[count]);
+
+        blive_log_set_level(BLIVE_LOG_SUBSYS_CORE, BLIVE_LOG_ERROR);
+        bench_run("disabled", thread_nums[count]);
+    }
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
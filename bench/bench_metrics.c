@@ -0,0 +1,132 @@
+/**
+ * @file bench_metrics.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 指标统计性能测试：多线程同时更新时每次计数、记录耗时的开销，与所有线程共用一个原子计数器对比；
+ *          以及输出Prometheus文本的耗时
+ * @version 0.1
+ * @date 2023-02-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "blive_internal.h"
+
+
+#define BENCH_UPDATE_NUM    20000000    /*每个线程的更新次数*/
+#define BENCH_MAX_THREADS   8
+#define BENCH_ROOM_NUM      100
+
+typedef enum {
+    BENCH_SHARED,                       /*所有线程累加同一个原子计数器*/
+    BENCH_COUNT,                        /*blive_metrics_count*/
+    BENCH_OBSERVE,                      /*blive_metrics_observe*/
+} bench_mode;
+
+typedef struct {
+    bench_mode      mode;
+    blive_metrics*  room;               /*每个线程模拟一个直播间*/
+    double          cost;
+} bench_arg;
+
+static uint64_t     shared_counter = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+static void* update_routine(void* arg)
+{
+    bench_arg*  bench = (bench_arg*)arg;
+    double      begin = now_ns();
+
+    switch (bench->mode) {
+    case BENCH_SHARED:
+        for (int count = 0; count < BENCH_UPDATE_NUM; count++) {
+            __atomic_fetch_add(&shared_counter, 1, __ATOMIC_RELAXED);
+        }
+        break;
+    case BENCH_COUNT:
+        for (int count = 0; count < BENCH_UPDATE_NUM; count++) {
+            blive_metrics_count(bench->room, BLIVE_METRIC_MSGS, 1);
+        }
+        break;
+    case BENCH_OBSERVE:
+        for (int count = 0; count < BENCH_UPDATE_NUM; count++) {
+            blive_metrics_observe(bench->room, BLIVE_METRIC_STAGE_HANDLER, 200 + (count & 4095));
+        }
+        break;
+    }
+    bench->cost = now_ns() - begin;
+
+    return NULL;
+}
+
+static void bench_run(const char* name, bench_mode mode, int thread_num)
+{
+    pthread_t       tids[BENCH_MAX_THREADS];
+    bench_arg       args[BENCH_MAX_THREADS];
+    double          total = 0;
+
+    for (int count = 0; count < thread_num; count++) {
+        args[count].mode = mode;
+        args[count].room = calloc(1, sizeof(blive_metrics));
+        pthread_create(&tids[count], NULL, update_routine, &args[count]);
+    }
+    for (int count = 0; count < thread_num; count++) {
+        pthread_join(tids[count], NULL);
+        total += args[count].cost;
+        free(args[count].room);
+    }
+
+    printf("%-22s %d thread(s): %6.2f ns/update\n", name, thread_num, total / ((double)thread_num * BENCH_UPDATE_NUM));
+}
+
+static void bench_render(void)
+{
+    blive*          entities[BENCH_ROOM_NUM];
+    char*           text = NULL;
+    size_t          len = 0;
+    double          begin = 0;
+
+    for (int count = 0; count < BENCH_ROOM_NUM; count++) {
+        blive_create(&entities[count], 0, 1000 + count, 0);
+        for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+            blive_metrics_observe(&entities[count]->metrics, stage, 1000 * (count + 1));
+        }
+    }
+
+    begin = now_ns();
+    blive_metrics_render(entities, BENCH_ROOM_NUM, &text, &len);
+    printf("render %d rooms: %.2f ms, %zu bytes\n", BENCH_ROOM_NUM, (now_ns() - begin) / 1000000, len);
+    free(text);
+
+    for (int count = 0; count < BENCH_ROOM_NUM; count++) {
+        blive_destroy(entities[count]);
+    }
+}
+
+int main()
+{
+    int thread_nums[] = {1, 4, 8};
+
+    blive_api_init();
+    for (size_t count = 0; count < sizeof(thread_nums) / sizeof(thread_nums[0]); count++) {
+        bench_run("shared atomic counter", BENCH_SHARED, thread_nums[count]);
+        bench_run("blive_metrics_count", BENCH_COUNT, thread_nums[count]);
+        bench_run("blive_metrics_observe", BENCH_OBSERVE, thread_nums[count]);
+    }
+    bench_render();
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
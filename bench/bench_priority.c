@@ -0,0 +1,122 @@
+/**
+ * @file bench_priority.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 优先级分发性能测试：红包消息与数百条进场消息压缩在同一个数据包内时，测量红包回调的延迟
+ * @version 0.1
+ * @date 2023-02-08
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "msg.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_BATCH_NUM         600     /*单个数据包内的消息数*/
+#define BENCH_POCKET_INDEX      500     /*红包消息在数据包内的位置*/
+#define BENCH_ROUND             200
+#define BENCH_NORMAL_COST_NS    2000    /*普通消息回调的模拟耗时*/
+
+static const char*  entry_json = "{\"cmd\":\"ENTRY_EFFECT\",\"data\":{\"uid\":10086,\"copy_writing\":\"欢迎 <%bench%> 进入直播间\"}}";
+static const char*  interact_json = "{\"cmd\":\"INTERACT_WORD\",\"data\":{\"uid\":10087,\"uname\":\"bench\",\"msg_type\":1}}";
+static const char*  pocket_json = "{\"cmd\":\"POPULARITY_RED_POCKET_START\",\"data\":{\"lot_id\":1,\"sender_uid\":10088,\"total_price\":1000}}";
+
+static double       round_begin = 0;
+static double       pocket_latency[BENCH_ROUND];
+static int          round_index = 0;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void normal_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    double  begin = now_us();
+
+    while ((now_us() - begin) * 1000 < BENCH_NORMAL_COST_NS);
+}
+
+static void pocket_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    pocket_latency[round_index] = now_us() - round_begin;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+    return *(const double*)a < *(const double*)b ? -1 : *(const double*)a > *(const double*)b;
+}
+
+/**
+ * @brief 构造一个与服务端格式一致的brotli压缩数据包：每条消息带有16字节消息头，再整体压缩
+ * 
+ * @param [out] header 传出外层数据包头部（主机字节序）
+ * @param [out] body_size 传出压缩后的正文长度
+ * @return char* 压缩后的正文
+ */
+static char* batch_build(blive_msg_header* header, size_t* body_size)
+{
+    char*       plain = malloc(BENCH_BATCH_NUM * 256);
+    size_t      plain_size = 0;
+    char*       compressed = NULL;
+    const char* json = NULL;
+
+    for (int count = 0; count < BENCH_BATCH_NUM; count++) {
+        blive_msg_header*   inner = (blive_msg_header*)(plain + plain_size);
+
+        json = count == BENCH_POCKET_INDEX ? pocket_json : (count % 2 ? interact_json : entry_json);
+        memcpy(inner->body, json, strlen(json));
+        plain_size += bench_msg_pack(inner, strlen(json));
+    }
+
+    compressed = bench_frame_compress(plain, plain_size, 5, header, body_size);
+    free(plain);
+    return compressed;
+}
+
+static void bench_run(blive_priority priority)
+{
+    blive*              entity = NULL;
+    blive_msg_header    header = {0};
+    size_t              body_size = 0;
+    char*               body = batch_build(&header, &body_size);
+
+    blive_create(&entity, 0, 1000, 0);
+    blive_set_command_callback(entity, BLIVE_INFO_ENTRY_EFFECT, normal_handler, NULL);
+    blive_set_command_callback(entity, BLIVE_INFO_INTERACT_WORD, normal_handler, NULL);
+    blive_set_command_callback(entity, BLIVE_INFO_POPULARITY_RED_POCKET_START, pocket_handler, NULL);
+    blive_set_command_priority(entity, BLIVE_INFO_POPULARITY_RED_POCKET_START, priority);
+
+    for (round_index = 0; round_index < BENCH_ROUND; round_index++) {
+        round_begin = now_us();
+        blive_packet_process(entity, &header, body, body_size, blive_clock_now_ns());
+    }
+    qsort(pocket_latency, BENCH_ROUND, sizeof(double), cmp_double);
+
+    printf("%-8s red pocket callback latency: p50=%9.1f us  p99=%9.1f us  max=%9.1f us\n",
+           priority == BLIVE_PRIORITY_HIGH ? "high" : "normal", pocket_latency[BENCH_ROUND / 2],
+           pocket_latency[BENCH_ROUND * 99 / 100], pocket_latency[BENCH_ROUND - 1]);
+
+    blive_destroy(entity);
+    free(body);
+}
+
+int main()
+{
+    blive_api_init();
+    printf("batch=%d msgs, red pocket at #%d, normal handler=%dns\n", BENCH_BATCH_NUM, BENCH_POCKET_INDEX, BENCH_NORMAL_COST_NS);
+    bench_run(BLIVE_PRIORITY_NORMAL);
+    bench_run(BLIVE_PRIORITY_HIGH);
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
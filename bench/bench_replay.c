@@ -0,0 +1,336 @@
+/**
+ * @file bench_replay.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 抓取回放：把blive_capture抓取的分段文件通过blive_replay_perform交给完整的处理流程，
+ *          统计持续的每秒消息数、各阶段耗时与CPU占用，用于离线复现问题与对比优化前后的吞吐。
+ *          bench_replay -D 抓取目录 [-x 速度，0为尽快回放] [-j 线程数] [-L 每个直播间回放的遍数]
+ *                       [-d 解码线程数] [-e 执行器线程数] [-J] [-w 起始秒:结束秒] [-I] [-P]
+ *          尽快回放时由-j个线程（默认为CPU数）轮流领取直播间，每个直播间在一个线程内回放完所有遍数；
+ *          按速度回放时每个直播间一个线程，与在线时每个blive_perform一个线程相同。
+ *          默认订阅所有类型的事件回调，指定-J时改为订阅消息回调，回调前解析JSON。
+ *          -w只回放相对抓取开始的该时间范围，-I先为没有索引的分段重建索引；
+ *          -P在打开前把分段文件移出页缓存，结束后统计被读入页缓存的页数，用于确认按范围回放只访问了需要的页
+ * @version 0.1
+ * @date 2023-02-25
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+/**
+ * @brief 每个直播间的回放状态，消息计数只由回调线程写入，按缓存行隔开避免线程间争用
+ * 
+ */
+typedef struct {
+    blive*      entity;
+    uint64_t    received;
+    int         result;
+    char        pad[64 - sizeof(blive*) - sizeof(uint64_t) - sizeof(int)];
+} replay_room;
+
+static blive_replay*    replay = NULL;
+static replay_room*     rooms = NULL;
+static int              room_num = 0;
+static int              next_room = 0;
+static int              loops = 1;
+static double           speed = 0;
+static int              finished = 0;
+
+static void event_handler(blive* entity, const blive_event* event, void* usr_data)
+{
+    ((replay_room*)usr_data)->received++;
+}
+
+static void msg_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+    ((replay_room*)usr_data)->received++;
+}
+
+static void* replay_routine(void* arg)
+{
+    int     index = 0;
+
+    while ((index = __atomic_fetch_add(&next_room, 1, __ATOMIC_RELAXED)) < room_num) {
+        for (int loop = 0; loop < loops; loop++) {
+            if ((rooms[index].result = blive_replay_perform(rooms[index].entity, replay, speed)) != OK) {
+                break;
+            }
+        }
+        __atomic_fetch_add(&finished, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static uint64_t received_sum(void)
+{
+    uint64_t    sum = 0;
+
+    for (int index = 0; index < room_num; index++) {
+        sum += __atomic_load_n(&rooms[index].received, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+static double cpu_seconds(struct rusage* usage)
+{
+    getrusage(RUSAGE_SELF, usage);
+    return usage->ru_utime.tv_sec + usage->ru_stime.tv_sec + (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @brief 统计目录下分段文件在页缓存中的页数，evict为True时先将其移出页缓存
+ * 
+ */
+static void cache_pages(const char* dir, Bool evict, size_t* resident, size_t* total)
+{
+    DIR*            d = opendir(dir);
+    struct dirent*  entry = NULL;
+    char            path[1024] = {0};
+    struct stat     st = {0};
+    size_t          page_size = sysconf(_SC_PAGESIZE);
+    size_t          pages = 0;
+    unsigned char*  vec = NULL;
+    void*           base = NULL;
+    int             fd = -1;
+
+    *resident = *total = 0;
+    while (d != NULL && (entry = readdir(d)) != NULL) {
+        if (strstr(entry->d_name, ".cap") == NULL) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if ((fd = open(path, O_RDONLY)) == -1) {
+            continue;
+        }
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            if (evict) {
+                fdatasync(fd);
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            }
+            pages = (st.st_size + page_size - 1) / page_size;
+            vec = malloc(pages);
+            if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+                if (vec != NULL && mincore(base, st.st_size, vec) == 0) {
+                    for (size_t i = 0; i < pages; i++) {
+                        *resident += vec[i] & 1;
+                    }
+                }
+                munmap(base, st.st_size);
+            }
+            free(vec);
+            *total += pages;
+        }
+        close(fd);
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int                 opt = 0;
+    const char*         dir = NULL;
+    int                 thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int                 decoder_num = 0;
+    int                 worker_num = 0;
+    Bool                json = False;
+    blive_replay_stats  stats = {0};
+    uint64_t*           ids = NULL;
+    pthread_t*          tids = NULL;
+    blive_decoder*      dec = NULL;
+    blive_executor*     exec = NULL;
+    blive_metrics*      metrics = NULL;
+    uint64_t            start = 0;
+    uint64_t            last = 0;
+    uint64_t            total = 0;
+    double              elapsed = 0;
+    double              cpu = 0;
+    struct rusage       usage_begin = {0};
+    struct rusage       usage_end = {0};
+    double              from_s = 0;
+    double              to_s = 0;
+    Bool                ranged = False;
+    Bool                reindex = False;
+    Bool                cold = False;
+    size_t              resident = 0;
+    size_t              pages = 0;
+    uint64_t            open_ns = 0;
+    int                 failed = 0;
+
+    while ((opt = getopt(argc, argv, "D:x:j:L:d:e:Jw:IPh")) != -1) {
+        switch (opt) {
+        case 'D': dir = optarg; break;
+        case 'x': speed = atof(optarg); break;
+        case 'j': thread_num = atoi(optarg); break;
+        case 'L': loops = atoi(optarg); break;
+        case 'd': decoder_num = atoi(optarg); break;
+        case 'e': worker_num = atoi(optarg); break;
+        case 'J': json = True; break;
+        case 'I': reindex = True; break;
+        case 'P': cold = True; break;
+        case 'w':
+            if (sscanf(optarg, "%lf:%lf", &from_s, &to_s) != 2 || to_s <= from_s) {
+                printf("bad range: %s\n", optarg);
+                return 1;
+            }
+            ranged = True;
+            break;
+        default:
+            printf("usage: %s -D capture_dir [-x speed, 0 as fast as possible] [-j threads] [-L loops]\n"
+                   "          [-d decoder_threads] [-e executor_workers] [-J] [-w from_s:to_s] [-I] [-P]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (dir == NULL || speed < 0 || loops < 1) {
+        printf("usage: %s -D capture_dir [-x speed] [-j threads] [-L loops] [-d decoder_threads] [-e executor_workers] [-J]\n",
+               argv[0]);
+        return 1;
+    }
+
+    blive_api_init();
+    if (reindex) {
+        printf("%d index file(s) rebuilt\n", blive_capture_index_rebuild(dir, False));
+    }
+    if (cold) {
+        cache_pages(dir, True, &resident, &pages);
+        printf("evicted segments, %zu of %zu page(s) still cached\n", resident, pages);
+    }
+    open_ns = blive_clock_now_ns();
+    if (blive_replay_open(&replay, dir) != OK) {
+        printf("open capture in %s failed\n", dir);
+        return 1;
+    }
+    open_ns = blive_clock_now_ns() - open_ns;
+    blive_get_replay_stats(replay, &stats);
+    printf("%u segment(s) (%u indexed), %u room(s), %llu frames, %.2f MB over %.1f s, %llu corrupt segment(s), "
+           "opened in %.1f ms\n", stats.segments, stats.indexed, stats.rooms, (unsigned long long)stats.frames,
+           stats.bytes / 1048576.0, stats.span_ns / 1e9, (unsigned long long)stats.corrupt, open_ns / 1e6);
+    if (ranged) {
+        blive_replay_set_range(replay, stats.first_ms + (uint64_t)(from_s * 1000), stats.first_ms + (uint64_t)(to_s * 1000));
+        printf("range %.1f s to %.1f s after %llu ms\n", from_s, to_s, (unsigned long long)stats.first_ms);
+    }
+
+    if (decoder_num > 0) {
+        blive_decoder_create(&dec, decoder_num);
+    }
+    if (worker_num > 0) {
+        blive_executor_create(&exec, worker_num);
+    }
+    room_num = stats.rooms;
+    ids = calloc(room_num, sizeof(uint64_t));
+    rooms = aligned_alloc(64, sizeof(replay_room) * room_num);
+    memset(rooms, 0, sizeof(replay_room) * room_num);
+    blive_replay_rooms(replay, ids, room_num);
+    for (int index = 0; index < room_num; index++) {
+        blive_create(&rooms[index].entity, 0, ids[index], 0);
+        for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+            if (json) {
+                blive_set_command_callback(rooms[index].entity, type, msg_handler, &rooms[index]);
+            } else {
+                blive_set_event_callback(rooms[index].entity, type, event_handler, &rooms[index]);
+            }
+        }
+        if (dec != NULL) {
+            blive_set_decoder(rooms[index].entity, dec);
+        }
+        if (exec != NULL) {
+            blive_set_executor(rooms[index].entity, exec);
+        }
+    }
+
+    /*按速度回放时所有直播间需要同时进行*/
+    if (speed > 0 || thread_num > room_num) {
+        thread_num = room_num;
+    }
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    printf("replay %d room(s) x %d loop(s) at %s on %d thread(s), %d decoder thread(s), %d executor worker(s)\n",
+           room_num, loops, speed > 0 ? "paced speed" : "full speed", thread_num, decoder_num, worker_num);
+    if (speed > 0) {
+        printf("speed x%.2f, expected %.1f s per loop\n", speed, stats.span_ns / 1e9 / speed);
+    }
+
+    tids = calloc(thread_num, sizeof(pthread_t));
+    cpu = cpu_seconds(&usage_begin);
+    start = blive_clock_now_ns();
+    for (int index = 0; index < thread_num; index++) {
+        pthread_create(&tids[index], NULL, replay_routine, NULL);
+    }
+    for (int second = 1; __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < room_num; ) {
+        usleep(10000);
+        if (blive_clock_now_ns() - start < second * 1000000000ULL) {
+            continue;
+        }
+        total = received_sum();
+        printf("%3ds  %llu msg/s\n", second++, (unsigned long long)(total - last));
+        fflush(stdout);
+        last = total;
+    }
+    for (int index = 0; index < thread_num; index++) {
+        pthread_join(tids[index], NULL);
+    }
+
+    /*解码线程与执行器中可能仍有未处理完的数据包，解除绑定等待处理完毕后再停止计时*/
+    for (int index = 0; index < room_num; index++) {
+        blive_set_decoder(rooms[index].entity, NULL);
+        blive_set_executor(rooms[index].entity, NULL);
+        failed += rooms[index].result != OK;
+    }
+    elapsed = (blive_clock_now_ns() - start) / 1e9;
+    cpu = cpu_seconds(&usage_end) - cpu;
+
+    metrics = malloc(sizeof(blive_metrics));
+    blive_get_metrics(NULL, metrics);
+    total = received_sum();
+    printf("replayed %llu frames, %.2f MB, %llu msgs, %llu callbacks in %.3f s, %d room(s) failed\n",
+           (unsigned long long)metrics->counters[BLIVE_METRIC_RECV_FRAMES],
+           metrics->counters[BLIVE_METRIC_RECV_BYTES] / 1048576.0,
+           (unsigned long long)metrics->counters[BLIVE_METRIC_MSGS], (unsigned long long)total, elapsed, failed);
+    printf("sustained %.0f msg/s, %.0f frames/s, %.1f MB/s, cpu %.3f s (%.0f msg per cpu second)\n",
+           metrics->counters[BLIVE_METRIC_MSGS] / elapsed, metrics->counters[BLIVE_METRIC_RECV_FRAMES] / elapsed,
+           metrics->counters[BLIVE_METRIC_RECV_BYTES] / 1048576.0 / elapsed, cpu,
+           cpu > 0 ? metrics->counters[BLIVE_METRIC_MSGS] / cpu : 0);
+    printf("page faults %ld minor, %ld major\n", usage_end.ru_minflt - usage_begin.ru_minflt,
+           usage_end.ru_majflt - usage_begin.ru_majflt);
+    if (cold) {
+        cache_pages(dir, False, &resident, &pages);
+        printf("segment pages read into cache: %zu of %zu\n", resident, pages);
+    }
+    bench_quantile_print("unzip", &metrics->stages[BLIVE_METRIC_STAGE_UNZIP]);
+    bench_quantile_print("parse", &metrics->stages[BLIVE_METRIC_STAGE_PARSE]);
+    bench_quantile_print("handler", &metrics->stages[BLIVE_METRIC_STAGE_HANDLER]);
+
+    for (int index = 0; index < room_num; index++) {
+        blive_destroy(rooms[index].entity);
+    }
+    if (exec != NULL) {
+        blive_executor_destroy(exec);
+    }
+    if (dec != NULL) {
+        blive_decoder_destroy(dec);
+    }
+    blive_replay_close(replay);
+    free(metrics);
+    free(tids);
+    free(rooms);
+    free(ids);
+    blive_api_deinit();
+    return failed ? 1 : 0;
+}
\ No newline at end of file
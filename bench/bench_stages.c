@@ -0,0 +1,322 @@
+/**
+ * @file bench_stages.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 分阶段性能基线：在一组数据包上分别测量只切分、解压加切分、分发给事件回调、分发给JSON回调，
+ *          输出每条消息的耗时、吞吐、内存申请次数，以及解压、切分、回调各阶段与整个数据包的耗时分位数。
+ *          默认使用按线上比例构造的弹幕、进场、送礼与高能榜消息，也可以指定抓取的数据包文件：
+ *          bench_stages [file]，文件内容为按服务端格式首尾相接的数据包（网络字节序头部加正文）
+ * @version 0.1
+ * @date 2023-02-22
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "msg.h"
+#include "blive_internal.h"
+#include "bench_util.h"
+
+
+#define BENCH_MSG_NUM       (512 * 1024)    /*每个场景至少处理的消息数*/
+#define BENCH_FRAME_NUM     512             /*构造的数据包数*/
+#define BENCH_FRAME_MAX_MSG 32              /*构造的每个数据包内最多的消息数*/
+#define BENCH_JSON_MAX      1024
+
+typedef struct {
+    blive_msg_header    header;             /*主机字节序*/
+    char*               body;
+    size_t              body_size;
+} bench_frame;
+
+typedef enum {
+    BENCH_SPLIT,                            /*未压缩的单条消息，只有切分与类型识别*/
+    BENCH_UNZIP,                            /*解压（压缩的数据包）加切分，不订阅任何消息*/
+    BENCH_EVENT,                            /*再分发给只读取原文的事件回调*/
+    BENCH_JSON,                             /*再分发给消息回调，回调前解析JSON*/
+    BENCH_MODE_MAX,
+} bench_mode;
+
+static const char*  bench_mode_name[BENCH_MODE_MAX] = {"split", "decode", "dispatch event", "dispatch json"};
+
+/*被--wrap包装的内存申请函数，只在测量期间的单线程内统计*/
+static size_t       alloc_count = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+static void json_handler(blive* entity, const cJSON* msg, void* usr_data)
+{
+}
+
+static void event_handler(blive* entity, const blive_event* event, void* usr_data)
+{
+    size_t  len = 0;
+
+    blive_event_raw(event, &len);
+}
+
+/**
+ * @brief 按线上大致的比例构造一条消息：弹幕60%、进场25%、送礼10%、高能榜5%
+ * 
+ * @param [in] seq 消息序号
+ * @param [out] json 传出消息
+ * @return int 消息长度
+ */
+static int msg_build(int seq, char* json)
+{
+    int     kind = seq % 20;
+
+    if (kind < 12) {
+        return snprintf(json, BENCH_JSON_MAX, "{\"cmd\":\"DANMU_MSG\",\"info\":[[0,1,25,16777215,%lld,0,0,\"\",0,0,0,\"\",0,"
+                        "\"{}\",\"{}\"],\"弹幕内容%d\",[%d,\"user_%d\",0,0,0,10000,1,\"\"],[%d,\"粉丝牌\",\"主播\",1000,"
+                        "9868950,\"\",0],[%d,0,9868950,\">50000\",0],[\"\",\"\"],0,0,null,{\"ts\":%lld,\"ct\":\"%08X\"},"
+                        "0,0,null,null,0,7]}", 1676000000000LL + seq, seq, 10000 + seq, seq, seq % 30, seq % 60,
+                        1676000000LL + seq / 1000, seq);
+    }
+    if (kind < 17) {
+        return snprintf(json, BENCH_JSON_MAX, "{\"cmd\":\"INTERACT_WORD\",\"data\":{\"contribution\":{\"grade\":0},"
+                        "\"dmscore\":12,\"fans_medal\":{\"medal_level\":%d,\"medal_name\":\"\",\"target_id\":0},"
+                        "\"msg_type\":1,\"roomid\":1000,\"score\":%d,\"timestamp\":%lld,\"uid\":%d,\"uname\":\"user_%d\"}}",
+                        seq % 30, seq, 1676000000LL + seq / 1000, 10000 + seq, seq);
+    }
+    if (kind < 19) {
+        return snprintf(json, BENCH_JSON_MAX, "{\"cmd\":\"SEND_GIFT\",\"data\":{\"action\":\"投喂\",\"batch_combo_id\":\"\","
+                        "\"coin_type\":\"gold\",\"giftId\":%d,\"giftName\":\"礼物%d\",\"num\":%d,\"price\":%d,"
+                        "\"timestamp\":%lld,\"total_coin\":%d,\"uid\":%d,\"uname\":\"user_%d\"}}",
+                        30000 + seq % 10, seq % 10, 1 + seq % 5, 100 * (seq % 10), 1676000000LL + seq / 1000,
+                        100 * (seq % 10) * (1 + seq % 5), 10000 + seq, seq);
+    }
+    return snprintf(json, BENCH_JSON_MAX, "{\"cmd\":\"ONLINE_RANK_COUNT\",\"data\":{\"count\":%d}}", 1000 + seq);
+}
+
+/**
+ * @brief 构造数据包：压缩时每个数据包内1到32条消息，与服务端一样按brotli压缩；不压缩时每个数据包一条消息
+ * 
+ * @param [in] compressed 是否压缩
+ * @param [out] frame_num 传出数据包数
+ * @return bench_frame* 数据包数组
+ */
+static bench_frame* corpus_build(Bool compressed, int* frame_num)
+{
+    bench_frame*    frames = calloc(BENCH_FRAME_NUM, sizeof(bench_frame));
+    char*           plain = malloc(BENCH_FRAME_MAX_MSG * (sizeof(blive_msg_header) + BENCH_JSON_MAX));
+    int             seq = 0;
+
+    for (int index = 0; index < BENCH_FRAME_NUM; index++) {
+        int     batch = compressed ? 1 + (index * 7) % BENCH_FRAME_MAX_MSG : 1;
+        size_t  plain_size = 0;
+
+        for (int count = 0; count < batch; count++) {
+            blive_msg_header*   inner = (blive_msg_header*)(plain + plain_size);
+            int                 json_len = msg_build(seq++, inner->body);
+
+            plain_size += bench_msg_pack(inner, json_len);
+        }
+
+        if (compressed) {
+            frames[index].body = bench_frame_compress(plain, plain_size, BROTLI_DEFAULT_QUALITY,
+                                                      &frames[index].header, &frames[index].body_size);
+        } else {
+            frames[index].body_size = plain_size - sizeof(blive_msg_header);
+            frames[index].body = malloc(frames[index].body_size);
+            memcpy(frames[index].body, plain + sizeof(blive_msg_header), frames[index].body_size);
+            frames[index].header.msg_proto = BLIVE_MSG_PROTO_CMDNOCMPRES;
+        }
+        frames[index].header.packet_size = sizeof(blive_msg_header) + frames[index].body_size;
+        frames[index].header.header_size = sizeof(blive_msg_header);
+        frames[index].header.msg_operate = BLIVE_MSG_TYPE_COMMAND;
+    }
+
+    free(plain);
+    *frame_num = BENCH_FRAME_NUM;
+    return frames;
+}
+
+/**
+ * @brief 读取数据包文件，只保留普通包命令
+ * 
+ * @param [in] path 文件路径
+ * @param [out] frame_num 传出数据包数
+ * @return bench_frame* 数据包数组，读取失败或没有数据包时返回NULL
+ */
+static bench_frame* corpus_load(const char* path, int* frame_num)
+{
+    FILE*               file = fopen(path, "rb");
+    bench_frame*        frames = NULL;
+    bench_frame*        bigger = NULL;
+    int                 capacity = 0;
+    blive_msg_header    header = {0};
+
+    *frame_num = 0;
+    if (file == NULL) {
+        return NULL;
+    }
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        bench_frame frame = {0};
+
+        frame.header.packet_size = ntohl(header.packet_size);
+        frame.header.header_size = ntohs(header.header_size);
+        frame.header.msg_proto = ntohs(header.msg_proto);
+        frame.header.msg_operate = ntohl(header.msg_operate);
+        if (frame.header.packet_size < sizeof(blive_msg_header) || frame.header.header_size != sizeof(blive_msg_header)) {
+            break;
+        }
+        frame.body_size = frame.header.packet_size - sizeof(blive_msg_header);
+        frame.body = malloc(frame.body_size + 1);
+        if (fread(frame.body, 1, frame.body_size, file) != frame.body_size) {
+            free(frame.body);
+            break;
+        }
+        if (frame.header.msg_operate != BLIVE_MSG_TYPE_COMMAND) {
+            free(frame.body);
+            continue;
+        }
+        if (*frame_num == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            if ((bigger = realloc(frames, sizeof(bench_frame) * capacity)) == NULL) {
+                free(frame.body);
+                break;
+            }
+            frames = bigger;
+        }
+        frames[(*frame_num)++] = frame;
+    }
+    fclose(file);
+    return frames;
+}
+
+static void corpus_free(bench_frame* frames, int frame_num)
+{
+    for (int index = 0; index < frame_num; index++) {
+        free(frames[index].body);
+    }
+    free(frames);
+}
+
+static blive* entity_create(bench_mode mode)
+{
+    blive*  entity = NULL;
+
+    blive_create(&entity, 0, 1000, 0);
+    for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+        if (mode == BENCH_EVENT) {
+            blive_set_event_callback(entity, type, event_handler, NULL);
+        } else if (mode == BENCH_JSON) {
+            blive_set_command_callback(entity, type, json_handler, NULL);
+        }
+    }
+    return entity;
+}
+
+static void bench_run(bench_mode mode, const bench_frame* frames, int frame_num)
+{
+    blive*              entity = NULL;
+    blive_metrics*      metrics = malloc(sizeof(blive_metrics));
+    blive_metric_hist*  frame_hist = calloc(1, sizeof(blive_metric_hist));
+    size_t              wire_bytes = 0;
+    size_t              allocs = 0;
+    uint64_t            msgs = 0;
+    uint64_t            plain_bytes = 0;
+    double              begin = 0;
+    double              cost = 0;
+
+    entity = entity_create(mode);
+
+    /*预热一遍，解压缓冲区的初始大小等状态稳定后再计时*/
+    for (int index = 0; index < frame_num; index++) {
+        blive_packet_process(entity, &frames[index].header, frames[index].body, frames[index].body_size, blive_clock_now_ns());
+    }
+    blive_get_metrics(entity, metrics);
+    msgs = metrics->counters[BLIVE_METRIC_MSGS];
+    blive_destroy(entity);
+    entity = entity_create(mode);
+
+    allocs = alloc_count;
+    begin = bench_now_sec();
+    for (int round = 0; round < (int)(BENCH_MSG_NUM / (msgs ? msgs : 1)) + 1; round++) {
+        for (int index = 0; index < frame_num; index++) {
+            uint64_t    frame_begin = blive_clock_now_ns();
+
+            blive_packet_process(entity, &frames[index].header, frames[index].body, frames[index].body_size, frame_begin);
+            blive_metrics_hist_add(frame_hist, blive_clock_now_ns() - frame_begin);
+            frame_hist->count++;
+            wire_bytes += frames[index].header.packet_size;
+        }
+    }
+    cost = bench_now_sec() - begin;
+    allocs = alloc_count - allocs;
+
+    blive_get_metrics(entity, metrics);
+    msgs = metrics->counters[BLIVE_METRIC_MSGS];
+    plain_bytes = metrics->counters[BLIVE_METRIC_UNZIP_BYTES] ? metrics->counters[BLIVE_METRIC_UNZIP_BYTES] : wire_bytes;
+    printf("%-16s %8.1f ns/msg %9.1f wire MB/s %9.1f plain MB/s %6.2f allocs/msg\n", bench_mode_name[mode],
+           cost * 1e9 / msgs, wire_bytes / cost / 1048576, plain_bytes / cost / 1048576, (double)allocs / msgs);
+    bench_quantile_print("unzip", &metrics->stages[BLIVE_METRIC_STAGE_UNZIP]);
+    bench_quantile_print("parse", &metrics->stages[BLIVE_METRIC_STAGE_PARSE]);
+    bench_quantile_print("handler", &metrics->stages[BLIVE_METRIC_STAGE_HANDLER]);
+    bench_quantile_print("frame", frame_hist);
+
+    blive_destroy(entity);
+    free(frame_hist);
+    free(metrics);
+}
+
+int main(int argc, char* argv[])
+{
+    bench_frame*    frames = NULL;
+    int             frame_num = 0;
+
+    blive_api_init();
+
+    if (argc > 1) {
+        if ((frames = corpus_load(argv[1], &frame_num)) == NULL) {
+            printf("no command packet in %s\n", argv[1]);
+            blive_api_deinit();
+            return 1;
+        }
+        printf("corpus: %d packets from %s\n", frame_num, argv[1]);
+        for (int mode = BENCH_UNZIP; mode < BENCH_MODE_MAX; mode++) {
+            bench_run(mode, frames, frame_num);
+        }
+        corpus_free(frames, frame_num);
+        blive_api_deinit();
+        return 0;
+    }
+
+    frames = corpus_build(False, &frame_num);
+    bench_run(BENCH_SPLIT, frames, frame_num);
+    corpus_free(frames, frame_num);
+
+    frames = corpus_build(True, &frame_num);
+    for (int mode = BENCH_UNZIP; mode < BENCH_MODE_MAX; mode++) {
+        bench_run(mode, frames, frame_num);
+    }
+    corpus_free(frames, frame_num);
+
+    blive_api_deinit();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+/**
+ * @file bench_util.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 性能测试程序共用的计时与构造数据包函数，只被bench/下的程序包含
+ * @version 0.1
+ * @date 2023-02-08
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_BENCH_UTIL_H__
+#define __BLIVE_BENCH_UTIL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "brotli/encode.h"
+
+#include "msg.h"
+#include "blive_internal.h"
+
+
+/**
+ * @brief 单调时钟的当前时间
+ * 
+ * @return double 秒
+ */
+static inline double bench_now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/**
+ * @brief 为已写入inner->body的消息正文填写不压缩的16字节消息头
+ * 
+ * @param [in] inner 消息头位置
+ * @param [in] json_len 正文长度
+ * @return size_t 消息头加正文的长度
+ */
+static inline size_t bench_msg_pack(blive_msg_header* inner, size_t json_len)
+{
+    inner->packet_size = htonl(sizeof(blive_msg_header) + json_len);
+    inner->header_size = htons(sizeof(blive_msg_header));
+    inner->msg_proto = htons(BLIVE_MSG_PROTO_CMDNOCMPRES);
+    inner->msg_operate = htonl(BLIVE_MSG_TYPE_COMMAND);
+    inner->msg_seq = 0;
+    return sizeof(blive_msg_header) + json_len;
+}
+
+/**
+ * @brief 与服务端一样把依次排列的消息整体按brotli压缩，构造一个协议3的数据包
+ * 
+ * @param [in] plain 带消息头的消息
+ * @param [in] plain_size 消息的总长度
+ * @param [in] quality brotli压缩等级
+ * @param [out] header 传出外层数据包头部（主机字节序）
+ * @param [out] body_size 传出压缩后的正文长度
+ * @return char* 压缩后的正文，由调用者释放
+ */
+static inline char* bench_frame_compress(const char* plain, size_t plain_size, int quality, blive_msg_header* header,
+                                         size_t* body_size)
+{
+    char*   compressed = NULL;
+
+    *body_size = BrotliEncoderMaxCompressedSize(plain_size);
+    compressed = malloc(*body_size);
+    BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, plain_size, (const uint8_t*)plain, body_size,
+                          (uint8_t*)compressed);
+
+    header->packet_size = sizeof(blive_msg_header) + *body_size;
+    header->header_size = sizeof(blive_msg_header);
+    header->msg_proto = BLIVE_MSG_PROTO_CMDCOMPRESBROTLI;
+    header->msg_operate = BLIVE_MSG_TYPE_COMMAND;
+    return compressed;
+}
+
+/**
+ * @brief 打印延迟直方图的分位数，直方图为空时不打印
+ * 
+ * @param [in] name 名称
+ * @param [in] hist 直方图，单位为纳秒
+ */
+static inline void bench_quantile_print(const char* name, const blive_metric_hist* hist)
+{
+    if (!hist->count) {
+        return;
+    }
+    printf("%-10s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us  (%llu)\n", name,
+           blive_metric_hist_quantile(hist, 0.5) / 1000.0, blive_metric_hist_quantile(hist, 0.9) / 1000.0,
+           blive_metric_hist_quantile(hist, 0.99) / 1000.0, blive_metric_hist_quantile(hist, 0.999) / 1000.0,
+           blive_metric_hist_quantile(hist, 1) / 1000.0, (unsigned long long)hist->count);
+}
+
+#endif  //__BLIVE_BENCH_UTIL_H__
\ No newline at end of file
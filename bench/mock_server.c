@@ -0,0 +1,782 @@
+/**
+ * @file mock_server.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 本地模拟弹幕服务端，用于在单机上压测客户端的吞吐与延迟：
+ *          HTTP端口提供getDanmuInfo，返回令牌与TCP端口；TCP端口按blive_msg_header协议处理认证与心跳，
+ *          并按设定的速率与突发模式向每个已认证的直播间推送brotli压缩的普通包（协议3）。
+ *          每条消息带有"send_ns"字段，为发送时的CLOCK_MONOTONIC，同一台机器上的客户端可以据此计算延迟。
+ *          HTTP端口同时提供故障注入的控制接口，供bench_load的场景模式使用，也可以直接用curl调用：
+ *          GET /fault?kind=<reset|halfopen|split|authfail|hbdelay>&fraction=<0~1>&duration=<毫秒>&arg=<参数>
+ *          故障按直播间号选中，同一比例每次选中的直播间相同；返回故障生效时的CLOCK_MONOTONIC。
+ *          mock_server [-p tcp端口] [-w http端口] [-r 每个直播间每秒消息数] [-i 推送间隔毫秒]
+ *                      [-b 倍数:周期毫秒:持续毫秒] [-q brotli压缩等级]
+ * @version 0.1
+ * @date 2023-02-23
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "brotli/encode.h"
+
+#include "msg.h"
+
+
+#define MOCK_TCP_PORT       22430
+#define MOCK_HTTP_PORT      22431
+#define MOCK_MAX_EVENTS     256
+#define MOCK_IN_MAX         4096                /*客户端只发送认证与心跳包，不需要更大的接收缓冲*/
+#define MOCK_OUT_MAX        (8 * 1024 * 1024)   /*发送缓冲超过该值时丢弃新的数据包，并计入丢弃数*/
+#define MOCK_JSON_MAX       1024
+#define MOCK_BATCH_MAX      4096                /*单个数据包内最多的消息数*/
+#define MOCK_SPLIT_MAX      64                  /*切分发送时每段的默认最大字节数*/
+
+/**
+ * @brief 可注入的故障类型
+ * 
+ */
+typedef enum {
+    FAULT_RESET,            /*选中的连接以RST断开，持续时间内选中的直播间重新认证时同样断开*/
+    FAULT_HALFOPEN,         /*选中的连接不再收发任何数据，持续时间结束后以RST断开*/
+    FAULT_SPLIT,            /*持续时间内发往选中直播间的数据按1~arg字节随机切分，每毫秒发送一段*/
+    FAULT_AUTHFAIL,         /*选中的连接以RST断开，持续时间内选中的直播间认证回复code -101后关闭*/
+    FAULT_HBDELAY,          /*持续时间内选中直播间的心跳回复延迟arg毫秒*/
+    FAULT_MAX,
+} fault_kind;
+
+static const char* fault_names[FAULT_MAX] = {"reset", "halfopen", "split", "authfail", "hbdelay"};
+
+typedef struct {
+    fault_kind  kind;
+    double      fraction;
+    uint64_t    duration_ms;
+    uint64_t    arg;
+} mock_fault;
+
+typedef struct mock_conn {
+    int                 fd;
+    uint32_t            room_id;
+    Bool                authed;
+    uint32_t            seq;                /*发送的消息序号，用于构造不同的消息内容*/
+    double              credit;             /*按速率累积的待发送消息数，不足一条的部分留到下次*/
+    char                in[MOCK_IN_MAX];
+    size_t              in_len;
+    char*               out;
+    size_t              out_len;
+    size_t              out_cap;
+    Bool                want_write;         /*发送缓冲未写完，已注册EPOLLOUT*/
+    Bool                abort;              /*关闭时发送RST而不是FIN*/
+    uint64_t            halfopen_until;     /*非0时处于半开状态*/
+    uint64_t            split_until;        /*非0时发送缓冲逐段发送*/
+    uint64_t            hb_due;             /*非0时为延迟的心跳回复的发送时间*/
+} mock_conn;
+
+static struct {
+    int         tcp_port;
+    int         http_port;
+    double      rate;                       /*每个直播间每秒消息数*/
+    int         interval_ms;                /*推送间隔，服务端将间隔内的消息压缩为一个数据包*/
+    double      burst_factor;               /*突发期间速率的倍数，1为不突发*/
+    int         burst_period_ms;
+    int         burst_len_ms;               /*每个周期开始的burst_len_ms毫秒内为突发期*/
+    int         quality;
+    int         epfd;
+    mock_conn** conns;
+    int         conn_num;
+    int         conn_cap;
+    uint64_t    sent_msgs;
+    uint64_t    sent_bytes;
+    uint64_t    dropped;
+    uint64_t    faulted;                    /*因注入故障断开的连接数*/
+    /*各类故障的生效窗口，由主循环读写*/
+    uint64_t    fault_until[FAULT_MAX];
+    double      fault_fraction[FAULT_MAX];
+    uint64_t    fault_arg[FAULT_MAX];
+    /*控制接口提交的故障，由主循环取出生效后唤醒HTTP线程*/
+    pthread_mutex_t fault_lock;
+    pthread_cond_t  fault_cond;
+    mock_fault  pending;
+    Bool        has_pending;
+    uint64_t    applied_ns;
+} mock = {
+    .tcp_port = MOCK_TCP_PORT,
+    .http_port = MOCK_HTTP_PORT,
+    .rate = 100,
+    .interval_ms = 50,
+    .burst_factor = 1,
+    .burst_period_ms = 1000,
+    .burst_len_ms = 0,
+    .quality = 1,
+    .fault_lock = PTHREAD_MUTEX_INITIALIZER,
+    .fault_cond = PTHREAD_COND_INITIALIZER,
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t wall_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int listen_on(int port)
+{
+    int                 fd = socket(AF_INET, SOCK_STREAM, 0);
+    int                 on = 1;
+    struct sockaddr_in  addr = {0};
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 1024)) {
+        perror("listen");
+        exit(1);
+    }
+    return fd;
+}
+
+/**
+ * @brief 在发送缓冲末尾追加一个数据包，头部转换为网络字节序
+ * 
+ * @param [in] conn 连接
+ * @param [in] proto 协议版本
+ * @param [in] op 操作码
+ * @param [in] body 正文
+ * @param [in] body_size 正文长度
+ * @return int 发送缓冲已满返回ERROR
+ */
+static int out_append(mock_conn* conn, int proto, int op, const char* body, size_t body_size)
+{
+    blive_msg_header    header = {0};
+    size_t              need = conn->out_len + sizeof(header) + body_size;
+    char*               bigger = NULL;
+
+    if (need > MOCK_OUT_MAX) {
+        return ERROR;
+    }
+    if (need > conn->out_cap) {
+        size_t  cap = conn->out_cap ? conn->out_cap : 64 * 1024;
+
+        while (cap < need) {
+            cap *= 2;
+        }
+        if ((bigger = realloc(conn->out, cap)) == NULL) {
+            return ERROR;
+        }
+        conn->out = bigger;
+        conn->out_cap = cap;
+    }
+
+    header.packet_size = htonl(sizeof(header) + body_size);
+    header.header_size = htons(sizeof(header));
+    header.msg_proto = htons(proto);
+    header.msg_operate = htonl(op);
+    header.msg_seq = htonl(1);
+    memcpy(conn->out + conn->out_len, &header, sizeof(header));
+    memcpy(conn->out + conn->out_len + sizeof(header), body, body_size);
+    conn->out_len = need;
+    return OK;
+}
+
+/**
+ * @brief 从连接数组中移除并关闭连接，末尾的连接填补空位；设置了abort时以RST断开
+ * 
+ * @return int 被移除的连接在数组中的位置
+ */
+static int conn_drop(mock_conn* conn)
+{
+    struct linger   lg = {1, 0};
+    int             pos = 0;
+
+    for (pos = 0; pos < mock.conn_num; pos++) {
+        if (mock.conns[pos] == conn) {
+            mock.conns[pos] = mock.conns[--mock.conn_num];
+            break;
+        }
+    }
+    if (conn->abort) {
+        setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        mock.faulted++;
+    }
+    epoll_ctl(mock.epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->out);
+    free(conn);
+    return pos;
+}
+
+/**
+ * @brief 直播间是否被故障选中：按直播间号散列，同一比例每次选中的直播间相同
+ * 
+ * @param [in] kind 故障类型
+ * @param [in] room_id 直播间号
+ * @param [in] now 当前时间，传0时不检查故障是否仍在持续时间内
+ */
+static Bool fault_hit(fault_kind kind, uint32_t room_id, uint64_t now)
+{
+    if (now && now >= mock.fault_until[kind]) {
+        return False;
+    }
+    return (room_id * 2654435761U) % 10000 < mock.fault_fraction[kind] * 10000;
+}
+
+/**
+ * @brief 尽量写出发送缓冲，写不完时注册EPOLLOUT等待可写
+ * 
+ * @return int 连接出错返回ERROR
+ */
+static int conn_flush(mock_conn* conn)
+{
+    struct epoll_event  ev = {0};
+    ssize_t             sent = 0;
+    size_t              done = 0;
+    size_t              chunk = 0;
+
+    if (conn->halfopen_until) {
+        return OK;
+    }
+    /*切分发送：每次调用只发送一段，由主循环每毫秒调用一次，使各段分别到达客户端*/
+    if (conn->split_until && conn->out_len) {
+        if (conn->want_write) {
+            conn->want_write = False;
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn;
+            epoll_ctl(mock.epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        }
+        chunk = 1 + rand() % mock.fault_arg[FAULT_SPLIT];
+        sent = send(conn->fd, conn->out, chunk < conn->out_len ? chunk : conn->out_len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? OK : ERROR;
+        }
+        memmove(conn->out, conn->out + sent, conn->out_len - sent);
+        conn->out_len -= sent;
+        mock.sent_bytes += sent;
+        return OK;
+    }
+
+    while (done < conn->out_len) {
+        sent = send(conn->fd, conn->out + done, conn->out_len - done, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return ERROR;
+        }
+        done += sent;
+    }
+    memmove(conn->out, conn->out + done, conn->out_len - done);
+    conn->out_len -= done;
+    mock.sent_bytes += done;
+
+    if ((conn->out_len != 0) != conn->want_write) {
+        conn->want_write = conn->out_len != 0;
+        ev.events = EPOLLIN | (conn->want_write ? EPOLLOUT : 0);
+        ev.data.ptr = conn;
+        epoll_ctl(mock.epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+    return OK;
+}
+
+/**
+ * @brief 按线上大致的比例构造一条消息：弹幕60%、进场25%、送礼10%、高能榜5%，均带有send_ns
+ * 
+ * @return int 消息长度
+ */
+static int msg_build(mock_conn* conn, uint64_t send_ns, uint64_t ms, char* json)
+{
+    uint32_t    seq = conn->seq++;
+    int         kind = seq % 20;
+
+    if (kind < 12) {
+        return snprintf(json, MOCK_JSON_MAX, "{\"cmd\":\"DANMU_MSG\",\"send_ns\":%llu,\"info\":[[0,1,25,16777215,%llu,0,0,"
+                        "\"\",0,0,0,\"\",0,\"{}\",\"{}\"],\"弹幕内容%u\",[%u,\"user_%u\",0,0,0,10000,1,\"\"],[%u,\"粉丝牌\","
+                        "\"主播\",%u,9868950,\"\",0],[%u,0,9868950,\">50000\",0],[\"\",\"\"],0,0,null,"
+                        "{\"ts\":%llu,\"ct\":\"%08X\"},0,0,null,null,0,7]}", (unsigned long long)send_ns,
+                        (unsigned long long)ms, seq, 10000 + seq % 100000, seq % 100000, seq % 30, conn->room_id,
+                        seq % 60, (unsigned long long)ms / 1000, seq);
+    }
+    if (kind < 17) {
+        return snprintf(json, MOCK_JSON_MAX, "{\"cmd\":\"INTERACT_WORD\",\"send_ns\":%llu,\"data\":{\"contribution\":"
+                        "{\"grade\":0},\"dmscore\":12,\"fans_medal\":{\"medal_level\":%u,\"medal_name\":\"\",\"target_id\":0},"
+                        "\"msg_type\":1,\"roomid\":%u,\"score\":%u,\"timestamp\":%llu,\"uid\":%u,\"uname\":\"user_%u\"}}",
+                        (unsigned long long)send_ns, seq % 30, conn->room_id, seq, (unsigned long long)ms / 1000,
+                        10000 + seq % 100000, seq % 100000);
+    }
+    if (kind < 19) {
+        return snprintf(json, MOCK_JSON_MAX, "{\"cmd\":\"SEND_GIFT\",\"send_ns\":%llu,\"data\":{\"action\":\"投喂\","
+                        "\"coin_type\":\"gold\",\"giftId\":%u,\"giftName\":\"礼物%u\",\"num\":%u,\"price\":%u,"
+                        "\"timestamp\":%llu,\"uid\":%u,\"uname\":\"user_%u\"}}", (unsigned long long)send_ns,
+                        30000 + seq % 10, seq % 10, 1 + seq % 5, 100 * (seq % 10), (unsigned long long)ms / 1000,
+                        10000 + seq % 100000, seq % 100000);
+    }
+    return snprintf(json, MOCK_JSON_MAX, "{\"cmd\":\"ONLINE_RANK_COUNT\",\"send_ns\":%llu,\"data\":{\"count\":%u}}",
+                    (unsigned long long)send_ns, 1000 + seq % 1000);
+}
+
+/**
+ * @brief 将一个推送间隔内该直播间的消息压缩为一个协议3的数据包放入发送缓冲
+ * 
+ * @param [in] conn 连接
+ * @param [in] num 消息数
+ * @param [in] plain 压缩前的缓冲区
+ * @param [in] packed 压缩后的缓冲区
+ */
+static void room_push(mock_conn* conn, int num, char* plain, char* packed)
+{
+    uint64_t    send_ns = now_ns();
+    uint64_t    ms = wall_ms();
+    size_t      plain_size = 0;
+    size_t      packed_size = 0;
+
+    for (int count = 0; count < num; count++) {
+        blive_msg_header*   inner = (blive_msg_header*)(plain + plain_size);
+        int                 json_len = msg_build(conn, send_ns, ms, inner->body);
+
+        inner->packet_size = htonl(sizeof(blive_msg_header) + json_len);
+        inner->header_size = htons(sizeof(blive_msg_header));
+        inner->msg_proto = htons(BLIVE_MSG_PROTO_CMDNOCMPRES);
+        inner->msg_operate = htonl(BLIVE_MSG_TYPE_COMMAND);
+        inner->msg_seq = 0;
+        plain_size += sizeof(blive_msg_header) + json_len;
+    }
+
+    packed_size = BrotliEncoderMaxCompressedSize(plain_size);
+    if (!BrotliEncoderCompress(mock.quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, plain_size, (uint8_t*)plain,
+                               &packed_size, (uint8_t*)packed)) {
+        return;
+    }
+    if (out_append(conn, BLIVE_MSG_PROTO_CMDCOMPRESBROTLI, BLIVE_MSG_TYPE_COMMAND, packed, packed_size) != OK) {
+        mock.dropped += num;
+        return;
+    }
+    mock.sent_msgs += num;
+}
+
+/**
+ * @brief 处理客户端发来的数据包：认证包回复认证成功，心跳包回复人气值；注入的故障在此对新的认证与心跳生效
+ * 
+ * @return int 连接出错或按故障需要断开时返回ERROR
+ */
+static int conn_read(mock_conn* conn)
+{
+    ssize_t             size = 0;
+    blive_msg_header*   header = NULL;
+    uint32_t            packet_size = 0;
+    const char*         room = NULL;
+    uint32_t            pop = 0;
+    uint64_t            now = 0;
+    char                auth[MOCK_IN_MAX] = {0};
+
+    while ((size = recv(conn->fd, conn->in + conn->in_len, MOCK_IN_MAX - conn->in_len, 0)) > 0) {
+        conn->in_len += size;
+        while (conn->in_len >= sizeof(blive_msg_header)) {
+            header = (blive_msg_header*)conn->in;
+            packet_size = ntohl(header->packet_size);
+            if (packet_size < sizeof(blive_msg_header) || packet_size > MOCK_IN_MAX) {
+                return ERROR;
+            }
+            if (conn->in_len < packet_size) {
+                break;
+            }
+
+            now = now_ns();
+            switch (ntohl(header->msg_operate)) {
+            case BLIVE_MSG_TYPE_AUTH:
+                memcpy(auth, header->body, packet_size - sizeof(blive_msg_header));
+                auth[packet_size - sizeof(blive_msg_header)] = '\0';
+                if ((room = strstr(auth, "\"roomid\":")) != NULL) {
+                    conn->room_id = strtoul(room + strlen("\"roomid\":"), NULL, 10);
+                }
+                if (fault_hit(FAULT_RESET, conn->room_id, now)) {
+                    conn->abort = True;
+                    return ERROR;
+                }
+                if (fault_hit(FAULT_AUTHFAIL, conn->room_id, now)) {
+                    out_append(conn, BLIVE_MSG_PROTO_HBAUNOCMPRES, BLIVE_MSG_TYPE_AUTH_REPLY, "{\"code\":-101}",
+                               strlen("{\"code\":-101}"));
+                    conn_flush(conn);
+                    mock.faulted++;
+                    return ERROR;
+                }
+                conn->authed = True;
+                if (fault_hit(FAULT_SPLIT, conn->room_id, now)) {
+                    conn->split_until = mock.fault_until[FAULT_SPLIT];
+                }
+                out_append(conn, BLIVE_MSG_PROTO_HBAUNOCMPRES, BLIVE_MSG_TYPE_AUTH_REPLY, "{\"code\":0}", strlen("{\"code\":0}"));
+                break;
+            case BLIVE_MSG_TYPE_HEARTBEAT:
+                if (fault_hit(FAULT_HBDELAY, conn->room_id, now)) {
+                    conn->hb_due = now + mock.fault_arg[FAULT_HBDELAY] * 1000000ULL;
+                    break;
+                }
+                pop = htonl(1000 + conn->room_id % 1000);
+                out_append(conn, BLIVE_MSG_PROTO_HBAUNOCMPRES, BLIVE_MSG_TYPE_HBREPLY_POP, (char*)&pop, sizeof(pop));
+                break;
+            default:
+                break;
+            }
+            memmove(conn->in, conn->in + packet_size, conn->in_len - packet_size);
+            conn->in_len -= packet_size;
+        }
+        if (conn->in_len == MOCK_IN_MAX) {
+            return ERROR;
+        }
+    }
+    if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return ERROR;
+    }
+    return conn_flush(conn);
+}
+
+/**
+ * @brief 故障生效：记录持续时间窗口，并对已认证的选中连接立即执行断开、半开或切分
+ * 
+ * @param [in] fault 故障
+ * @param [in] now 生效时间
+ */
+static void fault_apply(const mock_fault* fault, uint64_t now)
+{
+    struct epoll_event  ev = {0};
+    mock_conn*          conn = NULL;
+
+    mock.fault_until[fault->kind] = now + fault->duration_ms * 1000000ULL;
+    mock.fault_fraction[fault->kind] = fault->fraction;
+    mock.fault_arg[fault->kind] = fault->arg;
+
+    for (int pos = 0; pos < mock.conn_num; pos++) {
+        conn = mock.conns[pos];
+        if (!conn->authed || !fault_hit(fault->kind, conn->room_id, 0)) {
+            continue;
+        }
+        switch (fault->kind) {
+        case FAULT_RESET:
+        case FAULT_AUTHFAIL:
+            conn->abort = True;
+            pos = conn_drop(conn) - 1;      /*末尾的连接填补了当前位置*/
+            break;
+        case FAULT_HALFOPEN:
+            /*不再监听任何事件，客户端的数据留在接收缓冲中*/
+            conn->halfopen_until = mock.fault_until[FAULT_HALFOPEN];
+            conn->want_write = False;
+            ev.events = 0;
+            ev.data.ptr = conn;
+            epoll_ctl(mock.epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+            break;
+        case FAULT_SPLIT:
+            conn->split_until = mock.fault_until[FAULT_SPLIT];
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 处理连接上到期的故障状态：半开到期断开、发送延迟的心跳回复、逐段发送切分的数据
+ * 
+ * @return int 需要断开连接时返回ERROR
+ */
+static int conn_tick(mock_conn* conn, uint64_t now)
+{
+    uint32_t    pop = 0;
+
+    if (conn->halfopen_until) {
+        if (now < conn->halfopen_until) {
+            return OK;
+        }
+        conn->abort = True;
+        return ERROR;
+    }
+    if (conn->hb_due && now >= conn->hb_due) {
+        conn->hb_due = 0;
+        pop = htonl(1000 + conn->room_id % 1000);
+        out_append(conn, BLIVE_MSG_PROTO_HBAUNOCMPRES, BLIVE_MSG_TYPE_HBREPLY_POP, (char*)&pop, sizeof(pop));
+    }
+    if (conn->split_until && now >= conn->split_until) {
+        conn->split_until = 0;
+    }
+    return conn->out_len ? conn_flush(conn) : OK;
+}
+
+/**
+ * @brief 处理控制接口的故障注入请求，等待主循环使故障生效后返回
+ * 
+ * @param [in] request HTTP请求
+ * @param [out] body 响应正文
+ * @param [in] size 响应正文缓冲区大小
+ * @return int 响应正文长度
+ */
+static int fault_request(const char* request, char* body, size_t size)
+{
+    mock_fault  fault = {FAULT_MAX, 1, 0, 0};
+    const char* kind = strstr(request, "kind=");
+    const char* value = NULL;
+    uint64_t    applied = 0;
+    size_t      len = 0;
+
+    for (int index = 0; kind != NULL && index < FAULT_MAX; index++) {
+        len = strlen(fault_names[index]);
+        if (!strncmp(kind + strlen("kind="), fault_names[index], len) && strchr("& ", kind[strlen("kind=") + len])) {
+            fault.kind = index;
+        }
+    }
+    if (fault.kind == FAULT_MAX) {
+        return snprintf(body, size, "{\"code\":-400,\"message\":\"unknown fault kind\"}");
+    }
+    if ((value = strstr(request, "fraction=")) != NULL) {
+        fault.fraction = atof(value + strlen("fraction="));
+    }
+    if ((value = strstr(request, "duration=")) != NULL) {
+        fault.duration_ms = strtoull(value + strlen("duration="), NULL, 10);
+    }
+    if ((value = strstr(request, "arg=")) != NULL) {
+        fault.arg = strtoull(value + strlen("arg="), NULL, 10);
+    }
+    if (fault.kind == FAULT_SPLIT && !fault.arg) {
+        fault.arg = MOCK_SPLIT_MAX;
+    }
+
+    pthread_mutex_lock(&mock.fault_lock);
+    mock.pending = fault;
+    mock.has_pending = True;
+    while (mock.has_pending) {
+        pthread_cond_wait(&mock.fault_cond, &mock.fault_lock);
+    }
+    applied = mock.applied_ns;
+    pthread_mutex_unlock(&mock.fault_lock);
+
+    printf("fault %s fraction %.2f duration %llu ms arg %llu\n", fault_names[fault.kind], fault.fraction,
+           (unsigned long long)fault.duration_ms, (unsigned long long)fault.arg);
+    fflush(stdout);
+    return snprintf(body, size, "{\"code\":0,\"applied_ns\":%llu}", (unsigned long long)applied);
+}
+
+/**
+ * @brief getDanmuInfo的替身与故障注入的控制接口，每个连接处理一个请求后关闭，返回的令牌不做校验
+ * 
+ */
+static void* http_routine(void* arg)
+{
+    int     listen_fd = *(int*)arg;
+    int     fd = 0;
+    char    request[2048] = {0};
+    char    body[512] = {0};
+    char    response[1024] = {0};
+    ssize_t size = 0;
+    size_t  len = 0;
+    char*   id = NULL;
+    int     body_len = 0;
+    int     resp_len = 0;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        len = 0;
+        while (len < sizeof(request) - 1 && (size = recv(fd, request + len, sizeof(request) - 1 - len, 0)) > 0) {
+            len += size;
+            request[len] = '\0';
+            if (strstr(request, "\r\n\r\n") != NULL) {
+                break;
+            }
+        }
+        request[len] = '\0';
+        if (!strncmp(request, "GET /fault?", strlen("GET /fault?"))) {
+            body_len = fault_request(request, body, sizeof(body));
+            goto reply;
+        }
+        id = strstr(request, "id=");
+        body_len = snprintf(body, sizeof(body), "{\"code\":0,\"message\":\"0\",\"ttl\":1,\"data\":{\"group\":\"live\","
+                            "\"token\":\"mock-token-%lu\",\"host_list\":[{\"host\":\"127.0.0.1\",\"port\":%d,"
+                            "\"wss_port\":443,\"ws_port\":2244}]}}", id != NULL ? strtoul(id + 3, NULL, 10) : 0UL,
+                            mock.tcp_port);
+reply:
+        resp_len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                            "Content-Length: %d\r\nConnection: close\r\n\r\n%s", body_len, body);
+        send(fd, response, resp_len, MSG_NOSIGNAL);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void usage(const char* name)
+{
+    printf("usage: %s [-p tcp_port] [-w http_port] [-r msgs_per_sec_per_room] [-i interval_ms]\n"
+           "          [-b factor:period_ms:length_ms] [-q brotli_quality]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+    int                 opt = 0;
+    int                 tcp_fd = 0;
+    int                 http_fd = 0;
+    int                 fd = 0;
+    int                 num = 0;
+    int                 on = 1;
+    pthread_t           http_tid;
+    struct epoll_event  ev = {0};
+    struct epoll_event  events[MOCK_MAX_EVENTS];
+    mock_conn*          conn = NULL;
+    char*               plain = NULL;
+    char*               packed = NULL;
+    uint64_t            start = 0;
+    uint64_t            next_push = 0;
+    uint64_t            next_report = 0;
+    uint64_t            last_msgs = 0;
+    uint64_t            last_bytes = 0;
+    uint64_t            now = 0;
+    double              rate = 0;
+    int                 timeout_ms = 0;
+
+    while ((opt = getopt(argc, argv, "p:w:r:i:b:q:h")) != -1) {
+        switch (opt) {
+        case 'p': mock.tcp_port = atoi(optarg); break;
+        case 'w': mock.http_port = atoi(optarg); break;
+        case 'r': mock.rate = atof(optarg); break;
+        case 'i': mock.interval_ms = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 'b':
+            if (sscanf(optarg, "%lf:%d:%d", &mock.burst_factor, &mock.burst_period_ms, &mock.burst_len_ms) != 3
+                || mock.burst_period_ms <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'q': mock.quality = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    tcp_fd = listen_on(mock.tcp_port);
+    http_fd = listen_on(mock.http_port);
+    pthread_create(&http_tid, NULL, http_routine, &http_fd);
+    fcntl(tcp_fd, F_SETFL, fcntl(tcp_fd, F_GETFL) | O_NONBLOCK);
+
+    mock.epfd = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;     /*监听套接字*/
+    epoll_ctl(mock.epfd, EPOLL_CTL_ADD, tcp_fd, &ev);
+
+    plain = malloc(MOCK_BATCH_MAX * (sizeof(blive_msg_header) + MOCK_JSON_MAX));
+    packed = malloc(BrotliEncoderMaxCompressedSize(MOCK_BATCH_MAX * (sizeof(blive_msg_header) + MOCK_JSON_MAX)));
+    printf("mock server: tcp 127.0.0.1:%d, getDanmuInfo http://127.0.0.1:%d/xlive/web-room/v1/index/getDanmuInfo\n"
+           "%.0f msg/s per room every %d ms, burst x%.1f for %d of every %d ms, brotli quality %d\n",
+           mock.tcp_port, mock.http_port, mock.rate, mock.interval_ms, mock.burst_factor, mock.burst_len_ms,
+           mock.burst_period_ms, mock.quality);
+
+    start = now_ns();
+    next_push = start;
+    next_report = start + 1000000000ULL;
+    for (;;) {
+        now = now_ns();
+        timeout_ms = next_push > now ? (int)((next_push - now) / 1000000) : 0;
+        if (now < mock.fault_until[FAULT_SPLIT] && timeout_ms > 1) {
+            timeout_ms = 1;     /*切分发送期间每毫秒发送一段*/
+        }
+        num = epoll_wait(mock.epfd, events, MOCK_MAX_EVENTS, timeout_ms);
+        for (int index = 0; index < num; index++) {
+            conn = events[index].data.ptr;
+            if (conn == NULL) {
+                while ((fd = accept(tcp_fd, NULL, NULL)) >= 0) {
+                    if (mock.conn_num == mock.conn_cap) {
+                        mock.conn_cap = mock.conn_cap ? mock.conn_cap * 2 : 64;
+                        mock.conns = realloc(mock.conns, sizeof(mock_conn*) * mock.conn_cap);
+                    }
+                    conn = calloc(1, sizeof(mock_conn));
+                    conn->fd = fd;
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = conn;
+                    epoll_ctl(mock.epfd, EPOLL_CTL_ADD, fd, &ev);
+                    mock.conns[mock.conn_num++] = conn;
+                }
+                continue;
+            }
+            if (((events[index].events & EPOLLIN) && conn_read(conn) != OK)
+                || ((events[index].events & EPOLLOUT) && conn_flush(conn) != OK)
+                || (events[index].events & (EPOLLERR | EPOLLHUP))) {
+                conn_drop(conn);
+            }
+        }
+
+        /*控制接口提交的故障在两次事件处理之间生效，避免与事件处理同时修改连接*/
+        pthread_mutex_lock(&mock.fault_lock);
+        if (mock.has_pending) {
+            mock.applied_ns = now_ns();
+            fault_apply(&mock.pending, mock.applied_ns);
+            mock.has_pending = False;
+            pthread_cond_broadcast(&mock.fault_cond);
+        }
+        pthread_mutex_unlock(&mock.fault_lock);
+
+        now = now_ns();
+        for (int pos = 0; pos < mock.conn_num; pos++) {
+            if (conn_tick(mock.conns[pos], now) != OK) {
+                pos = conn_drop(mock.conns[pos]) - 1;
+            }
+        }
+
+        /*每个推送间隔为所有已认证的直播间各生成一个数据包*/
+        now = now_ns();
+        if (now >= next_push) {
+            rate = mock.rate;
+            if (mock.burst_len_ms && ((now - start) / 1000000) % mock.burst_period_ms < (uint64_t)mock.burst_len_ms) {
+                rate *= mock.burst_factor;
+            }
+            for (int pos = 0; pos < mock.conn_num; pos++) {
+                conn = mock.conns[pos];
+                if (!conn->authed || conn->halfopen_until) {
+                    continue;
+                }
+                conn->credit += rate * mock.interval_ms / 1000.0;
+                num = conn->credit < MOCK_BATCH_MAX ? (int)conn->credit : MOCK_BATCH_MAX;
+                if (num > 0) {
+                    conn->credit -= num;
+                    room_push(conn, num, plain, packed);
+                    conn_flush(conn);
+                }
+            }
+            next_push += mock.interval_ms * 1000000ULL;
+            if (next_push < now) {
+                next_push = now;    /*生成速度跟不上时不追赶，避免之后集中发送*/
+            }
+        }
+
+        if (now >= next_report) {
+            printf("rooms %d  sent %llu msg/s  %.2f MB/s  dropped %llu  faulted %llu\n", mock.conn_num,
+                   (unsigned long long)(mock.sent_msgs - last_msgs), (mock.sent_bytes - last_bytes) / 1048576.0,
+                   (unsigned long long)mock.dropped, (unsigned long long)mock.faulted);
+            fflush(stdout);
+            last_msgs = mock.sent_msgs;
+            last_bytes = mock.sent_bytes;
+            next_report += 1000000000ULL;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -13,24 +13,44 @@
 #include "blive_def.h"
 
 
+/*未定义BLIVE_LOG_SUBSYS的源文件中，日志归入通用子系统；模块内的源文件在包含本头文件之前定义*/
+#ifndef BLIVE_LOG_SUBSYS
+#define BLIVE_LOG_SUBSYS            BLIVE_LOG_SUBSYS_CORE
+#endif
+
+/*运行时等级低于子系统设置的日志只有一次比较的开销，参数不求值；通过等级检查后再按调用处限流*/
+#define blive_log_at(subsys, level, format, ...)                                                        \
+    do {                                                                                                \
+        static blive_log_site blive_log_site_ = {0};                                                    \
+        if ((level) >= blive_log_levels[subsys]                                                         \
+            && blive_log_site_allow(&blive_log_site_, (level), __FUNCTION__, __LINE__)) {               \
+            blive_log((level), __FUNCTION__, __LINE__, format, ##__VA_ARGS__);                          \
+        }                                                                                               \
+    } while (0)
+
+/*编译期的BLIVE_API_DEBUG_*决定哪些等级被编译进来，运行时的等级只能在此范围内调整*/
 #if (defined BLIVE_API_DEBUG_DEBUG)
-#define blive_logd(format, ...)     blive_log(BLIVE_LOG_DEBUG, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)   /*debug等级的日志打印*/
-#define blive_logi(format, ...)     blive_log(BLIVE_LOG_INFO, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)    /*info等级的日志打印*/
-#define blive_loge(format, ...)     blive_log(BLIVE_LOG_ERROR, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)   /*error等级的日志打印*/
+#define blive_logd_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_DEBUG, format, ##__VA_ARGS__)
+#define blive_logi_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_INFO, format, ##__VA_ARGS__)
+#define blive_loge_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_ERROR, format, ##__VA_ARGS__)
 #elif (defined BLIVE_API_DEBUG_INFO)
-#define blive_logd(format, ...)
-#define blive_logi(format, ...)     blive_log(BLIVE_LOG_INFO, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)    /*info等级的日志打印*/
-#define blive_loge(format, ...)     blive_log(BLIVE_LOG_ERROR, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)   /*error等级的日志打印*/
+#define blive_logd_at(subsys, format, ...)
+#define blive_logi_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_INFO, format, ##__VA_ARGS__)
+#define blive_loge_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_ERROR, format, ##__VA_ARGS__)
 #elif (defined BLIVE_API_DEBUG_ERROR)
-#define blive_logd(format, ...)
-#define blive_logi(format, ...)
-#define blive_loge(format, ...)     blive_log(BLIVE_LOG_ERROR, __FUNCTION__, __LINE__, format, ##__VA_ARGS__)   /*error等级的日志打印*/
+#define blive_logd_at(subsys, format, ...)
+#define blive_logi_at(subsys, format, ...)
+#define blive_loge_at(subsys, format, ...)  blive_log_at(subsys, BLIVE_LOG_ERROR, format, ##__VA_ARGS__)
 #else
-#define blive_logd(format, ...)
-#define blive_logi(format, ...)
-#define blive_loge(format, ...)
+#define blive_logd_at(subsys, format, ...)
+#define blive_logi_at(subsys, format, ...)
+#define blive_loge_at(subsys, format, ...)
 #endif
 
+#define blive_logd(format, ...)     blive_logd_at(BLIVE_LOG_SUBSYS, format, ##__VA_ARGS__)     /*debug等级的日志打印*/
+#define blive_logi(format, ...)     blive_logi_at(BLIVE_LOG_SUBSYS, format, ##__VA_ARGS__)     /*info等级的日志打印*/
+#define blive_loge(format, ...)     blive_loge_at(BLIVE_LOG_SUBSYS, format, ##__VA_ARGS__)     /*error等级的日志打印*/
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,6 +68,76 @@ extern "C" {
  */
 int blive_log(blive_log_level level, const char* func_name, int line, const char* fmt, ...);
 
+/**
+ * @brief 获取单调时间，模块内所有的接收时间与延迟统计都使用该时间基准
+ * 
+ * @return uint64_t 纳秒，起点不确定，只用于计算时间间隔
+ */
+uint64_t blive_clock_now_ns(void);
+
+/**
+ * @brief 获取缓存的系统时间，只有一次内存读取。精度取决于blive_perform、解码线程等循环的刷新间隔，
+ *          日志线程运行时至少每10毫秒刷新一次
+ * 
+ * @return uint64_t 1970年以来的毫秒数
+ */
+uint64_t blive_clock_wall_ms(void);
+
+/**
+ * @brief 各子系统当前的日志等级，由日志宏直接读取，请通过blive_log_set_level修改
+ * 
+ */
+extern uint8_t blive_log_levels[BLIVE_LOG_SUBSYS_MAX];
+
+/**
+ * @brief 设置子系统的日志等级，低于该等级的日志不打印，运行中随时生效。默认均为BLIVE_LOG_ERROR，
+ *          也可以在blive_api_init之前通过环境变量设置，如 BLIVE_LOG_LEVEL=debug 或
+ *          BLIVE_LOG_LEVEL=conn=debug,msg=info,decode=error，子系统名为core、conn、msg、decode
+ * 
+ * @param [in] subsys 子系统
+ * @param [in] level 日志等级，BLIVE_LOG_NONE为关闭
+ * @return int 
+ */
+int blive_log_set_level(blive_log_subsys subsys, blive_log_level level);
+
+/**
+ * @brief 设置每个日志调用处的限流：令牌桶每秒补充rate个令牌，最多积累burst个，每条日志消耗一个。
+ *          被限流的日志计数后丢弃，该调用处下一次打印前输出丢弃的条数。默认每秒20条，最多积累100条
+ * 
+ * @param [in] rate 每秒补充的令牌数，0为不限流
+ * @param [in] burst 令牌桶容量，最大65535
+ * @return int 
+ */
+int blive_log_set_rate_limit(uint32_t rate, uint32_t burst);
+
+/**
+ * @brief 日志宏使用的限流检查，不需要直接调用
+ * 
+ * @param [in] site 调用处的限流状态
+ * @param [in] level 日志等级
+ * @param [in] func_name 函数名
+ * @param [in] line 行数
+ * @return Bool 是否打印本条日志
+ */
+Bool blive_log_site_allow(blive_log_site* site, blive_log_level level, const char* func_name, int line);
+
+/**
+ * @brief 等待所有已打印的日志写出到stderr。blive_api_init之后日志默认异步写出，
+ *          需要确保日志落盘时（如程序即将abort）调用
+ * 
+ * @return int 
+ */
+int blive_log_flush(void);
+
+/**
+ * @brief 切换日志的写出方式。异步模式下调用线程只把日志写入本线程的队列，由后台线程格式化并批量写出，
+ *          队列已满时丢弃并在之后输出丢弃的条数；同步模式下在调用线程内直接写出
+ * 
+ * @param [in] async True为异步（blive_api_init之后的默认值），False为同步
+ * @return int 日志后台线程未启动（blive_api_init之前或blive_api_deinit之后）时不能切换为异步，返回ERROR
+ */
+int blive_log_set_async(Bool async);
+
 /**
  * @brief B站直播间API使用前初始化。为了多线程安全，请勿在子线程内调用初始化或反初始化
  * 
@@ -95,6 +185,221 @@ int blive_destroy(blive* entity);
  */
 int blive_set_command_callback(blive* entity, blive_info_type info, blive_msg_handler cb, void* usr_data);
 
+/**
+ * @brief 设置在收到指定类型的消息后调起的事件回调。事件携带消息在解压缓冲区中的原文，
+ *          只转发消息的使用者可以直接复制原文，不必对JSON重新序列化。只订阅了事件回调的类型不会解析JSON
+ *          （原文模式），回调内调用blive_event_json时才按需解析。与blive_set_command_callback可以同时设置，
+ *          事件回调先执行。合并窗口的结果没有对应的原始报文，原文由合并后的JSON序列化得到
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] info 指定的消息类型
+ * @param [in] cb 事件回调函数，NULL为取消事件回调
+ * @param [in] usr_data 回调函数允许传入的额外的调用者数据
+ * @return int 
+ */
+int blive_set_event_callback(blive* entity, blive_info_type info, blive_event_handler cb, void* usr_data);
+
+/**
+ * @brief 设置批量回调。每个数据包解压后，info_mask中订阅的所有消息在一次回调中以事件数组交付，
+ *          高优先级消息排在前面，适合批量入库与向量化处理。批量回调在解码所在的线程内直接执行，
+ *          不经过回调执行器与合并窗口，与blive_set_command_callback设置的回调相互独立
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] info_mask 订阅的消息类型，由BLIVE_INFO_BIT(type)组合，BLIVE_INFO_ALL为全部类型
+ * @param [in] cb 批量回调函数，NULL为取消批量回调
+ * @param [in] usr_data 回调函数允许传入的额外的调用者数据
+ * @return int 
+ */
+int blive_set_batch_callback(blive* entity, uint64_t info_mask, blive_batch_handler cb, void* usr_data);
+
+/**
+ * @brief 持有事件，在回调返回后继续使用。事件引用解压缓冲区中的原文，持有期间缓冲区不会被释放，
+ *          不发生数据复制；所有引用释放后缓冲区回到缓冲池。持有的事件可以交给其他线程，
+ *          但同一事件的blive_event_json不能在多个线程中同时首次调用
+ * 
+ * @param [in] event 回调中收到的事件
+ * @return blive_event* 需要使用该返回值访问并最终调用blive_event_release，申请失败返回NULL
+ */
+blive_event* blive_event_retain(const blive_event* event);
+
+/**
+ * @brief 释放blive_event_retain持有的事件
+ * 
+ * @param [in] event 事件
+ */
+void blive_event_release(blive_event* event);
+
+/**
+ * @brief 获取事件所在数据包的接收时间，与blive_clock_now_ns使用同一时间基准，相减即为接收到回调的延迟。
+ *          合并消息为窗口内最后一条消息的接收时间
+ * 
+ * @param [in] event 事件
+ * @return uint64_t 单调时间（纳秒）
+ */
+uint64_t blive_event_recv_ns(const blive_event* event);
+
+/**
+ * @brief 获取事件的消息类型
+ * 
+ * @param [in] event 事件
+ * @return blive_info_type 
+ */
+blive_info_type blive_event_type(const blive_event* event);
+
+/**
+ * @brief 获取事件解析后的JSON消息，首次调用时才解析，只读取原文的批量回调不产生解析开销
+ * 
+ * @param [in] event 事件
+ * @return const cJSON* 解析失败时返回NULL
+ */
+const cJSON* blive_event_json(const blive_event* event);
+
+/**
+ * @brief 获取事件的消息原文，指向解压后的数据包，不以'\0'结尾
+ * 
+ * @param [in] event 事件
+ * @param [out] len 传出原文长度，可以为NULL
+ * @return const char* 
+ */
+const char* blive_event_raw(const blive_event* event, size_t* len);
+
+/**
+ * @brief 设置指定消息类型的分发优先级。默认红包（POPULARITY_RED_POCKET_START、POPULARITY_RED_POCKET_NEW）
+ *          与主播准备中（PREPARING）为高优先级，其余为普通优先级。高优先级消息只先于同一数据包内的普通消息回调，
+ *          不会越过此前数据包中尚未执行的消息
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] info 消息类型
+ * @param [in] priority 分发优先级
+ * @return int 
+ */
+int blive_set_command_priority(blive* entity, blive_info_type info, blive_priority priority);
+
+/**
+ * @brief 设置指定消息类型的合并窗口。开启后同类消息在窗口内合并，窗口到期后只调起一次回调，
+ *          消息内容为窗口内的最后一条，并追加 "coalesce": {"count": 合并数, "window_ms": 窗口长度} 字段。
+ *          适用于LIKE_INFO_V3_CLICK（count即点赞次数之和）、WATCHED_CHANGE与ONLINE_RANK_COUNT（保留最新值）、
+ *          COMBO_SEND（按送礼用户与礼物分别合并，保留最新的连击总数）等高频消息
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] info 消息类型
+ * @param [in] window_ms 窗口长度（毫秒），0为关闭合并（默认）
+ * @return int 
+ */
+int blive_set_coalesce_window(blive* entity, blive_info_type info, uint32_t window_ms);
+
+/**
+ * @brief 编译过滤表达式。表达式直接在消息原文上求值，不构建JSON树，语法：
+ *          条件：type == SEND_GIFT、type != DANMU_MSG、type in (SEND_GIFT, COMBO_SEND)
+ *               字段 比较符 数值，比较符为 == != < <= > >=，如 price > 1000、medal_level >= 20
+ *               字段 == "字符串"、字段 != "字符串"、字段 contains "字符串"
+ *               字段 in (1, 2, 3)、字段 in $集合名，集合内容由blive_filter_bind_set设置
+ *          组合：&&、||、!与括号
+ *          字段：uid、uname、text、medal_level、user_level、guard_level、gift_id、gift_name、price、num、
+ *               total_coin、combo_num、msg_type、timestamp，同一字段在各消息类型中的位置由模块内置；
+ *               消息中不存在该字段时，涉及该字段的条件为假
+ * 
+ * @param [out] filter 传出过滤器
+ * @param [in] expr 过滤表达式，如 type == SEND_GIFT && price > 1000 || uid in $watchlist
+ * @return int 语法错误时返回ERROR，并打印错误位置
+ */
+int blive_filter_compile(blive_filter** filter, const char* expr);
+
+/**
+ * @brief 设置表达式中$name引用的集合内容，需要在blive_set_filter之前设置
+ * 
+ * @param [in] filter 过滤器
+ * @param [in] name 集合名，不含'$'
+ * @param [in] values 集合内容
+ * @param [in] num 元素个数
+ * @return int 表达式中没有引用该集合时返回ERROR
+ */
+int blive_filter_bind_set(blive_filter* filter, const char* name, const uint64_t* values, size_t num);
+
+/**
+ * @brief 销毁过滤器，需要先从所有使用它的直播间实体上解除
+ * 
+ * @param [in] filter 过滤器
+ * @return int 
+ */
+int blive_filter_destroy(blive_filter* filter);
+
+/**
+ * @brief 设置直播间的消息过滤器。不满足条件的消息在解析JSON与分发之前丢弃，不会到达任何回调。
+ *          多个直播间实体可以共用同一个过滤器
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] filter 过滤器，NULL为不过滤
+ * @return int 
+ */
+int blive_set_filter(blive* entity, blive_filter* filter);
+
+/**
+ * @brief 判断事件是否满足过滤条件，可用于在回调中按不同条件分流
+ * 
+ * @param [in] filter 过滤器
+ * @param [in] event 事件
+ * @return Bool 
+ */
+Bool blive_filter_match(const blive_filter* filter, const blive_event* event);
+
+/**
+ * @brief 创建关键词集合，内容由blive_keywords_update设置。多个直播间实体可以共用同一个集合
+ * 
+ * @param [out] kw 传出关键词集合
+ * @return int 
+ */
+int blive_keywords_create(blive_keywords** kw);
+
+/**
+ * @brief 替换关键词集合的内容。新的匹配自动机在调用线程内构建完成后一次性替换，正在处理的数据包
+ *          继续使用旧的关键词，之后的数据包使用新的关键词，可以在运行中随时调用
+ * 
+ * @param [in] kw 关键词集合
+ * @param [in] words 关键词，UTF-8编码，按字节匹配，区分大小写；空串忽略
+ * @param [in] ids 各关键词的id，命中时以id标记事件，不同关键词可以使用相同的id
+ * @param [in] num 关键词个数，0为清空
+ * @return int 申请内存失败时返回ERROR，集合保持原有内容
+ */
+int blive_keywords_update(blive_keywords* kw, const char* const* words, const uint32_t* ids, size_t num);
+
+/**
+ * @brief 销毁关键词集合，需要先从所有使用它的直播间实体上解除
+ * 
+ * @param [in] kw 关键词集合
+ * @return int 
+ */
+int blive_keywords_destroy(blive_keywords* kw);
+
+/**
+ * @brief 设置直播间的关键词集合。弹幕消息（DANMU_MSG）的文本在分发前一次扫描匹配全部关键词，
+ *          命中的关键词id通过blive_event_keywords获取。匹配在原文上进行，文本中的JSON转义字符不还原
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] kw 关键词集合，NULL为不匹配
+ * @return int 
+ */
+int blive_set_keywords(blive* entity, blive_keywords* kw);
+
+/**
+ * @brief 获取事件命中的关键词id，按在文本中首次命中的顺序排列并去重，最多BLIVE_KEYWORD_TAG_MAX个
+ * 
+ * @param [in] event 事件
+ * @param [out] num 传出命中的关键词数，没有命中时为0
+ * @return const uint32_t* 关键词id数组，有效期与事件相同
+ */
+const uint32_t* blive_event_keywords(const blive_event* event, size_t* num);
+
+/**
+ * @brief 替换获取信息流服务器与认证密钥的getDanmuInfo地址，用于连接本地的模拟服务端等场合。
+ *          只影响之后的连接与重连，请勿与blive_establish_connection同时调用
+ * 
+ * @param [in] url 完整的地址（不含参数），如http://127.0.0.1:22431/xlive/web-room/v1/index/getDanmuInfo，
+ *          NULL时恢复为B站的地址
+ * @return int 
+ */
+int blive_set_danmu_info_url(const char* url);
+
 /**
  * @brief 连接B站直播间，将会每隔30秒进行自动发送心跳包
  * 
@@ -125,6 +430,472 @@ int blive_close_connection(blive* entity);
  */
 int blive_set_command_callback(blive* entity, blive_info_type info, blive_msg_handler cb, void* usr_data);
 
+/**
+ * @brief 创建回调执行器。执行器内的工作线程负责执行用户回调，每个直播间的回调按接收顺序串行执行，
+ *          不同直播间之间并行执行，空闲的工作线程会从繁忙的工作线程窃取待执行的直播间。
+ *          多个直播间实体可以共用同一个执行器
+ * 
+ * @param [out] exec 传出执行器
+ * @param [in] worker_num 工作线程数量
+ * @return int 
+ */
+int blive_executor_create(blive_executor** exec, int worker_num);
+
+/**
+ * @brief 销毁回调执行器，已投递的回调会全部执行完毕后返回。调用前需先销毁使用该执行器的直播间实体，
+ *          或通过blive_set_executor将其解除
+ * 
+ * @param [in] exec 执行器
+ * @return int 
+ */
+int blive_executor_destroy(blive_executor* exec);
+
+/**
+ * @brief 设置直播间实体的回调执行器。设置后blive_perform只负责接收和解析，回调在执行器的工作线程内执行，
+ *          单个回调耗时较长时不会阻塞socket的读取。exec为NULL时恢复为在blive_perform线程内直接执行回调。
+ *          请勿在blive_perform运行期间或该直播间的回调内调用
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] exec 执行器，NULL表示不使用执行器
+ * @return int 
+ */
+int blive_set_executor(blive* entity, blive_executor* exec);
+
+/**
+ * @brief 设置执行器内所有直播间排队事件总数的上限，超出时按各消息类型的策略处理
+ * 
+ * @param [in] exec 执行器
+ * @param [in] capacity 排队事件总数上限，0为不限制（默认）
+ * @return int 
+ */
+int blive_executor_set_capacity(blive_executor* exec, size_t capacity);
+
+/**
+ * @brief 获取执行器内所有直播间的事件队列统计
+ * 
+ * @param [in] exec 执行器
+ * @param [out] stats 传出统计信息
+ * @return int 
+ */
+int blive_executor_get_queue_stats(blive_executor* exec, blive_queue_stats* stats);
+
+/**
+ * @brief 设置直播间排队事件数的上限，超出时按各消息类型的策略处理
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] capacity 排队事件数上限，0为不限制（默认）
+ * @return int 
+ */
+int blive_set_queue_capacity(blive* entity, size_t capacity);
+
+/**
+ * @brief 设置指定消息类型在事件队列已满时的处理策略。默认人气值、高能用户数量、看过人数、点赞数、
+ *          主播信息更新只保留最新的一条，其余类型阻塞接收线程而不丢弃
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] info 消息类型
+ * @param [in] policy 处理策略
+ * @return int 
+ */
+int blive_set_queue_policy(blive* entity, blive_info_type info, blive_queue_policy policy);
+
+/**
+ * @brief 获取直播间的事件队列统计，未设置执行器时统计全部为0
+ * 
+ * @param [in] entity 直播间实体
+ * @param [out] stats 传出统计信息
+ * @return int 
+ */
+int blive_get_queue_stats(blive* entity, blive_queue_stats* stats);
+
+/**
+ * @brief 创建解码线程池。brotli解压与JSON解析在解码线程内完成，接收线程只负责收取完整的数据包，
+ *          大量压缩数据包突发时不会拖慢socket的读取。多个直播间实体可以共用同一个解码线程池
+ * 
+ * @param [out] dec 传出解码线程池
+ * @param [in] worker_num 解码线程数量
+ * @return int 
+ */
+int blive_decoder_create(blive_decoder** dec, int worker_num);
+
+/**
+ * @brief 销毁解码线程池，已提交的数据包会全部处理完毕后返回。调用前需先销毁使用它的直播间实体，
+ *          或通过blive_set_decoder将其解除
+ * 
+ * @param [in] dec 解码线程池
+ * @return int 
+ */
+int blive_decoder_destroy(blive_decoder* dec);
+
+/**
+ * @brief 设置直播间实体的解码线程池。同一直播间的数据包始终由同一个解码线程按接收顺序处理，
+ *          未设置执行器时回调在解码线程内执行。dec为NULL时恢复为在blive_perform线程内解码。
+ *          解除时等待已提交的数据包处理完，不必等解码线程空闲。请勿在该直播间的blive_perform运行期间调用；
+ *          可以在其他直播间的回调内调用，在该直播间自身的回调内调用时返回ERROR
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] dec 解码线程池，NULL表示不使用
+ * @return int 
+ */
+int blive_set_decoder(blive* entity, blive_decoder* dec);
+
+/**
+ * @brief 获取指标快照。直播间的指标随实体销毁，全局指标为所有直播间（包括已销毁的）的累计。
+ *          读取过程中其他线程仍在更新，各项之间不保证是同一时刻的值
+ *
+ * @param [in] entity 直播间实体，NULL表示全局指标
+ * @param [out] metrics 传出指标快照
+ * @return int
+ */
+int blive_get_metrics(blive* entity, blive_metrics* metrics);
+
+/**
+ * @brief 获取直方图第index个桶的上界，桶内的耗时不超过该值
+ *
+ * @param [in] index 桶下标，0 ~ BLIVE_METRIC_HIST_BUCKETS - 1
+ * @return uint64_t 纳秒
+ */
+uint64_t blive_metric_hist_bound(int index);
+
+/**
+ * @brief 按直方图估算分位数，返回分位数所在桶的上界
+ *
+ * @param [in] hist 直方图
+ * @param [in] q 分位，0 ~ 1，如0.99
+ * @return uint64_t 纳秒，直方图为空时返回0
+ */
+uint64_t blive_metric_hist_quantile(const blive_metric_hist* hist, double q);
+
+/**
+ * @brief 以Prometheus文本格式输出全局指标与指定直播间的指标。全局指标名为blive_*，直播间指标名为
+ *          blive_room_*并带有room标签，两者分开命名避免聚合时重复计算；耗时直方图按固定的若干个le
+ *          输出，由内部的桶汇总，le处的计数按桶上界近似
+ *
+ * @param [in] entities 直播间实体数组，可以为NULL
+ * @param [in] num 直播间实体数
+ * @param [out] text 传出文本，以'\0'结尾，使用后调用free释放
+ * @param [out] len 传出文本长度，可以为NULL
+ * @return int
+ */
+int blive_metrics_render(blive* const* entities, size_t num, char** text, size_t* len);
+
+/**
+ * @brief 开启或关闭性能剖析模式（全局）。开启后每个线程在第一次经过解压、切分与回调阶段时通过perf_event_open
+ *          打开一组用户态硬件计数器，每个阶段前后各读取一次，差值计入指标的pmu。每次读取是一次系统调用，
+ *          会增加各阶段的耗时统计，只在排查性能问题时开启。关闭后已打开的计数器保留到线程退出
+ * 
+ * @param [in] enable 是否开启
+ * @return int 开启时当前线程无法打开硬件计数器（平台不支持、权限不足或虚拟机未暴露PMU）返回ERROR
+ */
+int blive_set_profiling(Bool enable);
+
+/**
+ * @brief 计算一个处理阶段的每周期指令数
+ * 
+ * @param [in] pmu 处理阶段的硬件计数
+ * @return double 没有计数时返回0
+ */
+double blive_metric_pmu_ipc(const blive_metric_pmu* pmu);
+
+/**
+ * @brief 计算一个处理阶段每处理1KB数据的硬件事件数，如BLIVE_METRIC_PMU_CACHE_MISSES
+ * 
+ * @param [in] pmu 处理阶段的硬件计数
+ * @param [in] event 硬件计数器
+ * @return double 没有计数时返回0
+ */
+double blive_metric_pmu_per_kb(const blive_metric_pmu* pmu, blive_metric_pmu_event event);
+
+/**
+ * @brief 开启、修改或关闭直播间的链路追踪。开启后交给回调的每个事件记录收到、解压完成、切分完成、
+ *          回调开始与结束的时间，弹幕、送礼与进场消息另外从原文中读取服务端时间；各区间按直播间汇总、
+ *          总耗时按消息类型汇总为直方图，慢事件按采样比例写入慢事件记录。请勿在blive_perform运行期间调用
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] config 追踪设置，NULL为关闭。修改设置时已有的统计与慢事件记录清空
+ * @return int 
+ */
+int blive_set_trace(blive* entity, const blive_trace_config* config);
+
+/**
+ * @brief 获取直播间的链路追踪统计，未开启链路追踪时统计全部为0
+ * 
+ * @param [in] entity 直播间实体
+ * @param [out] stats 传出统计
+ * @return int 
+ */
+int blive_get_trace_stats(blive* entity, blive_trace_stats* stats);
+
+/**
+ * @brief 按时间顺序取出慢事件记录，取出的记录从缓冲区中移除
+ * 
+ * @param [in] entity 直播间实体
+ * @param [out] traces 传出慢事件记录
+ * @param [in] max traces的容量
+ * @return int 取出的记录数
+ */
+int blive_trace_fetch(blive* entity, blive_trace* traces, int max);
+
+/**
+ * @brief 创建数据包抓取器。接收线程收到的每个数据包连同直播间id与接收时间原样追加到dir下内存映射的分段文件中，
+ *          brotli压缩的正文不解压。每个接收线程独占自己的分段文件，写入时不加锁，只有一次内存拷贝，
+ *          每写入1MB异步msync一次；写满后切换到后台线程提前准备好的分段，线程退出时封存其分段。
+ *          多个直播间实体可以共用同一个抓取器。写入页的缺页由文件系统处理，带日志的文件系统（如ext4）
+ *          在回写繁忙时会让个别缺页等待数毫秒，对尾部延迟敏感时可将dir放在tmpfs上再定期转存。
+ *          分段创建时即预留全部空间，空间不足时新分段创建失败，之后的数据包计入统计中的dropped
+ * 
+ * @param [out] cap 传出抓取器
+ * @param [in] dir 分段文件所在目录，需已存在
+ * @param [in] segment_size 单个分段文件的大小，0为默认的16MB，大于该大小的数据包不抓取
+ * @return int 
+ */
+int blive_capture_create(blive_capture** cap, const char* dir, size_t segment_size);
+
+/**
+ * @brief 销毁抓取器并封存所有分段文件。调用前需先停止使用它的直播间的blive_perform，
+ *          或通过blive_set_capture将其解除
+ * 
+ * @param [in] cap 抓取器
+ * @return int 
+ */
+int blive_capture_destroy(blive_capture* cap);
+
+/**
+ * @brief 设置直播间实体的数据包抓取器，可以在blive_perform运行期间调用。等待正在写入原抓取器的接收线程写完后才返回，
+ *          返回后原抓取器不会再被该直播间使用
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] cap 抓取器，NULL表示停止抓取
+ * @return int 
+ */
+int blive_set_capture(blive* entity, blive_capture* cap);
+
+/**
+ * @brief 获取抓取统计，包括已退出的写入线程
+ * 
+ * @param [in] cap 抓取器
+ * @param [out] stats 传出统计
+ * @return int 
+ */
+int blive_get_capture_stats(blive_capture* cap, blive_capture_stats* stats);
+
+/**
+ * @brief 为dir下的分段文件离线重建索引，用于没有索引的旧文件或异常退出时未封存的分段。
+ *          抓取器封存分段时已经写入了索引，正常情况下不需要调用
+ * 
+ * @param [in] dir 分段文件所在目录
+ * @param [in] force True为重建所有分段的索引，False为只重建没有有效索引的分段
+ * @return int 写入的索引文件数，无法读取目录时返回ERROR
+ */
+int blive_capture_index_rebuild(const char* dir, Bool force);
+
+/**
+ * @brief 打开dir下的所有抓取分段文件用于回放。分段文件以只读方式映射，每个直播间的数据包按接收时间排序，
+ *          仍在写入的分段只读取打开时已写入的部分。打开后可被多个线程同时用于不同直播间的回放
+ * 
+ * @param [out] replay 传出回放数据
+ * @param [in] dir 分段文件所在目录
+ * @return int 目录中没有可读取的分段文件时返回ERROR
+ */
+int blive_replay_open(blive_replay** replay, const char* dir);
+
+/**
+ * @brief 关闭回放数据并解除所有映射。调用前需先结束所有使用它的blive_replay_perform
+ * 
+ * @param [in] replay 回放数据
+ * @return int 
+ */
+int blive_replay_close(blive_replay* replay);
+
+/**
+ * @brief 获取回放数据中的直播间id，按从小到大排列
+ * 
+ * @param [in] replay 回放数据
+ * @param [out] rooms 传出直播间id
+ * @param [in] max rooms的容量
+ * @return int 传出的直播间数
+ */
+int blive_replay_rooms(blive_replay* replay, uint64_t* rooms, int max);
+
+/**
+ * @brief 获取回放数据的概况
+ * 
+ * @param [in] replay 回放数据
+ * @param [out] stats 传出概况
+ * @return int 
+ */
+int blive_get_replay_stats(blive_replay* replay, blive_replay_stats* stats);
+
+/**
+ * @brief 设置回放的系统时间范围，之后的blive_replay_perform与blive_replay_scan只处理接收时间在范围内的数据包。
+ *          有索引的分段只读取与范围重叠的时间段所在的页
+ * 
+ * @param [in] replay 回放数据
+ * @param [in] from_ms 起始时间（1970年以来的毫秒数，含），0为不限制
+ * @param [in] to_ms 结束时间（不含），0为不限制
+ * @return int 
+ */
+int blive_replay_set_range(blive_replay* replay, uint64_t from_ms, uint64_t to_ms);
+
+/**
+ * @brief 按接收时间顺序取出直播间在时间范围内的原始数据包，不经过处理流程
+ * 
+ * @param [in] replay 回放数据
+ * @param [in] room_id 直播间id
+ * @param [in] handler 对每个数据包调用，返回ERROR时停止
+ * @param [in] usr_data 传递给handler的调用者数据
+ * @return int 取出的数据包数，回放数据中没有该直播间时返回ERROR
+ */
+int blive_replay_scan(blive_replay* replay, uint64_t room_id, blive_replay_handler handler, void* usr_data);
+
+/**
+ * @brief 代替blive_perform，将抓取的该直播间（entity创建时的room_id）的数据包依次交给与接收时相同的处理流程：
+ *          计入接收指标、交给解码线程池或在当前线程内解压、切分并分发，回调与在线时一致，接收时间为交付时刻。
+ *          不需要建立连接；不同直播间的实体可以在各自的线程内同时回放，blive_force_stop可以终止回放
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] replay 回放数据
+ * @param [in] speed 回放速度：1.0为按抓取时的间隔实时回放，大于1.0为相应倍速，0为不等待尽快回放
+ * @return int 回放数据中没有该直播间或处理失败时返回ERROR
+ */
+int blive_replay_perform(blive* entity, blive_replay* replay, double speed);
+
+/**
+ * @brief 从dir下的抓取数据中训练归档压缩使用的共享字典：均匀取样各直播间的消息，
+ *          选出在最多消息中出现的片段拼接为brotli的前缀字典，写入dict_path
+ * 
+ * @param [in] dir 分段文件所在目录
+ * @param [in] dict_size 字典大小，0为默认的64KB；样本不足时实际写入的字典更小
+ * @param [in] dict_path 字典文件路径
+ * @return int 写入的字典字节数，失败时返回ERROR
+ */
+int blive_archive_train(const char* dir, size_t dict_size, const char* dict_path);
+
+/**
+ * @brief 将dir下的抓取数据压缩为归档文件：数据包解压并切分为消息，每个直播间的消息按接收时间合并为约1MB的块，
+ *          用brotli重新压缩。只保留消息正文、操作码与接收时间，不保留原始数据包的头部与分包方式
+ * 
+ * @param [in] dir 分段文件所在目录
+ * @param [in] archive_path 归档文件路径，写入完成后才出现
+ * @param [in] dict_path blive_archive_train生成的共享字典，NULL为不使用字典；读取时需要同一个字典
+ * @param [in] quality brotli压缩等级1~11，0为默认的9
+ * @param [out] stats 传出压缩统计，可以为NULL
+ * @return int 
+ */
+int blive_archive_compact(const char* dir, const char* archive_path, const char* dict_path, int quality,
+                          blive_archive_stats* stats);
+
+/**
+ * @brief 打开归档文件用于读取，文件以只读方式映射
+ * 
+ * @param [out] archive 传出归档
+ * @param [in] path 归档文件路径
+ * @param [in] dict_path 压缩时使用的共享字典，归档未使用字典时可以为NULL；内容不一致时返回ERROR
+ * @return int 
+ */
+int blive_archive_open(blive_archive** archive, const char* path, const char* dict_path);
+
+/**
+ * @brief 关闭归档文件
+ * 
+ * @param [in] archive 归档
+ * @return int 
+ */
+int blive_archive_close(blive_archive* archive);
+
+/**
+ * @brief 依次解压归档中的块并对每条消息调用handler，同一直播间的消息按接收时间排列。
+ *          每次调用使用独立的解压缓冲区，多个线程可以同时读取同一个归档
+ * 
+ * @param [in] archive 归档
+ * @param [in] room_id 只读取该直播间的块，0为全部
+ * @param [in] handler 对每条消息调用，返回ERROR时停止
+ * @param [in] usr_data 传递给handler的调用者数据
+ * @return int 读出的消息数，块损坏时返回ERROR
+ */
+int blive_archive_read(blive_archive* archive, uint64_t room_id, blive_archive_handler handler, void* usr_data);
+
+/**
+ * @brief 创建列式事件文件的写入器。弹幕、进场与送礼类消息按行组写入，每个行组内各列分别编码：
+ *          时间与直播间按差值编码，用户名、勋章名与礼物名按字典编码，等级等数值减去最小值后按位存放
+ * 
+ * @param [out] writer 传出写入器
+ * @param [in] path 文件路径，blive_column_finish后才出现
+ * @return int 
+ */
+int blive_column_create(blive_column_writer** writer, const char* path);
+
+/**
+ * @brief 写入一条消息，只提取各列对应的字段，不构建JSON树
+ * 
+ * @param [in] writer 写入器
+ * @param [in] room_id 直播间id
+ * @param [in] wall_ns 接收时的系统时间，1970年以来的纳秒数
+ * @param [in] raw 单条消息的JSON原文
+ * @param [in] len 原文长度
+ * @return int 写入的行数：不是弹幕、进场或送礼类消息时为0，写入文件失败时返回ERROR
+ */
+int blive_column_write(blive_column_writer* writer, uint64_t room_id, uint64_t wall_ns, const char* raw, int len);
+
+/**
+ * @brief 写入剩余的行与行组目录并释放写入器，无论成功与否写入器都不能再使用
+ * 
+ * @param [in] writer 写入器
+ * @return int 
+ */
+int blive_column_finish(blive_column_writer* writer);
+
+/**
+ * @brief 打开列式事件文件用于读取，文件以只读方式映射，可被多个线程同时读取
+ * 
+ * @param [out] reader 传出读取器
+ * @param [in] path 文件路径
+ * @return int 
+ */
+int blive_column_open(blive_column_reader** reader, const char* path);
+
+/**
+ * @brief 关闭列式事件文件
+ * 
+ * @param [in] reader 读取器
+ * @return int 
+ */
+int blive_column_close(blive_column_reader* reader);
+
+/**
+ * @brief 按列名查找列，列名与blive_field_name一致，另有"type"、"room_id"、"wall_ns"
+ * 
+ * @param [in] name 列名
+ * @return int 列id，不存在时返回ERROR
+ */
+int blive_column_lookup(const char* name);
+
+/**
+ * @brief 获取列式文件的概况与累计的读取统计
+ * 
+ * @param [in] reader 读取器
+ * @param [out] stats 传出统计
+ * @return int 
+ */
+int blive_get_column_stats(blive_column_reader* reader, blive_column_stats* stats);
+
+/**
+ * @brief 读取满足所有条件的行的指定列。先按各行组的最小最大值与字典跳过不可能满足条件的行组，
+ *          再只解码条件涉及的列，每批1024行得到满足条件的行后，才解码投影的列并交付；
+ *          字符串列的条件在行组内转换为字典编码的比较。没有涉及的列不会被访问
+ * 
+ * @param [in] reader 读取器
+ * @param [in] columns 投影的列
+ * @param [in] column_num 投影的列数
+ * @param [in] preds 过滤条件，可以为NULL
+ * @param [in] pred_num 过滤条件数
+ * @param [in] handler 对每批满足条件的行调用，返回ERROR时停止
+ * @param [in] usr_data 传递给handler的调用者数据
+ * @return int 交付的行数，条件不合法或文件损坏时返回ERROR
+ */
+int blive_column_scan(blive_column_reader* reader, const blive_column_id* columns, int column_num,
+                      const blive_column_pred* preds, int pred_num, blive_column_handler handler, void* usr_data);
+
 /**
  * @brief 运行blive模块，处理与直播间的心跳包处理、命令消息预处理
  * 
@@ -49,8 +49,26 @@ typedef enum {
     BLIVE_LOG_DEBUG,
     BLIVE_LOG_INFO,
     BLIVE_LOG_ERROR,
+    BLIVE_LOG_NONE,                 /*仅用于设置日志等级，关闭该子系统的所有日志*/
 } blive_log_level;
 
+typedef enum {
+    BLIVE_LOG_SUBSYS_CORE,          /*初始化、执行器等通用部分，以及调用者自己的日志*/
+    BLIVE_LOG_SUBSYS_CONN,          /*连接、鉴权、心跳、收发与重连*/
+    BLIVE_LOG_SUBSYS_MSG,           /*消息识别、过滤与分发*/
+    BLIVE_LOG_SUBSYS_DECODE,        /*解码线程、解压与分包*/
+    BLIVE_LOG_SUBSYS_MAX,
+} blive_log_subsys;
+
+/**
+ * @brief 日志调用处的限流状态，由日志宏在每个调用处定义为静态变量
+ * 
+ */
+typedef struct {
+    uint64_t    state;              /*令牌桶：高48位为上次补充令牌的时间（毫秒），低16位为剩余令牌数，原子操作*/
+    uint32_t    suppressed;         /*因限流未打印的日志数，原子操作*/
+} blive_log_site;
+
 typedef enum {
     True = 1,
     False = 0
@@ -85,11 +103,369 @@ typedef enum {
     BLIVE_INFO_MIN = BLIVE_INFO_DANMU_MSG,
 } blive_info_type;
 
+/**
+ * @brief 消息的分发优先级。同一个数据包内的高优先级消息会先于所有普通消息分发，
+ *          使用回调执行器时也会先于队列中的普通消息执行；同一优先级内保持接收顺序
+ * 
+ */
+typedef enum {
+    BLIVE_PRIORITY_NORMAL,                          /*普通优先级*/
+    BLIVE_PRIORITY_HIGH,                            /*高优先级*/
+    BLIVE_PRIORITY_MAX,
+} blive_priority;
+
+/**
+ * @brief 使用回调执行器时，接收线程与回调之间的事件队列已满时的处理策略，按消息类型分别设置
+ * 
+ */
+typedef enum {
+    BLIVE_QUEUE_BLOCK,                              /*阻塞接收线程直到队列有空位，不丢弃消息*/
+    BLIVE_QUEUE_DROP_OLDEST,                        /*丢弃队列中最早的一条同类型消息*/
+    BLIVE_QUEUE_DROP_NEWEST,                        /*丢弃刚收到的这条消息*/
+    BLIVE_QUEUE_COALESCE,                           /*队列中同类型的消息只保留最新的一条*/
+} blive_queue_policy;
+
+/**
+ * @brief 事件队列的统计信息
+ * 
+ */
+typedef struct {
+    size_t  queued;                                 /*当前排队等待执行的事件数*/
+    size_t  blocked;                                /*因队列已满而阻塞接收线程的次数*/
+    size_t  dropped[BLIVE_INFO_MAX];                /*各类型被丢弃的消息数*/
+    size_t  coalesced[BLIVE_INFO_MAX];              /*各类型被合并的消息数*/
+} blive_queue_stats;
+
+/**
+ * @brief 计数类指标，只增不减
+ * 
+ */
+typedef enum {
+    BLIVE_METRIC_RECV_BYTES,                        /*从服务端收到的字节数，含数据包头部*/
+    BLIVE_METRIC_RECV_FRAMES,                       /*从服务端收到的数据包数*/
+    BLIVE_METRIC_UNZIP_BYTES,                       /*解压后的字节数*/
+    BLIVE_METRIC_UNZIP_ERRORS,                      /*解压失败的数据包数*/
+    BLIVE_METRIC_MSGS,                              /*切分出的消息数*/
+    BLIVE_METRIC_PARSE_ERRORS,                      /*切分或JSON解析失败的次数*/
+    BLIVE_METRIC_FILTERED,                          /*被过滤器丢弃的消息数*/
+    BLIVE_METRIC_RECONNECTS,                        /*断线重连的尝试次数*/
+    BLIVE_METRIC_COUNTER_MAX,
+} blive_metric_counter;
+
+/**
+ * @brief 耗时直方图对应的处理阶段
+ * 
+ */
+typedef enum {
+    BLIVE_METRIC_STAGE_RECV,                        /*收到数据包头部到收完正文*/
+    BLIVE_METRIC_STAGE_UNZIP,                       /*brotli解压*/
+    BLIVE_METRIC_STAGE_PARSE,                       /*切分消息、过滤与关键词匹配，不含分发*/
+    BLIVE_METRIC_STAGE_HANDLER,                     /*单次回调，含消息回调之前按需解析JSON；批量回调按一次计*/
+    BLIVE_METRIC_STAGE_MAX,
+} blive_metric_stage;
+
+#define BLIVE_METRIC_HIST_BUCKETS   272     /*每个2的幂区间分为8个桶，相对误差不超过12.5%，上限约68秒*/
+
+/**
+ * @brief 耗时直方图，第i个桶的上界由blive_metric_hist_bound获取
+ * 
+ */
+typedef struct {
+    uint64_t    count;                              /*观测次数*/
+    uint64_t    sum_ns;                             /*耗时总和（纳秒）*/
+    uint64_t    buckets[BLIVE_METRIC_HIST_BUCKETS]; /*各桶的观测次数*/
+} blive_metric_hist;
+
+/**
+ * @brief 性能剖析模式下统计的硬件计数器，只计用户态
+ * 
+ */
+typedef enum {
+    BLIVE_METRIC_PMU_CYCLES,                        /*CPU周期数*/
+    BLIVE_METRIC_PMU_INSTRUCTIONS,                  /*执行的指令数*/
+    BLIVE_METRIC_PMU_CACHE_MISSES,                  /*末级缓存未命中次数*/
+    BLIVE_METRIC_PMU_BRANCH_MISSES,                 /*分支预测失败次数*/
+    BLIVE_METRIC_PMU_MAX,
+} blive_metric_pmu_event;
+
+/**
+ * @brief 一个处理阶段累计的硬件计数，IPC与每KB未命中次数由blive_metric_pmu_ipc、blive_metric_pmu_per_kb计算
+ * 
+ */
+typedef struct {
+    uint64_t    samples;                            /*计数次数*/
+    uint64_t    bytes;                              /*处理的字节数：解压为压缩数据，切分为解压后的正文，回调为消息原文*/
+    uint64_t    events[BLIVE_METRIC_PMU_MAX];       /*各硬件计数器的累计值*/
+} blive_metric_pmu;
+
+/**
+ * @brief 指标快照，全局或单个直播间
+ * 
+ */
+typedef struct {
+    uint64_t            counters[BLIVE_METRIC_COUNTER_MAX];
+    blive_metric_hist   stages[BLIVE_METRIC_STAGE_MAX];
+    blive_metric_pmu    pmu[BLIVE_METRIC_STAGE_MAX];    /*开启性能剖析后各阶段的硬件计数，接收阶段不统计*/
+} blive_metrics;
+
+/**
+ * @brief 链路追踪中相邻两个时间点之间的区间。服务端时间来自消息内容，弹幕精确到毫秒，送礼与进场只精确到秒
+ * 
+ */
+typedef enum {
+    BLIVE_TRACE_SPAN_SERVER,                        /*服务端时间到收到数据包，受两端时钟偏差影响*/
+    BLIVE_TRACE_SPAN_UNZIP,                         /*收到数据包到解压完成，含等待解码线程的时间*/
+    BLIVE_TRACE_SPAN_PARSE,                         /*解压完成到切分、过滤完成*/
+    BLIVE_TRACE_SPAN_QUEUE,                         /*切分完成到回调开始，含执行器排队与同一数据包内之前的回调*/
+    BLIVE_TRACE_SPAN_HANDLER,                       /*回调开始到回调结束*/
+    BLIVE_TRACE_SPAN_TOTAL,                         /*服务端时间（消息中没有时为接收时间）到回调结束*/
+    BLIVE_TRACE_SPAN_MAX,
+} blive_trace_span;
+
+#define BLIVE_TRACE_RAW_MAX         128     /*慢事件记录中保留的消息原文长度*/
+
+/**
+ * @brief 链路追踪的设置
+ * 
+ */
+typedef struct {
+    uint64_t    slow_ns;                            /*BLIVE_TRACE_SPAN_TOTAL超过该值的事件为慢事件*/
+    uint32_t    sample_every;                       /*每sample_every个慢事件记录1个，0为不记录*/
+    uint32_t    ring_size;                          /*慢事件记录的容量，写满后覆盖最早的记录*/
+} blive_trace_config;
+
+/**
+ * @brief 数据包抓取统计
+ * 
+ */
+typedef struct {
+    uint64_t    frames;                             /*写入的数据包数*/
+    uint64_t    bytes;                              /*写入的记录字节数*/
+    uint64_t    segments;                           /*创建的分段文件数*/
+    uint64_t    dropped;                            /*大于分段文件或文件操作失败而未写入的数据包数*/
+    uint32_t    writers;                            /*当前持有分段文件的写入线程数*/
+} blive_capture_stats;
+
+/**
+ * @brief 抓取回放的数据概况
+ * 
+ */
+typedef struct {
+    uint64_t    frames;                             /*可回放的数据包数*/
+    uint64_t    bytes;                              /*可回放的数据包字节数，含头部*/
+    uint64_t    span_ns;                            /*最早与最晚数据包的接收时间间隔*/
+    uint64_t    first_ms;                           /*最早数据包的系统时间（毫秒），精确到索引的时间段*/
+    uint64_t    last_ms;                            /*最晚数据包的系统时间（毫秒），精确到索引的时间段*/
+    uint64_t    corrupt;                            /*因记录损坏而提前结束读取的分段文件数*/
+    uint32_t    segments;                           /*打开的分段文件数*/
+    uint32_t    indexed;                            /*通过索引文件读取、没有扫描记录的分段文件数*/
+    uint32_t    rooms;                              /*直播间数*/
+} blive_replay_stats;
+
+/**
+ * @brief 归档压缩的结果统计
+ * 
+ */
+typedef struct {
+    uint64_t    frames;                             /*读取的原始数据包数*/
+    uint64_t    frame_bytes;                        /*原始数据包字节数，含头部，即直接保存协议3数据包所需的空间*/
+    uint64_t    msgs;                               /*写入的消息数*/
+    uint64_t    msg_bytes;                          /*消息解压后的正文字节数*/
+    uint64_t    archive_bytes;                      /*归档文件字节数，不含共享字典*/
+    uint64_t    skipped;                            /*协议不支持或数据损坏而跳过的数据包数*/
+    uint32_t    blocks;                             /*压缩块数*/
+    uint32_t    dict_size;                          /*使用的共享字典大小，0为未使用*/
+} blive_archive_stats;
+
+/**
+ * @brief 从归档中读出的一条消息
+ * 
+ */
+typedef struct {
+    uint64_t        room_id;                        /*直播间id*/
+    uint64_t        wall_ns;                        /*所在数据包的接收时间，1970年以来的纳秒数*/
+    uint32_t        operate;                        /*所在数据包的操作码，命令消息为5，人气值为3*/
+    uint32_t        len;                            /*消息正文长度*/
+    const char*     data;                           /*消息正文，不以'\0'结尾，仅在回调执行期间有效*/
+} blive_archive_msg;
+
+/**
+ * @brief 列式事件文件的列，弹幕、进场与送礼类消息共用同一组列，消息中没有的字段为0或空字符串
+ * 
+ */
+typedef enum {
+    BLIVE_COLUMN_TYPE,                              /*消息类型，blive_info_type*/
+    BLIVE_COLUMN_ROOM_ID,                           /*直播间id*/
+    BLIVE_COLUMN_WALL_NS,                           /*接收时的系统时间，1970年以来的纳秒数*/
+    BLIVE_COLUMN_TIMESTAMP,                         /*服务端时间，统一为毫秒*/
+    BLIVE_COLUMN_UID,                               /*用户id*/
+    BLIVE_COLUMN_UNAME,                             /*用户名，字符串*/
+    BLIVE_COLUMN_MEDAL_NAME,                        /*粉丝勋章名，字符串*/
+    BLIVE_COLUMN_MEDAL_LEVEL,                       /*粉丝勋章等级*/
+    BLIVE_COLUMN_USER_LEVEL,                        /*用户等级*/
+    BLIVE_COLUMN_GUARD_LEVEL,                       /*大航海等级*/
+    BLIVE_COLUMN_TEXT,                              /*弹幕内容，字符串*/
+    BLIVE_COLUMN_GIFT_ID,                           /*礼物id*/
+    BLIVE_COLUMN_GIFT_NAME,                         /*礼物名，字符串*/
+    BLIVE_COLUMN_GIFT_NUM,                          /*礼物数量*/
+    BLIVE_COLUMN_PRICE,                             /*礼物单价*/
+    BLIVE_COLUMN_MSG_TYPE,                          /*进场或关注的类型*/
+    BLIVE_COLUMN_MAX,
+} blive_column_id;
+
+typedef enum {
+    BLIVE_COLUMN_EQ,
+    BLIVE_COLUMN_NE,
+    BLIVE_COLUMN_LT,
+    BLIVE_COLUMN_LE,
+    BLIVE_COLUMN_GT,
+    BLIVE_COLUMN_GE,
+} blive_column_op;
+
+/**
+ * @brief 读取列式文件时的过滤条件，多个条件之间为“且”
+ * 
+ */
+typedef struct {
+    blive_column_id     column;                     /*比较的列*/
+    blive_column_op     op;                         /*比较方式，字符串列只支持EQ与NE*/
+    uint64_t            value;                      /*数值列的比较值*/
+    const char*         str;                        /*字符串列的比较值，以'\0'结尾，数值列为NULL*/
+} blive_column_pred;
+
+/**
+ * @brief 字符串列的一个值，内容与消息原文中引号内的内容相同，转义字符未还原；字段不存在时str为NULL
+ * 
+ */
+typedef struct {
+    const char*     str;
+    uint32_t        len;
+} blive_column_str;
+
+/**
+ * @brief 读取列式文件时一次交付的一批满足条件的行，只有投影的列有值
+ * 
+ */
+typedef struct {
+    uint32_t                    rows;                           /*行数*/
+    const uint64_t*             values[BLIVE_COLUMN_MAX];       /*数值列，未投影或为字符串列时为NULL*/
+    const blive_column_str*     strs[BLIVE_COLUMN_MAX];         /*字符串列，未投影或为数值列时为NULL*/
+} blive_column_batch;
+
+/**
+ * @brief 列式文件的概况与累计的读取统计
+ * 
+ */
+typedef struct {
+    uint64_t    rows;                               /*总行数*/
+    uint64_t    file_bytes;                         /*文件字节数*/
+    uint64_t    column_bytes[BLIVE_COLUMN_MAX];     /*各列的列块字节数*/
+    uint32_t    groups;                             /*行组数*/
+    uint64_t    scanned_groups;                     /*读取时解码过的行组数*/
+    uint64_t    skipped_groups;                     /*读取时按最小最大值或字典跳过的行组数*/
+    uint64_t    touched_bytes;                      /*读取时访问的列块字节数*/
+} blive_column_stats;
+
+/**
+ * @brief 一个慢事件的各个时间点，除server_ms外均为blive_clock_now_ns的时间基准，未经过的阶段为0
+ * 
+ */
+typedef struct {
+    blive_info_type     type;                       /*消息类型*/
+    uint32_t            room_id;                    /*直播间id*/
+    uint64_t            server_ms;                  /*消息中的服务端时间（1970年以来的毫秒数），没有时为0*/
+    uint64_t            server_ns;                  /*服务端时间换算到单调时间，没有时为0*/
+    uint64_t            recv_ns;                    /*收到数据包*/
+    uint64_t            unzip_ns;                   /*解压完成*/
+    uint64_t            parse_ns;                   /*切分、过滤完成*/
+    uint64_t            handler_start_ns;           /*回调开始*/
+    uint64_t            handler_end_ns;             /*回调结束*/
+    char                raw[BLIVE_TRACE_RAW_MAX];   /*消息原文的开头，以'\0'结尾*/
+} blive_trace;
+
+/**
+ * @brief 直播间的链路追踪统计
+ * 
+ */
+typedef struct {
+    uint64_t            traced;                     /*追踪的事件数*/
+    uint64_t            slow;                       /*慢事件数*/
+    uint64_t            sampled;                    /*记录下来的慢事件数*/
+    blive_metric_hist   spans[BLIVE_TRACE_SPAN_MAX];    /*各区间的耗时*/
+    blive_metric_hist   cmds[BLIVE_INFO_MAX];       /*各消息类型的BLIVE_TRACE_SPAN_TOTAL*/
+} blive_trace_stats;
+
 typedef struct blive blive;
+typedef struct blive_executor blive_executor;
+typedef struct blive_decoder blive_decoder;
+typedef struct blive_capture blive_capture;
+typedef struct blive_replay blive_replay;
+typedef struct blive_archive blive_archive;
+typedef struct blive_column_writer blive_column_writer;
+typedef struct blive_column_reader blive_column_reader;
+typedef struct blive_event blive_event;
+typedef struct blive_filter blive_filter;
+typedef struct blive_keywords blive_keywords;
 typedef struct cJSON cJSON;
 
 typedef void (*blive_msg_handler)(blive* entity, const cJSON* msg, void* usr_data);
 
+/**
+ * @brief 事件回调函数，通过blive_event_raw获取消息原文，转发原文时无需重新序列化
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] event 事件，仅在回调执行期间有效，需要继续使用时调用blive_event_retain
+ * @param [in] usr_data 设置事件回调时传入的调用者数据
+ * 
+ */
+typedef void (*blive_event_handler)(blive* entity, const blive_event* event, void* usr_data);
+
+/**
+ * @brief 批量回调函数，一个数据包解压后的所有已订阅消息在一次调用中交付，顺序与分发顺序一致
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] events 事件数组，事件仅在回调执行期间有效，需要继续使用时调用blive_event_retain
+ * @param [in] count 事件数
+ * @param [in] usr_data 设置批量回调时传入的调用者数据
+ * 
+ */
+typedef void (*blive_batch_handler)(blive* entity, blive_event* const* events, size_t count, void* usr_data);
+
+/**
+ * @brief 抓取回放中按范围取出原始数据包的回调函数
+ * 
+ * @param [in] room_id 直播间id
+ * @param [in] wall_ns 接收时的系统时间，1970年以来的纳秒数
+ * @param [in] frame 网络字节序的数据包头部与正文，指向只读映射，仅在回调执行期间有效
+ * @param [in] size 数据包长度
+ * @param [in] usr_data 调用者数据
+ * @return int 返回ERROR时停止取出
+ */
+typedef int (*blive_replay_handler)(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data);
+
+/**
+ * @brief 读取归档时对每条消息调用的函数
+ * 
+ * @param [in] msg 消息，仅在回调执行期间有效
+ * @param [in] usr_data 调用者数据
+ * @return int 返回ERROR时停止读取
+ */
+typedef int (*blive_archive_handler)(const blive_archive_msg* msg, void* usr_data);
+
+/**
+ * @brief 读取列式文件时对每批满足条件的行调用的函数
+ * 
+ * @param [in] batch 一批行，仅在回调执行期间有效
+ * @param [in] usr_data 调用者数据
+ * @return int 返回ERROR时停止读取
+ */
+typedef int (*blive_column_handler)(const blive_column_batch* batch, void* usr_data);
+
+#define BLIVE_INFO_BIT(info)        ((uint64_t)1 << (info))     /*批量回调订阅的消息类型掩码*/
+#define BLIVE_INFO_ALL              (BLIVE_INFO_BIT(BLIVE_INFO_MAX) - 1)
+
+#define BLIVE_KEYWORD_TAG_MAX       8       /*单个事件最多记录的命中关键词数*/
+
 /**
  * @brief blive模块所需的外部定时器模块触发时的回调函数
  * 
@@ -0,0 +1,801 @@
+/**
+ * @file archive.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 抓取归档：通过回放读取抓取的分段，把每个数据包解压、切分为消息，按直播间依次写入约1MB的块，
+ *          每个块用brotli的压缩部分重新压缩。弹幕消息大量重复相同的cmd、字段名与勋章结构，
+ *          单个数据包只有几百字节到几KB，协议3逐包压缩几乎用不上这些重复；合并成大块后同一直播间的消息
+ *          可以互相引用，再以从抓取数据中训练出的共享字典作为前缀字典，块开头与小直播间的块也能引用常见内容。
+ *          字典的训练选取样本中在最多消息里出现的片段：统计每个8字节子串出现在多少条消息中，
+ *          把样本平均分为与字典片段数相同的若干段，在每段中选出子串出现次数之和最大的片段放入字典，
+ *          再将选中片段内的子串计数清零，避免字典里重复相同的内容
+ * @version 0.1
+ * @date 2023-02-26
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "brotli/encode.h"
+#include "brotli/decode.h"
+#include "archive.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+#include "msg.h"
+
+
+#define ARCHIVE_TRAIN_DMER          8                   /*统计出现次数的子串长度*/
+#define ARCHIVE_TRAIN_SEGMENT       128                 /*每次放入字典的片段长度*/
+#define ARCHIVE_TRAIN_SAMPLE_MAX    (4 * 1024 * 1024)   /*训练样本的大小上限*/
+#define ARCHIVE_TRAIN_SAMPLE_RATIO  64                  /*样本大小取字典大小的倍数*/
+#define ARCHIVE_TRAIN_INFLATE       4                   /*估计样本数量时假设的解压倍数*/
+
+/**
+ * @brief 对数据包中的每条消息调用的函数
+ * 
+ * @return int 返回ERROR时停止
+ */
+typedef int (*archive_msg_visit)(void* ctx, uint32_t operate, const char* data, uint32_t len);
+
+/**
+ * @brief 归档压缩的写入状态
+ * 
+ */
+typedef struct {
+    FILE*                               file;
+    BrotliEncoderPreparedDictionary*    dict;
+    int                                 quality;
+    size_t                              unzip_hint;     /*上一个数据包解压后的大小*/
+    char*                               raw;            /*当前块压缩前的数据*/
+    size_t                              raw_size;
+    size_t                              raw_capacity;
+    uint8_t*                            packed;
+    size_t                              packed_capacity;
+    blive_archive_block                 block;
+    uint64_t                            wall_ns;        /*当前数据包的接收时间*/
+    blive_archive_header                header;
+    blive_archive_stats                 stats;
+    int                                 retval;
+} archive_writer;
+
+/**
+ * @brief 字典训练的样本，所有消息首尾相接，ends记录每条消息的结束位置
+ * 
+ */
+typedef struct {
+    size_t          unzip_hint;                         /*上一个数据包解压后的大小*/
+    char*           data;
+    size_t          size;
+    size_t          capacity;
+    uint32_t*       ends;
+    uint32_t        msg_num;
+    uint32_t        msg_capacity;
+    uint64_t        stride;                             /*每stride个数据包取一个作为样本*/
+    uint64_t        frames;
+} archive_sample;
+
+typedef struct {
+    uint64_t        key;
+    uint32_t        freq;                               /*出现该子串的消息数*/
+    uint32_t        last;                               /*最后一次计数的消息编号加1，0为空位*/
+} archive_train_slot;
+
+struct blive_archive {
+    char*                           base;               /*归档文件的只读映射*/
+    size_t                          size;
+    const blive_archive_header*     header;
+    char*                           dict;
+    size_t                          dict_size;
+    uint32_t                        raw_max;            /*最大块压缩前的长度*/
+};
+
+
+static int frame_unpack(size_t* unzip_hint, const char* frame, size_t size, archive_msg_visit visit, void* ctx);
+static int compact_frame_visit(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data);
+static int compact_msg_visit(void* ctx, uint32_t operate, const char* data, uint32_t len);
+static int block_flush(archive_writer* writer);
+static int sample_frame_visit(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data);
+static int sample_msg_visit(void* ctx, uint32_t operate, const char* data, uint32_t len);
+static size_t dict_select(const archive_sample* sample, char* dict, size_t dict_size);
+static archive_train_slot* train_slot_get(archive_train_slot* slots, uint64_t mask, uint64_t key, Bool create);
+static int replay_rooms_all(blive_replay* replay, uint64_t** rooms);
+static char* file_load(const char* path, size_t* size);
+static uint64_t dict_hash(const char* data, size_t size);
+
+
+int blive_archive_train(const char* dir, size_t dict_size, const char* dict_path)
+{
+    blive_replay*       replay = NULL;
+    blive_replay_stats  replay_stats = {0};
+    archive_sample      sample = {0};
+    uint64_t*           rooms = NULL;
+    int                 room_num = 0;
+    char*               dict = NULL;
+    size_t              selected = 0;
+    FILE*               file = NULL;
+    int                 retval = ERROR;
+
+    if (dir == NULL || dict_path == NULL) {
+        return ERROR;
+    }
+    if (dict_size == 0) {
+        dict_size = BLIVE_ARCHIVE_DICT_SIZE;
+    }
+    if (dict_size < ARCHIVE_TRAIN_SEGMENT || dict_size > BLIVE_ARCHIVE_DICT_MAX) {
+        return ERROR;
+    }
+    if (blive_replay_open(&replay, dir) != OK) {
+        return ERROR;
+    }
+
+    /*按解压后约为数据包的ARCHIVE_TRAIN_INFLATE倍估计消息总量，均匀地从所有直播间取样*/
+    blive_get_replay_stats(replay, &replay_stats);
+    sample.capacity = dict_size * ARCHIVE_TRAIN_SAMPLE_RATIO;
+    if (sample.capacity > ARCHIVE_TRAIN_SAMPLE_MAX) {
+        sample.capacity = ARCHIVE_TRAIN_SAMPLE_MAX;
+    }
+    sample.stride = replay_stats.bytes * ARCHIVE_TRAIN_INFLATE / sample.capacity + 1;
+    sample.data = malloc(sample.capacity);
+    dict = malloc(dict_size);
+    if (sample.data == NULL || dict == NULL || (room_num = replay_rooms_all(replay, &rooms)) == ERROR) {
+        goto out;
+    }
+    for (int i = 0; i < room_num && sample.size < sample.capacity; i++) {
+        blive_replay_scan(replay, rooms[i], sample_frame_visit, &sample);
+    }
+    if (sample.msg_num == 0) {
+        blive_loge("no message to train dictionary in %s", dir);
+        goto out;
+    }
+
+    /*片段从字典末尾向前放入，selected为实际填入的长度，样本不足时字典比dict_size小*/
+    selected = dict_select(&sample, dict, dict_size);
+    if ((file = fopen(dict_path, "wb")) == NULL) {
+        blive_loge("open archive dict %s failed: %s", dict_path, strerror(errno));
+        goto out;
+    }
+    if (fwrite(dict + dict_size - selected, 1, selected, file) != selected) {
+        blive_loge("write archive dict %s failed: %s", dict_path, strerror(errno));
+        fclose(file);
+        goto out;
+    }
+    if (fclose(file) != 0) {
+        goto out;
+    }
+    blive_logi("archive dict %s: %lu bytes from %u msgs, %lu sample bytes",
+               dict_path, selected, sample.msg_num, sample.size);
+    retval = selected;
+
+out:
+    free(rooms);
+    free(dict);
+    free(sample.data);
+    free(sample.ends);
+    blive_replay_close(replay);
+    return retval;
+}
+
+int blive_archive_compact(const char* dir, const char* archive_path, const char* dict_path, int quality,
+                          blive_archive_stats* stats)
+{
+    blive_replay*       replay = NULL;
+    archive_writer      writer = {0};
+    char                tmp[1040] = {0};
+    char*               dict = NULL;
+    size_t              dict_size = 0;
+    uint64_t*           rooms = NULL;
+    int                 room_num = 0;
+    long                archive_bytes = 0;
+
+    if (dir == NULL || archive_path == NULL) {
+        return ERROR;
+    }
+    if (quality <= 0 || quality > BROTLI_MAX_QUALITY) {
+        quality = BLIVE_ARCHIVE_QUALITY;
+    }
+    if (dict_path != NULL && (dict = file_load(dict_path, &dict_size)) == NULL) {
+        return ERROR;
+    }
+    if (blive_replay_open(&replay, dir) != OK) {
+        free(dict);
+        return ERROR;
+    }
+
+    writer.quality = quality;
+    writer.retval = OK;
+    writer.header.magic = BLIVE_ARCHIVE_MAGIC;
+    writer.header.version = BLIVE_ARCHIVE_VERSION;
+    writer.header.header_size = sizeof(blive_archive_header);
+    writer.header.quality = quality;
+    writer.header.block_size = BLIVE_ARCHIVE_BLOCK_SIZE;
+    if (dict != NULL) {
+        /*预处理只做一次，之后每个块的压缩器都附加同一个字典*/
+        writer.dict = BrotliEncoderPrepareDictionary(BROTLI_SHARED_DICTIONARY_RAW, dict_size, (const uint8_t*)dict,
+                                                     quality, NULL, NULL, NULL);
+        if (writer.dict == NULL) {
+            blive_loge("prepare archive dict %s failed", dict_path);
+            writer.retval = ERROR;
+            goto out;
+        }
+        writer.header.dict_id = dict_hash(dict, dict_size);
+        writer.header.dict_size = dict_size;
+        writer.stats.dict_size = dict_size;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", archive_path);
+    if ((writer.file = fopen(tmp, "wb")) == NULL) {
+        blive_loge("open archive %s failed: %s", tmp, strerror(errno));
+        writer.retval = ERROR;
+        goto out;
+    }
+    if ((room_num = replay_rooms_all(replay, &rooms)) == ERROR
+        || fwrite(&writer.header, sizeof(writer.header), 1, writer.file) != 1) {
+        writer.retval = ERROR;
+        goto out;
+    }
+
+    /*每个直播间单独成块，块内的消息按接收时间排列*/
+    for (int i = 0; i < room_num && writer.retval == OK; i++) {
+        writer.block.room_id = rooms[i];
+        blive_replay_scan(replay, rooms[i], compact_frame_visit, &writer);
+        if (writer.retval == OK) {
+            writer.retval = block_flush(&writer);
+        }
+    }
+    if (writer.retval != OK) {
+        goto out;
+    }
+
+    /*写完所有块后回填头部的块数与消息数*/
+    writer.header.block_num = writer.stats.blocks;
+    writer.header.msg_num = writer.stats.msgs;
+    if ((archive_bytes = ftell(writer.file)) < 0 || fseek(writer.file, 0, SEEK_SET) != 0
+        || fwrite(&writer.header, sizeof(writer.header), 1, writer.file) != 1) {
+        blive_loge("write archive %s failed: %s", tmp, strerror(errno));
+        writer.retval = ERROR;
+        goto out;
+    }
+    writer.stats.archive_bytes = archive_bytes;
+    if (fclose(writer.file) != 0 || rename(tmp, archive_path) != 0) {
+        blive_loge("save archive %s failed: %s", archive_path, strerror(errno));
+        writer.file = NULL;
+        writer.retval = ERROR;
+        goto out;
+    }
+    writer.file = NULL;
+    if (stats != NULL) {
+        *stats = writer.stats;
+    }
+
+out:
+    if (writer.file != NULL) {
+        fclose(writer.file);
+        unlink(tmp);
+    }
+    if (writer.dict != NULL) {
+        BrotliEncoderDestroyPreparedDictionary(writer.dict);
+    }
+    free(rooms);
+    free(writer.raw);
+    free(writer.packed);
+    free(dict);
+    blive_replay_close(replay);
+    return writer.retval;
+}
+
+int blive_archive_open(blive_archive** archive, const char* path, const char* dict_path)
+{
+    int                         fd = -1;
+    struct stat                 st = {0};
+    const blive_archive_block*  block = NULL;
+    size_t                      offset = 0;
+
+    if (archive == NULL || path == NULL) {
+        return ERROR;
+    }
+
+    *archive = malloc(sizeof(blive_archive));
+    if (*archive == NULL) {
+        return ERROR;
+    }
+    memset(*archive, 0, sizeof(blive_archive));
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(blive_archive_header)) {
+        blive_loge("open archive %s failed: %s", path, strerror(errno));
+        goto fail;
+    }
+    (*archive)->size = st.st_size;
+    (*archive)->base = mmap(NULL, (*archive)->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    fd = -1;
+    if ((*archive)->base == MAP_FAILED) {
+        (*archive)->base = NULL;
+        blive_loge("map archive %s failed: %s", path, strerror(errno));
+        goto fail;
+    }
+    (*archive)->header = (const blive_archive_header*)(*archive)->base;
+    if ((*archive)->header->magic != BLIVE_ARCHIVE_MAGIC || (*archive)->header->version != BLIVE_ARCHIVE_VERSION
+        || (*archive)->header->header_size < sizeof(blive_archive_header)) {
+        blive_loge("invalid archive %s", path);
+        goto fail;
+    }
+
+    /*字典内容必须与压缩时使用的完全一致*/
+    if ((*archive)->header->dict_id != 0) {
+        if (dict_path == NULL || ((*archive)->dict = file_load(dict_path, &(*archive)->dict_size)) == NULL
+            || dict_hash((*archive)->dict, (*archive)->dict_size) != (*archive)->header->dict_id) {
+            blive_loge("archive %s needs its dictionary, %s mismatch", path, dict_path ? dict_path : "none");
+            goto fail;
+        }
+    }
+
+    /*只读取块头部，检查块是否完整并得到解压缓冲区的大小*/
+    offset = (*archive)->header->header_size;
+    for (uint32_t i = 0; i < (*archive)->header->block_num; i++) {
+        block = (const blive_archive_block*)((*archive)->base + offset);
+        if (offset + sizeof(blive_archive_block) > (*archive)->size
+            || block->packed_size > (*archive)->size - offset - sizeof(blive_archive_block)) {
+            blive_loge("truncated archive %s at block %u", path, i);
+            goto fail;
+        }
+        if (block->raw_size > (*archive)->raw_max) {
+            (*archive)->raw_max = block->raw_size;
+        }
+        offset += sizeof(blive_archive_block) + block->packed_size;
+    }
+    return OK;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    blive_archive_close(*archive);
+    *archive = NULL;
+    return ERROR;
+}
+
+int blive_archive_close(blive_archive* archive)
+{
+    if (archive == NULL) {
+        return ERROR;
+    }
+
+    if (archive->base != NULL) {
+        munmap(archive->base, archive->size);
+    }
+    free(archive->dict);
+    free(archive);
+    return OK;
+}
+
+int blive_archive_read(blive_archive* archive, uint64_t room_id, blive_archive_handler handler, void* usr_data)
+{
+    const blive_archive_block*  block = NULL;
+    blive_archive_entry         entry = {0};
+    blive_archive_msg           msg = {0};
+    char*                       raw = NULL;
+    size_t                      offset = 0;
+    size_t                      decoded = 0;
+    size_t                      pos = 0;
+    int                         count = 0;
+    BrotliDecoderState*         state = NULL;
+    BrotliDecoderResult         res = BROTLI_DECODER_RESULT_ERROR;
+    const uint8_t*              next_in = NULL;
+    size_t                      avail_in = 0;
+    uint8_t*                    next_out = NULL;
+    size_t                      avail_out = 0;
+
+    if (archive == NULL || handler == NULL) {
+        return ERROR;
+    }
+    if ((raw = malloc(archive->raw_max + 1)) == NULL) {
+        return ERROR;
+    }
+
+    offset = archive->header->header_size;
+    for (uint32_t i = 0; i < archive->header->block_num; i++, offset += sizeof(blive_archive_block) + block->packed_size) {
+        block = (const blive_archive_block*)(archive->base + offset);
+        if (room_id != 0 && block->room_id != room_id) {
+            continue;
+        }
+
+        /*字典需要在开始解压前附加，解压器不能复用，每个块创建一个*/
+        if ((state = BrotliDecoderCreateInstance(NULL, NULL, NULL)) == NULL) {
+            count = ERROR;
+            break;
+        }
+        if (archive->dict != NULL
+            && !BrotliDecoderAttachDictionary(state, BROTLI_SHARED_DICTIONARY_RAW, archive->dict_size,
+                                              (const uint8_t*)archive->dict)) {
+            BrotliDecoderDestroyInstance(state);
+            count = ERROR;
+            break;
+        }
+        next_in = (const uint8_t*)(block + 1);
+        avail_in = block->packed_size;
+        next_out = (uint8_t*)raw;
+        avail_out = archive->raw_max + 1;
+        res = BrotliDecoderDecompressStream(state, &avail_in, &next_in, &avail_out, &next_out, NULL);
+        BrotliDecoderDestroyInstance(state);
+        decoded = (char*)next_out - raw;
+        if (res != BROTLI_DECODER_RESULT_SUCCESS || decoded != block->raw_size) {
+            blive_loge("archive block %u decode failed: %d, %lu/%u", i, res, decoded, block->raw_size);
+            count = ERROR;
+            break;
+        }
+
+        msg.room_id = block->room_id;
+        for (pos = 0; pos + sizeof(blive_archive_entry) <= decoded; pos += entry.len) {
+            memcpy(&entry, raw + pos, sizeof(blive_archive_entry));
+            pos += sizeof(blive_archive_entry);
+            if (entry.len > decoded - pos) {
+                break;
+            }
+            msg.wall_ns = entry.wall_ns;
+            msg.operate = entry.operate;
+            msg.len = entry.len;
+            msg.data = raw + pos;
+            count++;
+            if (handler(&msg, usr_data) == ERROR) {
+                free(raw);
+                return count;
+            }
+        }
+    }
+
+    free(raw);
+    return count;
+}
+
+static int frame_unpack(size_t* unzip_hint, const char* frame, size_t size, archive_msg_visit visit, void* ctx)
+{
+    const blive_msg_header*     wire = (const blive_msg_header*)frame;
+    uint32_t                    packet_size = 0;
+    uint16_t                    header_size = 0;
+    uint16_t                    proto = 0;
+    uint32_t                    operate = 0;
+    blive_buffer*               buffer = NULL;
+    blive_msg_header            inner = {0};
+    const char*                 data = NULL;
+    int                         decoded = 0;
+    int                         offset = 0;
+    int                         count = 0;
+
+    if (size < sizeof(blive_msg_header)) {
+        return ERROR;
+    }
+    packet_size = ntohl(wire->packet_size);
+    header_size = ntohs(wire->header_size);
+    proto = ntohs(wire->msg_proto);
+    operate = ntohl(wire->msg_operate);
+    if (packet_size != size || header_size < sizeof(blive_msg_header) || header_size > packet_size) {
+        return ERROR;
+    }
+    if (proto == BLIVE_MSG_PROTO_CMDNOCMPRES || proto == BLIVE_MSG_PROTO_HBAUNOCMPRES) {
+        return visit(ctx, operate, frame + header_size, packet_size - header_size) == ERROR ? ERROR : 1;
+    }
+    if (proto != BLIVE_MSG_PROTO_CMDCOMPRESBROTLI) {
+        return ERROR;
+    }
+
+    /*与接收时相同的解压与切分，解压后大小同样受BLIVE_MSG_MAX_SIZE限制*/
+    if ((decoded = blive_msg_unzip(&buffer, frame + header_size, packet_size - header_size, *unzip_hint)) == ERROR) {
+        return ERROR;
+    }
+    *unzip_hint = decoded;
+
+    /*解压后是若干个带头部的协议0数据包，每个包是一条消息*/
+    while (offset < decoded) {
+        if ((data = blive_msg_inner_next(buffer->data, decoded, &offset, &inner)) == NULL) {
+            count = count ? count : ERROR;
+            break;
+        }
+        if (visit(ctx, inner.msg_operate, data, inner.packet_size - inner.header_size) == ERROR) {
+            count = ERROR;
+            break;
+        }
+        count++;
+    }
+    blive_buffer_release(buffer);
+    return count;
+}
+
+static int compact_frame_visit(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data)
+{
+    archive_writer*     writer = (archive_writer*)usr_data;
+
+    writer->stats.frames++;
+    writer->stats.frame_bytes += size;
+    writer->wall_ns = wall_ns;
+    if (frame_unpack(&writer->unzip_hint, frame, size, compact_msg_visit, writer) == ERROR) {
+        if (writer->retval != OK) {
+            return ERROR;
+        }
+        writer->stats.skipped++;
+    }
+    return OK;
+}
+
+static int compact_msg_visit(void* ctx, uint32_t operate, const char* data, uint32_t len)
+{
+    archive_writer*         writer = (archive_writer*)ctx;
+    blive_archive_entry     entry = {len, operate, writer->wall_ns};
+    size_t                  need = sizeof(blive_archive_entry) + len;
+    char*                   bigger = NULL;
+
+    if (writer->raw_size + need > BLIVE_ARCHIVE_BLOCK_SIZE && writer->block.msg_num > 0) {
+        if ((writer->retval = block_flush(writer)) != OK) {
+            return ERROR;
+        }
+    }
+    if (writer->raw_size + need > writer->raw_capacity) {
+        /*单条消息大于块大小时该块只含这一条*/
+        if ((bigger = realloc(writer->raw, need > BLIVE_ARCHIVE_BLOCK_SIZE ? need : BLIVE_ARCHIVE_BLOCK_SIZE)) == NULL) {
+            writer->retval = ERROR;
+            return ERROR;
+        }
+        writer->raw = bigger;
+        writer->raw_capacity = need > BLIVE_ARCHIVE_BLOCK_SIZE ? need : BLIVE_ARCHIVE_BLOCK_SIZE;
+    }
+
+    memcpy(writer->raw + writer->raw_size, &entry, sizeof(entry));
+    memcpy(writer->raw + writer->raw_size + sizeof(entry), data, len);
+    writer->raw_size += need;
+    if (writer->block.msg_num++ == 0) {
+        writer->block.first_wall_ns = writer->wall_ns;
+    }
+    writer->block.last_wall_ns = writer->wall_ns;
+    writer->stats.msgs++;
+    writer->stats.msg_bytes += len;
+    return OK;
+}
+
+static int block_flush(archive_writer* writer)
+{
+    BrotliEncoderState*     state = NULL;
+    const uint8_t*          next_in = (const uint8_t*)writer->raw;
+    size_t                  avail_in = writer->raw_size;
+    uint8_t*                next_out = NULL;
+    size_t                  avail_out = 0;
+    size_t                  need = BrotliEncoderMaxCompressedSize(writer->raw_size);
+    uint8_t*                bigger = NULL;
+    int                     retval = ERROR;
+
+    if (writer->block.msg_num == 0) {
+        return OK;
+    }
+    if (need == 0) {
+        need = writer->raw_size + 1024;
+    }
+    if (need > writer->packed_capacity) {
+        if ((bigger = realloc(writer->packed, need)) == NULL) {
+            return ERROR;
+        }
+        writer->packed = bigger;
+        writer->packed_capacity = need;
+    }
+
+    if ((state = BrotliEncoderCreateInstance(NULL, NULL, NULL)) == NULL) {
+        return ERROR;
+    }
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, writer->quality);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, BLIVE_ARCHIVE_LGWIN);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_SIZE_HINT, writer->raw_size);
+    if (writer->dict != NULL && !BrotliEncoderAttachPreparedDictionary(state, writer->dict)) {
+        goto out;
+    }
+    next_out = writer->packed;
+    avail_out = writer->packed_capacity;
+    if (!BrotliEncoderCompressStream(state, BROTLI_OPERATION_FINISH, &avail_in, &next_in, &avail_out, &next_out, NULL)
+        || !BrotliEncoderIsFinished(state)) {
+        blive_loge("archive block compress failed: %lu bytes", writer->raw_size);
+        goto out;
+    }
+
+    writer->block.raw_size = writer->raw_size;
+    writer->block.packed_size = next_out - writer->packed;
+    if (fwrite(&writer->block, sizeof(blive_archive_block), 1, writer->file) != 1
+        || fwrite(writer->packed, 1, writer->block.packed_size, writer->file) != writer->block.packed_size) {
+        blive_loge("write archive block failed: %s", strerror(errno));
+        goto out;
+    }
+    writer->stats.blocks++;
+    writer->raw_size = 0;
+    writer->block.msg_num = 0;
+    retval = OK;
+
+out:
+    BrotliEncoderDestroyInstance(state);
+    return retval;
+}
+
+static int sample_frame_visit(uint64_t room_id, uint64_t wall_ns, const char* frame, size_t size, void* usr_data)
+{
+    archive_sample*     sample = (archive_sample*)usr_data;
+
+    if (sample->frames++ % sample->stride != 0) {
+        return OK;
+    }
+    frame_unpack(&sample->unzip_hint, frame, size, sample_msg_visit, sample);
+    return sample->size < sample->capacity ? OK : ERROR;
+}
+
+static int sample_msg_visit(void* ctx, uint32_t operate, const char* data, uint32_t len)
+{
+    archive_sample*     sample = (archive_sample*)ctx;
+    uint32_t*           bigger = NULL;
+
+    /*人气值等非命令消息只有几个字节，不参与训练*/
+    if (operate != BLIVE_MSG_TYPE_COMMAND || len < ARCHIVE_TRAIN_DMER) {
+        return OK;
+    }
+    if (sample->size + len > sample->capacity) {
+        sample->size = sample->capacity;
+        return ERROR;
+    }
+    if (sample->msg_num >= sample->msg_capacity) {
+        sample->msg_capacity = sample->msg_capacity ? sample->msg_capacity * 2 : 1024;
+        if ((bigger = realloc(sample->ends, sizeof(uint32_t) * sample->msg_capacity)) == NULL) {
+            return ERROR;
+        }
+        sample->ends = bigger;
+    }
+
+    memcpy(sample->data + sample->size, data, len);
+    sample->size += len;
+    sample->ends[sample->msg_num++] = sample->size;
+    return OK;
+}
+
+static size_t dict_select(const archive_sample* sample, char* dict, size_t dict_size)
+{
+    archive_train_slot*     slots = NULL;
+    archive_train_slot*     slot = NULL;
+    uint64_t                mask = 0;
+    uint64_t                key = 0;
+    size_t                  begin = 0;
+    size_t                  epoch_num = dict_size / ARCHIVE_TRAIN_SEGMENT;
+    size_t                  epoch_len = 0;
+    size_t                  epoch_end = 0;
+    size_t                  best = 0;
+    uint64_t                best_score = 0;
+    uint64_t                score = 0;
+    size_t                  selected = 0;
+    const size_t            window = ARCHIVE_TRAIN_SEGMENT - ARCHIVE_TRAIN_DMER + 1;
+
+    /*样本不比字典大时整个样本就是字典*/
+    if (sample->size <= dict_size) {
+        memcpy(dict + dict_size - sample->size, sample->data, sample->size);
+        return sample->size;
+    }
+
+    for (mask = 1024; mask < sample->size * 2; mask <<= 1);
+    if ((slots = calloc(mask, sizeof(archive_train_slot))) == NULL) {
+        memcpy(dict, sample->data + sample->size - dict_size, dict_size);
+        return dict_size;
+    }
+    mask -= 1;
+
+    /*统计每个子串出现在多少条消息中，同一条消息内的重复只计一次*/
+    for (uint32_t m = 0; m < sample->msg_num; m++) {
+        for (size_t i = begin; i + ARCHIVE_TRAIN_DMER <= sample->ends[m]; i++) {
+            memcpy(&key, sample->data + i, sizeof(key));
+            slot = train_slot_get(slots, mask, key, True);
+            if (slot->last != m + 1) {
+                slot->last = m + 1;
+                slot->freq++;
+            }
+        }
+        begin = sample->ends[m];
+    }
+
+    /*每段内用滑动窗口找出子串计数之和最大的片段，选中后清零其中子串的计数*/
+    epoch_len = sample->size / epoch_num;
+    for (size_t e = 0; e < epoch_num && selected + ARCHIVE_TRAIN_SEGMENT <= dict_size; e++) {
+        begin = e * epoch_len;
+        epoch_end = (e + 1 == epoch_num) ? sample->size : begin + epoch_len;
+        if (epoch_end - begin < ARCHIVE_TRAIN_SEGMENT) {
+            epoch_end = begin + ARCHIVE_TRAIN_SEGMENT > sample->size ? sample->size : begin + ARCHIVE_TRAIN_SEGMENT;
+            if (epoch_end - begin < ARCHIVE_TRAIN_SEGMENT) {
+                break;
+            }
+        }
+        score = 0;
+        best_score = 0;
+        for (size_t i = begin; i + ARCHIVE_TRAIN_DMER <= epoch_end; i++) {
+            memcpy(&key, sample->data + i, sizeof(key));
+            score += (slot = train_slot_get(slots, mask, key, False)) ? slot->freq : 0;
+            if (i >= begin + window) {
+                memcpy(&key, sample->data + i - window, sizeof(key));
+                score -= (slot = train_slot_get(slots, mask, key, False)) ? slot->freq : 0;
+            }
+            if (i + 1 >= begin + window && score > best_score) {
+                best_score = score;
+                best = i + 1 - window;
+            }
+        }
+        if (best_score == 0) {
+            continue;
+        }
+
+        for (size_t i = best; i < best + window; i++) {
+            memcpy(&key, sample->data + i, sizeof(key));
+            if ((slot = train_slot_get(slots, mask, key, False)) != NULL) {
+                slot->freq = 0;
+            }
+        }
+        selected += ARCHIVE_TRAIN_SEGMENT;
+        memcpy(dict + dict_size - selected, sample->data + best, ARCHIVE_TRAIN_SEGMENT);
+    }
+
+    free(slots);
+    return selected;
+}
+
+static archive_train_slot* train_slot_get(archive_train_slot* slots, uint64_t mask, uint64_t key, Bool create)
+{
+    uint64_t    pos = (key * 0x9e3779b97f4a7c15ULL) >> 20;
+
+    for (pos &= mask; slots[pos].last != 0; pos = (pos + 1) & mask) {
+        if (slots[pos].key == key) {
+            return &slots[pos];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    slots[pos].key = key;
+    return &slots[pos];
+}
+
+static int replay_rooms_all(blive_replay* replay, uint64_t** rooms)
+{
+    blive_replay_stats  stats = {0};
+
+    blive_get_replay_stats(replay, &stats);
+    if ((*rooms = malloc(sizeof(uint64_t) * (stats.rooms + 1))) == NULL) {
+        return ERROR;
+    }
+    return blive_replay_rooms(replay, *rooms, stats.rooms);
+}
+
+static char* file_load(const char* path, size_t* size)
+{
+    FILE*   file = NULL;
+    char*   data = NULL;
+    long    len = 0;
+
+    if ((file = fopen(path, "rb")) == NULL) {
+        blive_loge("open %s failed: %s", path, strerror(errno));
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) <= 0 || len > BLIVE_ARCHIVE_DICT_MAX
+        || fseek(file, 0, SEEK_SET) != 0 || (data = malloc(len)) == NULL
+        || fread(data, 1, len, file) != (size_t)len) {
+        blive_loge("read %s failed", path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = len;
+    return data;
+}
+
+static uint64_t dict_hash(const char* data, size_t size)
+{
+    uint64_t    hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+/**
+ * @file archive.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 归档文件格式。归档文件以blive_archive_header开头，之后依次是各个压缩块：blive_archive_block加压缩后的数据。
+ *          每个块只含一个直播间按接收时间排列的消息，压缩前为依次排列的blive_archive_entry加消息正文，不做对齐；
+ *          块使用brotli压缩，并以共享字典作为LZ77的前缀字典，字典单独保存，多个归档文件共用同一个字典。
+ *          所有字段为主机字节序
+ * @version 0.1
+ * @date 2023-02-26
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_ARCHIVE_H__
+#define __BLIVE_ARCHIVE_H__
+
+#include "blive_def.h"
+
+
+#define BLIVE_ARCHIVE_MAGIC         0x31435241564c4221ULL   /*"!BLVARC1"*/
+#define BLIVE_ARCHIVE_VERSION       1
+#define BLIVE_ARCHIVE_BLOCK_SIZE    (1024 * 1024)           /*单个块压缩前的大小上限*/
+#define BLIVE_ARCHIVE_DICT_SIZE     (64 * 1024)             /*默认的共享字典大小*/
+#define BLIVE_ARCHIVE_DICT_MAX      (16 * 1024 * 1024)
+#define BLIVE_ARCHIVE_QUALITY       9                       /*默认的brotli压缩等级*/
+#define BLIVE_ARCHIVE_LGWIN         24                      /*压缩窗口，需覆盖整个块*/
+
+/**
+ * @brief 归档文件头部，固定64字节
+ * 
+ */
+typedef struct {
+    uint64_t    magic;                  /*BLIVE_ARCHIVE_MAGIC*/
+    uint32_t    version;                /*BLIVE_ARCHIVE_VERSION*/
+    uint32_t    header_size;            /*本头部长度，第一个块从此处开始*/
+    uint64_t    dict_id;                /*共享字典内容的FNV-1a哈希，0为未使用字典*/
+    uint32_t    dict_size;              /*共享字典的大小*/
+    uint32_t    quality;                /*压缩等级*/
+    uint32_t    block_size;             /*单个块压缩前的大小上限*/
+    uint32_t    block_num;              /*块数*/
+    uint64_t    msg_num;                /*消息数*/
+    uint64_t    reserved[2];
+} blive_archive_header;
+
+/**
+ * @brief 压缩块的头部，之后紧跟packed_size字节的压缩数据
+ * 
+ */
+typedef struct {
+    uint32_t    packed_size;            /*压缩后的长度*/
+    uint32_t    raw_size;               /*压缩前的长度*/
+    uint32_t    msg_num;                /*块内的消息数*/
+    uint32_t    reserved;
+    uint64_t    room_id;                /*直播间id*/
+    uint64_t    first_wall_ns;          /*块内第一条消息的接收时间*/
+    uint64_t    last_wall_ns;           /*块内最后一条消息的接收时间*/
+} blive_archive_block;
+
+/**
+ * @brief 块内的一条消息，之后紧跟len字节的消息正文
+ * 
+ */
+typedef struct {
+    uint32_t    len;                    /*消息正文长度*/
+    uint32_t    operate;                /*所在数据包的操作码*/
+    uint64_t    wall_ns;                /*所在数据包的接收时间，1970年以来的纳秒数*/
+} blive_archive_entry;
+
+#endif  //__BLIVE_ARCHIVE_H__
\ No newline at end of file
@@ -164,12 +164,17 @@ int blive_api_init()
 #ifdef WIN32
     system("chcp 65001");   /*让日志模块的颜色输出显示正常*/
 #endif
+    if (blive_log_start() != OK) {
+        blive_loge("start log thread failed, log synchronously");
+    }
     return curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK ? OK : ERROR;
 }
 
 void blive_api_deinit()
 {
-    return curl_global_cleanup();
+    blive_buffer_pool_clear();
+    curl_global_cleanup();
+    blive_log_stop();
 }
 
 int blive_create(blive** entity, uint64_t usr_id, uint64_t room_id, uint16_t max_reconnect)
@@ -194,6 +199,10 @@ int blive_create(blive** entity, uint64_t usr_id, uint64_t room_id, uint16_t max
         (*entity)->max_reconnect = max_reconnect;
         (*entity)->auto_reconnect = True;
     }
+    blive_queue_policy_default((*entity)->queue_policy);
+    (*entity)->cmd_priority[BLIVE_INFO_POPULARITY_RED_POCKET_START] = BLIVE_PRIORITY_HIGH;
+    (*entity)->cmd_priority[BLIVE_INFO_POPULARITY_RED_POCKET_NEW] = BLIVE_PRIORITY_HIGH;
+    (*entity)->cmd_priority[BLIVE_INFO_PREPARING] = BLIVE_PRIORITY_HIGH;
     (*entity)->room_id = room_id;
     (*entity)->usr_id = usr_id;
     (*entity)->curl_handle = curl_easy_init();
@@ -215,6 +224,21 @@ int blive_destroy(blive* entity)
         return ERROR;
     }
 
+    /*等待解码线程处理完本直播间的数据包*/
+    if (entity->decode_ring != NULL) {
+        blive_set_decoder(entity, NULL);
+    }
+
+    /*丢弃尚未分发的合并结果*/
+    blive_coalesce_destroy(entity);
+
+    /*等待执行器内本直播间的回调执行完毕*/
+    if (entity->strand != NULL) {
+        blive_strand_destroy(entity->strand);
+        entity->strand = NULL;
+    }
+    blive_set_trace(entity, NULL);
+
     /*关闭curl实体*/
     if (entity->curl_handle != NULL) {
         curl_easy_cleanup(entity->curl_handle);
@@ -20,12 +20,28 @@
 #include "curl/curl.h"
 #include "cJSON/cJSON.h"
 #include "blive_api/blive_api.h"
+#include "executor.h"
+#include "decoder.h"
+#include "coalesce.h"
+#include "event.h"
+#include "buffer.h"
+#include "filter.h"
+#include "keyword.h"
+#include "log.h"
+#include "clock.h"
+#include "metrics.h"
+#include "pmu.h"
+#include "trace.h"
+#include "capture.h"
+#include "probe.h"
 
 
 #ifdef WIN32
 typedef SOCKET sock_t;
+#define sock_close(fd)  closesocket(fd)
 #else
 typedef int sock_t;
+#define sock_close(fd)  close(fd)
 #endif
 
 typedef struct {
@@ -49,12 +65,35 @@ struct blive {
     CURL*                   curl_handle;        /*http请求的处理实体，来自curl库*/
     blive_schedule_func     sched_func;         /*外部提供的定时器功能的注册函数指针*/
     void*                   sched_entity;       /*外部提供的定时器功能的实体*/
+    Bool                    heartbeat_armed;    /*已注册发送心跳包的定时器，重连时不再重复注册*/
 
     size_t                  msg_seq;            /*与服务端的消息序列号*/
     struct {
         blive_msg_handler   handler;            /*在接收到服务端特定类型时的回调函数*/
         void*               usr_data;           /*在接收到服务端特定类型时的回调函数中传递的调用者数据*/
+        blive_event_handler event_handler;      /*接收消息原文的事件回调，只订阅事件回调的类型不解析JSON*/
+        void*               event_usr_data;     /*事件回调中传递的调用者数据*/
     } msg_handler[BLIVE_INFO_MAX];              /*在接收到服务端特定类型时的回调函数列表*/
+    struct {
+        blive_batch_handler handler;            /*批量回调函数*/
+        void*               usr_data;           /*批量回调函数中传递的调用者数据*/
+        uint64_t            info_mask;          /*批量回调订阅的消息类型*/
+    } batch_handler;
+    blive_priority          cmd_priority[BLIVE_INFO_MAX];   /*各类型消息的分发优先级*/
+    blive_executor*         executor;           /*回调执行器，NULL时在blive_perform线程内直接执行回调*/
+    blive_strand*           strand;             /*本直播间在回调执行器上的串行队列*/
+    size_t                  queue_capacity;     /*本直播间排队事件数上限，0为不限制*/
+    blive_queue_policy      queue_policy[BLIVE_INFO_MAX];   /*各类型在队列已满时的处理策略*/
+    blive_decode_ring*      decode_ring;        /*交给解码线程的数据包队列，NULL时在blive_perform线程内解码*/
+    blive_coalescer*        coalescer;          /*高频消息合并状态，未开启合并时为NULL*/
+    blive_filter*           filter;             /*消息过滤器，NULL时不过滤*/
+    blive_keywords*         keywords;           /*弹幕关键词集合，NULL时不匹配*/
+    size_t                  unzip_size_hint;    /*上一个数据包解压后的大小，作为下一次解压缓冲区的初始大小*/
+    blive_metrics           metrics;            /*本直播间的指标*/
+    blive_tracer*           tracer;             /*链路追踪状态，未开启时为NULL*/
+    blive_capture*          capture;            /*数据包抓取器，NULL时不抓取*/
+    uint32_t                capture_epoch;      /*抓取器的更换次数，写入线程按其奇偶登记，原子操作*/
+    int                     capture_writers[2]; /*按更换次数奇偶分组的正在写入抓取器的线程数，原子操作*/
 
     sock_t                  pair_fd[2];         /*用于打断blive_perform的运行使用的文件描述符*/
     sock_t                  conn_fd;            /*与服务端的TCP连接socket文件描述符*/
@@ -0,0 +1,138 @@
+/**
+ * @file buffer.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 带引用计数的解压缓冲区与全局缓冲池，缓冲池按容量分级缓存释放后的缓冲区
+ * @version 0.1
+ * @date 2023-02-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "buffer.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define BUFFER_MIN_SIZE     2048    /*最小级别的容量*/
+#define BUFFER_CLASS_NUM    14      /*容量级别数，最大级别为16MB*/
+#define BUFFER_POOL_DEPTH   8       /*每个级别最多缓存的空闲缓冲区数*/
+
+static struct {
+    pthread_mutex_t     lock;
+    blive_buffer*       free_list[BUFFER_CLASS_NUM];
+    int                 free_num[BUFFER_CLASS_NUM];
+} buffer_pool = {PTHREAD_MUTEX_INITIALIZER};
+
+
+static int size_class_of(size_t size);
+
+
+blive_buffer* blive_buffer_alloc(size_t size)
+{
+    blive_buffer*   buffer = NULL;
+    int             size_class = size_class_of(size);
+    size_t          capacity = 0;
+
+    if (size_class >= BUFFER_CLASS_NUM) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&buffer_pool.lock);
+    if ((buffer = buffer_pool.free_list[size_class]) != NULL) {
+        buffer_pool.free_list[size_class] = buffer->next;
+        buffer_pool.free_num[size_class]--;
+    }
+    pthread_mutex_unlock(&buffer_pool.lock);
+
+    if (buffer == NULL) {
+        capacity = (size_t)BUFFER_MIN_SIZE << size_class;
+        buffer = malloc(sizeof(blive_buffer) + capacity);
+        if (buffer == NULL) {
+            return NULL;
+        }
+        buffer->size_class = size_class;
+        buffer->capacity = capacity;
+        buffer->data = (char*)(buffer + 1);
+    }
+    buffer->next = NULL;
+    buffer->refcount = 1;
+
+    return buffer;
+}
+
+blive_buffer* blive_buffer_grow(blive_buffer* buffer, size_t used, size_t size)
+{
+    blive_buffer*   bigger = NULL;
+
+    if (size <= buffer->capacity) {
+        return buffer;
+    }
+    if ((bigger = blive_buffer_alloc(size)) == NULL) {
+        return NULL;
+    }
+    memcpy(bigger->data, buffer->data, used);
+    blive_buffer_release(buffer);
+
+    return bigger;
+}
+
+void blive_buffer_retain(blive_buffer* buffer)
+{
+    __atomic_fetch_add(&buffer->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void blive_buffer_release(blive_buffer* buffer)
+{
+    if (buffer == NULL || __atomic_sub_fetch(&buffer->refcount, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    pthread_mutex_lock(&buffer_pool.lock);
+    if (buffer_pool.free_num[buffer->size_class] < BUFFER_POOL_DEPTH) {
+        buffer->next = buffer_pool.free_list[buffer->size_class];
+        buffer_pool.free_list[buffer->size_class] = buffer;
+        buffer_pool.free_num[buffer->size_class]++;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&buffer_pool.lock);
+
+    free(buffer);
+}
+
+void blive_buffer_pool_clear(void)
+{
+    blive_buffer*   buffer = NULL;
+
+    pthread_mutex_lock(&buffer_pool.lock);
+    for (int size_class = 0; size_class < BUFFER_CLASS_NUM; size_class++) {
+        while ((buffer = buffer_pool.free_list[size_class]) != NULL) {
+            buffer_pool.free_list[size_class] = buffer->next;
+            free(buffer);
+        }
+        buffer_pool.free_num[size_class] = 0;
+    }
+    pthread_mutex_unlock(&buffer_pool.lock);
+}
+
+
+/**
+ * @brief 计算容纳size字节所需的最小容量级别
+ * 
+ * @param [in] size 所需容量
+ * @return int 容量级别，超过最大级别时返回BUFFER_CLASS_NUM
+ */
+static int size_class_of(size_t size)
+{
+    int     size_class = 0;
+
+    while (size_class < BUFFER_CLASS_NUM && ((size_t)BUFFER_MIN_SIZE << size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+/**
+ * @file buffer.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 带引用计数的解压缓冲区，事件引用缓冲区中的消息原文，最后一个引用释放后缓冲区回到缓冲池
+ * @version 0.1
+ * @date 2023-02-14
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_BUFFER_H__
+#define __BLIVE_BUFFER_H__
+
+#include "blive_def.h"
+
+
+typedef struct blive_buffer {
+    struct blive_buffer*    next;           /*缓冲池空闲链表中的下一个缓冲区*/
+    uint32_t                refcount;       /*引用计数，原子操作*/
+    uint32_t                size_class;     /*容量级别，容量为BUFFER_MIN_SIZE << size_class*/
+    size_t                  capacity;       /*data的可用长度*/
+    char*                   data;           /*数据，与结构体在同一块内存中*/
+} blive_buffer;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 申请容量不小于size的缓冲区，优先从缓冲池中取出，引用计数为1
+ * 
+ * @param [in] size 所需容量
+ * @return blive_buffer* 申请失败返回NULL
+ */
+blive_buffer* blive_buffer_alloc(size_t size);
+
+/**
+ * @brief 将缓冲区扩容到不小于size，保留前used字节的内容。只能在缓冲区没有其他引用时调用
+ * 
+ * @param [in] buffer 原缓冲区，扩容成功后被释放
+ * @param [in] used 需要保留的字节数
+ * @param [in] size 所需容量
+ * @return blive_buffer* 扩容失败返回NULL，原缓冲区不变
+ */
+blive_buffer* blive_buffer_grow(blive_buffer* buffer, size_t used, size_t size);
+
+/**
+ * @brief 增加一个引用
+ * 
+ * @param [in] buffer 缓冲区
+ */
+void blive_buffer_retain(blive_buffer* buffer);
+
+/**
+ * @brief 释放一个引用，最后一个引用释放后缓冲区回到缓冲池，缓冲池已满时直接释放
+ * 
+ * @param [in] buffer 缓冲区
+ */
+void blive_buffer_release(blive_buffer* buffer);
+
+/**
+ * @brief 释放缓冲池中缓存的所有缓冲区
+ * 
+ */
+void blive_buffer_pool_clear(void);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
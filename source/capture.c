@@ -0,0 +1,871 @@
+/**
+ * @file capture.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 数据包抓取：每个写入线程独占一个内存映射的分段文件，接收线程追加记录时只有内存拷贝，
+ *          每写入BLIVE_CAPTURE_SYNC_BYTES字节异步msync一次。分段的创建、映射与封存由后台线程完成：
+ *          写入线程总是持有一个提前准备好的备用分段，写满时直接切换，不在接收路径上打开或截断文件。
+ *          不预先写入备用分段的页：直播间的数据量通常远小于分段大小，预先分配的页缓存大多用不上，
+ *          写入时每4KB一次缺页的开销分摊到每个数据包上很小。
+ *          写入线程同时在内存中维护该分段的稀疏索引，封存时由后台线程写入索引文件
+ * @version 0.1
+ * @date 2023-02-24
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "capture.h"
+#include "clock.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define CAPTURE_SEGMENT_DEFAULT     (16 * 1024 * 1024)
+#define CAPTURE_SEGMENT_MIN         (64 * 1024)
+#define BLIVE_CAPTURE_SYNC_BYTES    (1024 * 1024)       /*距上次msync累计写入该字节数后再次提交*/
+
+/**
+ * @brief 备用分段的状态，由写入线程与后台线程通过原子操作交接
+ * 
+ */
+typedef enum {
+    SEGMENT_PENDING,            /*等待后台线程创建*/
+    SEGMENT_READY,              /*已创建并映射*/
+    SEGMENT_FAILED,             /*创建失败*/
+    SEGMENT_ABANDONED,          /*写入线程已退出，后台线程创建完成后直接删除*/
+} segment_state;
+
+/**
+ * @brief 一个分段文件，同时作为后台线程的任务：准备（创建并映射）或封存
+ * 
+ */
+typedef struct capture_segment {
+    struct capture_segment* next;               /*后台任务链表*/
+    int                     state;              /*segment_state，原子操作*/
+    Bool                    seal;               /*True为封存任务，False为准备任务*/
+    uint32_t                writer_id;
+    uint32_t                segment_no;
+    int                     fd;
+    char*                   base;               /*映射地址*/
+    size_t                  used;
+    size_t                  synced;             /*已提交msync的位置*/
+    char*                   path;
+    blive_capture_indexer   index;              /*写入线程维护的索引，封存时写入索引文件*/
+} capture_segment;
+
+/**
+ * @brief 一个写入线程的状态，只由所属线程修改；统计字段由所属线程写、blive_get_capture_stats读，均为原子操作
+ * 
+ */
+typedef struct capture_writer {
+    struct capture_writer*  next;
+    blive_capture*          cap;
+    uint32_t                id;
+    uint32_t                segment_no;         /*下一个分段的编号*/
+    capture_segment*        current;            /*正在写入的分段，没有时为NULL*/
+    capture_segment*        spare;              /*后台线程准备中或已准备好的下一个分段*/
+    uint64_t                frames;
+    uint64_t                bytes;
+    uint64_t                segments;
+    uint64_t                dropped;
+} capture_writer;
+
+struct blive_capture {
+    char*               dir;
+    size_t              segment_size;
+    size_t              page_size;
+    pthread_key_t       key;                    /*各线程的写入状态，线程退出时封存其分段*/
+    pthread_mutex_t     lock;                   /*保护写入线程链表、已退出线程的统计与后台任务，不在每次写入的路径上*/
+    pthread_cond_t      cond;
+    capture_writer*     writers;
+    uint32_t            writer_seq;
+    blive_capture_stats retired;                /*已退出的写入线程的统计*/
+    capture_segment*    jobs;                   /*后台任务，先进先出*/
+    capture_segment**   jobs_tail;
+    Bool                stop;
+    pthread_t           thread;
+};
+
+static pthread_mutex_t capture_set_lock = PTHREAD_MUTEX_INITIALIZER;     /*依次执行blive_set_capture的分组切换与等待*/
+
+
+static capture_writer* writer_create(blive_capture* cap);
+static int writer_roll(capture_writer* writer);
+static void writer_exit(void* arg);
+static void writer_finish(capture_writer* writer);
+static capture_segment* segment_new(capture_writer* writer);
+static int segment_map(blive_capture* cap, capture_segment* segment);
+static void segment_seal(blive_capture* cap, capture_segment* segment);
+static void segment_discard(blive_capture* cap, capture_segment* segment);
+static void capture_submit(blive_capture* cap, capture_segment* segment);
+static void* capture_routine(void* arg);
+static int index_filter(const struct dirent* entry);
+static int index_path(const char* segment_path, char* path, size_t len);
+static int index_entry_cmp(const void* a, const void* b);
+static int index_rebuild(const char* path, Bool force);
+
+
+int blive_capture_create(blive_capture** cap, const char* dir, size_t segment_size)
+{
+    if (cap == NULL || dir == NULL) {
+        return ERROR;
+    }
+    if (segment_size == 0) {
+        segment_size = CAPTURE_SEGMENT_DEFAULT;
+    }
+    if (segment_size < CAPTURE_SEGMENT_MIN) {
+        segment_size = CAPTURE_SEGMENT_MIN;
+    }
+
+    *cap = malloc(sizeof(blive_capture));
+    if (*cap == NULL) {
+        return ERROR;
+    }
+    memset(*cap, 0, sizeof(blive_capture));
+    (*cap)->page_size = sysconf(_SC_PAGESIZE);
+    (*cap)->segment_size = (segment_size + (*cap)->page_size - 1) & ~((*cap)->page_size - 1);
+    (*cap)->jobs_tail = &(*cap)->jobs;
+    if (((*cap)->dir = strdup(dir)) == NULL || pthread_key_create(&(*cap)->key, writer_exit) != 0) {
+        free((*cap)->dir);
+        free(*cap);
+        *cap = NULL;
+        return ERROR;
+    }
+    pthread_mutex_init(&(*cap)->lock, NULL);
+    pthread_cond_init(&(*cap)->cond, NULL);
+    if (pthread_create(&(*cap)->thread, NULL, capture_routine, *cap) != 0) {
+        pthread_key_delete((*cap)->key);
+        pthread_cond_destroy(&(*cap)->cond);
+        pthread_mutex_destroy(&(*cap)->lock);
+        free((*cap)->dir);
+        free(*cap);
+        *cap = NULL;
+        return ERROR;
+    }
+
+    return OK;
+}
+
+int blive_capture_destroy(blive_capture* cap)
+{
+    capture_writer* writer = NULL;
+
+    if (cap == NULL) {
+        return ERROR;
+    }
+
+    /*先删除线程私有数据，之后退出的线程不会再调用writer_exit*/
+    pthread_key_delete(cap->key);
+    while ((writer = cap->writers) != NULL) {
+        cap->writers = writer->next;
+        writer_finish(writer);
+    }
+
+    /*后台线程处理完已提交的封存任务后退出*/
+    pthread_mutex_lock(&cap->lock);
+    cap->stop = True;
+    pthread_cond_signal(&cap->cond);
+    pthread_mutex_unlock(&cap->lock);
+    pthread_join(cap->thread, NULL);
+
+    pthread_cond_destroy(&cap->cond);
+    pthread_mutex_destroy(&cap->lock);
+    free(cap->dir);
+    free(cap);
+    return OK;
+}
+
+int blive_set_capture(blive* entity, blive_capture* cap)
+{
+    uint32_t    epoch = 0;
+
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    /*替换后切换登记分组，之后的写入登记在另一组，只需等待原分组中可能读到原抓取器的写入完成，
+      持续写入的接收线程不会让等待无法结束。多个线程同时更换时依次进行*/
+    pthread_mutex_lock(&capture_set_lock);
+    __atomic_store_n(&entity->capture, cap, __ATOMIC_SEQ_CST);
+    epoch = __atomic_fetch_add(&entity->capture_epoch, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&entity->capture_writers[epoch & 1], __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+    pthread_mutex_unlock(&capture_set_lock);
+    return OK;
+}
+
+int blive_get_capture_stats(blive_capture* cap, blive_capture_stats* stats)
+{
+    if (cap == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    pthread_mutex_lock(&cap->lock);
+    *stats = cap->retired;
+    stats->writers = 0;
+    for (capture_writer* writer = cap->writers; writer != NULL; writer = writer->next) {
+        stats->frames += __atomic_load_n(&writer->frames, __ATOMIC_RELAXED);
+        stats->bytes += __atomic_load_n(&writer->bytes, __ATOMIC_RELAXED);
+        stats->segments += __atomic_load_n(&writer->segments, __ATOMIC_RELAXED);
+        stats->dropped += __atomic_load_n(&writer->dropped, __ATOMIC_RELAXED);
+        stats->writers++;
+    }
+    pthread_mutex_unlock(&cap->lock);
+    return OK;
+}
+
+void blive_capture_feed(blive* entity, const blive_msg_header* header, const char* body, int body_size, uint64_t recv_ns)
+{
+    blive_capture*  cap = NULL;
+    uint32_t        epoch = 0;
+
+    if (__atomic_load_n(&entity->capture, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+
+    /*先登记再读取抓取器；登记期间分组被切换时改到新的分组，保证blive_set_capture等待的分组只减不增*/
+    for (;;) {
+        epoch = __atomic_load_n(&entity->capture_epoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&entity->capture_writers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&entity->capture_epoch, __ATOMIC_SEQ_CST) == epoch) {
+            break;
+        }
+        __atomic_fetch_sub(&entity->capture_writers[epoch & 1], 1, __ATOMIC_RELEASE);
+    }
+    if ((cap = __atomic_load_n(&entity->capture, __ATOMIC_SEQ_CST)) != NULL) {
+        blive_capture_write(cap, entity->room_id, header, body, body_size, recv_ns);
+    }
+    __atomic_fetch_sub(&entity->capture_writers[epoch & 1], 1, __ATOMIC_RELEASE);
+}
+
+void blive_capture_write(blive_capture* cap, uint64_t room_id, const blive_msg_header* header,
+                         const char* body, int body_size, uint64_t recv_ns)
+{
+    capture_writer*         writer = pthread_getspecific(cap->key);
+    capture_segment*        segment = NULL;
+    blive_capture_record*   record = NULL;
+    blive_msg_header*       wire = NULL;
+    size_t                  frame_size = sizeof(blive_msg_header) + body_size;
+    size_t                  record_size = BLIVE_CAPTURE_ALIGN(sizeof(blive_capture_record) + frame_size);
+    size_t                  sync_from = 0;
+
+    if (writer == NULL && (writer = writer_create(cap)) == NULL) {
+        return;
+    }
+    if (record_size > cap->segment_size - sizeof(blive_capture_segment)) {
+        __atomic_store_n(&writer->dropped, writer->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (writer->current == NULL || writer->current->used + record_size > cap->segment_size) {
+        if (writer_roll(writer) != OK) {
+            __atomic_store_n(&writer->dropped, writer->dropped + 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    segment = writer->current;
+
+    /*记录内的头部按收到时的网络字节序还原*/
+    record = (blive_capture_record*)(segment->base + segment->used);
+    record->frame_size = frame_size;
+    record->room_id = room_id;
+    record->wall_ns = blive_clock_wall_coarse_ns();
+    record->recv_ns = recv_ns;
+    wire = (blive_msg_header*)record->frame;
+    wire->packet_size = htonl(header->packet_size);
+    wire->header_size = htons(header->header_size);
+    wire->msg_proto = htons(header->msg_proto);
+    wire->msg_operate = htonl(header->msg_operate);
+    wire->msg_seq = htonl(header->msg_seq);
+    memcpy(wire->body, body, body_size);
+    /*record_size最后写入：读取写入中的文件时，非0的record_size表示整条记录已完整*/
+    __atomic_store_n(&record->record_size, record_size, __ATOMIC_RELEASE);
+    blive_capture_index_add(&segment->index, record, segment->used);
+    segment->used += record_size;
+    __atomic_store_n(&((blive_capture_segment*)segment->base)->used, segment->used, __ATOMIC_RELEASE);
+
+    if (segment->used - segment->synced >= BLIVE_CAPTURE_SYNC_BYTES) {
+        sync_from = segment->synced & ~(cap->page_size - 1);
+        msync(segment->base + sync_from, segment->used - sync_from, MS_ASYNC);
+        segment->synced = segment->used;
+    }
+
+    __atomic_store_n(&writer->frames, writer->frames + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&writer->bytes, writer->bytes + record_size, __ATOMIC_RELAXED);
+}
+
+int blive_capture_index_rebuild(const char* dir, Bool force)
+{
+    struct dirent** entries = NULL;
+    char            path[1024] = {0};
+    int             num = 0;
+    int             rebuilt = 0;
+
+    if (dir == NULL) {
+        return ERROR;
+    }
+    if ((num = scandir(dir, &entries, index_filter, alphasort)) < 0) {
+        blive_loge("scan capture dir %s failed: %s", dir, strerror(errno));
+        return ERROR;
+    }
+    for (int i = 0; i < num; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+        rebuilt += index_rebuild(path, force) == OK;
+        free(entries[i]);
+    }
+    free(entries);
+    return rebuilt;
+}
+
+void blive_capture_index_add(blive_capture_indexer* indexer, const blive_capture_record* record, uint64_t offset)
+{
+    blive_capture_index_entry*  entry = NULL;
+    blive_capture_index_entry*  bigger = NULL;
+    uint64_t                    bucket = record->wall_ns / BLIVE_CAPTURE_INDEX_BUCKET;
+    uint32_t                    capacity = 0;
+    uint32_t                    index = indexer->last;
+
+    if (indexer->failed) {
+        return;
+    }
+
+    /*通常一个写入线程只接收一个直播间，上一次的条目即命中；多个直播间时从后往前找该直播间最近的条目*/
+    if (indexer->entry_num > 0 && indexer->entries[index].room_id != record->room_id) {
+        for (index = indexer->entry_num; index > 0 && indexer->entries[index - 1].room_id != record->room_id; index--);
+        index = index > 0 ? index - 1 : indexer->entry_num;
+    }
+    if (index < indexer->entry_num && indexer->entries[index].bucket == bucket) {
+        entry = &indexer->entries[index];
+        entry->end = offset + record->record_size;
+        entry->last_recv_ns = record->recv_ns;
+        entry->frames++;
+        entry->bytes += record->frame_size;
+        indexer->last = index;
+        return;
+    }
+
+    if (indexer->entry_num == indexer->capacity) {
+        capacity = indexer->capacity ? indexer->capacity * 2 : 64;
+        if ((bigger = realloc(indexer->entries, sizeof(blive_capture_index_entry) * capacity)) == NULL) {
+            indexer->failed = True;
+            return;
+        }
+        indexer->entries = bigger;
+        indexer->capacity = capacity;
+    }
+    entry = &indexer->entries[indexer->entry_num];
+    entry->room_id = record->room_id;
+    entry->bucket = bucket;
+    entry->begin = offset;
+    entry->end = offset + record->record_size;
+    entry->first_recv_ns = entry->last_recv_ns = record->recv_ns;
+    entry->frames = 1;
+    entry->bytes = record->frame_size;
+    indexer->last = indexer->entry_num++;
+}
+
+Bool blive_capture_record_valid(const blive_capture_record* record, uint32_t record_size, uint64_t avail)
+{
+    const blive_msg_header* wire = (const blive_msg_header*)record->frame;
+
+    return record_size <= avail
+        && record_size == BLIVE_CAPTURE_ALIGN(sizeof(blive_capture_record) + record->frame_size)
+        && record->frame_size >= sizeof(blive_msg_header)
+        && ntohl(wire->packet_size) == record->frame_size;
+}
+
+int blive_capture_index_scan(blive_capture_indexer* indexer, const char* base, size_t size, uint64_t* covered)
+{
+    const blive_capture_segment*    segment = (const blive_capture_segment*)base;
+    const blive_capture_record*     record = NULL;
+    size_t                          used = __atomic_load_n(&segment->used, __ATOMIC_ACQUIRE);
+    size_t                          offset = segment->header_size;
+    uint32_t                        record_size = 0;
+    int                             retval = OK;
+
+    if (used > size) {
+        used = size;
+    }
+    while (offset + sizeof(blive_capture_record) <= used) {
+        record = (const blive_capture_record*)(base + offset);
+        if ((record_size = __atomic_load_n(&record->record_size, __ATOMIC_ACQUIRE)) == 0) {
+            break;
+        }
+        if (!blive_capture_record_valid(record, record_size, used - offset)) {
+            retval = ERROR;
+            break;
+        }
+        blive_capture_index_add(indexer, record, offset);
+        offset += record_size;
+    }
+    *covered = offset;
+    return indexer->failed ? ERROR : retval;
+}
+
+int blive_capture_index_save(blive_capture_indexer* indexer, const char* segment_path, uint64_t covered)
+{
+    char                    path[1024] = {0};
+    char                    tmp[1040] = {0};
+    blive_capture_index     header = {0};
+    FILE*                   file = NULL;
+
+    if (indexer->failed || index_path(segment_path, path, sizeof(path)) != OK) {
+        return ERROR;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    qsort(indexer->entries, indexer->entry_num, sizeof(blive_capture_index_entry), index_entry_cmp);
+    indexer->last = 0;
+    header.magic = BLIVE_CAPTURE_INDEX_MAGIC;
+    header.version = BLIVE_CAPTURE_INDEX_VERSION;
+    header.header_size = sizeof(blive_capture_index);
+    header.bucket_ns = BLIVE_CAPTURE_INDEX_BUCKET;
+    header.covered = covered;
+    header.entry_size = sizeof(blive_capture_index_entry);
+    header.entry_num = indexer->entry_num;
+
+    if ((file = fopen(tmp, "wb")) == NULL) {
+        blive_loge("open capture index %s failed: %s", tmp, strerror(errno));
+        return ERROR;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || fwrite(indexer->entries, sizeof(blive_capture_index_entry), indexer->entry_num, file) != indexer->entry_num) {
+        blive_loge("write capture index %s failed: %s", tmp, strerror(errno));
+        fclose(file);
+        unlink(tmp);
+        return ERROR;
+    }
+    if (fclose(file) != 0 || rename(tmp, path) != 0) {
+        blive_loge("save capture index %s failed: %s", path, strerror(errno));
+        unlink(tmp);
+        return ERROR;
+    }
+    return OK;
+}
+
+int blive_capture_index_load(blive_capture_indexer* indexer, const char* segment_path, const blive_capture_segment* segment)
+{
+    char                    path[1024] = {0};
+    blive_capture_index     header = {0};
+    FILE*                   file = NULL;
+
+    memset(indexer, 0, sizeof(blive_capture_indexer));
+    if (index_path(segment_path, path, sizeof(path)) != OK || (file = fopen(path, "rb")) == NULL) {
+        return ERROR;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != BLIVE_CAPTURE_INDEX_MAGIC
+        || header.version != BLIVE_CAPTURE_INDEX_VERSION || header.header_size < sizeof(blive_capture_index)
+        || header.entry_size != sizeof(blive_capture_index_entry) || header.bucket_ns == 0
+        || header.covered != __atomic_load_n(&segment->used, __ATOMIC_ACQUIRE)) {
+        fclose(file);
+        return ERROR;
+    }
+    if (header.entry_num > 0) {
+        indexer->entries = malloc(sizeof(blive_capture_index_entry) * header.entry_num);
+        if (indexer->entries == NULL || fseek(file, header.header_size, SEEK_SET) != 0
+            || fread(indexer->entries, sizeof(blive_capture_index_entry), header.entry_num, file) != header.entry_num) {
+            free(indexer->entries);
+            indexer->entries = NULL;
+            fclose(file);
+            return ERROR;
+        }
+    }
+    indexer->entry_num = indexer->capacity = header.entry_num;
+    fclose(file);
+
+    /*条目的偏移需落在索引覆盖的范围内，保证按索引读取时不越界*/
+    for (uint32_t i = 0; i < indexer->entry_num; i++) {
+        if (indexer->entries[i].begin < segment->header_size || indexer->entries[i].begin >= indexer->entries[i].end
+            || indexer->entries[i].end > header.covered) {
+            blive_capture_index_free(indexer);
+            return ERROR;
+        }
+    }
+    return OK;
+}
+
+void blive_capture_index_free(blive_capture_indexer* indexer)
+{
+    free(indexer->entries);
+    memset(indexer, 0, sizeof(blive_capture_indexer));
+}
+
+
+/**
+ * @brief 调用线程第一次写入时创建其写入状态
+ * 
+ */
+static capture_writer* writer_create(blive_capture* cap)
+{
+    capture_writer* writer = malloc(sizeof(capture_writer));
+
+    if (writer == NULL) {
+        return NULL;
+    }
+    memset(writer, 0, sizeof(capture_writer));
+    writer->cap = cap;
+
+    pthread_mutex_lock(&cap->lock);
+    writer->id = cap->writer_seq++;
+    writer->next = cap->writers;
+    cap->writers = writer;
+    pthread_mutex_unlock(&cap->lock);
+    pthread_setspecific(cap->key, writer);
+
+    return writer;
+}
+
+/**
+ * @brief 切换到备用分段，当前分段交给后台线程封存，并请求准备下一个备用分段。
+ *          第一次写入时还没有备用分段，在调用线程内同步创建；备用分段尚未准备好时等待，保证分段编号与写入顺序一致
+ * 
+ * @return int 没有可用的分段时返回ERROR
+ */
+static int writer_roll(capture_writer* writer)
+{
+    blive_capture*      cap = writer->cap;
+    capture_segment*    segment = writer->spare;
+    int                 state = SEGMENT_PENDING;
+
+    if (writer->current != NULL) {
+        writer->current->seal = True;
+        capture_submit(cap, writer->current);
+        writer->current = NULL;
+    }
+
+    if (segment == NULL) {
+        if ((segment = segment_new(writer)) == NULL) {
+            return ERROR;
+        }
+        if (segment_map(cap, segment) != OK) {
+            segment_discard(cap, segment);
+            return ERROR;
+        }
+    } else {
+        while ((state = __atomic_load_n(&segment->state, __ATOMIC_ACQUIRE)) == SEGMENT_PENDING) {
+            sched_yield();
+        }
+        writer->spare = NULL;
+        if (state != SEGMENT_READY) {
+            segment_discard(cap, segment);
+            return ERROR;
+        }
+    }
+    writer->current = segment;
+    __atomic_store_n(&writer->segments, writer->segments + 1, __ATOMIC_RELAXED);
+
+    if ((writer->spare = segment_new(writer)) != NULL) {
+        capture_submit(cap, writer->spare);
+    }
+    return OK;
+}
+
+/**
+ * @brief 写入线程退出：从链表中移除，统计并入抓取器后封存分段
+ * 
+ */
+static void writer_exit(void* arg)
+{
+    capture_writer*     writer = (capture_writer*)arg;
+    blive_capture*      cap = writer->cap;
+    capture_writer**    link = NULL;
+
+    pthread_mutex_lock(&cap->lock);
+    for (link = &cap->writers; *link != NULL; link = &(*link)->next) {
+        if (*link == writer) {
+            *link = writer->next;
+            break;
+        }
+    }
+    cap->retired.frames += writer->frames;
+    cap->retired.bytes += writer->bytes;
+    cap->retired.segments += writer->segments;
+    cap->retired.dropped += writer->dropped;
+    pthread_mutex_unlock(&cap->lock);
+
+    writer_finish(writer);
+}
+
+/**
+ * @brief 提交当前分段的封存任务，放弃备用分段：后台线程尚未处理时由其创建后删除，否则在此删除
+ * 
+ */
+static void writer_finish(capture_writer* writer)
+{
+    int     state = SEGMENT_PENDING;
+
+    if (writer->current != NULL) {
+        writer->current->seal = True;
+        capture_submit(writer->cap, writer->current);
+    }
+    if (writer->spare != NULL && !__atomic_compare_exchange_n(&writer->spare->state, &state, SEGMENT_ABANDONED,
+                                                              False, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        segment_discard(writer->cap, writer->spare);
+    }
+    free(writer);
+}
+
+/**
+ * @brief 为写入线程分配下一个编号的分段，文件名为 目录/blive-进程号-写入线程编号-分段编号.cap
+ * 
+ */
+static capture_segment* segment_new(capture_writer* writer)
+{
+    capture_segment*    segment = malloc(sizeof(capture_segment));
+    size_t              len = strlen(writer->cap->dir) + 64;
+
+    if (segment == NULL) {
+        return NULL;
+    }
+    memset(segment, 0, sizeof(capture_segment));
+    if ((segment->path = malloc(len)) == NULL) {
+        free(segment);
+        return NULL;
+    }
+    segment->state = SEGMENT_PENDING;
+    segment->fd = -1;
+    segment->writer_id = writer->id;
+    segment->segment_no = writer->segment_no++;
+    snprintf(segment->path, len, "%s/blive-%d-%u-%06u" BLIVE_CAPTURE_SUFFIX, writer->cap->dir, (int)getpid(),
+             segment->writer_id, segment->segment_no);
+    return segment;
+}
+
+/**
+ * @brief 创建分段文件，预留分段大小的磁盘空间后映射，写入文件头部。空间不足时在这里失败，
+ *          而不是在写入映射页时触发SIGBUS
+ * 
+ * @return int
+ */
+static int segment_map(blive_capture* cap, capture_segment* segment)
+{
+    blive_capture_segment*  header = NULL;
+    int                     ret = 0;
+
+    segment->fd = open(segment->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (segment->fd == -1) {
+        blive_loge("open capture segment %s failed: %s", segment->path, strerror(errno));
+        return ERROR;
+    }
+    if ((ret = posix_fallocate(segment->fd, 0, cap->segment_size)) != 0) {
+        blive_loge("allocate capture segment %s failed: %s", segment->path, strerror(ret));
+        return ERROR;
+    }
+    if ((segment->base = mmap(NULL, cap->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0)) == MAP_FAILED) {
+        blive_loge("map capture segment %s failed: %s", segment->path, strerror(errno));
+        segment->base = NULL;
+        return ERROR;
+    }
+
+    header = (blive_capture_segment*)segment->base;
+    header->magic = BLIVE_CAPTURE_MAGIC;
+    header->version = BLIVE_CAPTURE_VERSION;
+    header->header_size = sizeof(blive_capture_segment);
+    header->segment_size = cap->segment_size;
+    header->created_wall_ns = blive_clock_wall_coarse_ns();
+    header->pid = getpid();
+    header->writer_id = segment->writer_id;
+    header->segment_no = segment->segment_no;
+    header->used = sizeof(blive_capture_segment);
+    segment->used = segment->synced = sizeof(blive_capture_segment);
+
+    return OK;
+}
+
+/**
+ * @brief 封存分段：置封存标记，异步提交剩余部分，解除映射后把文件截断为实际写入的长度
+ * 
+ */
+static void segment_seal(blive_capture* cap, capture_segment* segment)
+{
+    size_t  sync_from = segment->synced & ~(cap->page_size - 1);
+
+    ((blive_capture_segment*)segment->base)->sealed = 1;
+    msync(segment->base, cap->page_size, MS_ASYNC);
+    msync(segment->base + sync_from, segment->used - sync_from, MS_ASYNC);
+    munmap(segment->base, cap->segment_size);
+    if (ftruncate(segment->fd, segment->used) == -1) {
+        blive_loge("truncate capture segment %s failed: %s", segment->path, strerror(errno));
+    }
+    close(segment->fd);
+    blive_capture_index_save(&segment->index, segment->path, segment->used);
+    blive_capture_index_free(&segment->index);
+    free(segment->path);
+    free(segment);
+}
+
+/**
+ * @brief 删除没有写入过记录的分段
+ * 
+ */
+static void segment_discard(blive_capture* cap, capture_segment* segment)
+{
+    if (segment->base != NULL) {
+        munmap(segment->base, cap->segment_size);
+    }
+    if (segment->fd != -1) {
+        close(segment->fd);
+        unlink(segment->path);
+    }
+    blive_capture_index_free(&segment->index);
+    free(segment->path);
+    free(segment);
+}
+
+static void capture_submit(blive_capture* cap, capture_segment* segment)
+{
+    pthread_mutex_lock(&cap->lock);
+    segment->next = NULL;
+    *cap->jobs_tail = segment;
+    cap->jobs_tail = &segment->next;
+    pthread_cond_signal(&cap->cond);
+    pthread_mutex_unlock(&cap->lock);
+}
+
+/**
+ * @brief 后台线程：按提交顺序准备或封存分段，停止时处理完剩余任务后退出
+ * 
+ */
+static void* capture_routine(void* arg)
+{
+    blive_capture*      cap = (blive_capture*)arg;
+    capture_segment*    segment = NULL;
+    int                 state = SEGMENT_PENDING;
+
+    pthread_mutex_lock(&cap->lock);
+    for (;;) {
+        while (cap->jobs == NULL && !cap->stop) {
+            pthread_cond_wait(&cap->cond, &cap->lock);
+        }
+        if ((segment = cap->jobs) == NULL) {
+            break;
+        }
+        if ((cap->jobs = segment->next) == NULL) {
+            cap->jobs_tail = &cap->jobs;
+        }
+        pthread_mutex_unlock(&cap->lock);
+
+        if (segment->seal) {
+            segment_seal(cap, segment);
+        } else {
+            state = SEGMENT_PENDING;
+            if (!__atomic_compare_exchange_n(&segment->state, &state,
+                                             segment_map(cap, segment) == OK ? SEGMENT_READY : SEGMENT_FAILED,
+                                             False, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                segment_discard(cap, segment);  /*写入线程已经退出*/
+            }
+        }
+
+        pthread_mutex_lock(&cap->lock);
+    }
+    pthread_mutex_unlock(&cap->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief 只处理抓取分段文件
+ * 
+ */
+static int index_filter(const struct dirent* entry)
+{
+    size_t  len = strlen(entry->d_name);
+    size_t  suffix_len = strlen(BLIVE_CAPTURE_SUFFIX);
+
+    return len > suffix_len && strcmp(entry->d_name + len - suffix_len, BLIVE_CAPTURE_SUFFIX) == 0;
+}
+
+/**
+ * @brief 分段文件对应的索引文件路径：把.cap后缀替换为.idx
+ * 
+ * @return int 
+ */
+static int index_path(const char* segment_path, char* path, size_t len)
+{
+    size_t  path_len = strlen(segment_path);
+    size_t  suffix_len = strlen(BLIVE_CAPTURE_SUFFIX);
+
+    if (path_len <= suffix_len || path_len - suffix_len + strlen(BLIVE_CAPTURE_INDEX_SUFFIX) >= len
+        || strcmp(segment_path + path_len - suffix_len, BLIVE_CAPTURE_SUFFIX) != 0) {
+        return ERROR;
+    }
+    memcpy(path, segment_path, path_len - suffix_len);
+    strcpy(path + path_len - suffix_len, BLIVE_CAPTURE_INDEX_SUFFIX);
+    return OK;
+}
+
+/**
+ * @brief 索引条目按直播间、时间段、偏移排序
+ * 
+ */
+static int index_entry_cmp(const void* a, const void* b)
+{
+    const blive_capture_index_entry*    ea = (const blive_capture_index_entry*)a;
+    const blive_capture_index_entry*    eb = (const blive_capture_index_entry*)b;
+
+    if (ea->room_id != eb->room_id) {
+        return ea->room_id < eb->room_id ? -1 : 1;
+    }
+    if (ea->bucket != eb->bucket) {
+        return ea->bucket < eb->bucket ? -1 : 1;
+    }
+    if (ea->begin != eb->begin) {
+        return ea->begin < eb->begin ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 为一个分段文件重建索引，force为False时已有有效索引的分段跳过
+ * 
+ * @return int 写入了索引文件时返回OK
+ */
+static int index_rebuild(const char* path, Bool force)
+{
+    int                     fd = -1;
+    struct stat             st = {0};
+    char*                   base = NULL;
+    blive_capture_indexer   indexer = {0};
+    uint64_t                covered = 0;
+    int                     retval = ERROR;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        blive_loge("open capture segment %s failed: %s", path, strerror(errno));
+        return ERROR;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(blive_capture_segment)
+        || (base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        blive_loge("map capture segment %s failed", path);
+        close(fd);
+        return ERROR;
+    }
+    close(fd);
+
+    if (((blive_capture_segment*)base)->magic != BLIVE_CAPTURE_MAGIC
+        || ((blive_capture_segment*)base)->version != BLIVE_CAPTURE_VERSION) {
+        blive_loge("invalid capture segment %s", path);
+    } else if (!force && blive_capture_index_load(&indexer, path, (blive_capture_segment*)base) == OK) {
+        blive_capture_index_free(&indexer);
+    } else {
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+        if (blive_capture_index_scan(&indexer, base, st.st_size, &covered) != OK) {
+            blive_loge("capture segment %s is corrupt, not indexed", path);   /*索引与used不一致也不会被使用*/
+        } else {
+            retval = blive_capture_index_save(&indexer, path, covered);
+        }
+        blive_capture_index_free(&indexer);
+    }
+    munmap(base, st.st_size);
+    return retval;
+}
\ No newline at end of file
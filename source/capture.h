@@ -0,0 +1,197 @@
+/**
+ * @file capture.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 数据包抓取的内部头文件与分段文件格式。
+ *          分段文件以blive_capture_segment开头，之后是按8字节对齐依次追加的blive_capture_record，
+ *          record_size为0处即为已写入部分的末尾；写入中的文件以头部的used为准，关闭后文件截断为used大小。
+ *          所有字段为主机字节序，记录内的数据包保持网络字节序，与从服务端收到的字节完全一致。
+ *          每个分段封存时在同名的.idx文件中写入稀疏索引：每个直播间在每个时间段内的记录所在的偏移范围，
+ *          按时间或直播间回放时只需读取索引与命中的范围
+ * @version 0.1
+ * @date 2023-02-24
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_CAPTURE_H__
+#define __BLIVE_CAPTURE_H__
+
+#include "blive_def.h"
+#include "msg.h"
+
+
+#define BLIVE_CAPTURE_MAGIC         0x31504143564c4221ULL   /*"!BLVCAP1"*/
+#define BLIVE_CAPTURE_VERSION       1
+#define BLIVE_CAPTURE_SUFFIX        ".cap"
+#define BLIVE_CAPTURE_ALIGN(size)   (((size) + 7) & ~(size_t)7)
+
+#define BLIVE_CAPTURE_INDEX_MAGIC   0x31584449564c4221ULL   /*"!BLVIDX1"*/
+#define BLIVE_CAPTURE_INDEX_VERSION 1
+#define BLIVE_CAPTURE_INDEX_SUFFIX  ".idx"
+#define BLIVE_CAPTURE_INDEX_BUCKET  1000000000ULL           /*索引的时间段长度，纳秒*/
+
+/**
+ * @brief 分段文件头部，固定64字节
+ * 
+ */
+typedef struct {
+    uint64_t    magic;                  /*BLIVE_CAPTURE_MAGIC*/
+    uint32_t    version;                /*BLIVE_CAPTURE_VERSION*/
+    uint32_t    header_size;            /*本头部长度，第一条记录从此处开始*/
+    uint64_t    segment_size;           /*创建时的文件大小*/
+    uint64_t    used;                   /*已写入的长度，含本头部，每追加一条记录后更新*/
+    uint64_t    created_wall_ns;        /*创建时的系统时间*/
+    uint32_t    pid;                    /*写入进程*/
+    uint32_t    writer_id;              /*写入线程在抓取器内的编号*/
+    uint32_t    segment_no;             /*该写入线程的第几个分段，从0开始*/
+    uint32_t    sealed;                 /*写满或关闭后置1，之后不再修改*/
+    uint64_t    reserved;
+} blive_capture_segment;
+
+/**
+ * @brief 一条记录：一个完整的数据包及其直播间与接收时间
+ * 
+ */
+typedef struct {
+    uint32_t    record_size;            /*整条记录的长度，含本头部与对齐填充*/
+    uint32_t    frame_size;             /*数据包长度：头部加实际收到的正文*/
+    uint64_t    room_id;                /*直播间id*/
+    uint64_t    wall_ns;                /*接收时的系统时间，1970年以来的纳秒数*/
+    uint64_t    recv_ns;                /*接收时的单调时间，与blive_clock_now_ns同一基准*/
+    char        frame[0];               /*网络字节序的blive_msg_header与正文，brotli压缩的正文不解压*/
+} blive_capture_record;
+
+/**
+ * @brief 索引文件头部，固定64字节，之后是按room_id、bucket、begin排序的blive_capture_index_entry
+ * 
+ */
+typedef struct {
+    uint64_t    magic;                  /*BLIVE_CAPTURE_INDEX_MAGIC*/
+    uint32_t    version;                /*BLIVE_CAPTURE_INDEX_VERSION*/
+    uint32_t    header_size;            /*本头部长度，第一个条目从此处开始*/
+    uint64_t    bucket_ns;              /*时间段长度*/
+    uint64_t    covered;                /*建立索引时分段的used，与分段头部的used不一致时索引无效*/
+    uint32_t    entry_size;             /*单个条目的长度*/
+    uint32_t    entry_num;              /*条目数*/
+    uint64_t    reserved[3];
+} blive_capture_index;
+
+/**
+ * @brief 一个索引条目：一个直播间在一个时间段内的记录。同一时间段内其他直播间的记录可能夹在begin与end之间
+ * 
+ */
+typedef struct {
+    uint64_t    room_id;                /*直播间id*/
+    uint64_t    bucket;                 /*wall_ns / bucket_ns*/
+    uint64_t    begin;                  /*第一条记录在分段内的偏移*/
+    uint64_t    end;                    /*最后一条记录的结束偏移*/
+    uint64_t    first_recv_ns;          /*第一条记录的recv_ns*/
+    uint64_t    last_recv_ns;           /*最后一条记录的recv_ns*/
+    uint32_t    frames;                 /*记录数*/
+    uint32_t    bytes;                  /*数据包字节数，不含记录头部与填充*/
+} blive_capture_index_entry;
+
+/**
+ * @brief 构建中的索引，由写入线程在追加记录时更新，或离线扫描分段文件建立
+ * 
+ */
+typedef struct {
+    blive_capture_index_entry*  entries;
+    uint32_t                    entry_num;
+    uint32_t                    capacity;
+    uint32_t                    last;           /*上一次更新的条目，同一直播间连续写入时不用查找*/
+    Bool                        failed;         /*申请内存失败，索引不完整，不再写入索引文件*/
+} blive_capture_indexer;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 在接收线程内追加一个数据包，写入调用线程独占的分段文件，不加锁
+ * 
+ * @param [in] cap 抓取器
+ * @param [in] room_id 直播间id
+ * @param [in] header 主机字节序的数据包头部
+ * @param [in] body 正文
+ * @param [in] body_size 实际收到的正文长度
+ * @param [in] recv_ns 收到数据包头部的时间
+ */
+void blive_capture_write(blive_capture* cap, uint64_t room_id, const blive_msg_header* header,
+                         const char* body, int body_size, uint64_t recv_ns);
+
+/**
+ * @brief 将直播间收到的数据包写入其当前的抓取器，未设置抓取器时直接返回。写入期间登记在直播间上，
+ *          blive_set_capture据此等待写入完成后才返回
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] header 主机字节序的数据包头部
+ * @param [in] body 正文
+ * @param [in] body_size 实际收到的正文长度
+ * @param [in] recv_ns 收到数据包头部的时间
+ */
+void blive_capture_feed(blive* entity, const blive_msg_header* header, const char* body, int body_size, uint64_t recv_ns);
+
+/**
+ * @brief 检查一条记录的各个长度是否一致：记录长度与数据包长度相符、数据包不短于头部、
+ *          头部的packet_size与数据包长度相同，且整条记录不超出可读范围
+ * 
+ * @param [in] record 记录
+ * @param [in] record_size 已读出的记录长度
+ * @param [in] avail 从记录起始到可读范围末尾的长度
+ * @return Bool 
+ */
+Bool blive_capture_record_valid(const blive_capture_record* record, uint32_t record_size, uint64_t avail);
+
+/**
+ * @brief 把一条记录计入索引：与该直播间最近的条目同一时间段时扩展该条目，否则追加新条目
+ * 
+ * @param [in] indexer 构建中的索引
+ * @param [in] record 记录
+ * @param [in] offset 记录在分段内的偏移
+ */
+void blive_capture_index_add(blive_capture_indexer* indexer, const blive_capture_record* record, uint64_t offset);
+
+/**
+ * @brief 扫描映射的分段文件建立索引，只读取到分段头部的used为止
+ * 
+ * @param [in] indexer 构建中的索引
+ * @param [in] base 分段文件的映射地址
+ * @param [in] size 映射长度
+ * @param [out] covered 传出已读取的长度
+ * @return int 遇到损坏的记录时返回ERROR，之前的记录已计入索引
+ */
+int blive_capture_index_scan(blive_capture_indexer* indexer, const char* base, size_t size, uint64_t* covered);
+
+/**
+ * @brief 排序后写入分段文件对应的索引文件，先写入临时文件再改名，读取方不会看到写了一半的索引
+ * 
+ * @param [in] indexer 构建中的索引
+ * @param [in] segment_path 分段文件路径
+ * @param [in] covered 索引覆盖的分段长度
+ * @return int 
+ */
+int blive_capture_index_save(blive_capture_indexer* indexer, const char* segment_path, uint64_t covered);
+
+/**
+ * @brief 读取分段文件对应的索引文件，索引覆盖的长度需与分段头部的used一致
+ * 
+ * @param [in] indexer 传出索引，成功时entries由调用者通过blive_capture_index_free释放
+ * @param [in] segment_path 分段文件路径
+ * @param [in] segment 分段文件头部
+ * @return int 没有索引文件或索引无效时返回ERROR
+ */
+int blive_capture_index_load(blive_capture_indexer* indexer, const char* segment_path, const blive_capture_segment* segment);
+
+/**
+ * @brief 释放索引条目
+ * 
+ * @param [in] indexer 索引
+ */
+void blive_capture_index_free(blive_capture_indexer* indexer);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
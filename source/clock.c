@@ -0,0 +1,54 @@
+/**
+ * @file clock.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 时钟服务：数据包接收时间、延迟统计统一使用CLOCK_MONOTONIC；日志使用在各循环中刷新的缓存系统时间，
+ *          读取时只有一次原子读
+ * @version 0.1
+ * @date 2023-02-18
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "clock.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+static uint64_t     wall_cache_ns = 0;      /*缓存的系统时间，原子操作*/
+
+
+uint64_t blive_clock_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t blive_clock_wall_ms(void)
+{
+    return blive_clock_wall_coarse_ns() / 1000000;
+}
+
+void blive_clock_tick(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    __atomic_store_n(&wall_cache_ns, (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, __ATOMIC_RELAXED);
+}
+
+uint64_t blive_clock_wall_coarse_ns(void)
+{
+    uint64_t    now = __atomic_load_n(&wall_cache_ns, __ATOMIC_RELAXED);
+
+    /*还没有任何循环刷新过时，读取一次实际时间*/
+    if (!now) {
+        blive_clock_tick();
+        now = __atomic_load_n(&wall_cache_ns, __ATOMIC_RELAXED);
+    }
+    return now;
+}
\ No newline at end of file
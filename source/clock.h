@@ -0,0 +1,38 @@
+/**
+ * @file clock.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 时钟服务的内部头文件：缓存的粗粒度系统时间，以及统一的单调时间基准
+ * @version 0.1
+ * @date 2023-02-18
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_CLOCK_H__
+#define __BLIVE_CLOCK_H__
+
+#include "blive_def.h"
+
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 刷新缓存的系统时间，由blive_perform、解码线程与日志线程在每次循环时调用
+ * 
+ */
+void blive_clock_tick(void);
+
+/**
+ * @brief 读取缓存的系统时间，精度为各循环的刷新间隔，用于日志等不需要精确时间的场合
+ * 
+ * @return uint64_t 1970年以来的纳秒数
+ */
+uint64_t blive_clock_wall_coarse_ns(void);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,244 @@
+/**
+ * @file coalesce.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 高频消息合并：点赞、连击、看过人数、高能用户数量等消息在时间窗口内合并为一次回调
+ * @version 0.1
+ * @date 2023-02-10
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "coalesce.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define COALESCE_ENTRY_INIT_NUM     8
+
+/**
+ * @brief 窗口内的一组合并结果。COMBO_SEND按送礼用户与礼物分别合并，其他类型整个窗口只有一组
+ *
+ */
+typedef struct {
+    uint64_t    uid;            /*COMBO_SEND的送礼用户，其他类型为0*/
+    uint64_t    gift_id;        /*COMBO_SEND的礼物id，其他类型为0*/
+    cJSON*      last;           /*窗口内最后一条消息*/
+    uint64_t    recv_ns;        /*最后一条消息的接收时间*/
+    uint32_t    count;          /*窗口内合并的消息数，LIKE_INFO_V3_CLICK即为点赞次数之和*/
+} coalesce_entry;
+
+typedef struct {
+    uint32_t        window_ms;      /*窗口长度，0为不合并*/
+    uint64_t        window_end;     /*当前窗口的到期时间，0表示当前没有待分发的结果*/
+    coalesce_entry* entries;
+    int             entry_num;
+    int             entry_cap;
+} coalesce_slot;
+
+struct blive_coalescer {
+    coalesce_slot   slots[BLIVE_INFO_MAX];
+};
+
+
+static void slot_emit(blive* entity, blive_info_type type, coalesce_slot* slot, blive_coalesce_emit emit);
+static void entry_key(blive_info_type type, const cJSON* json_obj, uint64_t* uid, uint64_t* gift_id);
+
+
+int blive_set_coalesce_window(blive* entity, blive_info_type info, uint32_t window_ms)
+{
+    if ((entity == NULL) || (info >= BLIVE_INFO_MAX) || (info < BLIVE_INFO_MIN)) {
+        return ERROR;
+    }
+
+    if (entity->coalescer == NULL) {
+        if (!window_ms) {
+            return OK;
+        }
+        entity->coalescer = malloc(sizeof(blive_coalescer));
+        if (entity->coalescer == NULL) {
+            return ERROR;
+        }
+        memset(entity->coalescer, 0, sizeof(blive_coalescer));
+    }
+
+    /*关闭合并时，已经在窗口内的结果仍然在到期后分发*/
+    entity->coalescer->slots[info].window_ms = window_ms;
+    return OK;
+}
+
+Bool blive_coalesce_enabled(blive* entity, blive_info_type type)
+{
+    return (entity->coalescer != NULL && entity->coalescer->slots[type].window_ms) ? True : False;
+}
+
+void blive_coalesce_push(blive* entity, blive_info_type type, cJSON* json_obj, uint64_t recv_ns, blive_coalesce_emit emit)
+{
+    coalesce_slot*  slot = &entity->coalescer->slots[type];
+    coalesce_entry* entry = NULL;
+    coalesce_entry* bigger = NULL;
+    uint64_t        now = blive_clock_now_ns() / 1000000;
+    uint64_t        uid = 0;
+    uint64_t        gift_id = 0;
+
+    if (slot->window_end && now >= slot->window_end) {
+        slot_emit(entity, type, slot, emit);
+    }
+    if (!slot->window_end) {
+        slot->window_end = now + slot->window_ms;
+    }
+
+    entry_key(type, json_obj, &uid, &gift_id);
+    for (int count = 0; count < slot->entry_num; count++) {
+        if (slot->entries[count].uid == uid && slot->entries[count].gift_id == gift_id) {
+            entry = &slot->entries[count];
+            break;
+        }
+    }
+
+    /*已有同一组的消息，只保留最后一条并累加计数*/
+    if (entry != NULL) {
+        cJSON_Delete(entry->last);
+        entry->last = json_obj;
+        entry->recv_ns = recv_ns;
+        entry->count++;
+        return;
+    }
+
+    if (slot->entry_num >= slot->entry_cap) {
+        int new_cap = slot->entry_cap ? slot->entry_cap * 2 : COALESCE_ENTRY_INIT_NUM;
+
+        bigger = realloc(slot->entries, sizeof(coalesce_entry) * new_cap);
+        if (bigger == NULL) {
+            /*内存不足时不再合并，直接分发*/
+            emit(entity, type, json_obj, recv_ns);
+            return;
+        }
+        slot->entries = bigger;
+        slot->entry_cap = new_cap;
+    }
+    entry = &slot->entries[slot->entry_num++];
+    entry->uid = uid;
+    entry->gift_id = gift_id;
+    entry->last = json_obj;
+    entry->recv_ns = recv_ns;
+    entry->count = 1;
+}
+
+void blive_coalesce_flush(blive* entity, blive_coalesce_emit emit)
+{
+    uint64_t    now = 0;
+
+    if (entity->coalescer == NULL) {
+        return;
+    }
+
+    now = blive_clock_now_ns() / 1000000;
+    for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+        if (entity->coalescer->slots[type].window_end && now >= entity->coalescer->slots[type].window_end) {
+            slot_emit(entity, type, &entity->coalescer->slots[type], emit);
+        }
+    }
+}
+
+int blive_coalesce_timeout(blive* entity)
+{
+    uint64_t    now = 0;
+    uint64_t    nearest = 0;
+
+    if (entity->coalescer == NULL) {
+        return -1;
+    }
+
+    for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+        if (entity->coalescer->slots[type].window_end
+            && (!nearest || entity->coalescer->slots[type].window_end < nearest)) {
+            nearest = entity->coalescer->slots[type].window_end;
+        }
+    }
+    if (!nearest) {
+        return -1;
+    }
+
+    now = blive_clock_now_ns() / 1000000;
+    return nearest > now ? (int)(nearest - now) : 0;
+}
+
+void blive_coalesce_destroy(blive* entity)
+{
+    coalesce_slot*  slot = NULL;
+
+    if (entity->coalescer == NULL) {
+        return;
+    }
+
+    for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+        slot = &entity->coalescer->slots[type];
+        for (int count = 0; count < slot->entry_num; count++) {
+            cJSON_Delete(slot->entries[count].last);
+        }
+        free(slot->entries);
+    }
+    free(entity->coalescer);
+    entity->coalescer = NULL;
+}
+
+
+/**
+ * @brief 分发窗口内的所有合并结果，每组一次回调。在消息中追加coalesce字段：
+ *          {"count": 合并的消息数, "window_ms": 窗口长度}
+ *
+ * @param [in] entity 直播间实体
+ * @param [in] type 消息类型
+ * @param [in] slot 该类型的合并状态
+ * @param [in] emit 分发函数
+ */
+static void slot_emit(blive* entity, blive_info_type type, coalesce_slot* slot, blive_coalesce_emit emit)
+{
+    cJSON*  info = NULL;
+
+    for (int count = 0; count < slot->entry_num; count++) {
+        info = cJSON_CreateObject();
+        if (info != NULL) {
+            cJSON_AddNumberToObject(info, "count", slot->entries[count].count);
+            cJSON_AddNumberToObject(info, "window_ms", slot->window_ms);
+            cJSON_AddItemToObject(slot->entries[count].last, "coalesce", info);
+        }
+        emit(entity, type, slot->entries[count].last, slot->entries[count].recv_ns);
+        slot->entries[count].last = NULL;
+    }
+
+    slot->entry_num = 0;
+    slot->window_end = 0;
+}
+
+/**
+ * @brief 获取消息的合并分组：COMBO_SEND按data.uid与data.gift_id分组，其他类型整个窗口合并为一组
+ *
+ * @param [in] type 消息类型
+ * @param [in] json_obj 消息内容
+ * @param [out] uid 传出送礼用户
+ * @param [out] gift_id 传出礼物id
+ */
+static void entry_key(blive_info_type type, const cJSON* json_obj, uint64_t* uid, uint64_t* gift_id)
+{
+    cJSON*  data = NULL;
+    cJSON*  item = NULL;
+
+    *uid = 0;
+    *gift_id = 0;
+    if (type != BLIVE_INFO_COMBO_SEND) {
+        return;
+    }
+
+    data = cJSON_GetObjectItem(json_obj, "data");
+    if ((item = cJSON_GetObjectItem(data, "uid")) != NULL && item->type == cJSON_Number) {
+        *uid = (uint64_t)item->valuedouble;
+    }
+    if ((item = cJSON_GetObjectItem(data, "gift_id")) != NULL && item->type == cJSON_Number) {
+        *gift_id = (uint64_t)item->valuedouble;
+    }
+}
\ No newline at end of file
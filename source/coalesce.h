@@ -0,0 +1,80 @@
+/**
+ * @file coalesce.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 高频消息合并的内部头文件，在时间窗口内将同类消息合并为一次回调
+ * @version 0.1
+ * @date 2023-02-10
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_COALESCE_H__
+#define __BLIVE_COALESCE_H__
+
+#include "blive_def.h"
+
+
+typedef struct blive_coalescer blive_coalescer;
+
+/**
+ * @brief 合并窗口到期后，将合并结果交给回调分发的函数
+ *
+ * @param [in] entity 直播间实体
+ * @param [in] type 消息类型
+ * @param [in] json_obj 合并后的消息，所有权转交
+ * @param [in] recv_ns 窗口内最后一条消息的接收时间
+ */
+typedef void (*blive_coalesce_emit)(blive* entity, blive_info_type type, cJSON* json_obj, uint64_t recv_ns);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 判断指定类型的消息是否开启了合并
+ *
+ * @param [in] entity 直播间实体
+ * @param [in] type 消息类型
+ * @return Bool
+ */
+Bool blive_coalesce_enabled(blive* entity, blive_info_type type);
+
+/**
+ * @brief 将一条消息放入合并窗口，窗口已到期时先把上一个窗口的结果分发出去
+ *
+ * @param [in] entity 直播间实体
+ * @param [in] type 消息类型
+ * @param [in] json_obj 消息内容，所有权转交
+ * @param [in] recv_ns 消息的接收时间
+ * @param [in] emit 分发函数
+ */
+void blive_coalesce_push(blive* entity, blive_info_type type, cJSON* json_obj, uint64_t recv_ns, blive_coalesce_emit emit);
+
+/**
+ * @brief 分发所有已到期窗口的合并结果
+ *
+ * @param [in] entity 直播间实体
+ * @param [in] emit 分发函数
+ */
+void blive_coalesce_flush(blive* entity, blive_coalesce_emit emit);
+
+/**
+ * @brief 计算距离最近一个窗口到期的毫秒数，用作blive_perform等待socket的超时时间
+ *
+ * @param [in] entity 直播间实体
+ * @return int 毫秒数，没有待分发的合并结果时返回-1
+ */
+int blive_coalesce_timeout(blive* entity);
+
+/**
+ * @brief 释放合并状态，尚未分发的合并结果直接丢弃
+ *
+ * @param [in] entity 直播间实体
+ */
+void blive_coalesce_destroy(blive* entity);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
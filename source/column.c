@@ -0,0 +1,1070 @@
+/**
+ * @file column.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 列式事件文件：写入时按行组缓存各列的值，行组写满后逐列编码写入，只在写入时从原文中提取一次字段；
+ *          读取时先按行组目录中的最小最大值与字典判断行组能否跳过，再只解码条件涉及的列，
+ *          每批最多BLIVE_COLUMN_BATCH行在解码后的数组上逐个条件收窄选择向量，
+ *          最后只为选中的行取出投影的列。统计某个字段时只访问该列的列块，不再读取消息原文
+ * @version 0.1
+ * @date 2023-02-27
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "column.h"
+#include "field.h"
+#include "msg.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define COLUMN_DICT_SLOTS           (BLIVE_COLUMN_GROUP_ROWS * 2)   /*字典哈希表的槽数，为2的幂*/
+#define COLUMN_STRING_INIT          (64 * 1024)
+
+/**
+ * @brief 列的定义：来源字段与编码方式
+ * 
+ */
+typedef struct {
+    const char*             name;               /*不从原文提取的列的列名，其余列与字段同名*/
+    int                     field;              /*blive_field_id，-1为不从原文提取*/
+    blive_column_encoding   encoding;
+} column_def;
+
+/**
+ * @brief 写入时一个字符串列在当前行组内的内容。DICT为去重后的字典项，PLAIN为每行一项；
+ *          offsets[i]与offsets[i + 1]之间为第i项，offsets[0]总是0
+ * 
+ */
+typedef struct {
+    char*       data;
+    size_t      size;
+    size_t      capacity;
+    uint32_t*   offsets;
+    uint32_t    num;
+    uint32_t*   slots;                          /*DICT的哈希表，存放编码，0为空位*/
+} column_strings;
+
+struct blive_column_writer {
+    FILE*               file;
+    char                path[1024];
+    char                tmp[1040];
+    uint64_t            offset;                 /*下一个列块的写入位置*/
+    uint32_t            rows;                   /*当前行组的行数*/
+    uint32_t            group_num;
+    uint64_t            row_num;                /*已写入行组的总行数*/
+    uint64_t*           values[BLIVE_COLUMN_MAX];   /*当前行组的数值列与字典编码*/
+    column_strings      strs[BLIVE_COLUMN_MAX];
+    char*               directory;              /*已写入行组的目录*/
+    size_t              directory_size;
+    size_t              directory_capacity;
+    uint64_t*           words;                  /*列块的编码缓冲区*/
+    size_t              word_capacity;          /*字节数*/
+};
+
+struct blive_column_reader {
+    char*                       base;           /*文件的只读映射*/
+    size_t                      size;
+    const blive_column_header*  header;
+    const char*                 directory;
+    size_t                      group_size;     /*行组目录中每个行组的长度*/
+    blive_column_stats          stats;          /*概况在打开时填写，读取统计原子累加*/
+};
+
+/**
+ * @brief 读取时一个列在当前行组内的解码状态
+ * 
+ */
+typedef struct {
+    Bool                touched;                /*本行组是否访问过该列块*/
+    Bool                decoded;                /*values是否已解码*/
+    Bool                dict_loaded;
+    uint64_t*           values;                 /*解码后的数值或字典编码*/
+    blive_column_str*   dict;                   /*DICT的字典，下标为编码，0为字段不存在*/
+    uint32_t            dict_num;
+    uint32_t            dict_capacity;
+    const uint32_t*     offsets;                /*PLAIN的偏移*/
+    const char*         data;                   /*PLAIN的内容*/
+    uint64_t*           out;                    /*交付的数值*/
+    blive_column_str*   out_strs;               /*交付的字符串*/
+} column_cursor;
+
+/**
+ * @brief 一次读取的状态
+ * 
+ */
+typedef struct {
+    column_cursor       cursors[BLIVE_COLUMN_MAX];
+    Bool                projected[BLIVE_COLUMN_MAX];
+    uint64_t*           cmps;                   /*各条件在当前行组内的比较值，字符串条件为字典编码*/
+    uint32_t            sel[BLIVE_COLUMN_BATCH];
+    uint64_t            touched_bytes;
+} column_scan;
+
+static const column_def column_schema[BLIVE_COLUMN_MAX] = {
+    [BLIVE_COLUMN_TYPE]         = {"type",      -1,                         BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_ROOM_ID]      = {"room_id",   -1,                         BLIVE_COLUMN_ENC_DELTA},
+    [BLIVE_COLUMN_WALL_NS]      = {"wall_ns",   -1,                         BLIVE_COLUMN_ENC_DELTA},
+    [BLIVE_COLUMN_TIMESTAMP]    = {NULL,        BLIVE_FIELD_TIMESTAMP,      BLIVE_COLUMN_ENC_DELTA},
+    [BLIVE_COLUMN_UID]          = {NULL,        BLIVE_FIELD_UID,            BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_UNAME]        = {NULL,        BLIVE_FIELD_UNAME,          BLIVE_COLUMN_ENC_DICT},
+    [BLIVE_COLUMN_MEDAL_NAME]   = {NULL,        BLIVE_FIELD_MEDAL_NAME,     BLIVE_COLUMN_ENC_DICT},
+    [BLIVE_COLUMN_MEDAL_LEVEL]  = {NULL,        BLIVE_FIELD_MEDAL_LEVEL,    BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_USER_LEVEL]   = {NULL,        BLIVE_FIELD_USER_LEVEL,     BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_GUARD_LEVEL]  = {NULL,        BLIVE_FIELD_GUARD_LEVEL,    BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_TEXT]         = {NULL,        BLIVE_FIELD_TEXT,           BLIVE_COLUMN_ENC_PLAIN},
+    [BLIVE_COLUMN_GIFT_ID]      = {NULL,        BLIVE_FIELD_GIFT_ID,        BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_GIFT_NAME]    = {NULL,        BLIVE_FIELD_GIFT_NAME,      BLIVE_COLUMN_ENC_DICT},
+    [BLIVE_COLUMN_GIFT_NUM]     = {NULL,        BLIVE_FIELD_NUM,            BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_PRICE]        = {NULL,        BLIVE_FIELD_PRICE,          BLIVE_COLUMN_ENC_BITPACK},
+    [BLIVE_COLUMN_MSG_TYPE]     = {NULL,        BLIVE_FIELD_MSG_TYPE,       BLIVE_COLUMN_ENC_BITPACK},
+};
+
+
+static int column_flush(blive_column_writer* writer);
+static int chunk_encode(blive_column_writer* writer, blive_column_id column, blive_column_chunk* chunk);
+static int words_reserve(blive_column_writer* writer, size_t size);
+static int strings_add(column_strings* strs, const char* str, int len, Bool dedup, uint32_t* code);
+static int scan_prune(blive_column_reader* reader, const blive_column_chunk* chunks, const blive_column_pred* preds,
+                      int pred_num, column_scan* scan);
+static int scan_decode(blive_column_reader* reader, const blive_column_chunk* chunk, uint32_t rows,
+                       blive_column_id column, column_scan* scan);
+static int dict_load(blive_column_reader* reader, const blive_column_chunk* chunk, column_cursor* cursor);
+static uint32_t pred_filter(const uint64_t* values, uint32_t* sel, uint32_t sel_num, blive_column_op op, uint64_t cmp);
+static Bool pred_possible(blive_column_op op, uint64_t cmp, uint64_t min, uint64_t max);
+static void bits_pack(uint64_t* words, uint32_t bits, size_t index, uint64_t value);
+static void bits_unpack(const uint64_t* words, uint32_t bits, size_t begin, size_t num, uint64_t base, uint64_t* out);
+static uint32_t bits_of(uint64_t value);
+
+
+int blive_column_create(blive_column_writer** writer, const char* path)
+{
+    blive_column_header     header = {0};
+
+    if (writer == NULL || path == NULL) {
+        return ERROR;
+    }
+
+    *writer = calloc(1, sizeof(blive_column_writer));
+    if (*writer == NULL) {
+        return ERROR;
+    }
+    snprintf((*writer)->path, sizeof((*writer)->path), "%s", path);
+    snprintf((*writer)->tmp, sizeof((*writer)->tmp), "%s.tmp", path);
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        if (column_schema[column].encoding == BLIVE_COLUMN_ENC_PLAIN) {
+            (*writer)->strs[column].offsets = calloc(BLIVE_COLUMN_GROUP_ROWS + 1, sizeof(uint32_t));
+            if ((*writer)->strs[column].offsets == NULL) {
+                goto fail;
+            }
+            continue;
+        }
+        if (((*writer)->values[column] = malloc(sizeof(uint64_t) * BLIVE_COLUMN_GROUP_ROWS)) == NULL) {
+            goto fail;
+        }
+        if (column_schema[column].encoding == BLIVE_COLUMN_ENC_DICT) {
+            (*writer)->strs[column].offsets = calloc(BLIVE_COLUMN_GROUP_ROWS + 1, sizeof(uint32_t));
+            (*writer)->strs[column].slots = calloc(COLUMN_DICT_SLOTS, sizeof(uint32_t));
+            if ((*writer)->strs[column].offsets == NULL || (*writer)->strs[column].slots == NULL) {
+                goto fail;
+            }
+        }
+    }
+
+    /*头部在写入目录后回填*/
+    if (((*writer)->file = fopen((*writer)->tmp, "wb")) == NULL) {
+        blive_loge("open column file %s failed: %s", (*writer)->tmp, strerror(errno));
+        goto fail;
+    }
+    if (fwrite(&header, sizeof(header), 1, (*writer)->file) != 1) {
+        goto fail;
+    }
+    (*writer)->offset = sizeof(header);
+    return OK;
+
+fail:
+    if ((*writer)->file != NULL) {
+        fclose((*writer)->file);
+        unlink((*writer)->tmp);
+        (*writer)->file = NULL;
+    }
+    blive_column_finish(*writer);
+    *writer = NULL;
+    return ERROR;
+}
+
+int blive_column_write(blive_column_writer* writer, uint64_t room_id, uint64_t wall_ns, const char* raw, int len)
+{
+    int                 type = 0;
+    uint32_t            row = 0;
+    uint64_t            value = 0;
+    uint32_t            code = 0;
+    blive_field_value   field = {0};
+
+    if (writer == NULL || writer->file == NULL || raw == NULL) {
+        return ERROR;
+    }
+    type = blive_msg_type_lookup(raw, len);
+    if (type != BLIVE_INFO_DANMU_MSG && type != BLIVE_INFO_INTERACT_WORD && type != BLIVE_INFO_SEND_GIFT
+        && type != BLIVE_INFO_COMBO_SEND) {
+        return 0;
+    }
+
+    row = writer->rows;
+    writer->values[BLIVE_COLUMN_TYPE][row] = type;
+    writer->values[BLIVE_COLUMN_ROOM_ID][row] = room_id;
+    writer->values[BLIVE_COLUMN_WALL_NS][row] = wall_ns;
+    for (int column = BLIVE_COLUMN_WALL_NS + 1; column < BLIVE_COLUMN_MAX; column++) {
+        if (blive_field_extract(type, raw, len, column_schema[column].field, &field) != OK) {
+            field.kind = BLIVE_FIELD_NONE;
+        }
+        switch (column_schema[column].encoding) {
+        case BLIVE_COLUMN_ENC_DICT:
+        case BLIVE_COLUMN_ENC_PLAIN:
+            code = 0;
+            if (field.kind == BLIVE_FIELD_STRING || column_schema[column].encoding == BLIVE_COLUMN_ENC_PLAIN) {
+                if (strings_add(&writer->strs[column], field.kind == BLIVE_FIELD_STRING ? field.str : "",
+                                field.kind == BLIVE_FIELD_STRING ? field.str_len : 0,
+                                column_schema[column].encoding == BLIVE_COLUMN_ENC_DICT, &code) != OK) {
+                    return ERROR;
+                }
+            }
+            if (writer->values[column] != NULL) {
+                writer->values[column][row] = code;
+            }
+            break;
+        default:
+            value = field.kind == BLIVE_FIELD_NUMBER && field.number > 0 ? (uint64_t)field.number : 0;
+            /*弹幕的服务端时间为毫秒，其他类型为秒*/
+            if (column == BLIVE_COLUMN_TIMESTAMP && type != BLIVE_INFO_DANMU_MSG) {
+                value *= 1000;
+            }
+            writer->values[column][row] = value;
+            break;
+        }
+    }
+
+    if (++writer->rows == BLIVE_COLUMN_GROUP_ROWS && column_flush(writer) != OK) {
+        return ERROR;
+    }
+    return 1;
+}
+
+int blive_column_finish(blive_column_writer* writer)
+{
+    blive_column_header     header = {0};
+    int                     retval = ERROR;
+
+    if (writer == NULL) {
+        return ERROR;
+    }
+
+    if (writer->file != NULL && column_flush(writer) == OK) {
+        header.magic = BLIVE_COLUMN_MAGIC;
+        header.version = BLIVE_COLUMN_VERSION;
+        header.header_size = sizeof(header);
+        header.column_num = BLIVE_COLUMN_MAX;
+        header.group_num = writer->group_num;
+        header.row_num = writer->row_num;
+        header.directory = writer->offset;
+        if (fwrite(writer->directory, 1, writer->directory_size, writer->file) == writer->directory_size
+            && fseek(writer->file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, writer->file) == 1) {
+            retval = OK;
+        }
+    }
+    if (writer->file != NULL) {
+        if (fclose(writer->file) != 0) {
+            retval = ERROR;
+        }
+        if (retval == OK && rename(writer->tmp, writer->path) != 0) {
+            retval = ERROR;
+        }
+        if (retval != OK) {
+            blive_loge("save column file %s failed: %s", writer->path, strerror(errno));
+            unlink(writer->tmp);
+        }
+    }
+
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        free(writer->values[column]);
+        free(writer->strs[column].data);
+        free(writer->strs[column].offsets);
+        free(writer->strs[column].slots);
+    }
+    free(writer->directory);
+    free(writer->words);
+    free(writer);
+    return retval;
+}
+
+int blive_column_open(blive_column_reader** reader, const char* path)
+{
+    int                         fd = -1;
+    struct stat                 st = {0};
+    const blive_column_group*   group = NULL;
+    const blive_column_chunk*   chunks = NULL;
+    const blive_column_header*  header = NULL;
+
+    if (reader == NULL || path == NULL) {
+        return ERROR;
+    }
+
+    *reader = calloc(1, sizeof(blive_column_reader));
+    if (*reader == NULL) {
+        return ERROR;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(blive_column_header)) {
+        blive_loge("open column file %s failed: %s", path, strerror(errno));
+        goto fail;
+    }
+    (*reader)->size = st.st_size;
+    (*reader)->base = mmap(NULL, (*reader)->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    fd = -1;
+    if ((*reader)->base == MAP_FAILED) {
+        (*reader)->base = NULL;
+        blive_loge("map column file %s failed: %s", path, strerror(errno));
+        goto fail;
+    }
+    /*按行组随机访问列块，不需要预读*/
+    madvise((*reader)->base, (*reader)->size, MADV_RANDOM);
+
+    header = (*reader)->header = (const blive_column_header*)(*reader)->base;
+    (*reader)->group_size = sizeof(blive_column_group) + sizeof(blive_column_chunk) * BLIVE_COLUMN_MAX;
+    if (header->magic != BLIVE_COLUMN_MAGIC || header->version != BLIVE_COLUMN_VERSION
+        || header->column_num != BLIVE_COLUMN_MAX || header->directory < header->header_size
+        || header->directory > (*reader)->size
+        || ((*reader)->size - header->directory) / (*reader)->group_size < header->group_num) {
+        blive_loge("invalid column file %s", path);
+        goto fail;
+    }
+    (*reader)->directory = (*reader)->base + header->directory;
+
+    /*检查所有列块都在目录之前且编码与列定义一致，读取时不再检查位置*/
+    for (uint32_t i = 0; i < header->group_num; i++) {
+        group = (const blive_column_group*)((*reader)->directory + (*reader)->group_size * i);
+        chunks = (const blive_column_chunk*)(group + 1);
+        if (group->rows == 0 || group->rows > BLIVE_COLUMN_GROUP_ROWS) {
+            blive_loge("invalid column group %u in %s", i, path);
+            goto fail;
+        }
+        for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+            if (chunks[column].offset < header->header_size || chunks[column].offset % 8 != 0
+                || chunks[column].offset > header->directory || chunks[column].size > header->directory - chunks[column].offset
+                || chunks[column].encoding != column_schema[column].encoding || chunks[column].bits > 64) {
+                blive_loge("invalid column chunk %d of group %u in %s", column, i, path);
+                goto fail;
+            }
+            (*reader)->stats.column_bytes[column] += chunks[column].size;
+        }
+    }
+    (*reader)->stats.rows = header->row_num;
+    (*reader)->stats.groups = header->group_num;
+    (*reader)->stats.file_bytes = (*reader)->size;
+    return OK;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    blive_column_close(*reader);
+    *reader = NULL;
+    return ERROR;
+}
+
+int blive_column_close(blive_column_reader* reader)
+{
+    if (reader == NULL) {
+        return ERROR;
+    }
+
+    if (reader->base != NULL) {
+        munmap(reader->base, reader->size);
+    }
+    free(reader);
+    return OK;
+}
+
+int blive_column_lookup(const char* name)
+{
+    const char*     column_name = NULL;
+
+    if (name == NULL) {
+        return ERROR;
+    }
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        column_name = column_schema[column].field >= 0 ? blive_field_name(column_schema[column].field)
+                                                       : column_schema[column].name;
+        if (column_name != NULL && strcmp(name, column_name) == 0) {
+            return column;
+        }
+    }
+    return ERROR;
+}
+
+int blive_get_column_stats(blive_column_reader* reader, blive_column_stats* stats)
+{
+    if (reader == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    *stats = reader->stats;
+    stats->scanned_groups = __atomic_load_n(&reader->stats.scanned_groups, __ATOMIC_RELAXED);
+    stats->skipped_groups = __atomic_load_n(&reader->stats.skipped_groups, __ATOMIC_RELAXED);
+    stats->touched_bytes = __atomic_load_n(&reader->stats.touched_bytes, __ATOMIC_RELAXED);
+    return OK;
+}
+
+int blive_column_scan(blive_column_reader* reader, const blive_column_id* columns, int column_num,
+                      const blive_column_pred* preds, int pred_num, blive_column_handler handler, void* usr_data)
+{
+    column_scan*                scan = NULL;
+    column_cursor*              cursor = NULL;
+    const blive_column_group*   group = NULL;
+    const blive_column_chunk*   chunks = NULL;
+    blive_column_batch          batch = {0};
+    blive_column_encoding       encoding = BLIVE_COLUMN_ENC_BITPACK;
+    Bool                        needed[BLIVE_COLUMN_MAX] = {False};
+    uint32_t                    num = 0;
+    uint32_t                    sel_num = 0;
+    uint32_t                    row = 0;
+    int                         count = 0;
+    uint64_t                    scanned = 0;
+    uint64_t                    skipped = 0;
+
+    if (reader == NULL || handler == NULL || (columns == NULL && column_num > 0) || (preds == NULL && pred_num > 0)) {
+        return ERROR;
+    }
+
+    /*字符串条件只能比较相等，PLAIN列没有字典，不支持条件*/
+    for (int i = 0; i < pred_num; i++) {
+        if (preds[i].column >= BLIVE_COLUMN_MAX || preds[i].op > BLIVE_COLUMN_GE) {
+            return ERROR;
+        }
+        encoding = column_schema[preds[i].column].encoding;
+        if (encoding == BLIVE_COLUMN_ENC_PLAIN || (encoding == BLIVE_COLUMN_ENC_DICT) != (preds[i].str != NULL)
+            || (encoding == BLIVE_COLUMN_ENC_DICT && preds[i].op != BLIVE_COLUMN_EQ && preds[i].op != BLIVE_COLUMN_NE)) {
+            return ERROR;
+        }
+        needed[preds[i].column] = True;
+    }
+    for (int i = 0; i < column_num; i++) {
+        if (columns[i] >= BLIVE_COLUMN_MAX) {
+            return ERROR;
+        }
+        needed[columns[i]] = True;
+    }
+
+    if ((scan = calloc(1, sizeof(column_scan))) == NULL
+        || (pred_num > 0 && (scan->cmps = calloc(pred_num, sizeof(uint64_t))) == NULL)) {
+        free(scan);
+        return ERROR;
+    }
+    for (int i = 0; i < column_num; i++) {
+        scan->projected[columns[i]] = True;
+    }
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        cursor = &scan->cursors[column];
+        if (!needed[column]) {
+            continue;
+        }
+        if (column_schema[column].encoding != BLIVE_COLUMN_ENC_PLAIN
+            && (cursor->values = malloc(sizeof(uint64_t) * BLIVE_COLUMN_GROUP_ROWS)) == NULL) {
+            count = ERROR;
+            goto out;
+        }
+        if (scan->projected[column] && column_schema[column].encoding < BLIVE_COLUMN_ENC_DICT
+            && (cursor->out = malloc(sizeof(uint64_t) * BLIVE_COLUMN_BATCH)) == NULL) {
+            count = ERROR;
+            goto out;
+        }
+        if (scan->projected[column] && column_schema[column].encoding >= BLIVE_COLUMN_ENC_DICT
+            && (cursor->out_strs = malloc(sizeof(blive_column_str) * BLIVE_COLUMN_BATCH)) == NULL) {
+            count = ERROR;
+            goto out;
+        }
+    }
+
+    for (uint32_t g = 0; g < reader->header->group_num && count != ERROR; g++) {
+        group = (const blive_column_group*)(reader->directory + reader->group_size * g);
+        chunks = (const blive_column_chunk*)(group + 1);
+        for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+            scan->cursors[column].touched = False;
+            scan->cursors[column].decoded = False;
+            scan->cursors[column].dict_loaded = False;
+        }
+        if (scan_prune(reader, chunks, preds, pred_num, scan) != OK) {
+            skipped++;
+            continue;
+        }
+        scanned++;
+
+        /*条件涉及的列整个行组一次解码，投影的列在有行选中时才解码*/
+        for (int i = 0; i < pred_num && count != ERROR; i++) {
+            if (scan_decode(reader, &chunks[preds[i].column], group->rows, preds[i].column, scan) != OK) {
+                count = ERROR;
+            }
+        }
+        for (uint32_t begin = 0; begin < group->rows && count != ERROR; begin += BLIVE_COLUMN_BATCH) {
+            num = group->rows - begin < BLIVE_COLUMN_BATCH ? group->rows - begin : BLIVE_COLUMN_BATCH;
+            for (uint32_t i = 0; i < num; i++) {
+                scan->sel[i] = i;
+            }
+            sel_num = num;
+            for (int i = 0; i < pred_num && sel_num > 0; i++) {
+                sel_num = pred_filter(scan->cursors[preds[i].column].values + begin, scan->sel, sel_num,
+                                      preds[i].op, scan->cmps[i]);
+            }
+            if (sel_num == 0) {
+                continue;
+            }
+
+            memset(&batch, 0, sizeof(batch));
+            batch.rows = sel_num;
+            for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+                if (!scan->projected[column]) {
+                    continue;
+                }
+                if (scan_decode(reader, &chunks[column], group->rows, column, scan) != OK) {
+                    count = ERROR;
+                    break;
+                }
+                cursor = &scan->cursors[column];
+                switch (column_schema[column].encoding) {
+                case BLIVE_COLUMN_ENC_DICT:
+                    for (uint32_t i = 0; i < sel_num; i++) {
+                        cursor->out_strs[i] = cursor->dict[cursor->values[begin + scan->sel[i]]];
+                    }
+                    batch.strs[column] = cursor->out_strs;
+                    break;
+                case BLIVE_COLUMN_ENC_PLAIN:
+                    for (uint32_t i = 0; i < sel_num; i++) {
+                        row = begin + scan->sel[i];
+                        cursor->out_strs[i].str = cursor->data + cursor->offsets[row];
+                        cursor->out_strs[i].len = cursor->offsets[row + 1] - cursor->offsets[row];
+                    }
+                    batch.strs[column] = cursor->out_strs;
+                    break;
+                default:
+                    /*整批选中时直接交付解码后的数组*/
+                    if (sel_num == num) {
+                        batch.values[column] = cursor->values + begin;
+                        break;
+                    }
+                    for (uint32_t i = 0; i < sel_num; i++) {
+                        cursor->out[i] = cursor->values[begin + scan->sel[i]];
+                    }
+                    batch.values[column] = cursor->out;
+                    break;
+                }
+            }
+            if (count == ERROR) {
+                break;
+            }
+            count += sel_num;
+            if (handler(&batch, usr_data) == ERROR) {
+                g = reader->header->group_num;
+                break;
+            }
+        }
+    }
+
+out:
+    __atomic_fetch_add(&reader->stats.scanned_groups, scanned, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&reader->stats.skipped_groups, skipped, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&reader->stats.touched_bytes, scan->touched_bytes, __ATOMIC_RELAXED);
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        free(scan->cursors[column].values);
+        free(scan->cursors[column].dict);
+        free(scan->cursors[column].out);
+        free(scan->cursors[column].out_strs);
+    }
+    free(scan->cmps);
+    free(scan);
+    return count;
+}
+
+static int column_flush(blive_column_writer* writer)
+{
+    blive_column_group      group = {0};
+    blive_column_chunk      chunk = {0};
+    char*                   bigger = NULL;
+    size_t                  need = writer->directory_size + sizeof(group) + sizeof(chunk) * BLIVE_COLUMN_MAX;
+    int                     size = 0;
+
+    if (writer->rows == 0) {
+        return OK;
+    }
+    if (need > writer->directory_capacity) {
+        if ((bigger = realloc(writer->directory, need * 2)) == NULL) {
+            return ERROR;
+        }
+        writer->directory = bigger;
+        writer->directory_capacity = need * 2;
+    }
+
+    group.rows = writer->rows;
+    group.first_row = writer->row_num;
+    memcpy(writer->directory + writer->directory_size, &group, sizeof(group));
+    writer->directory_size += sizeof(group);
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        memset(&chunk, 0, sizeof(chunk));
+        if ((size = chunk_encode(writer, column, &chunk)) == ERROR) {
+            return ERROR;
+        }
+        /*编码缓冲区按8字节清零过，补齐的部分直接写出*/
+        chunk.offset = writer->offset;
+        chunk.size = size;
+        chunk.encoding = column_schema[column].encoding;
+        if (fwrite(writer->words, 1, BLIVE_COLUMN_ALIGN(size), writer->file) != BLIVE_COLUMN_ALIGN(size)) {
+            blive_loge("write column file %s failed: %s", writer->tmp, strerror(errno));
+            return ERROR;
+        }
+        writer->offset += BLIVE_COLUMN_ALIGN(size);
+        memcpy(writer->directory + writer->directory_size, &chunk, sizeof(chunk));
+        writer->directory_size += sizeof(chunk);
+    }
+
+    writer->row_num += writer->rows;
+    writer->rows = 0;
+    writer->group_num++;
+    for (int column = 0; column < BLIVE_COLUMN_MAX; column++) {
+        writer->strs[column].size = 0;
+        writer->strs[column].num = 0;
+        if (writer->strs[column].slots != NULL) {
+            memset(writer->strs[column].slots, 0, sizeof(uint32_t) * COLUMN_DICT_SLOTS);
+        }
+    }
+    return OK;
+}
+
+static int chunk_encode(blive_column_writer* writer, blive_column_id column, blive_column_chunk* chunk)
+{
+    const uint64_t*     values = writer->values[column];
+    column_strings*     strs = &writer->strs[column];
+    uint32_t            rows = writer->rows;
+    uint64_t            min = UINT64_MAX;
+    uint64_t            max = 0;
+    int64_t             delta = 0;
+    int64_t             min_delta = 0;
+    uint64_t            spread = 0;
+    uint32_t            bits = 0;
+    uint32_t            num = 0;
+    size_t              pos = 0;
+    size_t              size = 0;
+
+    if (values != NULL) {
+        for (uint32_t i = 0; i < rows; i++) {
+            min = values[i] < min ? values[i] : min;
+            max = values[i] > max ? values[i] : max;
+        }
+    }
+
+    switch (column_schema[column].encoding) {
+    case BLIVE_COLUMN_ENC_BITPACK:
+        bits = bits_of(max - min);
+        size = ((size_t)rows * bits + 63) / 64 * 8;
+        if (words_reserve(writer, size) != OK) {
+            return ERROR;
+        }
+        for (uint32_t i = 0; bits > 0 && i < rows; i++) {
+            bits_pack(writer->words, bits, i, values[i] - min);
+        }
+        chunk->min = min;
+        chunk->max = max;
+        chunk->bits = bits;
+        return size;
+
+    case BLIVE_COLUMN_ENC_DELTA:
+        size = 8 + (rows / BLIVE_COLUMN_DELTA_BLOCK + 1) * 16 + (size_t)rows * 8;
+        if (words_reserve(writer, size) != OK) {
+            return ERROR;
+        }
+        writer->words[0] = values[0];
+        pos = 1;
+        for (uint32_t begin = 1; begin < rows; begin += BLIVE_COLUMN_DELTA_BLOCK) {
+            num = rows - begin < BLIVE_COLUMN_DELTA_BLOCK ? rows - begin : BLIVE_COLUMN_DELTA_BLOCK;
+            min_delta = INT64_MAX;
+            for (uint32_t i = begin; i < begin + num; i++) {
+                delta = (int64_t)(values[i] - values[i - 1]);
+                min_delta = delta < min_delta ? delta : min_delta;
+            }
+            spread = 0;
+            for (uint32_t i = begin; i < begin + num; i++) {
+                delta = (int64_t)(values[i] - values[i - 1]);
+                spread = (uint64_t)(delta - min_delta) > spread ? (uint64_t)(delta - min_delta) : spread;
+            }
+            bits = bits_of(spread);
+            writer->words[pos++] = (uint64_t)min_delta;
+            writer->words[pos++] = bits;
+            for (uint32_t i = 0; bits > 0 && i < num; i++) {
+                bits_pack(writer->words + pos, bits, i, (uint64_t)((int64_t)(values[begin + i] - values[begin + i - 1]) - min_delta));
+            }
+            pos += ((size_t)num * bits + 63) / 64;
+        }
+        chunk->min = min;
+        chunk->max = max;
+        return pos * 8;
+
+    case BLIVE_COLUMN_ENC_DICT:
+        bits = bits_of(strs->num);
+        pos = BLIVE_COLUMN_ALIGN(8 + sizeof(uint32_t) * (strs->num + 1) + strs->size);
+        size = pos + ((size_t)rows * bits + 63) / 64 * 8;
+        if (words_reserve(writer, size) != OK) {
+            return ERROR;
+        }
+        ((uint32_t*)writer->words)[0] = strs->num;
+        ((uint32_t*)writer->words)[1] = strs->size;
+        memcpy((char*)writer->words + 8, strs->offsets, sizeof(uint32_t) * (strs->num + 1));
+        memcpy((char*)writer->words + 8 + sizeof(uint32_t) * (strs->num + 1), strs->data, strs->size);
+        for (uint32_t i = 0; bits > 0 && i < rows; i++) {
+            bits_pack((uint64_t*)((char*)writer->words + pos), bits, i, values[i]);
+        }
+        chunk->max = strs->num;
+        chunk->bits = bits;
+        return size;
+
+    default:
+        size = sizeof(uint32_t) * (rows + 1) + strs->size;
+        if (words_reserve(writer, size) != OK) {
+            return ERROR;
+        }
+        memcpy(writer->words, strs->offsets, sizeof(uint32_t) * (rows + 1));
+        memcpy((char*)writer->words + sizeof(uint32_t) * (rows + 1), strs->data, strs->size);
+        chunk->max = strs->size;
+        return size;
+    }
+}
+
+static int words_reserve(blive_column_writer* writer, size_t size)
+{
+    uint64_t*   bigger = NULL;
+
+    size = BLIVE_COLUMN_ALIGN(size);
+    if (size > writer->word_capacity) {
+        if ((bigger = realloc(writer->words, size)) == NULL) {
+            return ERROR;
+        }
+        writer->words = bigger;
+        writer->word_capacity = size;
+    }
+    memset(writer->words, 0, size);
+    return OK;
+}
+
+static int strings_add(column_strings* strs, const char* str, int len, Bool dedup, uint32_t* code)
+{
+    uint64_t    hash = 0xcbf29ce484222325ULL;
+    uint32_t    pos = 0;
+    uint32_t    found = 0;
+    char*       bigger = NULL;
+    size_t      capacity = 0;
+
+    if (dedup) {
+        for (int i = 0; i < len; i++) {
+            hash = (hash ^ (uint8_t)str[i]) * 0x100000001b3ULL;
+        }
+        for (pos = hash & (COLUMN_DICT_SLOTS - 1); (found = strs->slots[pos]) != 0; pos = (pos + 1) & (COLUMN_DICT_SLOTS - 1)) {
+            if (strs->offsets[found] - strs->offsets[found - 1] == (uint32_t)len
+                && memcmp(strs->data + strs->offsets[found - 1], str, len) == 0) {
+                *code = found;
+                return OK;
+            }
+        }
+    }
+
+    if (strs->size + len > strs->capacity) {
+        for (capacity = strs->capacity ? strs->capacity : COLUMN_STRING_INIT; capacity < strs->size + len; capacity *= 2);
+        if (capacity > UINT32_MAX || (bigger = realloc(strs->data, capacity)) == NULL) {
+            return ERROR;
+        }
+        strs->data = bigger;
+        strs->capacity = capacity;
+    }
+    memcpy(strs->data + strs->size, str, len);
+    strs->size += len;
+    strs->offsets[++strs->num] = strs->size;
+    if (dedup) {
+        strs->slots[pos] = strs->num;
+    }
+    *code = strs->num;
+    return OK;
+}
+
+static int scan_prune(blive_column_reader* reader, const blive_column_chunk* chunks, const blive_column_pred* preds,
+                      int pred_num, column_scan* scan)
+{
+    column_cursor*      cursor = NULL;
+    size_t              len = 0;
+
+    for (int i = 0; i < pred_num; i++) {
+        if (column_schema[preds[i].column].encoding != BLIVE_COLUMN_ENC_DICT) {
+            scan->cmps[i] = preds[i].value;
+            if (!pred_possible(preds[i].op, preds[i].value, chunks[preds[i].column].min, chunks[preds[i].column].max)) {
+                return ERROR;
+            }
+            continue;
+        }
+
+        /*字符串条件换成该行组字典中的编码，字典中没有时EQ不可能满足，NE总是满足*/
+        cursor = &scan->cursors[preds[i].column];
+        if (dict_load(reader, &chunks[preds[i].column], cursor) != OK) {
+            return ERROR;
+        }
+        scan->cmps[i] = UINT64_MAX;
+        len = strlen(preds[i].str);
+        for (uint32_t code = 1; code <= cursor->dict_num; code++) {
+            if (cursor->dict[code].len == len && memcmp(cursor->dict[code].str, preds[i].str, len) == 0) {
+                scan->cmps[i] = code;
+                break;
+            }
+        }
+        if (scan->cmps[i] == UINT64_MAX && preds[i].op == BLIVE_COLUMN_EQ) {
+            return ERROR;
+        }
+    }
+    return OK;
+}
+
+static int scan_decode(blive_column_reader* reader, const blive_column_chunk* chunk, uint32_t rows,
+                       blive_column_id column, column_scan* scan)
+{
+    column_cursor*      cursor = &scan->cursors[column];
+    const char*         data = reader->base + chunk->offset;
+    const uint64_t*     words = (const uint64_t*)data;
+    size_t              pos = 0;
+    uint32_t            num = 0;
+    uint32_t            bits = 0;
+    uint64_t            prev = 0;
+
+    if (cursor->decoded) {
+        return OK;
+    }
+    if (!cursor->touched) {
+        cursor->touched = True;
+        scan->touched_bytes += chunk->size;
+    }
+
+    switch (chunk->encoding) {
+    case BLIVE_COLUMN_ENC_BITPACK:
+        if (((size_t)rows * chunk->bits + 63) / 64 * 8 > chunk->size) {
+            return ERROR;
+        }
+        bits_unpack(words, chunk->bits, 0, rows, chunk->min, cursor->values);
+        break;
+
+    case BLIVE_COLUMN_ENC_DELTA:
+        if (chunk->size < 8) {
+            return ERROR;
+        }
+        prev = cursor->values[0] = words[0];
+        pos = 1;
+        for (uint32_t begin = 1; begin < rows; begin += BLIVE_COLUMN_DELTA_BLOCK) {
+            num = rows - begin < BLIVE_COLUMN_DELTA_BLOCK ? rows - begin : BLIVE_COLUMN_DELTA_BLOCK;
+            if ((pos + 2) * 8 > chunk->size || words[pos + 1] > 64
+                || (pos + 2 + ((size_t)num * words[pos + 1] + 63) / 64) * 8 > chunk->size) {
+                return ERROR;
+            }
+            bits = words[pos + 1];
+            bits_unpack(words + pos + 2, bits, 0, num, words[pos], cursor->values + begin);
+            for (uint32_t i = begin; i < begin + num; i++) {
+                prev = cursor->values[i] = prev + cursor->values[i];
+            }
+            pos += 2 + ((size_t)num * bits + 63) / 64;
+        }
+        break;
+
+    case BLIVE_COLUMN_ENC_DICT:
+        if (dict_load(reader, chunk, cursor) != OK) {
+            return ERROR;
+        }
+        pos = BLIVE_COLUMN_ALIGN(8 + sizeof(uint32_t) * (cursor->dict_num + 1) + ((const uint32_t*)data)[1]);
+        if (pos + ((size_t)rows * chunk->bits + 63) / 64 * 8 > chunk->size) {
+            return ERROR;
+        }
+        bits_unpack((const uint64_t*)(data + pos), chunk->bits, 0, rows, 0, cursor->values);
+        for (uint32_t i = 0; i < rows; i++) {
+            if (cursor->values[i] > cursor->dict_num) {
+                return ERROR;
+            }
+        }
+        break;
+
+    default:
+        cursor->offsets = (const uint32_t*)data;
+        cursor->data = data + sizeof(uint32_t) * (rows + 1);
+        if (sizeof(uint32_t) * (rows + 1) > chunk->size || cursor->offsets[0] != 0) {
+            return ERROR;
+        }
+        for (uint32_t i = 0; i < rows; i++) {
+            if (cursor->offsets[i + 1] < cursor->offsets[i]) {
+                return ERROR;
+            }
+        }
+        if (cursor->offsets[rows] > chunk->size - sizeof(uint32_t) * (rows + 1)) {
+            return ERROR;
+        }
+        break;
+    }
+
+    cursor->decoded = True;
+    return OK;
+}
+
+static int dict_load(blive_column_reader* reader, const blive_column_chunk* chunk, column_cursor* cursor)
+{
+    const char*         data = reader->base + chunk->offset;
+    const uint32_t*     offsets = (const uint32_t*)(data + 8);
+    const char*         strs = NULL;
+    uint32_t            num = 0;
+    uint32_t            size = 0;
+    blive_column_str*   bigger = NULL;
+
+    if (cursor->dict_loaded) {
+        return OK;
+    }
+    if (chunk->size < 8) {
+        return ERROR;
+    }
+    num = ((const uint32_t*)data)[0];
+    size = ((const uint32_t*)data)[1];
+    if (num > BLIVE_COLUMN_GROUP_ROWS || 8 + sizeof(uint32_t) * (num + 1) + (size_t)size > chunk->size
+        || offsets[0] != 0 || offsets[num] != size) {
+        return ERROR;
+    }
+    strs = data + 8 + sizeof(uint32_t) * (num + 1);
+    if (num + 1 > cursor->dict_capacity) {
+        if ((bigger = realloc(cursor->dict, sizeof(blive_column_str) * (num + 1))) == NULL) {
+            return ERROR;
+        }
+        cursor->dict = bigger;
+        cursor->dict_capacity = num + 1;
+    }
+
+    cursor->dict[0].str = NULL;
+    cursor->dict[0].len = 0;
+    for (uint32_t i = 0; i < num; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            return ERROR;
+        }
+        cursor->dict[i + 1].str = strs + offsets[i];
+        cursor->dict[i + 1].len = offsets[i + 1] - offsets[i];
+    }
+    cursor->dict_num = num;
+    cursor->dict_loaded = True;
+    return OK;
+}
+
+static uint32_t pred_filter(const uint64_t* values, uint32_t* sel, uint32_t sel_num, blive_column_op op, uint64_t cmp)
+{
+    uint32_t    num = 0;
+
+    /*无分支地收窄选择向量：总是写入，满足条件时才前进*/
+    switch (op) {
+    case BLIVE_COLUMN_EQ:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] == cmp;
+        }
+        break;
+    case BLIVE_COLUMN_NE:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] != cmp;
+        }
+        break;
+    case BLIVE_COLUMN_LT:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] < cmp;
+        }
+        break;
+    case BLIVE_COLUMN_LE:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] <= cmp;
+        }
+        break;
+    case BLIVE_COLUMN_GT:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] > cmp;
+        }
+        break;
+    case BLIVE_COLUMN_GE:
+        for (uint32_t i = 0; i < sel_num; i++) {
+            sel[num] = sel[i];
+            num += values[sel[i]] >= cmp;
+        }
+        break;
+    }
+    return num;
+}
+
+static Bool pred_possible(blive_column_op op, uint64_t cmp, uint64_t min, uint64_t max)
+{
+    switch (op) {
+    case BLIVE_COLUMN_EQ:
+        return cmp >= min && cmp <= max;
+    case BLIVE_COLUMN_NE:
+        return !(min == max && min == cmp);
+    case BLIVE_COLUMN_LT:
+        return min < cmp;
+    case BLIVE_COLUMN_LE:
+        return min <= cmp;
+    case BLIVE_COLUMN_GT:
+        return max > cmp;
+    case BLIVE_COLUMN_GE:
+        return max >= cmp;
+    }
+    return True;
+}
+
+static inline void bits_pack(uint64_t* words, uint32_t bits, size_t index, uint64_t value)
+{
+    size_t      pos = index * bits;
+    uint32_t    shift = pos & 63;
+
+    words[pos >> 6] |= value << shift;
+    if (shift + bits > 64) {
+        words[(pos >> 6) + 1] |= value >> (64 - shift);
+    }
+}
+
+static void bits_unpack(const uint64_t* words, uint32_t bits, size_t begin, size_t num, uint64_t base, uint64_t* out)
+{
+    uint64_t    mask = bits >= 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+    uint64_t    value = 0;
+    size_t      pos = 0;
+    uint32_t    shift = 0;
+
+    if (bits == 0) {
+        for (size_t i = 0; i < num; i++) {
+            out[i] = base;
+        }
+        return;
+    }
+    for (size_t i = 0; i < num; i++) {
+        pos = (begin + i) * bits;
+        shift = pos & 63;
+        value = words[pos >> 6] >> shift;
+        if (shift + bits > 64) {
+            value |= words[(pos >> 6) + 1] << (64 - shift);
+        }
+        out[i] = base + (value & mask);
+    }
+}
+
+static inline uint32_t bits_of(uint64_t value)
+{
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/**
+ * @file column.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 列式事件文件格式。文件以blive_column_header开头，之后依次是各个行组的列块，最后是行组目录。
+ *          每个行组最多BLIVE_COLUMN_GROUP_ROWS行，每列一个列块，列块从8字节对齐处开始；
+ *          行组目录中每个行组为blive_column_group加column_num个blive_column_chunk，
+ *          列块描述中带有该列在行组内的最小最大值，读取时据此跳过整个行组。所有字段为主机字节序。
+ *          列块的编码：
+ *          BITPACK：每个值减去min后按bits位依次存放在uint64_t中，低位在前；
+ *          DELTA：第一个值，之后每BLIVE_COLUMN_DELTA_BLOCK个差值一组：int64_t最小差值、uint64_t位数、按位存放的差值减最小差值；
+ *          DICT：uint32_t字符串数、uint32_t字符串总长度、uint32_t偏移[字符串数+1]、字符串内容，8字节对齐后是按bits位存放的编码，
+ *                编码0为字段不存在，1起为字典中的下标加1；
+ *          PLAIN：uint32_t偏移[行数+1]、字符串内容
+ * @version 0.1
+ * @date 2023-02-27
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_COLUMN_H__
+#define __BLIVE_COLUMN_H__
+
+#include "blive_def.h"
+
+
+#define BLIVE_COLUMN_MAGIC          0x314c4f43564c4221ULL   /*"!BLVCOL1"*/
+#define BLIVE_COLUMN_VERSION        1
+#define BLIVE_COLUMN_GROUP_ROWS     65536                   /*单个行组的最大行数*/
+#define BLIVE_COLUMN_BATCH          1024                    /*读取时每批交付的最大行数*/
+#define BLIVE_COLUMN_DELTA_BLOCK    128                     /*DELTA编码中共用一个位数的差值个数*/
+#define BLIVE_COLUMN_ALIGN(size)    (((size) + 7) & ~(size_t)7)
+
+typedef enum {
+    BLIVE_COLUMN_ENC_BITPACK,           /*减去最小值后按位存放*/
+    BLIVE_COLUMN_ENC_DELTA,             /*与前一个值的差值分组按位存放*/
+    BLIVE_COLUMN_ENC_DICT,              /*字符串字典加按位存放的编码*/
+    BLIVE_COLUMN_ENC_PLAIN,             /*字符串偏移加内容*/
+} blive_column_encoding;
+
+/**
+ * @brief 列式文件头部，固定64字节
+ * 
+ */
+typedef struct {
+    uint64_t    magic;                  /*BLIVE_COLUMN_MAGIC*/
+    uint32_t    version;                /*BLIVE_COLUMN_VERSION*/
+    uint32_t    header_size;            /*本头部长度，第一个列块从此处开始*/
+    uint32_t    column_num;             /*列数，与BLIVE_COLUMN_MAX一致*/
+    uint32_t    group_num;              /*行组数*/
+    uint64_t    row_num;                /*总行数*/
+    uint64_t    directory;              /*行组目录的偏移，写入完成前为0*/
+    uint64_t    reserved[3];
+} blive_column_header;
+
+/**
+ * @brief 一个列块的描述
+ * 
+ */
+typedef struct {
+    uint64_t    offset;                 /*列块在文件内的偏移*/
+    uint32_t    size;                   /*列块长度*/
+    uint8_t     encoding;               /*blive_column_encoding*/
+    uint8_t     bits;                   /*BITPACK的值位数或DICT的编码位数*/
+    uint16_t    reserved;
+    uint64_t    min;                    /*数值列的最小值，字符串列为0*/
+    uint64_t    max;                    /*数值列的最大值，字符串列为字典的字符串数或最长字符串长度*/
+} blive_column_chunk;
+
+/**
+ * @brief 行组目录中的一个行组，之后紧跟column_num个blive_column_chunk
+ * 
+ */
+typedef struct {
+    uint32_t    rows;                   /*行数*/
+    uint32_t    reserved;
+    uint64_t    first_row;              /*第一行在文件内的行号*/
+} blive_column_group;
+
+#endif  //__BLIVE_COLUMN_H__
\ No newline at end of file
@@ -8,6 +8,8 @@
  * @copyright Copyright (c) 2023
  */
 
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_CONN
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -16,6 +18,7 @@
 #include <ws2tcpip.h>
 #include <Windows.h>
 #else
+#include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -28,9 +31,25 @@
 #include "blive_internal.h"
 
 
+#define DANMU_INFO_URL  "https://api.live.bilibili.com/xlive/web-room/v1/index/getDanmuInfo"
+
+static char*    danmu_info_url = NULL;      /*替换的getDanmuInfo地址，NULL时使用DANMU_INFO_URL*/
+
 static int get_stream_auth_key(char** auth_key, blive_srv_ipaddr* hosts, CURL* handle, uint32_t room_id);
 
 
+int blive_set_danmu_info_url(const char* url)
+{
+    char*   copied = NULL;
+
+    if (url != NULL && (copied = strdup(url)) == NULL) {
+        return ERROR;
+    }
+    free(danmu_info_url);
+    danmu_info_url = copied;
+    return OK;
+}
+
 int blive_establish_connection(blive* entity, blive_schedule_func schedule_func, void* schedule_entity)
 {
     if (entity == NULL || schedule_func == NULL) {
@@ -49,11 +68,14 @@ int blive_establish_connection(blive* entity, blive_schedule_func schedule_func,
         return ERROR;
     }
 
-    /*设置定时器事件，30秒后发送心跳包*/
+    /*设置定时器事件，30秒后发送心跳包；重连时之前注册的心跳定时器仍在循环，不再重复注册*/
     entity->sched_func = schedule_func;
     entity->sched_entity = schedule_entity;
-    if (schedule_func(schedule_entity, 30 * 1000, (blive_schedule_cb)blive_send_heartbeat, entity) != OK) {
-        return ERROR;
+    if (!entity->heartbeat_armed) {
+        if (schedule_func(schedule_entity, 30 * 1000, (blive_schedule_cb)blive_send_heartbeat, entity) != OK) {
+            return ERROR;
+        }
+        entity->heartbeat_armed = True;
     }
 
     blive_logi("connected to liveroom %d", entity->room_id);
@@ -75,6 +97,7 @@ int blive_close_connection(blive* entity)
     /*释放与服务端的TCP连接*/
     if (entity->conn_fd != 0) {
         shutdown(entity->conn_fd, SHUT_RDWR);
+        sock_close(entity->conn_fd);
         entity->conn_fd = 0;
     }
 
@@ -103,7 +126,7 @@ static int get_stream_auth_key(char** auth_key, blive_srv_ipaddr* hosts, CURL* h
     cJSON*  cjson_srvr_ret = NULL;
     cJSON*  cjson_obj = NULL;
     cJSON*  host_list = NULL;
-    char*   url = "https://api.live.bilibili.com/xlive/web-room/v1/index/getDanmuInfo";
+    char*   url = danmu_info_url != NULL ? danmu_info_url : DANMU_INFO_URL;
     char*   final_url = NULL;
     size_t  final_size = 0;
     blive_curl_data key_struct = {0};
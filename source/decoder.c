@@ -0,0 +1,431 @@
+/**
+ * @file decoder.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 解码线程池，接收线程通过单生产者单消费者环形队列将原始数据包交给解码线程进行brotli解压与JSON解析
+ * @version 0.1
+ * @date 2023-02-06
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_DECODE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define DECODE_RING_SIZE        256     /*每个直播间的环形队列长度，必须为2的幂*/
+#define DECODE_RING_BUDGET      32      /*解码线程单次从一个直播间连续处理的数据包数，避免个别直播间独占*/
+#define CACHE_LINE_SIZE         64
+
+typedef struct blive_decode_worker blive_decode_worker;
+
+struct blive_decode_ring {
+    size_t                  head;       /*下一个待处理的位置，仅解码线程在处理完数据包后修改*/
+    char                    pad0[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t                  tail;       /*下一个写入的位置，仅接收线程修改*/
+    char                    pad1[CACHE_LINE_SIZE - sizeof(size_t)];
+    blive*                  entity;
+    blive_decode_worker*    worker;     /*负责该直播间的解码线程，同一直播间始终由同一线程解码，保证顺序*/
+    blive_decode_ring*      next;       /*解码线程负责的下一个直播间，只由解码线程修改*/
+    Bool                    detach;     /*请求从解码线程解除，持有worker锁时读写*/
+    Bool                    detached;   /*解码线程已将其移出链表，持有worker锁时读写*/
+    blive_frame*            slots[DECODE_RING_SIZE];
+};
+
+struct blive_decode_worker {
+    pthread_t               tid;
+    pthread_mutex_t         lock;       /*保护rings链表的修改，并与cond配合用于休眠与唤醒；解码与分发时不持有*/
+    pthread_cond_t          cond;
+    pthread_cond_t          done;       /*解码线程移出请求解除的直播间后通知等待者*/
+    int                     sleeping;   /*解码线程是否正在休眠，原子操作*/
+    int                     detaching;  /*请求解除但尚未移出的直播间数，原子读，持有锁时修改*/
+    Bool                    running;    /*原子读，持有锁时修改*/
+    blive_decode_ring*      rings;      /*该线程负责的直播间链表，新直播间由其他线程加在表头，移出只在解码线程内进行*/
+    blive_decode_ring*      current;    /*解码线程正在处理的直播间，只由解码线程读写*/
+};
+
+struct blive_decoder {
+    int                     worker_num;
+    blive_decode_worker*    workers;
+    uint32_t                next_worker;    /*为新的直播间分配解码线程时使用的轮转下标*/
+};
+
+
+static void* decode_routine(void* arg);
+static Bool decode_worker_idle(blive_decode_worker* worker);
+static void decode_worker_wait(blive_decode_worker* worker);
+static int decode_ring_consume(blive_decode_ring* ring);
+static void decode_worker_detach(blive_decode_worker* worker);
+static void decode_ring_unlink(blive_decode_worker* worker, blive_decode_ring* ring);
+
+
+int blive_decoder_create(blive_decoder** dec, int worker_num)
+{
+    blive_decoder*  new_dec = NULL;
+    int             count = 0;
+
+    if (dec == NULL || worker_num <= 0) {
+        return ERROR;
+    }
+
+    new_dec = malloc(sizeof(blive_decoder));
+    if (new_dec == NULL) {
+        return ERROR;
+    }
+    memset(new_dec, 0, sizeof(blive_decoder));
+    new_dec->workers = malloc(sizeof(blive_decode_worker) * worker_num);
+    if (new_dec->workers == NULL) {
+        free(new_dec);
+        return ERROR;
+    }
+    memset(new_dec->workers, 0, sizeof(blive_decode_worker) * worker_num);
+
+    for (count = 0; count < worker_num; count++) {
+        pthread_mutex_init(&new_dec->workers[count].lock, NULL);
+        pthread_cond_init(&new_dec->workers[count].cond, NULL);
+        pthread_cond_init(&new_dec->workers[count].done, NULL);
+        new_dec->workers[count].running = True;
+        if (pthread_create(&new_dec->workers[count].tid, NULL, decode_routine, &new_dec->workers[count])) {
+            blive_loge("create decode worker %d failed", count);
+            pthread_cond_destroy(&new_dec->workers[count].done);
+            pthread_cond_destroy(&new_dec->workers[count].cond);
+            pthread_mutex_destroy(&new_dec->workers[count].lock);
+            break;
+        }
+        new_dec->worker_num++;
+    }
+
+    if (new_dec->worker_num != worker_num) {
+        blive_decoder_destroy(new_dec);
+        return ERROR;
+    }
+
+    blive_logi("decoder started with %d worker(s)", worker_num);
+    *dec = new_dec;
+    return OK;
+}
+
+int blive_decoder_destroy(blive_decoder* dec)
+{
+    blive_decode_worker*    worker = NULL;
+
+    if (dec == NULL) {
+        return ERROR;
+    }
+
+    for (int count = 0; count < dec->worker_num; count++) {
+        worker = &dec->workers[count];
+        pthread_mutex_lock(&worker->lock);
+        __atomic_store_n(&worker->running, False, __ATOMIC_RELEASE);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+        pthread_join(worker->tid, NULL);
+        pthread_cond_destroy(&worker->done);
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    free(dec->workers);
+    free(dec);
+    return OK;
+}
+
+int blive_set_decoder(blive* entity, blive_decoder* dec)
+{
+    blive_decode_ring*      ring = NULL;
+    blive_decode_worker*    worker = NULL;
+
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    /*解除原有的解码线程：已提交的数据包全部处理完毕后，由解码线程在两轮处理之间把它移出链表*/
+    if ((ring = entity->decode_ring) != NULL) {
+        worker = ring->worker;
+        if (pthread_equal(pthread_self(), worker->tid)) {
+            /*在同一解码线程的回调中调用，直接在本线程处理完并移出；不能解除正在处理的直播间自身*/
+            if (worker->current == ring) {
+                blive_loge("can not detach room %u from the decoder in its own callback", entity->room_id);
+                return ERROR;
+            }
+            while (decode_ring_consume(ring));
+            pthread_mutex_lock(&worker->lock);
+            decode_ring_unlink(worker, ring);
+            pthread_mutex_unlock(&worker->lock);
+        } else {
+            pthread_mutex_lock(&worker->lock);
+            ring->detach = True;
+            __atomic_store_n(&worker->detaching, worker->detaching + 1, __ATOMIC_RELEASE);
+            pthread_cond_signal(&worker->cond);
+            while (!ring->detached) {
+                pthread_cond_wait(&worker->done, &worker->lock);
+            }
+            pthread_mutex_unlock(&worker->lock);
+        }
+        entity->decode_ring = NULL;
+        free(ring);
+    }
+
+    if (dec == NULL) {
+        return OK;
+    }
+
+    ring = malloc(sizeof(blive_decode_ring));
+    if (ring == NULL) {
+        return ERROR;
+    }
+    memset(ring, 0, sizeof(blive_decode_ring));
+    worker = &dec->workers[__atomic_fetch_add(&dec->next_worker, 1, __ATOMIC_RELAXED) % dec->worker_num];
+    ring->entity = entity;
+    ring->worker = worker;
+
+    /*只在表头插入，不修改已有的节点，解码线程不持锁遍历也能看到完整的链表*/
+    pthread_mutex_lock(&worker->lock);
+    ring->next = worker->rings;
+    __atomic_store_n(&worker->rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&worker->lock);
+    entity->decode_ring = ring;
+
+    return OK;
+}
+
+blive_frame* blive_frame_alloc(const blive_msg_header* header)
+{
+    blive_frame*    frame = NULL;
+    size_t          body_size = 0;
+
+    /*packet_size直接来自网络，按其申请内存前先检查范围，超出范围视为协议错误*/
+    if (header->packet_size < sizeof(blive_msg_header) || header->packet_size > BLIVE_MSG_MAX_SIZE) {
+        blive_loge("invalid packet size %u", header->packet_size);
+        return NULL;
+    }
+    body_size = header->packet_size - sizeof(blive_msg_header);
+    frame = malloc(sizeof(blive_frame) + body_size + 1);
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->header = *header;
+    frame->body_size = 0;
+    frame->recv_ns = 0;
+    frame->body = (char*)(frame + 1);
+    frame->body[body_size] = '\0';
+
+    return frame;
+}
+
+void blive_frame_free(blive_frame* frame)
+{
+    free(frame);
+}
+
+int blive_decode_ring_push(blive_decode_ring* ring, blive_frame* frame)
+{
+    blive_decode_worker*    worker = ring->worker;
+    size_t                  tail = ring->tail;
+
+    /*队列已满，唤醒解码线程并让出CPU，直到有空位；此时接收线程不读socket，由TCP向服务端施加背压*/
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= DECODE_RING_SIZE) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+        sched_yield();
+    }
+
+    ring->slots[tail & (DECODE_RING_SIZE - 1)] = frame;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    /*解码线程正在休眠时才需要加锁唤醒，平时只有一次原子读*/
+    if (__atomic_load_n(&worker->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    return OK;
+}
+
+
+static void* decode_routine(void* arg)
+{
+    blive_decode_worker*    worker = (blive_decode_worker*)arg;
+    blive_decode_ring*      ring = NULL;
+    int                     handled = 0;
+
+    /*解压、解析与回调都不持有worker锁，锁只用于修改链表与休眠，其他线程增删直播间时不必等待本线程空闲*/
+    while (__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE)) {
+        blive_clock_tick();
+        decode_worker_detach(worker);
+        handled = 0;
+        for (ring = __atomic_load_n(&worker->rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            worker->current = ring;
+            handled += decode_ring_consume(ring);
+        }
+        worker->current = NULL;
+        if (handled) {
+            continue;
+        }
+
+        /*先声明即将休眠，再检查一遍队列，与接收线程的写入配合避免丢失唤醒*/
+        pthread_mutex_lock(&worker->lock);
+        __atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (worker->running && !worker->detaching && decode_worker_idle(worker)) {
+            decode_worker_wait(worker);
+        }
+        __atomic_store_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&worker->lock);
+
+        /*合并窗口在解码线程内到期分发*/
+        for (ring = __atomic_load_n(&worker->rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            worker->current = ring;
+            blive_packet_idle(ring->entity);
+        }
+        worker->current = NULL;
+    }
+
+    /*退出前处理完剩余的数据包*/
+    do {
+        handled = 0;
+        for (ring = __atomic_load_n(&worker->rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            worker->current = ring;
+            handled += decode_ring_consume(ring);
+        }
+        worker->current = NULL;
+    } while (handled);
+    decode_worker_detach(worker);
+
+    return NULL;
+}
+
+/**
+ * @brief 检查解码线程负责的所有直播间是否都没有待处理的数据包。调用时需持有worker锁
+ * 
+ * @param [in] worker 解码线程
+ * @return Bool
+ */
+static Bool decode_worker_idle(blive_decode_worker* worker)
+{
+    for (blive_decode_ring* ring = worker->rings; ring != NULL; ring = ring->next) {
+        if (ring->head != __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST)) {
+            return False;
+        }
+    }
+    return True;
+}
+
+/**
+ * @brief 休眠等待新的数据包；负责的直播间有待分发的合并窗口时，最多等待到窗口到期。调用时需持有worker锁
+ * 
+ * @param [in] worker 解码线程
+ */
+static void decode_worker_wait(blive_decode_worker* worker)
+{
+    int             timeout_ms = -1;
+    int             ring_timeout = -1;
+    struct timespec deadline = {0};
+
+    for (blive_decode_ring* ring = worker->rings; ring != NULL; ring = ring->next) {
+        ring_timeout = blive_coalesce_timeout(ring->entity);
+        if (ring_timeout >= 0 && (timeout_ms < 0 || ring_timeout < timeout_ms)) {
+            timeout_ms = ring_timeout;
+        }
+    }
+
+    if (timeout_ms < 0) {
+        pthread_cond_wait(&worker->cond, &worker->lock);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&worker->cond, &worker->lock, &deadline);
+}
+
+/**
+ * @brief 处理一个直播间环形队列中的数据包，最多处理DECODE_RING_BUDGET个。只在解码线程内调用，不持有worker锁
+ * 
+ * @param [in] ring 直播间的环形队列
+ * @return int 处理的数据包数
+ */
+static int decode_ring_consume(blive_decode_ring* ring)
+{
+    size_t          head = ring->head;
+    size_t          tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    blive_frame*    frame = NULL;
+    int             handled = 0;
+
+    while (head != tail && handled < DECODE_RING_BUDGET) {
+        frame = ring->slots[head & (DECODE_RING_SIZE - 1)];
+        blive_packet_process(ring->entity, &frame->header, frame->body, frame->body_size, frame->recv_ns);
+        blive_frame_free(frame);
+
+        /*处理完才移动head，接收线程据此判断数据包已全部处理完毕*/
+        head++;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        handled++;
+    }
+
+    return handled;
+}
+
+/**
+ * @brief 移出已请求解除且数据包已处理完的直播间，并通知等待的调用者。只在解码线程内调用
+ * 
+ * @param [in] worker 解码线程
+ */
+static void decode_worker_detach(blive_decode_worker* worker)
+{
+    blive_decode_ring*  ring = NULL;
+    blive_decode_ring*  next = NULL;
+    Bool                detached = False;
+
+    if (!__atomic_load_n(&worker->detaching, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    for (ring = worker->rings; ring != NULL; ring = next) {
+        next = ring->next;
+        if (ring->detach && ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+            decode_ring_unlink(worker, ring);
+            ring->detached = True;
+            __atomic_store_n(&worker->detaching, worker->detaching - 1, __ATOMIC_RELEASE);
+            detached = True;
+        }
+    }
+    if (detached) {
+        pthread_cond_broadcast(&worker->done);
+    }
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/**
+ * @brief 把直播间移出解码线程的链表。只在解码线程内调用，调用时需持有worker锁
+ * 
+ * @param [in] worker 解码线程
+ * @param [in] ring 直播间的环形队列
+ */
+static void decode_ring_unlink(blive_decode_worker* worker, blive_decode_ring* ring)
+{
+    blive_decode_ring**     iter = NULL;
+
+    for (iter = &worker->rings; *iter != NULL; iter = &(*iter)->next) {
+        if (*iter == ring) {
+            __atomic_store_n(iter, ring->next, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+/**
+ * @file decoder.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 解码线程池的内部头文件，接收线程只负责收取数据包，解压与解析在解码线程内完成
+ * @version 0.1
+ * @date 2023-02-06
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_DECODER_H__
+#define __BLIVE_DECODER_H__
+
+#include "blive_def.h"
+#include "msg.h"
+
+
+/**
+ * @brief 接收线程收取的一个完整数据包，头部已转换为主机字节序，正文与结构体在同一块内存中
+ * 
+ */
+typedef struct {
+    blive_msg_header    header;         /*数据包头部*/
+    int                 body_size;      /*实际收到的正文长度*/
+    uint64_t            recv_ns;        /*接收线程收到数据包头部的时间*/
+    char*               body;           /*正文，末尾额外保留一个'\0'*/
+} blive_frame;
+
+/**
+ * @brief 接收线程与解码线程之间的单生产者单消费者环形队列，每个直播间一个
+ * 
+ */
+typedef struct blive_decode_ring blive_decode_ring;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 按数据包头部申请一个数据包，正文空间为packet_size - 16 + 1
+ * 
+ * @param [in] header 数据包头部
+ * @return blive_frame* packet_size小于头部长度或大于BLIVE_MSG_MAX_SIZE时视为协议错误，与申请失败一样返回NULL
+ */
+blive_frame* blive_frame_alloc(const blive_msg_header* header);
+
+/**
+ * @brief 释放数据包
+ * 
+ * @param [in] frame 数据包
+ */
+void blive_frame_free(blive_frame* frame);
+
+/**
+ * @brief 将接收线程收取的数据包交给解码线程。环形队列已满时接收线程等待，向服务端施加背压
+ * 
+ * @param [in] ring 直播间的环形队列
+ * @param [in] frame 数据包，所有权转交给解码线程
+ * @return int
+ */
+int blive_decode_ring_push(blive_decode_ring* ring, blive_frame* frame);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
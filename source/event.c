@@ -0,0 +1,184 @@
+/**
+ * @file event.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 事件回调与批量回调，以及事件的访问与引用接口，JSON在首次访问时才解析
+ * @version 0.1
+ * @date 2023-02-12
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_MSG
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "event.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+int blive_set_event_callback(blive* entity, blive_info_type info, blive_event_handler cb, void* usr_data)
+{
+    if ((entity == NULL) || (info >= BLIVE_INFO_MAX) || (info < BLIVE_INFO_MIN)) {
+        return ERROR;
+    }
+
+    /*cb为NULL时取消事件回调*/
+    entity->msg_handler[info].event_handler = cb;
+    entity->msg_handler[info].event_usr_data = usr_data;
+
+    return OK;
+}
+
+int blive_set_batch_callback(blive* entity, uint64_t info_mask, blive_batch_handler cb, void* usr_data)
+{
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    /*cb为NULL时取消批量回调*/
+    entity->batch_handler.handler = cb;
+    entity->batch_handler.usr_data = usr_data;
+    entity->batch_handler.info_mask = cb != NULL ? info_mask & BLIVE_INFO_ALL : 0;
+
+    return OK;
+}
+
+blive_info_type blive_event_type(const blive_event* event)
+{
+    return event->type;
+}
+
+const cJSON* blive_event_json(const blive_event* event)
+{
+    blive_event*    mutable_event = (blive_event*)event;
+
+    /*只读取原文的使用者不需要为解析付出代价，因此推迟到第一次访问时解析*/
+    if (!event->parsed) {
+        mutable_event->json = cJSON_ParseWithLength(event->raw, event->raw_len);
+        mutable_event->parsed = True;
+        if (event->json == NULL) {
+            blive_loge("cjson parse failed: %.*s", (int)event->raw_len, event->raw);
+        }
+    }
+    return event->json;
+}
+
+const char* blive_event_raw(const blive_event* event, size_t* len)
+{
+    if (len != NULL) {
+        *len = event->raw_len;
+    }
+    return event->raw;
+}
+
+uint64_t blive_event_recv_ns(const blive_event* event)
+{
+    return event->recv_ns;
+}
+
+const uint32_t* blive_event_keywords(const blive_event* event, size_t* num)
+{
+    if (num != NULL) {
+        *num = event->keyword_num;
+    }
+    return event->keyword_ids;
+}
+
+blive_event* blive_event_retain(const blive_event* event)
+{
+    blive_event*    mutable_event = (blive_event*)event;
+
+    if (event == NULL) {
+        return NULL;
+    }
+
+    /*堆上的事件直接增加引用；回调中的临时事件在栈上，创建一个引用同一解压缓冲区的副本*/
+    if (event->refcount) {
+        __atomic_fetch_add(&mutable_event->refcount, 1, __ATOMIC_RELAXED);
+        return mutable_event;
+    }
+    if ((mutable_event = blive_event_create(event->type, event->buffer, event->raw, event->raw_len, NULL)) != NULL) {
+        mutable_event->recv_ns = event->recv_ns;
+        mutable_event->unzip_ns = event->unzip_ns;
+        mutable_event->parse_ns = event->parse_ns;
+        mutable_event->keyword_num = event->keyword_num;
+        memcpy(mutable_event->keyword_ids, event->keyword_ids, sizeof(uint32_t) * event->keyword_num);
+    }
+    return mutable_event;
+}
+
+void blive_event_release(blive_event* event)
+{
+    if (event == NULL || __atomic_sub_fetch(&event->refcount, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    cJSON_Delete(event->json);
+    blive_buffer_release(event->buffer);
+    free(event);
+}
+
+blive_event* blive_event_create(blive_info_type type, blive_buffer* buffer, const char* raw, size_t raw_len, cJSON* json_obj)
+{
+    blive_event*    event = NULL;
+
+    /*原文不在解压缓冲区时，与事件在同一块内存中，只需一次申请*/
+    event = malloc(sizeof(blive_event) + (buffer != NULL ? 0 : raw_len + 1));
+    if (event == NULL) {
+        return NULL;
+    }
+    event->type = type;
+    event->json = json_obj;
+    event->parsed = json_obj != NULL ? True : False;
+    event->raw = raw;
+    event->raw_len = raw != NULL ? raw_len : 0;
+    event->buffer = buffer;
+    event->refcount = 1;
+    event->recv_ns = 0;
+    event->unzip_ns = 0;
+    event->parse_ns = 0;
+    event->keyword_num = 0;
+    if (buffer != NULL) {
+        blive_buffer_retain(buffer);
+    } else if (raw != NULL) {
+        memcpy(event + 1, raw, raw_len);
+        ((char*)(event + 1))[raw_len] = '\0';
+        event->raw = (const char*)(event + 1);
+    }
+
+    return event;
+}
+
+void blive_event_deliver(blive* entity, blive_event* event)
+{
+    const cJSON*        json_obj = NULL;
+    blive_pmu_sample    pmu = {0};
+    Bool                profiling = blive_pmu_begin(&pmu);
+    uint64_t            begin = blive_clock_now_ns();
+    uint64_t            end = 0;
+
+    BLIVE_PROBE4(cmd_dispatch, entity->room_id, event->type, event->raw_len, event->recv_ns);
+    if (entity->msg_handler[event->type].event_handler != NULL) {
+        entity->msg_handler[event->type].event_handler(entity, event, entity->msg_handler[event->type].event_usr_data);
+    }
+
+    /*只订阅了事件回调的类型到这里为止，整个过程不解析JSON*/
+    if (entity->msg_handler[event->type].handler != NULL) {
+        if ((json_obj = blive_event_json(event)) != NULL) {
+            entity->msg_handler[event->type].handler(entity, json_obj, entity->msg_handler[event->type].usr_data);
+        } else {
+            blive_metrics_count(&entity->metrics, BLIVE_METRIC_PARSE_ERRORS, 1);
+        }
+    }
+    end = blive_clock_now_ns();
+    if (profiling) {
+        blive_pmu_account(&entity->metrics, BLIVE_METRIC_STAGE_HANDLER, &pmu, event->raw_len);
+    }
+    BLIVE_PROBE3(cmd_done, entity->room_id, event->type, end - begin);
+    blive_metrics_observe(&entity->metrics, BLIVE_METRIC_STAGE_HANDLER, end - begin);
+    if (entity->tracer != NULL) {
+        blive_trace_record(entity, event, begin, end);
+    }
+}
\ No newline at end of file
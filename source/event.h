@@ -0,0 +1,61 @@
+/**
+ * @file event.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 事件的内部头文件，一个事件对应数据包内的一条消息，同时携带消息原文与按需解析的JSON
+ * @version 0.1
+ * @date 2023-02-12
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_EVENT_H__
+#define __BLIVE_EVENT_H__
+
+#include "blive_def.h"
+#include "buffer.h"
+
+
+struct blive_event {
+    blive_info_type     type;           /*消息类型*/
+    cJSON*              json;           /*解析后的消息，首次访问时才解析*/
+    Bool                parsed;         /*是否已经尝试过解析*/
+    const char*         raw;            /*消息原文在解压缓冲区中的位置，不以'\0'结尾*/
+    size_t              raw_len;        /*消息原文长度*/
+    blive_buffer*       buffer;         /*原文所在的解压缓冲区，原文复制到事件内部时为NULL*/
+    uint32_t            refcount;       /*引用计数，原子操作；栈上的临时事件为0*/
+    uint64_t            recv_ns;        /*所在数据包的接收时间*/
+    uint64_t            unzip_ns;       /*所在数据包的解压完成时间，用于链路追踪*/
+    uint64_t            parse_ns;       /*所在数据包的切分完成时间，用于链路追踪*/
+    uint32_t            keyword_num;    /*命中的关键词数*/
+    uint32_t            keyword_ids[BLIVE_KEYWORD_TAG_MAX];    /*命中的关键词id*/
+};
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 在堆上创建一个事件，引用计数为1。原文位于解压缓冲区时只增加缓冲区的引用，否则复制到事件内部
+ * 
+ * @param [in] type 消息类型
+ * @param [in] buffer 原文所在的解压缓冲区，可以为NULL
+ * @param [in] raw 消息原文，可以为NULL
+ * @param [in] raw_len 消息原文长度
+ * @param [in] json_obj 已解析的消息，可以为NULL，所有权转交给事件
+ * @return blive_event* 申请失败返回NULL，此时json_obj的所有权不转交
+ */
+blive_event* blive_event_create(blive_info_type type, blive_buffer* buffer, const char* raw, size_t raw_len, cJSON* json_obj);
+
+/**
+ * @brief 将事件交给该类型订阅的事件回调与JSON回调，事件回调先执行
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] event 事件
+ */
+void blive_event_deliver(blive* entity, blive_event* event);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,653 @@
+/**
+ * @file executor.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 回调执行器，工作线程池按直播间串行执行用户回调，空闲线程从其他线程窃取任务
+ * @version 0.1
+ * @date 2023-02-04
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "executor.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define STRAND_RUN_BUDGET   64      /*一个串行队列单次最多连续执行的事件数，超出后让出线程，避免个别直播间独占*/
+
+typedef struct strand_event {
+    struct strand_event* next;
+    blive_info_type     type;
+    blive_priority      prio;           /*投递时的优先级，决定所在的队列*/
+    uint64_t            packet;         /*所属数据包的序号，高优先级事件只能越过同一数据包内的普通事件*/
+    blive_event*        event;          /*消息内容，执行回调后释放*/
+} strand_event;
+
+typedef struct {
+    pthread_t           tid;
+    pthread_mutex_t     lock;           /*保护就绪队列*/
+    blive_strand*       head;           /*就绪的串行队列链表，本线程与窃取线程均从头部取出*/
+    blive_strand*       tail;
+    blive_executor*     exec;
+} blive_worker;
+
+struct blive_executor {
+    int                 worker_num;     /*工作线程数量*/
+    blive_worker*       workers;        /*工作线程列表*/
+    pthread_mutex_t     lock;           /*与cond配合，用于空闲线程的休眠与唤醒*/
+    pthread_cond_t      cond;
+    size_t              ready;          /*所有工作线程上就绪的串行队列总数，原子操作*/
+    uint32_t            next_home;      /*为新建串行队列分配归属线程时使用的轮转下标*/
+    Bool                running;
+
+    size_t              capacity;       /*所有直播间排队事件总数的上限，0为不限制*/
+    size_t              pending;        /*所有直播间当前排队的事件总数，原子操作*/
+    pthread_mutex_t     space_lock;     /*与space_cond配合，队列满时阻塞的接收线程在此等待*/
+    pthread_cond_t      space_cond;
+    size_t              space_waiters;  /*正在等待空位的接收线程数，原子操作*/
+    size_t              blocked;        /*以下为全局统计，原子操作*/
+    size_t              dropped[BLIVE_INFO_MAX];
+    size_t              coalesced[BLIVE_INFO_MAX];
+};
+
+struct blive_strand {
+    pthread_mutex_t     lock;           /*保护事件队列与调度状态*/
+    pthread_cond_t      drained;        /*串行队列执行完毕的通知*/
+    strand_event*       head[BLIVE_PRIORITY_MAX];   /*各优先级待执行的事件链表，同一数据包内高优先级先执行*/
+    strand_event*       tail[BLIVE_PRIORITY_MAX];
+    Bool                scheduled;      /*已在某个工作线程的就绪队列中或正在执行*/
+    uint32_t            home;           /*归属的工作线程下标*/
+    blive*              entity;
+    blive_executor*     exec;
+    blive_strand*       next;           /*就绪队列中的下一个串行队列*/
+    uint64_t            packet;         /*当前正在分发的数据包序号，仅由接收线程修改，原子操作*/
+
+    size_t              count;          /*当前排队的事件数，原子操作*/
+    strand_event*       latest[BLIVE_INFO_MAX];     /*合并策略下，各类型在队列中尚未执行的事件*/
+    size_t              blocked;        /*以下为本直播间的统计*/
+    size_t              dropped[BLIVE_INFO_MAX];
+    size_t              coalesced[BLIVE_INFO_MAX];
+};
+
+
+static void* worker_routine(void* arg);
+static void worker_push(blive_worker* worker, blive_strand* strand);
+static blive_strand* worker_pop(blive_worker* worker);
+static blive_strand* worker_steal(blive_executor* exec, blive_worker* self);
+static strand_event* strand_pop(blive_strand* strand);
+static void strand_run(blive_strand* strand, blive_worker* worker);
+static Bool strand_is_full(blive_strand* strand);
+static strand_event* strand_remove_oldest(blive_strand* strand, blive_info_type type);
+static void strand_wait_space(blive_strand* strand);
+static void strand_release_slot(blive_strand* strand, strand_event* event);
+static void event_invoke(blive* entity, strand_event* event);
+
+
+int blive_executor_create(blive_executor** exec, int worker_num)
+{
+    blive_executor* new_exec = NULL;
+    int             count = 0;
+
+    if (exec == NULL || worker_num <= 0) {
+        return ERROR;
+    }
+
+    new_exec = malloc(sizeof(blive_executor));
+    if (new_exec == NULL) {
+        return ERROR;
+    }
+    memset(new_exec, 0, sizeof(blive_executor));
+    new_exec->workers = malloc(sizeof(blive_worker) * worker_num);
+    if (new_exec->workers == NULL) {
+        free(new_exec);
+        return ERROR;
+    }
+    memset(new_exec->workers, 0, sizeof(blive_worker) * worker_num);
+    pthread_mutex_init(&new_exec->lock, NULL);
+    pthread_cond_init(&new_exec->cond, NULL);
+    pthread_mutex_init(&new_exec->space_lock, NULL);
+    pthread_cond_init(&new_exec->space_cond, NULL);
+    new_exec->running = True;
+
+    for (count = 0; count < worker_num; count++) {
+        new_exec->workers[count].exec = new_exec;
+        pthread_mutex_init(&new_exec->workers[count].lock, NULL);
+        if (pthread_create(&new_exec->workers[count].tid, NULL, worker_routine, &new_exec->workers[count])) {
+            blive_loge("create worker %d failed", count);
+            pthread_mutex_destroy(&new_exec->workers[count].lock);
+            break;
+        }
+        new_exec->worker_num++;
+    }
+
+    if (new_exec->worker_num != worker_num) {
+        blive_executor_destroy(new_exec);
+        return ERROR;
+    }
+
+    blive_logi("executor started with %d worker(s)", worker_num);
+    *exec = new_exec;
+    return OK;
+}
+
+int blive_executor_destroy(blive_executor* exec)
+{
+    if (exec == NULL) {
+        return ERROR;
+    }
+
+    /*工作线程会先执行完所有已就绪的事件后再退出*/
+    pthread_mutex_lock(&exec->lock);
+    exec->running = False;
+    pthread_cond_broadcast(&exec->cond);
+    pthread_mutex_unlock(&exec->lock);
+
+    for (int count = 0; count < exec->worker_num; count++) {
+        pthread_join(exec->workers[count].tid, NULL);
+        pthread_mutex_destroy(&exec->workers[count].lock);
+    }
+
+    pthread_cond_destroy(&exec->space_cond);
+    pthread_mutex_destroy(&exec->space_lock);
+    pthread_cond_destroy(&exec->cond);
+    pthread_mutex_destroy(&exec->lock);
+    free(exec->workers);
+    free(exec);
+    return OK;
+}
+
+int blive_set_executor(blive* entity, blive_executor* exec)
+{
+    blive_strand*   strand = NULL;
+
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    if (exec != NULL && blive_strand_create(&strand, exec, entity) != OK) {
+        return ERROR;
+    }
+
+    /*先把旧执行器上尚未执行的事件处理完，再切换，保证直播间内的回调顺序*/
+    if (entity->strand != NULL) {
+        blive_strand_destroy(entity->strand);
+    }
+    entity->strand = strand;
+    entity->executor = exec;
+
+    return OK;
+}
+
+int blive_strand_create(blive_strand** strand, blive_executor* exec, blive* entity)
+{
+    blive_strand*   new_strand = NULL;
+
+    if (strand == NULL || exec == NULL) {
+        return ERROR;
+    }
+
+    new_strand = malloc(sizeof(blive_strand));
+    if (new_strand == NULL) {
+        return ERROR;
+    }
+    memset(new_strand, 0, sizeof(blive_strand));
+    pthread_mutex_init(&new_strand->lock, NULL);
+    pthread_cond_init(&new_strand->drained, NULL);
+    new_strand->entity = entity;
+    new_strand->exec = exec;
+    new_strand->home = __atomic_fetch_add(&exec->next_home, 1, __ATOMIC_RELAXED) % exec->worker_num;
+
+    *strand = new_strand;
+    return OK;
+}
+
+void blive_strand_destroy(blive_strand* strand)
+{
+    if (strand == NULL) {
+        return;
+    }
+
+    blive_strand_drain(strand);
+    pthread_cond_destroy(&strand->drained);
+    pthread_mutex_destroy(&strand->lock);
+    free(strand);
+}
+
+int blive_strand_submit(blive_strand* strand, blive_event* msg)
+{
+    blive_info_type     type = msg->type;
+    blive_executor*     exec = strand->exec;
+    blive_queue_policy  policy = strand->entity->queue_policy[type];
+    strand_event*       event = NULL;
+    Bool                need_schedule = False;
+
+    pthread_mutex_lock(&strand->lock);
+
+    /*合并策略：队列中已有同类型未执行的事件时，直接替换为最新的内容，队列长度不变*/
+    if (policy == BLIVE_QUEUE_COALESCE && strand->latest[type] != NULL) {
+        blive_event_release(strand->latest[type]->event);
+        strand->latest[type]->event = msg;
+        strand->coalesced[type]++;
+        pthread_mutex_unlock(&strand->lock);
+        __atomic_fetch_add(&exec->coalesced[type], 1, __ATOMIC_RELAXED);
+        return OK;
+    }
+
+    /*队列已满时按该消息类型的策略处理。合并类型每种最多只占一个位置，不受容量限制，保证最新值总能送达*/
+    while (policy != BLIVE_QUEUE_COALESCE && strand_is_full(strand)) {
+        if (policy == BLIVE_QUEUE_DROP_OLDEST && (event = strand_remove_oldest(strand, type)) != NULL) {
+            blive_event_release(event->event);
+            free(event);
+            event = NULL;
+            break;
+        }
+        if (policy != BLIVE_QUEUE_BLOCK) {
+            /*丢弃最新的一条；drop-oldest时队列中已没有同类型的事件可丢弃，也丢弃最新的一条*/
+            strand->dropped[type]++;
+            pthread_mutex_unlock(&strand->lock);
+            __atomic_fetch_add(&exec->dropped[type], 1, __ATOMIC_RELAXED);
+            blive_event_release(msg);
+            return OK;
+        }
+
+        /*阻塞接收线程，不再读取socket，由TCP滑动窗口向服务端施加背压*/
+        strand->blocked++;
+        pthread_mutex_unlock(&strand->lock);
+        __atomic_fetch_add(&exec->blocked, 1, __ATOMIC_RELAXED);
+        strand_wait_space(strand);
+        pthread_mutex_lock(&strand->lock);
+    }
+
+    event = malloc(sizeof(strand_event));
+    if (event == NULL) {
+        pthread_mutex_unlock(&strand->lock);
+        return ERROR;
+    }
+    event->next = NULL;
+    event->type = type;
+    event->prio = strand->entity->cmd_priority[type];
+    event->packet = __atomic_load_n(&strand->packet, __ATOMIC_RELAXED);
+    event->event = msg;
+
+    if (strand->tail[event->prio] != NULL) {
+        strand->tail[event->prio]->next = event;
+    } else {
+        strand->head[event->prio] = event;
+    }
+    strand->tail[event->prio] = event;
+    if (policy == BLIVE_QUEUE_COALESCE) {
+        strand->latest[type] = event;
+    }
+    __atomic_fetch_add(&strand->count, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&exec->pending, 1, __ATOMIC_SEQ_CST);
+    if (!strand->scheduled) {
+        strand->scheduled = True;
+        need_schedule = True;
+    }
+    pthread_mutex_unlock(&strand->lock);
+
+    /*串行队列原本空闲时，才需要放入工作线程的就绪队列*/
+    if (need_schedule) {
+        worker_push(&exec->workers[strand->home], strand);
+    }
+
+    return OK;
+}
+
+void blive_strand_packet(blive_strand* strand)
+{
+    __atomic_fetch_add(&strand->packet, 1, __ATOMIC_RELAXED);
+}
+
+void blive_strand_drain(blive_strand* strand)
+{
+    pthread_mutex_lock(&strand->lock);
+    while (strand->scheduled) {
+        pthread_cond_wait(&strand->drained, &strand->lock);
+    }
+    pthread_mutex_unlock(&strand->lock);
+}
+
+int blive_executor_set_capacity(blive_executor* exec, size_t capacity)
+{
+    if (exec == NULL) {
+        return ERROR;
+    }
+
+    exec->capacity = capacity;
+    return OK;
+}
+
+int blive_executor_get_queue_stats(blive_executor* exec, blive_queue_stats* stats)
+{
+    if (exec == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    memset(stats, 0, sizeof(blive_queue_stats));
+    stats->queued = __atomic_load_n(&exec->pending, __ATOMIC_RELAXED);
+    stats->blocked = __atomic_load_n(&exec->blocked, __ATOMIC_RELAXED);
+    for (int count = BLIVE_INFO_MIN; count < BLIVE_INFO_MAX; count++) {
+        stats->dropped[count] = __atomic_load_n(&exec->dropped[count], __ATOMIC_RELAXED);
+        stats->coalesced[count] = __atomic_load_n(&exec->coalesced[count], __ATOMIC_RELAXED);
+    }
+
+    return OK;
+}
+
+int blive_set_queue_capacity(blive* entity, size_t capacity)
+{
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    entity->queue_capacity = capacity;
+    return OK;
+}
+
+int blive_set_queue_policy(blive* entity, blive_info_type info, blive_queue_policy policy)
+{
+    if ((entity == NULL) || (info >= BLIVE_INFO_MAX) || (info < BLIVE_INFO_MIN)
+        || (policy < BLIVE_QUEUE_BLOCK) || (policy > BLIVE_QUEUE_COALESCE)) {
+        return ERROR;
+    }
+
+    entity->queue_policy[info] = policy;
+    return OK;
+}
+
+int blive_get_queue_stats(blive* entity, blive_queue_stats* stats)
+{
+    blive_strand*   strand = NULL;
+
+    if (entity == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    memset(stats, 0, sizeof(blive_queue_stats));
+    if ((strand = entity->strand) == NULL) {
+        return OK;
+    }
+
+    pthread_mutex_lock(&strand->lock);
+    stats->queued = strand->count;
+    stats->blocked = strand->blocked;
+    memcpy(stats->dropped, strand->dropped, sizeof(stats->dropped));
+    memcpy(stats->coalesced, strand->coalesced, sizeof(stats->coalesced));
+    pthread_mutex_unlock(&strand->lock);
+
+    return OK;
+}
+
+void blive_queue_policy_default(blive_queue_policy* policy)
+{
+    for (int count = BLIVE_INFO_MIN; count < BLIVE_INFO_MAX; count++) {
+        policy[count] = BLIVE_QUEUE_BLOCK;
+    }
+
+    /*只反映当前状态的消息，旧值没有意义，只保留最新的一条*/
+    policy[BLIVE_INFO_POP_VALUE_UPDATE] = BLIVE_QUEUE_COALESCE;
+    policy[BLIVE_INFO_ONLINE_RANK_COUNT] = BLIVE_QUEUE_COALESCE;
+    policy[BLIVE_INFO_WATCHED_CHANGE] = BLIVE_QUEUE_COALESCE;
+    policy[BLIVE_INFO_LIKE_INFO_V3_UPDATE] = BLIVE_QUEUE_COALESCE;
+    policy[BLIVE_INFO_ROOM_REAL_TIME_MESSAGE_UPDATE] = BLIVE_QUEUE_COALESCE;
+}
+
+
+/**
+ * @brief 判断串行队列是否已满：超出本直播间的容量，或所有直播间排队总数超出执行器的容量。调用时需持有strand锁
+ * 
+ * @param [in] strand 串行队列
+ * @return Bool 
+ */
+static inline Bool strand_is_full(blive_strand* strand)
+{
+    size_t  room_cap = strand->entity->queue_capacity;
+    size_t  global_cap = strand->exec->capacity;
+
+    if (room_cap && __atomic_load_n(&strand->count, __ATOMIC_SEQ_CST) >= room_cap) {
+        return True;
+    }
+    if (global_cap && __atomic_load_n(&strand->exec->pending, __ATOMIC_SEQ_CST) >= global_cap) {
+        return True;
+    }
+    return False;
+}
+
+/**
+ * @brief 从队列中移除最早的一条同类型事件，用于drop-oldest策略。调用时需持有strand锁
+ * 
+ * @param [in] strand 串行队列
+ * @param [in] type 消息类型
+ * @return strand_event* 被移除的事件，队列中没有同类型事件时返回NULL
+ */
+static strand_event* strand_remove_oldest(blive_strand* strand, blive_info_type type)
+{
+    strand_event*   prev = NULL;
+    strand_event*   event = NULL;
+    int             prio = BLIVE_PRIORITY_NORMAL;
+
+    for (prio = BLIVE_PRIORITY_NORMAL; prio < BLIVE_PRIORITY_MAX; prio++) {
+        for (prev = NULL, event = strand->head[prio]; event != NULL && event->type != type; event = event->next) {
+            prev = event;
+        }
+        if (event != NULL) {
+            break;
+        }
+    }
+    if (event == NULL) {
+        return NULL;
+    }
+
+    if (prev != NULL) {
+        prev->next = event->next;
+    } else {
+        strand->head[prio] = event->next;
+    }
+    if (strand->tail[prio] == event) {
+        strand->tail[prio] = prev;
+    }
+    if (strand->latest[type] == event) {
+        strand->latest[type] = NULL;
+    }
+    strand->dropped[type]++;
+    __atomic_fetch_add(&strand->exec->dropped[type], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&strand->count, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&strand->exec->pending, 1, __ATOMIC_SEQ_CST);
+
+    return event;
+}
+
+/**
+ * @brief 阻塞等待队列出现空位，调用时不可持有strand锁
+ * 
+ * @param [in] strand 串行队列
+ */
+static void strand_wait_space(blive_strand* strand)
+{
+    blive_executor* exec = strand->exec;
+
+    pthread_mutex_lock(&exec->space_lock);
+    __atomic_fetch_add(&exec->space_waiters, 1, __ATOMIC_SEQ_CST);
+    while (strand_is_full(strand)) {
+        pthread_cond_wait(&exec->space_cond, &exec->space_lock);
+    }
+    __atomic_fetch_sub(&exec->space_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&exec->space_lock);
+}
+
+/**
+ * @brief 从队列中取出一个事件后更新计数，有接收线程在等待空位时将其唤醒。调用时需持有strand锁
+ * 
+ * @param [in] strand 串行队列
+ * @param [in] event 取出的事件
+ */
+static void strand_release_slot(blive_strand* strand, strand_event* event)
+{
+    blive_executor* exec = strand->exec;
+
+    if (strand->latest[event->type] == event) {
+        strand->latest[event->type] = NULL;
+    }
+    __atomic_fetch_sub(&strand->count, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&exec->pending, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&exec->space_waiters, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&exec->space_lock);
+        pthread_cond_broadcast(&exec->space_cond);
+        pthread_mutex_unlock(&exec->space_lock);
+    }
+}
+
+static void* worker_routine(void* arg)
+{
+    blive_worker*   worker = (blive_worker*)arg;
+    blive_executor* exec = worker->exec;
+    blive_strand*   strand = NULL;
+
+    while (True) {
+        /*优先执行本线程的就绪队列，为空时再从其他线程窃取*/
+        strand = worker_pop(worker);
+        if (strand == NULL) {
+            strand = worker_steal(exec, worker);
+        }
+        if (strand != NULL) {
+            strand_run(strand, worker);
+            continue;
+        }
+
+        pthread_mutex_lock(&exec->lock);
+        while (!__atomic_load_n(&exec->ready, __ATOMIC_ACQUIRE) && exec->running) {
+            pthread_cond_wait(&exec->cond, &exec->lock);
+        }
+        if (!exec->running && !__atomic_load_n(&exec->ready, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_unlock(&exec->lock);
+            break;
+        }
+        pthread_mutex_unlock(&exec->lock);
+    }
+
+    return NULL;
+}
+
+static void worker_push(blive_worker* worker, blive_strand* strand)
+{
+    blive_executor* exec = worker->exec;
+
+    strand->next = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->tail != NULL) {
+        worker->tail->next = strand;
+    } else {
+        worker->head = strand;
+    }
+    worker->tail = strand;
+    pthread_mutex_unlock(&worker->lock);
+
+    /*先入队再计数，计数非0时保证一定能取到串行队列；在锁内唤醒，避免丢失唤醒*/
+    __atomic_fetch_add(&exec->ready, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&exec->lock);
+    pthread_cond_signal(&exec->cond);
+    pthread_mutex_unlock(&exec->lock);
+}
+
+static blive_strand* worker_pop(blive_worker* worker)
+{
+    blive_strand*   strand = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    strand = worker->head;
+    if (strand != NULL) {
+        worker->head = strand->next;
+        if (worker->head == NULL) {
+            worker->tail = NULL;
+        }
+        __atomic_fetch_sub(&worker->exec->ready, 1, __ATOMIC_ACQ_REL);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return strand;
+}
+
+static blive_strand* worker_steal(blive_executor* exec, blive_worker* self)
+{
+    blive_strand*   strand = NULL;
+    int             start = self - exec->workers;
+
+    for (int count = 1; count < exec->worker_num && strand == NULL; count++) {
+        strand = worker_pop(&exec->workers[(start + count) % exec->worker_num]);
+    }
+
+    return strand;
+}
+
+/**
+ * @brief 取出下一个待执行的事件。高优先级事件只有不晚于普通队列头部事件所属的数据包时才先取，
+ *          因此高优先级只在同一数据包内提前，不会越过更早数据包中仍在排队的普通事件。调用时需持有strand锁
+ * 
+ * @param [in] strand 串行队列
+ * @return strand_event* 队列为空时返回NULL
+ */
+static strand_event* strand_pop(blive_strand* strand)
+{
+    strand_event*   high = strand->head[BLIVE_PRIORITY_HIGH];
+    strand_event*   normal = strand->head[BLIVE_PRIORITY_NORMAL];
+    int             prio = BLIVE_PRIORITY_NORMAL;
+    strand_event*   event = NULL;
+
+    if (high == NULL && normal == NULL) {
+        return NULL;
+    }
+    if (normal == NULL || (high != NULL && high->packet <= normal->packet)) {
+        prio = BLIVE_PRIORITY_HIGH;
+    }
+
+    event = strand->head[prio];
+    strand->head[prio] = event->next;
+    if (strand->head[prio] == NULL) {
+        strand->tail[prio] = NULL;
+    }
+    return event;
+}
+
+static void strand_run(blive_strand* strand, blive_worker* worker)
+{
+    strand_event*   event = NULL;
+
+    for (int budget = 0; budget < STRAND_RUN_BUDGET; budget++) {
+        pthread_mutex_lock(&strand->lock);
+        event = strand_pop(strand);
+        if (event == NULL) {
+            strand->scheduled = False;
+            pthread_cond_broadcast(&strand->drained);
+            pthread_mutex_unlock(&strand->lock);
+            return;
+        }
+        strand_release_slot(strand, event);
+        pthread_mutex_unlock(&strand->lock);
+
+        event_invoke(strand->entity, event);
+    }
+
+    pthread_mutex_lock(&strand->lock);
+    if (strand->head[BLIVE_PRIORITY_NORMAL] == NULL && strand->head[BLIVE_PRIORITY_HIGH] == NULL) {
+        strand->scheduled = False;
+        pthread_cond_broadcast(&strand->drained);
+        pthread_mutex_unlock(&strand->lock);
+        return;
+    }
+    pthread_mutex_unlock(&strand->lock);
+
+    /*执行预算用完但仍有事件，排到本线程就绪队列末尾，让其他直播间先执行*/
+    worker_push(worker, strand);
+}
+
+static inline void event_invoke(blive* entity, strand_event* event)
+{
+    blive_event_deliver(entity, event->event);
+    blive_event_release(event->event);
+    free(event);
+}
\ No newline at end of file
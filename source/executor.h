@@ -0,0 +1,80 @@
+/**
+ * @file executor.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 回调执行器的内部头文件，工作线程池按直播间串行执行用户回调
+ * @version 0.1
+ * @date 2023-02-04
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_EXECUTOR_H__
+#define __BLIVE_EXECUTOR_H__
+
+#include "blive_def.h"
+
+
+/**
+ * @brief 每个直播间拥有一个串行队列（strand），同一时刻最多只有一个工作线程在执行它的事件，
+ * 因此同一直播间内的回调顺序与接收顺序一致，不同直播间之间则并行执行
+ * 
+ */
+typedef struct blive_strand blive_strand;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 为直播间创建挂载在执行器上的串行队列
+ * 
+ * @param [out] strand 传出串行队列
+ * @param [in] exec 执行器
+ * @param [in] entity 所属的直播间实体
+ * @return int
+ */
+int blive_strand_create(blive_strand** strand, blive_executor* exec, blive* entity);
+
+/**
+ * @brief 等待串行队列内的事件全部执行完毕后销毁。不可在该直播间的回调内调用
+ * 
+ * @param [in] strand 串行队列
+ */
+void blive_strand_destroy(blive_strand* strand);
+
+/**
+ * @brief 将一条消息投递到串行队列，立即返回，回调将在工作线程内执行
+ * 
+ * @param [in] strand 串行队列
+ * @param [in] msg 消息事件，投递成功后所有权转交给执行器，执行完回调后释放
+ * @return int
+ */
+int blive_strand_submit(blive_strand* strand, blive_event* msg);
+
+/**
+ * @brief 开始投递一个新数据包内的消息。高优先级事件只在同一数据包内先于普通事件执行，
+ *          不会越过此前数据包中尚未执行的事件。由接收线程在分发每个数据包前调用
+ * 
+ * @param [in] strand 串行队列
+ */
+void blive_strand_packet(blive_strand* strand);
+
+/**
+ * @brief 阻塞等待串行队列中已投递的事件全部执行完毕
+ * 
+ * @param [in] strand 串行队列
+ */
+void blive_strand_drain(blive_strand* strand);
+
+/**
+ * @brief 填充各消息类型默认的队列策略
+ * 
+ * @param [out] policy 长度为BLIVE_INFO_MAX的策略数组
+ */
+void blive_queue_policy_default(blive_queue_policy* policy);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
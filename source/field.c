@@ -0,0 +1,351 @@
+/**
+ * @file field.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 常用字段提取：按“data.uid”、“info.2.0”形式的路径在消息原文上跳过无关的值，直接定位字段
+ * @version 0.1
+ * @date 2023-02-15
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "field.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+static const char*  field_name[BLIVE_FIELD_MAX] = {
+    [BLIVE_FIELD_UID]           = "uid",
+    [BLIVE_FIELD_UNAME]         = "uname",
+    [BLIVE_FIELD_TEXT]          = "text",
+    [BLIVE_FIELD_MEDAL_LEVEL]   = "medal_level",
+    [BLIVE_FIELD_MEDAL_NAME]    = "medal_name",
+    [BLIVE_FIELD_USER_LEVEL]    = "user_level",
+    [BLIVE_FIELD_GUARD_LEVEL]   = "guard_level",
+    [BLIVE_FIELD_GIFT_ID]       = "gift_id",
+    [BLIVE_FIELD_GIFT_NAME]     = "gift_name",
+    [BLIVE_FIELD_PRICE]         = "price",
+    [BLIVE_FIELD_NUM]           = "num",
+    [BLIVE_FIELD_TOTAL_COIN]    = "total_coin",
+    [BLIVE_FIELD_COMBO_NUM]     = "combo_num",
+    [BLIVE_FIELD_MSG_TYPE]      = "msg_type",
+    [BLIVE_FIELD_TIMESTAMP]     = "timestamp",
+};
+
+/*各类型中字段的路径，以'.'分隔，数字为数组下标；NULL表示该类型没有此字段*/
+static const char*  field_path[BLIVE_FIELD_MAX][BLIVE_INFO_MAX] = {
+    [BLIVE_FIELD_UID] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.2.0",
+        [BLIVE_INFO_INTERACT_WORD]      = "data.uid",
+        [BLIVE_INFO_SEND_GIFT]          = "data.uid",
+        [BLIVE_INFO_COMBO_SEND]         = "data.uid",
+        [BLIVE_INFO_LIKE_INFO_V3_CLICK] = "data.uid",
+        [BLIVE_INFO_ENTRY_EFFECT]       = "data.uid",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_START]    = "data.sender_uid",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.uid",
+    },
+    [BLIVE_FIELD_UNAME] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.2.1",
+        [BLIVE_INFO_INTERACT_WORD]      = "data.uname",
+        [BLIVE_INFO_SEND_GIFT]          = "data.uname",
+        [BLIVE_INFO_COMBO_SEND]         = "data.uname",
+        [BLIVE_INFO_LIKE_INFO_V3_CLICK] = "data.uname",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_START]    = "data.sender_name",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.uname",
+    },
+    [BLIVE_FIELD_TEXT] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.1",
+    },
+    [BLIVE_FIELD_MEDAL_LEVEL] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.3.0",
+        [BLIVE_INFO_INTERACT_WORD]      = "data.fans_medal.medal_level",
+        [BLIVE_INFO_SEND_GIFT]          = "data.medal_info.medal_level",
+        [BLIVE_INFO_COMBO_SEND]         = "data.medal_info.medal_level",
+        [BLIVE_INFO_LIKE_INFO_V3_CLICK] = "data.fans_medal.medal_level",
+    },
+    [BLIVE_FIELD_MEDAL_NAME] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.3.1",
+        [BLIVE_INFO_INTERACT_WORD]      = "data.fans_medal.medal_name",
+        [BLIVE_INFO_SEND_GIFT]          = "data.medal_info.medal_name",
+        [BLIVE_INFO_COMBO_SEND]         = "data.medal_info.medal_name",
+        [BLIVE_INFO_LIKE_INFO_V3_CLICK] = "data.fans_medal.medal_name",
+    },
+    [BLIVE_FIELD_USER_LEVEL] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.4.0",
+    },
+    [BLIVE_FIELD_GUARD_LEVEL] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.7",
+        [BLIVE_INFO_SEND_GIFT]          = "data.guard_level",
+        [BLIVE_INFO_ENTRY_EFFECT]       = "data.privilege_type",
+    },
+    [BLIVE_FIELD_GIFT_ID] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.giftId",
+        [BLIVE_INFO_COMBO_SEND]         = "data.gift_id",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.gift_id",
+    },
+    [BLIVE_FIELD_GIFT_NAME] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.giftName",
+        [BLIVE_INFO_COMBO_SEND]         = "data.gift_name",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.gift_name",
+    },
+    [BLIVE_FIELD_PRICE] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.price",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_START]    = "data.total_price",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.price",
+    },
+    [BLIVE_FIELD_NUM] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.num",
+        [BLIVE_INFO_COMBO_SEND]         = "data.gift_num",
+        [BLIVE_INFO_POPULARITY_RED_POCKET_NEW]      = "data.num",
+    },
+    [BLIVE_FIELD_TOTAL_COIN] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.total_coin",
+        [BLIVE_INFO_COMBO_SEND]         = "data.combo_total_coin",
+    },
+    [BLIVE_FIELD_COMBO_NUM] = {
+        [BLIVE_INFO_SEND_GIFT]          = "data.super_gift_num",
+        [BLIVE_INFO_COMBO_SEND]         = "data.combo_num",
+    },
+    [BLIVE_FIELD_MSG_TYPE] = {
+        [BLIVE_INFO_INTERACT_WORD]      = "data.msg_type",
+    },
+    [BLIVE_FIELD_TIMESTAMP] = {
+        [BLIVE_INFO_DANMU_MSG]          = "info.0.4",
+        [BLIVE_INFO_INTERACT_WORD]      = "data.timestamp",
+        [BLIVE_INFO_SEND_GIFT]          = "data.timestamp",
+    },
+};
+
+
+static const char* json_skip_ws(const char* p, const char* end);
+static const char* json_skip_string(const char* p, const char* end);
+static const char* json_skip_value(const char* p, const char* end);
+static const char* json_find_key(const char* p, const char* end, const char* key, int key_len);
+static const char* json_find_index(const char* p, const char* end, int index);
+
+
+int blive_field_lookup(const char* name, int len)
+{
+    for (int field = 0; field < BLIVE_FIELD_MAX; field++) {
+        if (!strncmp(field_name[field], name, len) && field_name[field][len] == '\0') {
+            return field;
+        }
+    }
+    return ERROR;
+}
+
+const char* blive_field_name(blive_field_id field)
+{
+    return field < BLIVE_FIELD_MAX ? field_name[field] : "unknown";
+}
+
+int blive_field_extract(blive_info_type type, const char* raw, int len, blive_field_id field, blive_field_value* value)
+{
+    const char* path = NULL;
+    const char* next = NULL;
+    const char* p = raw;
+    const char* end = raw + len;
+    int         step_len = 0;
+    char*       num_end = NULL;
+
+    value->kind = BLIVE_FIELD_NONE;
+    if (type >= BLIVE_INFO_MAX || field >= BLIVE_FIELD_MAX || (path = field_path[field][type]) == NULL) {
+        return ERROR;
+    }
+
+    /*逐级定位，每一级只跳过不相关的值，不解析*/
+    while (p != NULL && *path) {
+        next = strchr(path, '.');
+        step_len = next != NULL ? next - path : (int)strlen(path);
+        p = json_skip_ws(p, end);
+        if (p < end && *p == '[' && *path >= '0' && *path <= '9') {
+            p = json_find_index(p, end, atoi(path));
+        } else if (p < end && *p == '{') {
+            p = json_find_key(p, end, path, step_len);
+        } else {
+            p = NULL;
+        }
+        path += step_len + (next != NULL ? 1 : 0);
+    }
+    if (p == NULL || (p = json_skip_ws(p, end)) >= end) {
+        return ERROR;
+    }
+
+    switch (*p) {
+    case '"':
+        if ((next = json_skip_string(p, end)) == NULL) {
+            return ERROR;
+        }
+        value->kind = BLIVE_FIELD_STRING;
+        value->str = p + 1;
+        value->str_len = next - p - 2;
+        break;
+    case 't':
+    case 'f':
+        value->kind = BLIVE_FIELD_NUMBER;
+        value->number = *p == 't' ? 1 : 0;
+        break;
+    case 'n':
+        return ERROR;
+    default:
+        /*数值后必然跟随','、']'或'}'，strtod不会越过原文末尾*/
+        value->number = strtod(p, &num_end);
+        if (num_end == p) {
+            return ERROR;
+        }
+        value->kind = BLIVE_FIELD_NUMBER;
+        break;
+    }
+
+    return OK;
+}
+
+
+static inline const char* json_skip_ws(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief 跳过一个字符串
+ * 
+ * @param [in] p 指向开头的引号
+ * @param [in] end 原文末尾
+ * @return const char* 指向结尾引号之后，字符串不完整时返回NULL
+ */
+static const char* json_skip_string(const char* p, const char* end)
+{
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 跳过一个任意类型的值，对象与数组只计算嵌套深度
+ * 
+ * @param [in] p 指向值的开头
+ * @param [in] end 原文末尾
+ * @return const char* 指向值之后，格式错误时返回NULL
+ */
+static const char* json_skip_value(const char* p, const char* end)
+{
+    int     depth = 0;
+
+    p = json_skip_ws(p, end);
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return json_skip_string(p, end);
+    }
+    if (*p != '{' && *p != '[') {
+        while (p < end && *p != ',' && *p != '}' && *p != ']') {
+            p++;
+        }
+        return p < end ? p : NULL;
+    }
+
+    while (p < end) {
+        switch (*p) {
+        case '"':
+            if ((p = json_skip_string(p, end)) == NULL) {
+                return NULL;
+            }
+            continue;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0) {
+                return p + 1;
+            }
+            break;
+        default:
+            break;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在对象中查找键
+ * 
+ * @param [in] p 指向对象的'{'
+ * @param [in] end 原文末尾
+ * @param [in] key 键名，不含引号
+ * @param [in] key_len 键名长度
+ * @return const char* 指向对应的值，不存在时返回NULL
+ */
+static const char* json_find_key(const char* p, const char* end, const char* key, int key_len)
+{
+    const char* key_begin = NULL;
+    const char* key_end = NULL;
+    Bool        matched = False;
+
+    for (p = json_skip_ws(p + 1, end); p < end && *p == '"'; ) {
+        key_begin = p + 1;
+        if ((key_end = json_skip_string(p, end)) == NULL) {
+            return NULL;
+        }
+        matched = (key_end - 1 - key_begin == key_len && !memcmp(key_begin, key, key_len)) ? True : False;
+        p = json_skip_ws(key_end, end);
+        if (p >= end || *p != ':') {
+            return NULL;
+        }
+        p = json_skip_ws(p + 1, end);
+        if (matched) {
+            return p;
+        }
+
+        if ((p = json_skip_value(p, end)) == NULL) {
+            return NULL;
+        }
+        p = json_skip_ws(p, end);
+        if (p >= end || *p != ',') {
+            return NULL;
+        }
+        p = json_skip_ws(p + 1, end);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在数组中查找下标
+ * 
+ * @param [in] p 指向数组的'['
+ * @param [in] end 原文末尾
+ * @param [in] index 下标
+ * @return const char* 指向对应的值，越界时返回NULL
+ */
+static const char* json_find_index(const char* p, const char* end, int index)
+{
+    p = json_skip_ws(p + 1, end);
+    if (p >= end || *p == ']') {
+        return NULL;
+    }
+    for (int count = 0; count < index; count++) {
+        if ((p = json_skip_value(p, end)) == NULL) {
+            return NULL;
+        }
+        p = json_skip_ws(p, end);
+        if (p >= end || *p != ',') {
+            return NULL;
+        }
+        p = json_skip_ws(p + 1, end);
+    }
+    return p;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+/**
+ * @file field.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 常用字段提取的内部头文件，直接在消息原文上按路径定位字段，不构建JSON树
+ * @version 0.1
+ * @date 2023-02-15
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_FIELD_H__
+#define __BLIVE_FIELD_H__
+
+#include "blive_def.h"
+
+
+/**
+ * @brief 各消息类型中含义相同的常用字段，同一字段在不同类型中的位置不同
+ * 
+ */
+typedef enum {
+    BLIVE_FIELD_UID,                    /*用户id*/
+    BLIVE_FIELD_UNAME,                  /*用户名*/
+    BLIVE_FIELD_TEXT,                   /*弹幕内容*/
+    BLIVE_FIELD_MEDAL_LEVEL,            /*粉丝勋章等级*/
+    BLIVE_FIELD_MEDAL_NAME,             /*粉丝勋章名*/
+    BLIVE_FIELD_USER_LEVEL,             /*用户等级*/
+    BLIVE_FIELD_GUARD_LEVEL,            /*大航海等级*/
+    BLIVE_FIELD_GIFT_ID,                /*礼物id*/
+    BLIVE_FIELD_GIFT_NAME,              /*礼物名*/
+    BLIVE_FIELD_PRICE,                  /*礼物单价*/
+    BLIVE_FIELD_NUM,                    /*礼物数量*/
+    BLIVE_FIELD_TOTAL_COIN,             /*礼物总价*/
+    BLIVE_FIELD_COMBO_NUM,              /*连击数*/
+    BLIVE_FIELD_MSG_TYPE,               /*进场或关注的类型*/
+    BLIVE_FIELD_TIMESTAMP,              /*服务端时间，弹幕为毫秒，其他类型为秒*/
+    BLIVE_FIELD_MAX,
+} blive_field_id;
+
+typedef enum {
+    BLIVE_FIELD_NONE,                   /*字段不存在或为null*/
+    BLIVE_FIELD_NUMBER,                 /*数值，true/false分别为1/0*/
+    BLIVE_FIELD_STRING,                 /*字符串，指向原文中引号内的内容，转义字符未还原*/
+} blive_field_kind;
+
+typedef struct {
+    blive_field_kind    kind;
+    double              number;
+    const char*         str;
+    int                 str_len;
+} blive_field_value;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 按字段名查找字段
+ * 
+ * @param [in] name 字段名，如"uid"、"medal_level"
+ * @param [in] len 字段名长度
+ * @return int 字段id，不存在时返回ERROR
+ */
+int blive_field_lookup(const char* name, int len);
+
+/**
+ * @brief 获取字段名
+ * 
+ * @param [in] field 字段id
+ * @return const char* 
+ */
+const char* blive_field_name(blive_field_id field);
+
+/**
+ * @brief 从消息原文中提取字段
+ * 
+ * @param [in] type 消息类型
+ * @param [in] raw 消息原文
+ * @param [in] len 原文长度
+ * @param [in] field 字段id
+ * @param [out] value 传出字段值，字段不存在时kind为BLIVE_FIELD_NONE
+ * @return int 该类型没有此字段或原文中不存在时返回ERROR
+ */
+int blive_field_extract(blive_info_type type, const char* raw, int len, blive_field_id field, blive_field_value* value);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,749 @@
+/**
+ * @file filter.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 消息过滤：过滤表达式的词法、语法分析与字节码生成，以及基于累加器的字节码解释执行
+ * @version 0.1
+ * @date 2023-02-15
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_MSG
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "filter.h"
+#include "field.h"
+#include "msg.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define FILTER_SET_NAME_LEN     32
+
+typedef enum {
+    OP_TYPE_IN,         /*acc = 消息类型在masks[arg]中*/
+    OP_NUM_CMP,         /*acc = 数值字段field与nums[arg]按cmp比较*/
+    OP_STR_EQ,          /*acc = 字符串字段field等于strs[arg]*/
+    OP_STR_NE,          /*acc = 字符串字段field不等于strs[arg]*/
+    OP_CONTAINS,        /*acc = 字符串字段field包含strs[arg]*/
+    OP_IN_SET,          /*acc = 数值字段field在sets[arg]中*/
+    OP_NOT,             /*acc = !acc*/
+    OP_JUMP_FALSE,      /*acc为False时跳转到arg，用于&&短路*/
+    OP_JUMP_TRUE,       /*acc为True时跳转到arg，用于||短路*/
+    OP_END,             /*返回acc*/
+} filter_op;
+
+typedef enum {
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+} filter_cmp;
+
+typedef struct {
+    uint8_t     op;
+    uint8_t     cmp;
+    uint8_t     field;
+    uint8_t     reserved;
+    uint32_t    arg;
+} filter_insn;
+
+typedef struct {
+    char*       str;
+    int         len;
+} filter_str;
+
+typedef struct {
+    char        name[FILTER_SET_NAME_LEN];  /*通过$name引用的集合名，字面量列表为空字符串*/
+    uint64_t*   values;                     /*升序排列*/
+    size_t      num;
+} filter_set;
+
+struct blive_filter {
+    filter_insn*    code;
+    int             code_num;
+    int             code_cap;
+    double*         nums;
+    int             num_num;
+    int             num_cap;
+    filter_str*     strs;
+    int             str_num;
+    int             str_cap;
+    uint64_t*       masks;
+    int             mask_num;
+    int             mask_cap;
+    filter_set*     sets;
+    int             set_num;
+    int             set_cap;
+};
+
+typedef enum {
+    TK_END,
+    TK_IDENT,
+    TK_NUMBER,
+    TK_STRING,
+    TK_SET,             /*$name*/
+    TK_LPAREN,
+    TK_RPAREN,
+    TK_COMMA,
+    TK_AND,
+    TK_OR,
+    TK_NOT,
+    TK_CMP,
+    TK_ERROR,
+} filter_token_kind;
+
+typedef struct {
+    const char*         expr;
+    const char*         pos;
+    blive_filter*       filter;
+    filter_token_kind   kind;       /*当前词法单元*/
+    const char*         start;
+    int                 len;
+    double              number;
+    filter_cmp          cmp;
+} filter_parser;
+
+
+static int array_push(void** array, int* num, int* cap, size_t elem_size, const void* elem);
+static int emit(filter_parser* parser, filter_op op, filter_cmp cmp, int field, uint32_t arg);
+static void token_next(filter_parser* parser);
+static int parse_error(filter_parser* parser, const char* what);
+static int parse_or(filter_parser* parser);
+static int parse_and(filter_parser* parser);
+static int parse_unary(filter_parser* parser);
+static int parse_cond(filter_parser* parser);
+static int parse_type_cond(filter_parser* parser);
+static int parse_set(filter_parser* parser, int field);
+static int parse_string(filter_parser* parser);
+static Bool token_is(const filter_parser* parser, const char* ident);
+static int cmp_uint64(const void* a, const void* b);
+static Bool set_contains(const filter_set* set, uint64_t value);
+static Bool str_contains(const char* str, int len, const filter_str* sub);
+
+
+int blive_filter_compile(blive_filter** filter, const char* expr)
+{
+    filter_parser   parser = {0};
+
+    if (filter == NULL || expr == NULL) {
+        return ERROR;
+    }
+
+    parser.filter = malloc(sizeof(blive_filter));
+    if (parser.filter == NULL) {
+        return ERROR;
+    }
+    memset(parser.filter, 0, sizeof(blive_filter));
+    parser.expr = expr;
+    parser.pos = expr;
+
+    token_next(&parser);
+    if (parse_or(&parser) == ERROR) {
+        blive_filter_destroy(parser.filter);
+        return ERROR;
+    }
+    if (parser.kind != TK_END) {
+        parse_error(&parser, "unexpected token");
+        blive_filter_destroy(parser.filter);
+        return ERROR;
+    }
+    if (emit(&parser, OP_END, CMP_EQ, 0, 0) == ERROR) {
+        blive_filter_destroy(parser.filter);
+        return ERROR;
+    }
+
+    blive_logi("filter compiled: %s (%d insns)", expr, parser.filter->code_num);
+    *filter = parser.filter;
+    return OK;
+}
+
+int blive_filter_bind_set(blive_filter* filter, const char* name, const uint64_t* values, size_t num)
+{
+    uint64_t*   sorted = NULL;
+
+    if (filter == NULL || name == NULL || (values == NULL && num)) {
+        return ERROR;
+    }
+
+    for (int count = 0; count < filter->set_num; count++) {
+        if (strcmp(filter->sets[count].name, name)) {
+            continue;
+        }
+        sorted = malloc(sizeof(uint64_t) * (num ? num : 1));
+        if (sorted == NULL) {
+            return ERROR;
+        }
+        memcpy(sorted, values, sizeof(uint64_t) * num);
+        qsort(sorted, num, sizeof(uint64_t), cmp_uint64);
+        free(filter->sets[count].values);
+        filter->sets[count].values = sorted;
+        filter->sets[count].num = num;
+        return OK;
+    }
+
+    blive_loge("filter set $%s not referenced", name);
+    return ERROR;
+}
+
+int blive_filter_destroy(blive_filter* filter)
+{
+    if (filter == NULL) {
+        return ERROR;
+    }
+
+    for (int count = 0; count < filter->str_num; count++) {
+        free(filter->strs[count].str);
+    }
+    for (int count = 0; count < filter->set_num; count++) {
+        free(filter->sets[count].values);
+    }
+    free(filter->code);
+    free(filter->nums);
+    free(filter->strs);
+    free(filter->masks);
+    free(filter->sets);
+    free(filter);
+
+    return OK;
+}
+
+int blive_set_filter(blive* entity, blive_filter* filter)
+{
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    entity->filter = filter;
+    return OK;
+}
+
+Bool blive_filter_match(const blive_filter* filter, const blive_event* event)
+{
+    size_t      len = 0;
+    const char* raw = blive_event_raw(event, &len);
+
+    return blive_filter_eval(filter, blive_event_type(event), raw, (int)len);
+}
+
+Bool blive_filter_eval(const blive_filter* filter, blive_info_type type, const char* raw, int len)
+{
+    blive_field_value   values[BLIVE_FIELD_MAX];
+    uint32_t            loaded = 0;
+    const filter_insn*  insn = NULL;
+    blive_field_value*  value = NULL;
+    Bool                acc = False;
+    double              diff = 0;
+
+    for (int pc = 0; ; pc++) {
+        insn = &filter->code[pc];
+
+        /*字段在第一次用到时才从原文中提取，同一条消息只提取一次*/
+        if (insn->op >= OP_NUM_CMP && insn->op <= OP_IN_SET) {
+            value = &values[insn->field];
+            if (!(loaded & (1U << insn->field))) {
+                blive_field_extract(type, raw, len, insn->field, value);
+                loaded |= 1U << insn->field;
+            }
+        }
+
+        switch (insn->op) {
+        case OP_TYPE_IN:
+            acc = (filter->masks[insn->arg] & BLIVE_INFO_BIT(type)) ? True : False;
+            break;
+        case OP_NUM_CMP:
+            if (value->kind != BLIVE_FIELD_NUMBER) {
+                acc = False;
+                break;
+            }
+            diff = value->number - filter->nums[insn->arg];
+            switch (insn->cmp) {
+            case CMP_EQ: acc = diff == 0 ? True : False; break;
+            case CMP_NE: acc = diff != 0 ? True : False; break;
+            case CMP_LT: acc = diff < 0 ? True : False; break;
+            case CMP_LE: acc = diff <= 0 ? True : False; break;
+            case CMP_GT: acc = diff > 0 ? True : False; break;
+            default:     acc = diff >= 0 ? True : False; break;
+            }
+            break;
+        case OP_STR_EQ:
+        case OP_STR_NE:
+            if (value->kind != BLIVE_FIELD_STRING) {
+                acc = False;
+                break;
+            }
+            acc = (value->str_len == filter->strs[insn->arg].len
+                   && !memcmp(value->str, filter->strs[insn->arg].str, value->str_len)) ? True : False;
+            if (insn->op == OP_STR_NE) {
+                acc = acc ? False : True;
+            }
+            break;
+        case OP_CONTAINS:
+            acc = value->kind == BLIVE_FIELD_STRING ? str_contains(value->str, value->str_len, &filter->strs[insn->arg]) : False;
+            break;
+        case OP_IN_SET:
+            acc = value->kind == BLIVE_FIELD_NUMBER ? set_contains(&filter->sets[insn->arg], (uint64_t)value->number) : False;
+            break;
+        case OP_NOT:
+            acc = acc ? False : True;
+            break;
+        case OP_JUMP_FALSE:
+            if (!acc) {
+                pc = insn->arg - 1;
+            }
+            break;
+        case OP_JUMP_TRUE:
+            if (acc) {
+                pc = insn->arg - 1;
+            }
+            break;
+        default:
+            return acc;
+        }
+    }
+}
+
+
+/**
+ * @brief 向动态数组末尾追加一个元素，容量不足时扩容
+ * 
+ * @return int 新元素的下标，申请内存失败时返回ERROR
+ */
+static int array_push(void** array, int* num, int* cap, size_t elem_size, const void* elem)
+{
+    void*   bigger = NULL;
+
+    if (*num >= *cap) {
+        bigger = realloc(*array, elem_size * (*cap ? *cap * 2 : 8));
+        if (bigger == NULL) {
+            return ERROR;
+        }
+        *array = bigger;
+        *cap = *cap ? *cap * 2 : 8;
+    }
+    memcpy((char*)*array + elem_size * *num, elem, elem_size);
+    return (*num)++;
+}
+
+static int emit(filter_parser* parser, filter_op op, filter_cmp cmp, int field, uint32_t arg)
+{
+    filter_insn insn = {op, cmp, field, 0, arg};
+
+    return array_push((void**)&parser->filter->code, &parser->filter->code_num, &parser->filter->code_cap,
+                      sizeof(filter_insn), &insn);
+}
+
+static void token_next(filter_parser* parser)
+{
+    const char* p = parser->pos;
+    char*       num_end = NULL;
+
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    parser->start = p;
+    parser->len = 1;
+
+    switch (*p) {
+    case '\0':
+        parser->kind = TK_END;
+        parser->len = 0;
+        break;
+    case '(':
+        parser->kind = TK_LPAREN;
+        break;
+    case ')':
+        parser->kind = TK_RPAREN;
+        break;
+    case ',':
+        parser->kind = TK_COMMA;
+        break;
+    case '&':
+    case '|':
+        parser->kind = p[1] == p[0] ? (*p == '&' ? TK_AND : TK_OR) : TK_ERROR;
+        parser->len = 2;
+        break;
+    case '!':
+        parser->kind = p[1] == '=' ? TK_CMP : TK_NOT;
+        parser->cmp = CMP_NE;
+        parser->len = p[1] == '=' ? 2 : 1;
+        break;
+    case '=':
+        parser->kind = p[1] == '=' ? TK_CMP : TK_ERROR;
+        parser->cmp = CMP_EQ;
+        parser->len = 2;
+        break;
+    case '<':
+    case '>':
+        parser->kind = TK_CMP;
+        parser->cmp = p[1] == '=' ? (*p == '<' ? CMP_LE : CMP_GE) : (*p == '<' ? CMP_LT : CMP_GT);
+        parser->len = p[1] == '=' ? 2 : 1;
+        break;
+    case '"':
+        /*字符串的转义在parse_string中处理，这里只找到结尾的引号*/
+        for (parser->len = 1; p[parser->len] && p[parser->len] != '"'; parser->len++) {
+            if (p[parser->len] == '\\' && p[parser->len + 1]) {
+                parser->len++;
+            }
+        }
+        parser->kind = p[parser->len] == '"' ? TK_STRING : TK_ERROR;
+        parser->len++;
+        break;
+    default:
+        if (*p == '$' || *p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+            parser->kind = *p == '$' ? TK_SET : TK_IDENT;
+            for (parser->len = 1; p[parser->len] == '_' || (p[parser->len] >= 'a' && p[parser->len] <= 'z')
+                 || (p[parser->len] >= 'A' && p[parser->len] <= 'Z') || (p[parser->len] >= '0' && p[parser->len] <= '9'); ) {
+                parser->len++;
+            }
+        } else if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            parser->number = strtod(p, &num_end);
+            parser->kind = num_end != p ? TK_NUMBER : TK_ERROR;
+            parser->len = num_end != p ? num_end - p : 1;
+        } else {
+            parser->kind = TK_ERROR;
+        }
+        break;
+    }
+
+    parser->pos = p + parser->len;
+}
+
+static int parse_error(filter_parser* parser, const char* what)
+{
+    if (parser->kind == TK_END) {
+        blive_loge("filter syntax error at end: %s", what);
+    } else {
+        blive_loge("filter syntax error at %d: %s near '%.*s'", (int)(parser->start - parser->expr), what,
+                   parser->len, parser->start);
+    }
+    return ERROR;
+}
+
+/**
+ * @brief or := and ('||' and)*，生成 A; JUMP_TRUE L; B; L:
+ * 
+ */
+static int parse_or(filter_parser* parser)
+{
+    int     jump = 0;
+
+    if (parse_and(parser) == ERROR) {
+        return ERROR;
+    }
+    while (parser->kind == TK_OR) {
+        token_next(parser);
+        if ((jump = emit(parser, OP_JUMP_TRUE, CMP_EQ, 0, 0)) == ERROR || parse_and(parser) == ERROR) {
+            return ERROR;
+        }
+        parser->filter->code[jump].arg = parser->filter->code_num;
+    }
+    return OK;
+}
+
+/**
+ * @brief and := unary ('&&' unary)*，生成 A; JUMP_FALSE L; B; L:
+ * 
+ */
+static int parse_and(filter_parser* parser)
+{
+    int     jump = 0;
+
+    if (parse_unary(parser) == ERROR) {
+        return ERROR;
+    }
+    while (parser->kind == TK_AND) {
+        token_next(parser);
+        if ((jump = emit(parser, OP_JUMP_FALSE, CMP_EQ, 0, 0)) == ERROR || parse_unary(parser) == ERROR) {
+            return ERROR;
+        }
+        parser->filter->code[jump].arg = parser->filter->code_num;
+    }
+    return OK;
+}
+
+/**
+ * @brief unary := '!' unary | '(' or ')' | cond
+ * 
+ */
+static int parse_unary(filter_parser* parser)
+{
+    if (parser->kind == TK_NOT) {
+        token_next(parser);
+        if (parse_unary(parser) == ERROR) {
+            return ERROR;
+        }
+        return emit(parser, OP_NOT, CMP_EQ, 0, 0) == ERROR ? ERROR : OK;
+    }
+    if (parser->kind == TK_LPAREN) {
+        token_next(parser);
+        if (parse_or(parser) == ERROR) {
+            return ERROR;
+        }
+        if (parser->kind != TK_RPAREN) {
+            return parse_error(parser, "expect ')'");
+        }
+        token_next(parser);
+        return OK;
+    }
+    return parse_cond(parser);
+}
+
+/**
+ * @brief cond := 'type' ... | field cmp (number | string) | field 'in' set | field 'contains' string
+ * 
+ */
+static int parse_cond(filter_parser* parser)
+{
+    int         field = ERROR;
+    int         index = ERROR;
+    filter_cmp  cmp = CMP_EQ;
+
+    if (parser->kind != TK_IDENT) {
+        return parse_error(parser, "expect field");
+    }
+    if (token_is(parser, "type")) {
+        return parse_type_cond(parser);
+    }
+    if ((field = blive_field_lookup(parser->start, parser->len)) == ERROR) {
+        return parse_error(parser, "unknown field");
+    }
+    token_next(parser);
+
+    if (parser->kind == TK_IDENT && token_is(parser, "in")) {
+        token_next(parser);
+        if ((index = parse_set(parser, field)) == ERROR) {
+            return ERROR;
+        }
+        return emit(parser, OP_IN_SET, CMP_EQ, field, index) == ERROR ? ERROR : OK;
+    }
+    if (parser->kind == TK_IDENT && token_is(parser, "contains")) {
+        token_next(parser);
+        if ((index = parse_string(parser)) == ERROR) {
+            return ERROR;
+        }
+        return emit(parser, OP_CONTAINS, CMP_EQ, field, index) == ERROR ? ERROR : OK;
+    }
+    if (parser->kind != TK_CMP) {
+        return parse_error(parser, "expect operator");
+    }
+    cmp = parser->cmp;
+    token_next(parser);
+
+    if (parser->kind == TK_STRING) {
+        if (cmp != CMP_EQ && cmp != CMP_NE) {
+            return parse_error(parser, "string only supports == and !=");
+        }
+        if ((index = parse_string(parser)) == ERROR) {
+            return ERROR;
+        }
+        return emit(parser, cmp == CMP_EQ ? OP_STR_EQ : OP_STR_NE, CMP_EQ, field, index) == ERROR ? ERROR : OK;
+    }
+    if (parser->kind != TK_NUMBER) {
+        return parse_error(parser, "expect number or string");
+    }
+    index = array_push((void**)&parser->filter->nums, &parser->filter->num_num, &parser->filter->num_cap,
+                       sizeof(double), &parser->number);
+    token_next(parser);
+    if (index == ERROR) {
+        return ERROR;
+    }
+    return emit(parser, OP_NUM_CMP, cmp, field, index) == ERROR ? ERROR : OK;
+}
+
+/**
+ * @brief 'type' ('=='|'!=') TYPE_NAME | 'type' 'in' '(' TYPE_NAME (',' TYPE_NAME)* ')'，类型名与cmd字段相同
+ * 
+ */
+static int parse_type_cond(filter_parser* parser)
+{
+    uint64_t    mask = 0;
+    int         type = BLIVE_INFO_MAX;
+    int         index = ERROR;
+    Bool        negative = False;
+    Bool        is_list = False;
+
+    token_next(parser);
+    if (parser->kind == TK_CMP && (parser->cmp == CMP_EQ || parser->cmp == CMP_NE)) {
+        negative = parser->cmp == CMP_NE ? True : False;
+    } else if (parser->kind == TK_IDENT && token_is(parser, "in")) {
+        is_list = True;
+        token_next(parser);
+        if (parser->kind != TK_LPAREN) {
+            return parse_error(parser, "expect '('");
+        }
+    } else {
+        return parse_error(parser, "expect ==, != or in");
+    }
+
+    do {
+        token_next(parser);
+        if (parser->kind != TK_IDENT || (type = blive_info_lookup(parser->start, parser->len)) >= BLIVE_INFO_MAX) {
+            return parse_error(parser, "unknown message type");
+        }
+        mask |= BLIVE_INFO_BIT(type);
+        token_next(parser);
+    } while (is_list && parser->kind == TK_COMMA);
+
+    if (is_list) {
+        if (parser->kind != TK_RPAREN) {
+            return parse_error(parser, "expect ')'");
+        }
+        token_next(parser);
+    }
+
+    index = array_push((void**)&parser->filter->masks, &parser->filter->mask_num, &parser->filter->mask_cap,
+                       sizeof(uint64_t), &mask);
+    if (index == ERROR || emit(parser, OP_TYPE_IN, CMP_EQ, 0, index) == ERROR) {
+        return ERROR;
+    }
+    return negative ? (emit(parser, OP_NOT, CMP_EQ, 0, 0) == ERROR ? ERROR : OK) : OK;
+}
+
+/**
+ * @brief '(' number (',' number)* ')' 或 $name，$name的内容通过blive_filter_bind_set设置
+ * 
+ * @return int 集合下标
+ */
+static int parse_set(filter_parser* parser, int field)
+{
+    filter_set  set = {{0}};
+    uint64_t    value = 0;
+    int         value_cap = 0;
+    int         value_num = 0;
+    int         index = ERROR;
+
+    if (parser->kind == TK_SET) {
+        if (parser->len - 1 >= FILTER_SET_NAME_LEN || parser->len == 1) {
+            return parse_error(parser, "invalid set name");
+        }
+        for (index = 0; index < parser->filter->set_num; index++) {
+            if (!strncmp(parser->filter->sets[index].name, parser->start + 1, parser->len - 1)
+                && parser->filter->sets[index].name[parser->len - 1] == '\0') {
+                token_next(parser);
+                return index;
+            }
+        }
+        memcpy(set.name, parser->start + 1, parser->len - 1);
+        token_next(parser);
+        return array_push((void**)&parser->filter->sets, &parser->filter->set_num, &parser->filter->set_cap,
+                          sizeof(filter_set), &set);
+    }
+
+    if (parser->kind != TK_LPAREN) {
+        return parse_error(parser, "expect '(' or $set");
+    }
+    do {
+        token_next(parser);
+        if (parser->kind != TK_NUMBER) {
+            free(set.values);
+            return parse_error(parser, "expect number");
+        }
+        value = (uint64_t)parser->number;
+        if (array_push((void**)&set.values, &value_num, &value_cap, sizeof(uint64_t), &value) == ERROR) {
+            free(set.values);
+            return ERROR;
+        }
+        token_next(parser);
+    } while (parser->kind == TK_COMMA);
+    if (parser->kind != TK_RPAREN) {
+        free(set.values);
+        return parse_error(parser, "expect ')'");
+    }
+    token_next(parser);
+
+    set.num = value_num;
+    qsort(set.values, set.num, sizeof(uint64_t), cmp_uint64);
+    if ((index = array_push((void**)&parser->filter->sets, &parser->filter->set_num, &parser->filter->set_cap,
+                            sizeof(filter_set), &set)) == ERROR) {
+        free(set.values);
+    }
+    return index;
+}
+
+/**
+ * @brief 将当前的字符串字面量还原转义后存入常量表
+ * 
+ * @return int 常量下标
+ */
+static int parse_string(filter_parser* parser)
+{
+    filter_str  str = {0};
+    int         index = ERROR;
+
+    if (parser->kind != TK_STRING) {
+        return parse_error(parser, "expect string");
+    }
+    str.str = malloc(parser->len);
+    if (str.str == NULL) {
+        return ERROR;
+    }
+    for (int count = 1; count < parser->len - 1; count++) {
+        if (parser->start[count] == '\\') {
+            count++;
+        }
+        str.str[str.len++] = parser->start[count];
+    }
+    token_next(parser);
+
+    if ((index = array_push((void**)&parser->filter->strs, &parser->filter->str_num, &parser->filter->str_cap,
+                            sizeof(filter_str), &str)) == ERROR) {
+        free(str.str);
+    }
+    return index;
+}
+
+static Bool token_is(const filter_parser* parser, const char* ident)
+{
+    return ((int)strlen(ident) == parser->len && !memcmp(parser->start, ident, parser->len)) ? True : False;
+}
+
+static int cmp_uint64(const void* a, const void* b)
+{
+    return *(const uint64_t*)a < *(const uint64_t*)b ? -1 : *(const uint64_t*)a > *(const uint64_t*)b;
+}
+
+static Bool set_contains(const filter_set* set, uint64_t value)
+{
+    size_t  low = 0;
+    size_t  high = set->num;
+    size_t  mid = 0;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (set->values[mid] == value) {
+            return True;
+        }
+        if (set->values[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return False;
+}
+
+static Bool str_contains(const char* str, int len, const filter_str* sub)
+{
+    const char* end = str + len - sub->len;
+    const char* p = str;
+
+    if (sub->len == 0) {
+        return True;
+    }
+    if (len < sub->len) {
+        return False;
+    }
+    while (p <= end && (p = memchr(p, sub->str[0], end - p + 1)) != NULL) {
+        if (!memcmp(p, sub->str, sub->len)) {
+            return True;
+        }
+        p++;
+    }
+    return False;
+}
\ No newline at end of file
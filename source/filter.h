@@ -0,0 +1,36 @@
+/**
+ * @file filter.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 消息过滤的内部头文件，过滤表达式编译为字节码，在构建JSON与分发之前直接在消息原文上求值
+ * @version 0.1
+ * @date 2023-02-15
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_FILTER_H__
+#define __BLIVE_FILTER_H__
+
+#include "blive_def.h"
+
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 对一条消息求值
+ * 
+ * @param [in] filter 过滤器
+ * @param [in] type 消息类型
+ * @param [in] raw 消息原文
+ * @param [in] len 原文长度
+ * @return Bool 满足条件返回True
+ */
+Bool blive_filter_eval(const blive_filter* filter, blive_info_type type, const char* raw, int len);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,426 @@
+/**
+ * @file keyword.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 弹幕关键词匹配：按字节构建Aho-Corasick自动机，浅层状态使用256项的直接跳转表，深层状态的出边
+ *          按字节排序后连续存放；扫描时在根节点用首字节表跳过不可能开始匹配的字节
+ * @version 0.1
+ * @date 2023-02-16
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_MSG
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "keyword.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define AC_ROOT         0
+#define AC_NONE         UINT32_MAX
+#define AC_DENSE_STATES 1024            /*按广度优先顺序，前若干个状态使用256项的直接跳转表，约1MB*/
+#define AC_LINEAR_EDGES 8               /*稀疏状态的出边不超过该数量时顺序查找，否则二分查找*/
+
+typedef struct {
+    uint8_t     byte;
+    uint32_t    target;
+} ac_edge;
+
+typedef struct {
+    uint32_t    edge_begin;     /*出边在edges中的起始位置*/
+    uint32_t    edge_num;
+    uint32_t    fail;           /*失配时跳转的状态*/
+    uint32_t    output;         /*以该状态结尾的关键词下标，没有时为AC_NONE*/
+    uint32_t    report;         /*沿失配链（含自身）最近的有输出的状态，没有时为AC_NONE*/
+} ac_state;
+
+struct blive_ac {
+    uint32_t    refcount;       /*引用计数，原子操作*/
+    ac_state*   states;         /*按广度优先顺序编号，浅层状态在前*/
+    uint32_t    state_num;
+    ac_edge*    edges;
+    uint32_t*   dense;          /*前dense_num个状态的完整跳转表，已包含失配跳转*/
+    uint32_t    dense_num;
+    uint8_t     first_byte[256];/*能作为关键词首字节的字节*/
+    uint32_t*   ids;            /*各关键词的用户id*/
+};
+
+struct blive_keywords {
+    pthread_mutex_t lock;       /*保护current的读取与替换*/
+    blive_ac*       current;
+};
+
+/*构建过程中使用的临时字典树，出边为按字节排序的动态数组*/
+typedef struct {
+    ac_edge*    edges;
+    uint32_t    edge_num;
+    uint32_t    edge_cap;
+    uint32_t    output;
+} trie_node;
+
+
+static blive_ac* ac_build(const char* const* words, const uint32_t* ids, size_t num);
+static int trie_child(trie_node** nodes, uint32_t* node_num, uint32_t* node_cap, uint32_t parent, uint8_t byte);
+static uint32_t ac_goto(const blive_ac* ac, uint32_t state, uint8_t byte);
+
+
+int blive_keywords_create(blive_keywords** kw)
+{
+    blive_keywords* new_kw = NULL;
+
+    if (kw == NULL) {
+        return ERROR;
+    }
+
+    new_kw = malloc(sizeof(blive_keywords));
+    if (new_kw == NULL) {
+        return ERROR;
+    }
+    pthread_mutex_init(&new_kw->lock, NULL);
+    new_kw->current = NULL;
+
+    *kw = new_kw;
+    return OK;
+}
+
+int blive_keywords_update(blive_keywords* kw, const char* const* words, const uint32_t* ids, size_t num)
+{
+    blive_ac*   ac = NULL;
+    blive_ac*   old = NULL;
+
+    if (kw == NULL || (num && (words == NULL || ids == NULL))) {
+        return ERROR;
+    }
+
+    /*在调用线程内构建完成后再替换，解码线程只会看到完整的旧集合或新集合*/
+    if (num && (ac = ac_build(words, ids, num)) == NULL) {
+        return ERROR;
+    }
+
+    pthread_mutex_lock(&kw->lock);
+    old = kw->current;
+    kw->current = ac;
+    pthread_mutex_unlock(&kw->lock);
+
+    /*正在使用旧集合的数据包处理完后，旧自动机随最后一个引用释放*/
+    blive_ac_release(old);
+    blive_logi("keywords updated: %ld words, %u states", num, ac != NULL ? ac->state_num : 0);
+    return OK;
+}
+
+int blive_keywords_destroy(blive_keywords* kw)
+{
+    if (kw == NULL) {
+        return ERROR;
+    }
+
+    blive_ac_release(kw->current);
+    pthread_mutex_destroy(&kw->lock);
+    free(kw);
+    return OK;
+}
+
+int blive_set_keywords(blive* entity, blive_keywords* kw)
+{
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    entity->keywords = kw;
+    return OK;
+}
+
+blive_ac* blive_keywords_acquire(blive_keywords* kw)
+{
+    blive_ac*   ac = NULL;
+
+    pthread_mutex_lock(&kw->lock);
+    if ((ac = kw->current) != NULL) {
+        __atomic_fetch_add(&ac->refcount, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&kw->lock);
+
+    return ac;
+}
+
+void blive_ac_release(blive_ac* ac)
+{
+    if (ac == NULL || __atomic_sub_fetch(&ac->refcount, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    free(ac->states);
+    free(ac->edges);
+    free(ac->dense);
+    free(ac->ids);
+    free(ac);
+}
+
+int blive_ac_match(const blive_ac* ac, const char* text, int len, uint32_t* ids, int max_ids)
+{
+    const uint8_t*  p = (const uint8_t*)text;
+    const uint8_t*  end = p + len;
+    uint32_t        state = AC_ROOT;
+    uint32_t        out = AC_NONE;
+    uint32_t        id = 0;
+    int             found = 0;
+    int             count = 0;
+
+    while (p < end) {
+        /*处于根节点时，跳过所有不是关键词首字节的字节，弹幕中大部分字节在这里被跳过*/
+        if (state == AC_ROOT) {
+            while (p < end && !ac->first_byte[*p]) {
+                p++;
+            }
+            if (p >= end) {
+                break;
+            }
+        }
+        state = ac_goto(ac, state, *p++);
+
+        for (out = ac->states[state].report; out != AC_NONE; out = ac->states[ac->states[out].fail].report) {
+            id = ac->ids[ac->states[out].output];
+            for (count = 0; count < found && ids[count] != id; count++);
+            if (count == found && found < max_ids) {
+                ids[found++] = id;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief 状态转移：浅层状态直接查表，深层状态查找出边，没有时沿失配链回退，直到进入查表的状态
+ * 
+ */
+static inline uint32_t ac_goto(const blive_ac* ac, uint32_t state, uint8_t byte)
+{
+    const ac_state* node = NULL;
+    const ac_edge*  edge = NULL;
+    uint32_t        low = 0;
+    uint32_t        high = 0;
+    uint32_t        mid = 0;
+
+    while (state >= ac->dense_num) {
+        node = &ac->states[state];
+        edge = ac->edges + node->edge_begin;
+        /*深层状态的出边通常只有一两条，顺序查找即可*/
+        if (node->edge_num <= AC_LINEAR_EDGES) {
+            for (low = 0; low < node->edge_num; low++) {
+                if (edge[low].byte == byte) {
+                    return edge[low].target;
+                }
+            }
+            state = node->fail;
+            continue;
+        }
+        for (low = 0, high = node->edge_num; low < high; ) {
+            mid = (low + high) / 2;
+            if (edge[mid].byte == byte) {
+                return edge[mid].target;
+            }
+            if (edge[mid].byte < byte) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        state = node->fail;
+    }
+    return ac->dense[(size_t)state * 256 + byte];
+}
+
+/**
+ * @brief 获取子节点，不存在时创建，保持出边按字节有序
+ * 
+ * @return int 子节点下标，申请内存失败时返回ERROR
+ */
+static int trie_child(trie_node** nodes, uint32_t* node_num, uint32_t* node_cap, uint32_t parent, uint8_t byte)
+{
+    trie_node*  node = &(*nodes)[parent];
+    trie_node*  bigger_nodes = NULL;
+    ac_edge*    bigger_edges = NULL;
+    uint32_t    pos = 0;
+    uint32_t    child = 0;
+
+    for (pos = 0; pos < node->edge_num && node->edges[pos].byte < byte; pos++);
+    if (pos < node->edge_num && node->edges[pos].byte == byte) {
+        return node->edges[pos].target;
+    }
+
+    if (*node_num >= *node_cap) {
+        bigger_nodes = realloc(*nodes, sizeof(trie_node) * *node_cap * 2);
+        if (bigger_nodes == NULL) {
+            return ERROR;
+        }
+        *nodes = bigger_nodes;
+        *node_cap *= 2;
+        node = &(*nodes)[parent];
+    }
+    if (node->edge_num >= node->edge_cap) {
+        bigger_edges = realloc(node->edges, sizeof(ac_edge) * (node->edge_cap ? node->edge_cap * 2 : 2));
+        if (bigger_edges == NULL) {
+            return ERROR;
+        }
+        node->edges = bigger_edges;
+        node->edge_cap = node->edge_cap ? node->edge_cap * 2 : 2;
+    }
+
+    child = (*node_num)++;
+    memset(&(*nodes)[child], 0, sizeof(trie_node));
+    (*nodes)[child].output = AC_NONE;
+    memmove(node->edges + pos + 1, node->edges + pos, sizeof(ac_edge) * (node->edge_num - pos));
+    node->edges[pos].byte = byte;
+    node->edges[pos].target = child;
+    node->edge_num++;
+
+    return child;
+}
+
+/**
+ * @brief 构建自动机：先插入字典树，再按广度优先重新编号并把出边压缩到连续数组中，
+ *          最后按编号顺序计算失配链与浅层状态的跳转表
+ * 
+ */
+static blive_ac* ac_build(const char* const* words, const uint32_t* ids, size_t num)
+{
+    trie_node*  nodes = NULL;
+    uint32_t    node_num = 1;
+    uint32_t    node_cap = 256;
+    uint32_t*   order = NULL;       /*新编号到字典树节点的映射*/
+    uint32_t*   renum = NULL;       /*字典树节点到新编号的映射*/
+    uint32_t    tail = 0;
+    uint32_t    edge_total = 0;
+    uint32_t    state = AC_ROOT;
+    int         child = 0;
+    blive_ac*   ac = NULL;
+    ac_state*   node = NULL;
+    trie_node*  origin = NULL;
+
+    nodes = malloc(sizeof(trie_node) * node_cap);
+    ac = malloc(sizeof(blive_ac));
+    if (nodes == NULL || ac == NULL) {
+        goto fail;
+    }
+    memset(ac, 0, sizeof(blive_ac));
+    memset(&nodes[AC_ROOT], 0, sizeof(trie_node));
+    nodes[AC_ROOT].output = AC_NONE;
+
+    for (size_t count = 0; count < num; count++) {
+        state = AC_ROOT;
+        for (const uint8_t* p = (const uint8_t*)words[count]; *p; p++) {
+            if ((child = trie_child(&nodes, &node_num, &node_cap, state, *p)) == ERROR) {
+                goto fail;
+            }
+            state = child;
+        }
+        /*空关键词与重复的关键词忽略，重复时保留第一个*/
+        if (state != AC_ROOT && nodes[state].output == AC_NONE) {
+            nodes[state].output = count;
+        }
+    }
+
+    ac->refcount = 1;
+    ac->state_num = node_num;
+    ac->dense_num = node_num < AC_DENSE_STATES ? node_num : AC_DENSE_STATES;
+    ac->states = malloc(sizeof(ac_state) * node_num);
+    ac->dense = malloc(sizeof(uint32_t) * 256 * ac->dense_num);
+    ac->ids = malloc(sizeof(uint32_t) * num);
+    order = malloc(sizeof(uint32_t) * node_num);
+    renum = malloc(sizeof(uint32_t) * node_num);
+    for (uint32_t count = 0; count < node_num; count++) {
+        edge_total += nodes[count].edge_num;
+    }
+    ac->edges = malloc(sizeof(ac_edge) * (edge_total ? edge_total : 1));
+    if (ac->states == NULL || ac->dense == NULL || ac->ids == NULL || order == NULL || renum == NULL || ac->edges == NULL) {
+        goto fail;
+    }
+    memcpy(ac->ids, ids, sizeof(uint32_t) * num);
+
+    /*广度优先重新编号，使浅层状态编号连续且失配状态的编号总是小于自身*/
+    order[tail++] = AC_ROOT;
+    renum[AC_ROOT] = AC_ROOT;
+    for (uint32_t head = 0; head < tail; head++) {
+        origin = &nodes[order[head]];
+        for (uint32_t count = 0; count < origin->edge_num; count++) {
+            renum[origin->edges[count].target] = tail;
+            order[tail++] = origin->edges[count].target;
+        }
+    }
+
+    /*压缩出边*/
+    edge_total = 0;
+    for (uint32_t count = 0; count < node_num; count++) {
+        origin = &nodes[order[count]];
+        node = &ac->states[count];
+        node->edge_begin = edge_total;
+        node->edge_num = origin->edge_num;
+        node->output = origin->output;
+        node->fail = AC_ROOT;
+        for (uint32_t edge = 0; edge < origin->edge_num; edge++) {
+            ac->edges[edge_total + edge].byte = origin->edges[edge].byte;
+            ac->edges[edge_total + edge].target = renum[origin->edges[edge].target];
+        }
+        edge_total += origin->edge_num;
+    }
+
+    /*按编号顺序处理：状态的失配状态与其跳转表都已在之前算出*/
+    for (state = AC_ROOT; state < node_num; state++) {
+        node = &ac->states[state];
+        node->report = node->output != AC_NONE ? state : (state != AC_ROOT ? ac->states[node->fail].report : AC_NONE);
+
+        if (state < ac->dense_num) {
+            uint32_t*   row = ac->dense + (size_t)state * 256;
+
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                row[byte] = state != AC_ROOT ? ac->dense[(size_t)node->fail * 256 + byte] : AC_ROOT;
+            }
+            for (uint32_t edge = 0; edge < node->edge_num; edge++) {
+                row[ac->edges[node->edge_begin + edge].byte] = ac->edges[node->edge_begin + edge].target;
+            }
+        }
+
+        for (uint32_t edge = 0; edge < node->edge_num; edge++) {
+            ac_edge*    next = &ac->edges[node->edge_begin + edge];
+
+            ac->states[next->target].fail = state != AC_ROOT ? ac_goto(ac, node->fail, next->byte) : AC_ROOT;
+            if (state == AC_ROOT) {
+                ac->first_byte[next->byte] = 1;
+            }
+        }
+    }
+
+    for (uint32_t count = 0; count < node_num; count++) {
+        free(nodes[count].edges);
+    }
+    free(nodes);
+    free(order);
+    free(renum);
+    return ac;
+
+fail:
+    if (nodes != NULL) {
+        for (uint32_t count = 0; count < node_num; count++) {
+            free(nodes[count].edges);
+        }
+    }
+    free(nodes);
+    free(order);
+    free(renum);
+    if (ac != NULL) {
+        free(ac->states);
+        free(ac->edges);
+        free(ac->dense);
+        free(ac->ids);
+        free(ac);
+    }
+    blive_loge("build keyword automaton failed");
+    return NULL;
+}
\ No newline at end of file
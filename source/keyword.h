@@ -0,0 +1,58 @@
+/**
+ * @file keyword.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 弹幕关键词匹配的内部头文件，多关键词一次扫描完成匹配
+ * @version 0.1
+ * @date 2023-02-16
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_KEYWORD_H__
+#define __BLIVE_KEYWORD_H__
+
+#include "blive_def.h"
+
+
+/**
+ * @brief 由一组关键词构建的Aho-Corasick自动机，构建后只读，带引用计数
+ * 
+ */
+typedef struct blive_ac blive_ac;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 获取关键词集合当前使用的自动机并增加引用，更新关键词集合不影响已获取的自动机
+ * 
+ * @param [in] kw 关键词集合
+ * @return blive_ac* 集合为空时返回NULL
+ */
+blive_ac* blive_keywords_acquire(blive_keywords* kw);
+
+/**
+ * @brief 释放blive_keywords_acquire获取的自动机
+ * 
+ * @param [in] ac 自动机
+ */
+void blive_ac_release(blive_ac* ac);
+
+/**
+ * @brief 在文本中查找所有关键词
+ * 
+ * @param [in] ac 自动机
+ * @param [in] text 文本
+ * @param [in] len 文本长度
+ * @param [out] ids 传出命中的关键词id，按首次命中的顺序去重
+ * @param [in] max_ids ids的容量，命中更多时只保留前max_ids个
+ * @return int 命中的关键词数
+ */
+int blive_ac_match(const blive_ac* ac, const char* text, int len, uint32_t* ids, int max_ids);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
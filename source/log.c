@@ -1,7 +1,8 @@
 /**
  * @file log.c
  * @author zhongqiaoning (691365572@qq.com)
- * @brief 日志打印相关，基本参考、复制ut_utils仓库，二次封装
+ * @brief 日志打印相关，基本参考、复制ut_utils仓库，二次封装。异步模式下调用线程只把日志写入本线程的
+ *          无锁环形队列，由后台线程按时间顺序合并、格式化后批量写出
  * @version 0.1
  * @date 2023-01-28
  * 
@@ -10,8 +11,17 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
 #include <sys/time.h>
-#include <sys/timeb.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "log.h"
 #include "blive_internal.h"
 
 
@@ -43,48 +53,581 @@
 
 
 static char*    log_prefix_fmt[] = {
-    ESC_STR(COLOR_CH_GREEN,     "[D] [%4d-%02d-%02d %02d:%02d:%02d.%03d %20s: %4d] "),
-    ESC_STR(COLOR_CH_YELLOW,    "[I] [%4d-%02d-%02d %02d:%02d:%02d.%03d %20s: %4d] "),
-    ESC_STR(COLOR_CH_RED,       "[E] [%4d-%02d-%02d %02d:%02d:%02d.%03d %20s: %4d] "),
+    ESC_STR(COLOR_CH_GREEN,     "[D] [%s.%03d %20s: %4d] "),
+    ESC_STR(COLOR_CH_YELLOW,    "[I] [%s.%03d %20s: %4d] "),
+    ESC_STR(COLOR_CH_RED,       "[E] [%s.%03d %20s: %4d] "),
+};
+
+#define LOG_MSG_MAX_SIZE        2048            /*单条日志正文的最大长度*/
+#define LOG_LINE_MAX_SIZE       (LOG_MSG_MAX_SIZE + 128)
+#define LOG_RING_SIZE           (256 * 1024)    /*每个线程的日志队列字节数，必须为2的幂*/
+#define LOG_BATCH_SIZE          (64 * 1024)     /*后台线程单次写出的最大字节数*/
+#define LOG_FLUSH_INTERVAL_MS   10              /*后台线程没有收到刷新请求时的轮询间隔*/
+#define LOG_RECORD_PAD          0xFFFF          /*队列末尾放不下一条记录时的填充记录*/
+#define LOG_TIMEZONE_OFFSET     28800           /*输出北京时间*/
+#define LOG_RATE_DEFAULT        20              /*每个调用处每秒补充的令牌数*/
+#define LOG_BURST_DEFAULT       100             /*每个调用处最多积累的令牌数*/
+#define LOG_BURST_MAX           0xFFFF
+
+/**
+ * @brief 环形队列中的一条日志记录，正文紧跟在结构体之后，整条记录按8字节对齐
+ * 
+ */
+typedef struct {
+    uint32_t        size;           /*记录占用的字节数*/
+    uint16_t        level;          /*日志等级，LOG_RECORD_PAD为填充记录*/
+    uint16_t        msg_len;        /*正文长度*/
+    int32_t         line;
+    uint64_t        ts_ns;          /*写入时缓存的系统时间（纳秒）*/
+    const char*     func;           /*函数名，指向__FUNCTION__常量，不需要复制*/
+    char            msg[0];
+} log_record;
+
+/**
+ * @brief 单个线程的日志队列，单生产者（所属线程）单消费者（后台线程）
+ * 
+ */
+typedef struct log_ring {
+    uint64_t            head;       /*下一条待写出记录的位置，仅后台线程修改*/
+    char                pad0[64 - sizeof(uint64_t)];
+    uint64_t            tail;       /*下一条记录的写入位置，仅所属线程修改*/
+    char                pad1[64 - sizeof(uint64_t)];
+    int                 orphaned;   /*所属线程已退出，写完后由后台线程释放，原子操作*/
+    struct log_ring*    next;
+    char                data[LOG_RING_SIZE];
+} log_ring;
+
+static struct {
+    pthread_mutex_t     lock;       /*保护rings链表与刷新请求*/
+    pthread_cond_t      cond;       /*唤醒后台线程*/
+    pthread_cond_t      done_cond;  /*通知刷新完成*/
+    pthread_t           tid;
+    Bool                running;
+    int                 async;      /*是否异步写出，原子操作*/
+    int                 writers;    /*已判断为异步模式、正在写入队列的线程数，原子操作*/
+    uint64_t            flush_req;  /*刷新请求序号*/
+    uint64_t            flushed;    /*已完成的刷新请求序号*/
+    uint64_t            dropped;    /*队列已满丢弃的日志数，原子操作*/
+    log_ring*           rings;
+    pthread_once_t      key_once;
+    pthread_key_t       key;        /*线程退出时标记其日志队列*/
+} log_ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+    .key_once = PTHREAD_ONCE_INIT,
+};
+
+static __thread log_ring*   local_ring = NULL;
+
+static const char*  log_subsys_name[BLIVE_LOG_SUBSYS_MAX] = {"core", "conn", "msg", "decode"};
+static const char*  log_level_name[] = {"debug", "info", "error", "none"};
+static uint32_t     log_rate = LOG_RATE_DEFAULT;
+static uint32_t     log_burst = LOG_BURST_DEFAULT;
+
+uint8_t             blive_log_levels[BLIVE_LOG_SUBSYS_MAX] = {
+    BLIVE_LOG_ERROR, BLIVE_LOG_ERROR, BLIVE_LOG_ERROR, BLIVE_LOG_ERROR,
 };
 
-#define TIME_PARAM(tm, tb)  (tm)->tm_year + 1900, (tm)->tm_mon + 1, (tm)->tm_mday, \
-                            (tm)->tm_hour, (tm)->tm_min, (tm)->tm_sec, \
-                            (tb)->millitm
+
+static void log_level_env(void);
+static int log_line_format(char* dst, int level, uint64_t ts_ns, const char* func, int line, const char* msg, int msg_len);
+static log_ring* log_ring_attach(void);
+static void log_ring_push(log_ring* ring, int level, uint64_t ts_ns, const char* func, int line, const char* msg, int msg_len);
+static void log_key_create(void);
+static void log_ring_detach(void* arg);
+static void* log_routine(void* arg);
+static void log_drain(char* batch);
 
 
 int blive_log(blive_log_level level, const char* func_name, int line, const char* fmt, ...)
 {
-    va_list va = {0};
-    int     print_size = 0;
-    int     prefix_size = 0;
-    char    print_buffer[20480] = {0};
-    struct timeb    tb_time;
-    struct tm*      tm_time;
-
+    va_list     va;
+    char        msg[LOG_MSG_MAX_SIZE];
+    int         msg_len = 0;
+    uint64_t    ts_ns = 0;
+    log_ring*   ring = NULL;
 
     if (level < BLIVE_LOG_DEBUG || level > BLIVE_LOG_ERROR) {
         return ERROR;
     }
 
-    ftime(&tb_time);
-    tb_time.time += 28800;
-    tm_time = gmtime(&tb_time.time);
-    prefix_size = snprintf(print_buffer, 2048 - 1, log_prefix_fmt[level], TIME_PARAM(tm_time, &tb_time), func_name, line);
-
+    /*异步模式下后台线程定时刷新缓存的时间；同步模式下没有后台线程，每条日志刷新一次*/
+    if (!__atomic_load_n(&log_ctx.async, __ATOMIC_RELAXED)) {
+        blive_clock_tick();
+    }
+    ts_ns = blive_clock_wall_coarse_ns();
     va_start(va, fmt);
-    print_size = vsnprintf(print_buffer + prefix_size, 2048 - prefix_size - 1, fmt, va);
+    msg_len = vsnprintf(msg, sizeof(msg), fmt, va);
     va_end(va);
+    if (msg_len < 0) {
+        return ERROR;
+    }
+    if (msg_len >= LOG_MSG_MAX_SIZE) {
+        msg_len = LOG_MSG_MAX_SIZE - 1;
+    }
+
+    /*同步模式直接格式化并写出。先登记再判断模式，停止后台线程时据此等待正在写入队列的线程*/
+    __atomic_fetch_add(&log_ctx.writers, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&log_ctx.async, __ATOMIC_SEQ_CST)
+        || ((ring = local_ring) == NULL && (ring = log_ring_attach()) == NULL)) {
+        char    line_buffer[LOG_LINE_MAX_SIZE];
+
+        __atomic_fetch_sub(&log_ctx.writers, 1, __ATOMIC_RELEASE);
+        fwrite(line_buffer, log_line_format(line_buffer, level, ts_ns, func_name, line, msg, msg_len), 1, stderr);
+        return msg_len;
+    }
+
+    /*异步模式：只复制正文到本线程的队列，格式化与写出都在后台线程完成*/
+    log_ring_push(ring, level, ts_ns, func_name, line, msg, msg_len);
+    __atomic_fetch_sub(&log_ctx.writers, 1, __ATOMIC_RELEASE);
+
+    return msg_len;
+}
+
+int blive_log_set_level(blive_log_subsys subsys, blive_log_level level)
+{
+    if (subsys < BLIVE_LOG_SUBSYS_CORE || subsys >= BLIVE_LOG_SUBSYS_MAX
+        || level < BLIVE_LOG_DEBUG || level > BLIVE_LOG_NONE) {
+        return ERROR;
+    }
+
+    __atomic_store_n(&blive_log_levels[subsys], level, __ATOMIC_RELAXED);
+    return OK;
+}
+
+int blive_log_set_rate_limit(uint32_t rate, uint32_t burst)
+{
+    if (rate && !burst) {
+        return ERROR;
+    }
+
+    __atomic_store_n(&log_burst, burst > LOG_BURST_MAX ? LOG_BURST_MAX : burst, __ATOMIC_RELAXED);
+    __atomic_store_n(&log_rate, rate, __ATOMIC_RELAXED);
+    return OK;
+}
+
+Bool blive_log_site_allow(blive_log_site* site, blive_log_level level, const char* func_name, int line)
+{
+    uint32_t    rate = __atomic_load_n(&log_rate, __ATOMIC_RELAXED);
+    uint32_t    burst = __atomic_load_n(&log_burst, __ATOMIC_RELAXED);
+    uint32_t    suppressed = 0;
+    uint64_t    now = 0;
+    uint64_t    old = 0;
+    uint64_t    last = 0;
+    uint64_t    tokens = 0;
+    uint64_t    refill = 0;
+
+    if (!rate) {
+        return True;
+    }
+
+    now = blive_clock_now_ns() / 1000000;
+    old = __atomic_load_n(&site->state, __ATOMIC_RELAXED);
+    do {
+        /*第一次打印时令牌桶是满的*/
+        last = old ? old >> 16 : now;
+        tokens = old ? old & LOG_BURST_MAX : burst;
+
+        /*按经过的时间补充令牌，不足一个令牌的时间保留到下一次*/
+        if (now > last && (refill = (now - last) * rate / 1000) != 0) {
+            tokens = tokens + refill >= burst ? burst : tokens + refill;
+            last = tokens == burst ? now : last + refill * 1000 / rate;
+        }
+        if (!tokens) {
+            __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+            return False;
+        }
+    } while (!__atomic_compare_exchange_n(&site->state, &old, (last << 16) | (tokens - 1), True,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if ((suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED)) != 0) {
+        blive_log(level, func_name, line, "%u similar log(s) suppressed", suppressed);
+    }
+    return True;
+}
+
+int blive_log_flush(void)
+{
+    uint64_t    req = 0;
+
+    pthread_mutex_lock(&log_ctx.lock);
+    if (!log_ctx.running) {
+        pthread_mutex_unlock(&log_ctx.lock);
+        fflush(stderr);
+        return OK;
+    }
+    req = ++log_ctx.flush_req;
+    pthread_cond_signal(&log_ctx.cond);
+    while (log_ctx.running && log_ctx.flushed < req) {
+        pthread_cond_wait(&log_ctx.done_cond, &log_ctx.lock);
+    }
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    return OK;
+}
+
+int blive_log_set_async(Bool async)
+{
+    pthread_mutex_lock(&log_ctx.lock);
+    if (async && !log_ctx.running) {
+        pthread_mutex_unlock(&log_ctx.lock);
+        return ERROR;   /*后台线程未启动*/
+    }
+    __atomic_store_n(&log_ctx.async, async ? 1 : 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    /*切换为同步前先写出已在队列中的日志*/
+    if (!async) {
+        blive_log_flush();
+    }
+    return OK;
+}
+
+int blive_log_start(void)
+{
+    pthread_once(&log_ctx.key_once, log_key_create);
+    log_level_env();
+
+    pthread_mutex_lock(&log_ctx.lock);
+    if (log_ctx.running) {
+        pthread_mutex_unlock(&log_ctx.lock);
+        return OK;
+    }
+    log_ctx.running = True;
+    if (pthread_create(&log_ctx.tid, NULL, log_routine, NULL)) {
+        log_ctx.running = False;
+        pthread_mutex_unlock(&log_ctx.lock);
+        return ERROR;
+    }
+    __atomic_store_n(&log_ctx.async, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    return OK;
+}
+
+void blive_log_stop(void)
+{
+    char*   batch = NULL;
+
+    pthread_mutex_lock(&log_ctx.lock);
+    if (!log_ctx.running) {
+        pthread_mutex_unlock(&log_ctx.lock);
+        return;
+    }
+    __atomic_store_n(&log_ctx.async, 0, __ATOMIC_SEQ_CST);
+    log_ctx.running = False;
+    pthread_cond_signal(&log_ctx.cond);
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    /*后台线程退出前写出所有队列中剩余的日志*/
+    pthread_join(log_ctx.tid, NULL);
+
+    /*切换前已判断为异步模式的线程可能在后台线程最后一次写出后才写入队列，等其写完后在本线程再写出一次*/
+    while (__atomic_load_n(&log_ctx.writers, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+    if ((batch = malloc(LOG_BATCH_SIZE)) != NULL) {
+        log_drain(batch);
+        free(batch);
+    }
+}
+
+
+/**
+ * @brief 按环境变量BLIVE_LOG_LEVEL设置日志等级，格式为"等级"或"子系统=等级,子系统=等级"
+ * 
+ */
+static void log_level_env(void)
+{
+    const char* spec = getenv("BLIVE_LOG_LEVEL");
+    const char* item = NULL;
+    const char* value = NULL;
+    int         item_len = 0;
+    int         name_len = 0;
+    int         subsys = 0;
+    int         level = 0;
+
+    for (item = spec; item != NULL && *item; item += item_len + (item[item_len] == ',')) {
+        item_len = strcspn(item, ",");
+        value = memchr(item, '=', item_len);
+        value = value != NULL ? value + 1 : item;
+        name_len = item_len - (value - item);
+
+        for (level = BLIVE_LOG_DEBUG; level <= BLIVE_LOG_NONE; level++) {
+            if ((int)strlen(log_level_name[level]) == name_len && !strncasecmp(value, log_level_name[level], name_len)) {
+                break;
+            }
+        }
+        if (level > BLIVE_LOG_NONE) {
+            fprintf(stderr, "invalid BLIVE_LOG_LEVEL item: %.*s\r\n", item_len, item);
+            continue;
+        }
+
+        /*只写等级时作用于所有子系统*/
+        for (subsys = BLIVE_LOG_SUBSYS_CORE; subsys < BLIVE_LOG_SUBSYS_MAX; subsys++) {
+            if (value == item || ((int)strlen(log_subsys_name[subsys]) == value - item - 1
+                                  && !strncasecmp(item, log_subsys_name[subsys], value - item - 1))) {
+                blive_log_set_level(subsys, level);
+            }
+        }
+    }
+}
+
+/**
+ * @brief 格式化一行日志：前缀、正文，并保证以"\r\n"结尾。日期部分按秒缓存，同一秒内不重复计算
+ * 
+ * @return int 格式化后的长度
+ */
+static int log_line_format(char* dst, int level, uint64_t ts_ns, const char* func, int line, const char* msg, int msg_len)
+{
+    static __thread time_t  cached_sec = -1;
+    static __thread char    cached_date[32];
+    time_t                  sec = ts_ns / 1000000000;
+    struct tm               tm_time;
+    int                     size = 0;
+
+    if (sec != cached_sec) {
+        sec += LOG_TIMEZONE_OFFSET;
+        gmtime_r(&sec, &tm_time);
+        strftime(cached_date, sizeof(cached_date), "%Y-%m-%d %H:%M:%S", &tm_time);
+        cached_sec = ts_ns / 1000000000;
+    }
+
+    size = snprintf(dst, LOG_LINE_MAX_SIZE - LOG_MSG_MAX_SIZE - 2, log_prefix_fmt[level], cached_date,
+                    (int)(ts_ns / 1000000 % 1000), func, line);
+    memcpy(dst + size, msg, msg_len);
+    size += msg_len;
 
     /*如果打印末尾未添加换行符，则补上一个换行符*/
-    if (print_buffer[print_size + prefix_size - 2] != '\r' && print_buffer[print_size + prefix_size - 1] == '\n') {
-        print_buffer[print_size + prefix_size - 1] = '\r';
-        print_buffer[print_size + prefix_size] = '\n';
-    } else if (print_buffer[print_size + prefix_size - 2] != '\r' && print_buffer[print_size + prefix_size - 1] != '\n') {
-        print_buffer[print_size + prefix_size] = '\r';
-        print_buffer[print_size + prefix_size + 1] = '\n';
+    if (size && dst[size - 1] == '\n') {
+        size--;
+    }
+    if (size && dst[size - 1] == '\r') {
+        size--;
+    }
+    dst[size++] = '\r';
+    dst[size++] = '\n';
+
+    return size;
+}
+
+/**
+ * @brief 为调用线程创建日志队列并加入后台线程的链表
+ * 
+ * @return log_ring* 申请失败返回NULL，该线程的日志同步写出
+ */
+static log_ring* log_ring_attach(void)
+{
+    log_ring*   ring = NULL;
+
+    ring = malloc(sizeof(log_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    memset(ring, 0, offsetof(log_ring, data));
+
+    pthread_mutex_lock(&log_ctx.lock);
+    ring->next = log_ctx.rings;
+    log_ctx.rings = ring;
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    pthread_setspecific(log_ctx.key, ring);
+    local_ring = ring;
+    return ring;
+}
+
+static void log_key_create(void)
+{
+    pthread_key_create(&log_ctx.key, log_ring_detach);
+}
+
+/**
+ * @brief 将一条日志复制到本线程的队列，队列已满时丢弃并计数，不阻塞调用线程
+ * 
+ * @param [in] ring 本线程的日志队列
+ * @param [in] level 日志等级
+ * @param [in] ts_ns 日志时间
+ * @param [in] func 函数名
+ * @param [in] line 行号
+ * @param [in] msg 日志正文
+ * @param [in] msg_len 正文长度
+ */
+static void log_ring_push(log_ring* ring, int level, uint64_t ts_ns, const char* func, int line, const char* msg, int msg_len)
+{
+    log_record* record = NULL;
+    uint64_t    head = 0;
+    uint64_t    tail = 0;
+    uint32_t    need = 0;
+    uint32_t    contiguous = 0;
+
+    need = (sizeof(log_record) + msg_len + 7) & ~7u;
+    tail = ring->tail;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    contiguous = LOG_RING_SIZE - (tail & (LOG_RING_SIZE - 1));
+    if (contiguous < need) {
+        /*队列末尾放不下，填充后从头写入*/
+        if (tail + contiguous + need - head > LOG_RING_SIZE) {
+            __atomic_fetch_add(&log_ctx.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        record = (log_record*)(ring->data + (tail & (LOG_RING_SIZE - 1)));
+        record->size = contiguous;
+        record->level = LOG_RECORD_PAD;
+        tail += contiguous;
+    } else if (tail + need - head > LOG_RING_SIZE) {
+        /*队列已满时丢弃并计数，不阻塞调用线程*/
+        __atomic_fetch_add(&log_ctx.dropped, 1, __ATOMIC_RELAXED);
+        return;
     }
-    fwrite(print_buffer, print_size + prefix_size + 2, 1, stderr);
 
-    return print_size;
+    record = (log_record*)(ring->data + (tail & (LOG_RING_SIZE - 1)));
+    record->size = need;
+    record->level = level;
+    record->msg_len = msg_len;
+    record->line = line;
+    record->ts_ns = ts_ns;
+    record->func = func;
+    memcpy(record->msg, msg, msg_len);
+    __atomic_store_n(&ring->tail, tail + need, __ATOMIC_RELEASE);
+
+    /*平时由后台线程定时轮询，只有队列刚超过一半时才唤醒，避免突发日志在轮询间隔内打满队列*/
+    if (ring->tail - head >= LOG_RING_SIZE / 2 && ring->tail - need - head < LOG_RING_SIZE / 2) {
+        pthread_mutex_lock(&log_ctx.lock);
+        pthread_cond_signal(&log_ctx.cond);
+        pthread_mutex_unlock(&log_ctx.lock);
+    }
+}
+
+/**
+ * @brief 线程退出时标记其日志队列，队列中剩余的日志写出后由后台线程释放
+ * 
+ */
+static void log_ring_detach(void* arg)
+{
+    local_ring = NULL;
+    __atomic_store_n(&((log_ring*)arg)->orphaned, 1, __ATOMIC_RELEASE);
 }
+
+static void* log_routine(void* arg)
+{
+    char*       batch = malloc(LOG_BATCH_SIZE);
+    uint64_t    req = 0;
+    Bool        running = True;
+
+    if (batch == NULL) {
+        return NULL;
+    }
+
+    while (running) {
+        pthread_mutex_lock(&log_ctx.lock);
+        req = log_ctx.flush_req;
+        running = log_ctx.running;
+        pthread_mutex_unlock(&log_ctx.lock);
+
+        /*没有其他循环在运行时，日志时间至少按轮询间隔刷新*/
+        blive_clock_tick();
+        log_drain(batch);
+
+        pthread_mutex_lock(&log_ctx.lock);
+        log_ctx.flushed = req;
+        pthread_cond_broadcast(&log_ctx.done_cond);
+        if (log_ctx.running && log_ctx.flush_req == req) {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&log_ctx.cond, &log_ctx.lock, &deadline);
+        }
+        pthread_mutex_unlock(&log_ctx.lock);
+    }
+
+    free(batch);
+    return NULL;
+}
+
+/**
+ * @brief 写出所有队列中已有的日志：每次取时间最早的一条，多个线程的日志按时间顺序交错输出
+ * 
+ * @param [in] batch 格式化缓冲区，长度为LOG_BATCH_SIZE
+ */
+static void log_drain(char* batch)
+{
+    log_ring*   rings = NULL;
+    log_ring*   ring = NULL;
+    log_ring*   earliest = NULL;
+    log_ring**  iter = NULL;
+    log_record* record = NULL;
+    log_record* first = NULL;
+    uint64_t    dropped = 0;
+    int         batch_size = 0;
+
+    pthread_mutex_lock(&log_ctx.lock);
+    rings = log_ctx.rings;
+    pthread_mutex_unlock(&log_ctx.lock);
+
+    for (;;) {
+        /*在各队列的第一条记录中找出时间最早的一条，跳过填充记录*/
+        earliest = NULL;
+        first = NULL;
+        for (ring = rings; ring != NULL; ring = ring->next) {
+            while (ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+                record = (log_record*)(ring->data + (ring->head & (LOG_RING_SIZE - 1)));
+                if (record->level != LOG_RECORD_PAD) {
+                    break;
+                }
+                __atomic_store_n(&ring->head, ring->head + record->size, __ATOMIC_RELEASE);
+            }
+            if (ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            if (first == NULL || record->ts_ns < first->ts_ns) {
+                earliest = ring;
+                first = record;
+            }
+        }
+        if (first == NULL) {
+            break;
+        }
+
+        if (batch_size + LOG_LINE_MAX_SIZE > LOG_BATCH_SIZE) {
+            fwrite(batch, batch_size, 1, stderr);
+            batch_size = 0;
+        }
+        batch_size += log_line_format(batch + batch_size, first->level, first->ts_ns, first->func, first->line,
+                                      first->msg, first->msg_len);
+        __atomic_store_n(&earliest->head, earliest->head + first->size, __ATOMIC_RELEASE);
+    }
+
+    if ((dropped = __atomic_exchange_n(&log_ctx.dropped, 0, __ATOMIC_RELAXED)) != 0) {
+        char    msg[64];
+
+        if (batch_size + LOG_LINE_MAX_SIZE > LOG_BATCH_SIZE) {
+            fwrite(batch, batch_size, 1, stderr);
+            batch_size = 0;
+        }
+        batch_size += log_line_format(batch + batch_size, BLIVE_LOG_ERROR, blive_clock_wall_coarse_ns(), __FUNCTION__, __LINE__, msg,
+                                      snprintf(msg, sizeof(msg), "%lu log records dropped", (unsigned long)dropped));
+    }
+    if (batch_size) {
+        fwrite(batch, batch_size, 1, stderr);
+        fflush(stderr);
+    }
+
+    /*释放已退出线程的空队列*/
+    pthread_mutex_lock(&log_ctx.lock);
+    for (iter = &log_ctx.rings; *iter != NULL; ) {
+        ring = *iter;
+        if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE) && ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+            *iter = ring->next;
+            free(ring);
+            continue;
+        }
+        iter = &ring->next;
+    }
+    pthread_mutex_unlock(&log_ctx.lock);
+}
\ No newline at end of file
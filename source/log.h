@@ -0,0 +1,38 @@
+/**
+ * @file log.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 日志模块的内部头文件，异步模式下由后台线程统一格式化并批量写出
+ * @version 0.1
+ * @date 2023-02-17
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_LOG_H__
+#define __BLIVE_LOG_H__
+
+#include "blive_def.h"
+
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 启动日志后台线程并切换为异步模式，由blive_api_init调用
+ * 
+ * @return int 创建线程失败时返回ERROR，日志保持同步写出
+ */
+int blive_log_start(void);
+
+/**
+ * @brief 写出所有尚未写出的日志并停止后台线程，之后的日志同步写出，由blive_api_deinit调用
+ * 
+ */
+void blive_log_stop(void);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,455 @@
+/**
+ * @file metrics.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 指标统计：直播间与全局的计数、各处理阶段的耗时直方图，支持快照读取与Prometheus文本输出
+ * @version 0.1
+ * @date 2023-02-19
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "metrics.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define METRICS_TEXT_INIT_SIZE  (16 * 1024)
+#define METRICS_STAGE_HELP      "Time spent in each processing stage."
+
+/**
+ * @brief 全局指标的一个分片，同一时刻只属于一个线程
+ * 
+ */
+typedef struct metrics_shard {
+    blive_metrics           data;
+    int                     orphaned;   /*所属线程已退出，可以被新线程复用，受metrics_ctx.lock保护*/
+    struct metrics_shard*   next;
+} metrics_shard;
+
+typedef struct {
+    char*   data;
+    size_t  len;
+    size_t  cap;
+    Bool    failed;     /*扩容失败，之后的输出全部忽略*/
+} metrics_text;
+
+static struct {
+    pthread_mutex_t     lock;       /*保护shards链表*/
+    metrics_shard*      shards;
+    pthread_once_t      key_once;
+    pthread_key_t       key;        /*线程退出时释放其分片的所有权*/
+} metrics_ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .key_once = PTHREAD_ONCE_INIT,
+};
+
+__thread blive_metrics* blive_metrics_local = NULL;
+
+static const struct {
+    const char*     name;
+    const char*     help;
+} metrics_counter_desc[BLIVE_METRIC_COUNTER_MAX] = {
+    {"recv_bytes_total",    "Bytes received from the server, including packet headers."},
+    {"recv_frames_total",   "Packets received from the server."},
+    {"unzip_bytes_total",   "Bytes produced by brotli decompression."},
+    {"unzip_errors_total",  "Packets that failed to decompress."},
+    {"messages_total",      "Messages split out of packets."},
+    {"parse_errors_total",  "Packet split or JSON parse failures."},
+    {"filtered_total",      "Messages dropped by the filter."},
+    {"reconnects_total",    "Reconnect attempts."},
+};
+
+static const char*  metrics_stage_name[BLIVE_METRIC_STAGE_MAX] = {"recv", "unzip", "parse", "handler"};
+static const char*  metrics_pmu_name[BLIVE_METRIC_PMU_MAX] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+/*Prometheus直方图输出的le（纳秒）*/
+static const uint64_t   metrics_text_le[] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000,
+    10000000, 50000000, 100000000, 500000000, 1000000000, 5000000000,
+};
+
+
+static void metrics_key_create(void);
+static void metrics_shard_detach(void* arg);
+static void metrics_load(blive_metrics* dst, const blive_metrics* src, Bool add);
+static void metrics_text_append(metrics_text* text, const char* fmt, ...);
+static void metrics_text_counter(metrics_text* text, const blive_metrics* global, blive* const* entities, size_t num,
+                                 const blive_metrics* rooms, blive_metric_counter counter);
+static void metrics_text_hist(metrics_text* text, const char* family, const char* labels, blive_metric_stage stage,
+                              const blive_metric_hist* hist);
+static void metrics_text_pmu(metrics_text* text, const blive_metrics* global);
+
+
+int blive_get_metrics(blive* entity, blive_metrics* metrics)
+{
+    metrics_shard*  shard = NULL;
+
+    if (metrics == NULL) {
+        return ERROR;
+    }
+
+    if (entity != NULL) {
+        metrics_load(metrics, &entity->metrics, False);
+        return OK;
+    }
+
+    memset(metrics, 0, sizeof(blive_metrics));
+    pthread_mutex_lock(&metrics_ctx.lock);
+    for (shard = metrics_ctx.shards; shard != NULL; shard = shard->next) {
+        metrics_load(metrics, &shard->data, True);
+    }
+    pthread_mutex_unlock(&metrics_ctx.lock);
+
+    return OK;
+}
+
+uint64_t blive_metric_hist_bound(int index)
+{
+    int     shift = 0;
+
+    if (index < 0) {
+        return 0;
+    }
+    if (index < (1 << METRICS_HIST_SUB_BITS)) {
+        return index;
+    }
+    if (index >= BLIVE_METRIC_HIST_BUCKETS) {
+        index = BLIVE_METRIC_HIST_BUCKETS - 1;
+    }
+
+    /*第index个桶为[(8 + sub) << shift, (9 + sub) << shift)，shift = msb - 3*/
+    shift = (index >> METRICS_HIST_SUB_BITS) - 1;
+    return ((uint64_t)((1 << METRICS_HIST_SUB_BITS) + (index & ((1 << METRICS_HIST_SUB_BITS) - 1)) + 1) << shift) - 1;
+}
+
+uint64_t blive_metric_hist_quantile(const blive_metric_hist* hist, double q)
+{
+    uint64_t    rank = 0;
+    uint64_t    seen = 0;
+
+    if (hist == NULL || !hist->count) {
+        return 0;
+    }
+    if (q < 0) {
+        q = 0;
+    }
+    if (q > 1) {
+        q = 1;
+    }
+
+    /*第rank个观测值（从1开始）所在的桶*/
+    rank = (uint64_t)(q * hist->count + 0.5);
+    if (!rank) {
+        rank = 1;
+    }
+    for (int index = 0; index < BLIVE_METRIC_HIST_BUCKETS; index++) {
+        seen += hist->buckets[index];
+        if (seen >= rank) {
+            return blive_metric_hist_bound(index);
+        }
+    }
+    return blive_metric_hist_bound(BLIVE_METRIC_HIST_BUCKETS - 1);
+}
+
+int blive_metrics_render(blive* const* entities, size_t num, char** text, size_t* len)
+{
+    blive_metrics*  global = NULL;
+    blive_metrics*  rooms = NULL;
+    metrics_text    out = {0};
+    char            labels[32] = {0};
+
+    if (text == NULL || (entities == NULL && num)) {
+        return ERROR;
+    }
+
+    global = malloc(sizeof(blive_metrics) * (num + 1));
+    out.data = malloc(METRICS_TEXT_INIT_SIZE);
+    if (global == NULL || out.data == NULL) {
+        free(global);
+        free(out.data);
+        return ERROR;
+    }
+    out.cap = METRICS_TEXT_INIT_SIZE;
+    out.data[0] = '\0';
+
+    /*先取全部快照再输出，格式化期间的更新不会使同一直播间的各项相差太远*/
+    rooms = global + 1;
+    blive_get_metrics(NULL, global);
+    for (size_t count = 0; count < num; count++) {
+        blive_get_metrics(entities[count], &rooms[count]);
+    }
+
+    for (int counter = 0; counter < BLIVE_METRIC_COUNTER_MAX; counter++) {
+        metrics_text_counter(&out, global, entities, num, rooms, counter);
+    }
+
+    /*同一指标族的各行需要连续输出，全局的各阶段输出完后再输出各直播间的*/
+    metrics_text_append(&out, "# HELP blive_stage_duration_seconds %s\n"
+                        "# TYPE blive_stage_duration_seconds histogram\n", METRICS_STAGE_HELP);
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        metrics_text_hist(&out, "blive_stage_duration_seconds", "", stage, &global->stages[stage]);
+    }
+    if (num) {
+        metrics_text_append(&out, "# HELP blive_room_stage_duration_seconds %s\n"
+                            "# TYPE blive_room_stage_duration_seconds histogram\n", METRICS_STAGE_HELP);
+    }
+    for (size_t count = 0; count < num; count++) {
+        snprintf(labels, sizeof(labels), "room=\"%u\",", entities[count]->room_id);
+        for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+            metrics_text_hist(&out, "blive_room_stage_duration_seconds", labels, stage, &rooms[count].stages[stage]);
+        }
+    }
+    metrics_text_pmu(&out, global);
+    free(global);
+
+    if (out.failed) {
+        free(out.data);
+        return ERROR;
+    }
+    *text = out.data;
+    if (len != NULL) {
+        *len = out.len;
+    }
+    return OK;
+}
+
+void blive_metrics_hist_load(blive_metric_hist* dst, const blive_metric_hist* src)
+{
+    uint64_t    value = 0;
+
+    dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+    for (int index = 0; index < BLIVE_METRIC_HIST_BUCKETS; index++) {
+        value = __atomic_load_n(&src->buckets[index], __ATOMIC_RELAXED);
+        dst->buckets[index] += value;
+        dst->count += value;
+    }
+}
+
+blive_metrics* blive_metrics_attach(void)
+{
+    metrics_shard*  shard = NULL;
+
+    pthread_once(&metrics_ctx.key_once, metrics_key_create);
+
+    /*已退出线程的分片继续累加，全局指标不会因为线程退出而减少*/
+    pthread_mutex_lock(&metrics_ctx.lock);
+    for (shard = metrics_ctx.shards; shard != NULL; shard = shard->next) {
+        if (shard->orphaned) {
+            shard->orphaned = 0;
+            break;
+        }
+    }
+    if (shard == NULL && (shard = malloc(sizeof(metrics_shard))) != NULL) {
+        memset(shard, 0, sizeof(metrics_shard));
+        shard->next = metrics_ctx.shards;
+        metrics_ctx.shards = shard;
+    }
+    pthread_mutex_unlock(&metrics_ctx.lock);
+
+    if (shard == NULL) {
+        return NULL;
+    }
+    pthread_setspecific(metrics_ctx.key, shard);
+    blive_metrics_local = &shard->data;
+    return blive_metrics_local;
+}
+
+
+static void metrics_key_create(void)
+{
+    pthread_key_create(&metrics_ctx.key, metrics_shard_detach);
+}
+
+/**
+ * @brief 线程退出时交出分片的所有权，分片保留在链表中等待新线程复用
+ * 
+ */
+static void metrics_shard_detach(void* arg)
+{
+    blive_metrics_local = NULL;
+    pthread_mutex_lock(&metrics_ctx.lock);
+    ((metrics_shard*)arg)->orphaned = 1;
+    pthread_mutex_unlock(&metrics_ctx.lock);
+}
+
+/**
+ * @brief 读取一份正在被更新的指标
+ * 
+ * @param [out] dst 传出快照
+ * @param [in] src 指标
+ * @param [in] add True时累加到dst上，False时覆盖dst
+ */
+static void metrics_load(blive_metrics* dst, const blive_metrics* src, Bool add)
+{
+    if (!add) {
+        memset(dst, 0, sizeof(blive_metrics));
+    }
+    for (int counter = 0; counter < BLIVE_METRIC_COUNTER_MAX; counter++) {
+        dst->counters[counter] += __atomic_load_n(&src->counters[counter], __ATOMIC_RELAXED);
+    }
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        blive_metrics_hist_load(&dst->stages[stage], &src->stages[stage]);
+        dst->pmu[stage].samples += __atomic_load_n(&src->pmu[stage].samples, __ATOMIC_RELAXED);
+        dst->pmu[stage].bytes += __atomic_load_n(&src->pmu[stage].bytes, __ATOMIC_RELAXED);
+        for (int event = 0; event < BLIVE_METRIC_PMU_MAX; event++) {
+            dst->pmu[stage].events[event] += __atomic_load_n(&src->pmu[stage].events[event], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void metrics_text_append(metrics_text* text, const char* fmt, ...)
+{
+    va_list     va;
+    int         size = 0;
+    char*       bigger = NULL;
+
+    if (text->failed) {
+        return;
+    }
+
+    va_start(va, fmt);
+    size = vsnprintf(text->data + text->len, text->cap - text->len, fmt, va);
+    va_end(va);
+    if (size < 0) {
+        text->failed = True;
+        return;
+    }
+
+    /*空间不足时扩容后重新格式化*/
+    if ((size_t)size >= text->cap - text->len) {
+        size_t  new_cap = text->cap * 2;
+
+        while (new_cap - text->len <= (size_t)size) {
+            new_cap *= 2;
+        }
+        if ((bigger = realloc(text->data, new_cap)) == NULL) {
+            text->failed = True;
+            return;
+        }
+        text->data = bigger;
+        text->cap = new_cap;
+        va_start(va, fmt);
+        vsnprintf(text->data + text->len, text->cap - text->len, fmt, va);
+        va_end(va);
+    }
+    text->len += size;
+}
+
+/**
+ * @brief 输出一个计数类指标的全局与直播间两个指标族
+ * 
+ * @param [in|out] text 输出文本
+ * @param [in] global 全局指标快照
+ * @param [in] entities 直播间实体数组
+ * @param [in] num 直播间实体数
+ * @param [in] rooms 各直播间的指标快照
+ * @param [in] counter 指标
+ */
+static void metrics_text_counter(metrics_text* text, const blive_metrics* global, blive* const* entities, size_t num,
+                                 const blive_metrics* rooms, blive_metric_counter counter)
+{
+    const char* name = metrics_counter_desc[counter].name;
+
+    metrics_text_append(text, "# HELP blive_%s %s\n# TYPE blive_%s counter\n", name, metrics_counter_desc[counter].help, name);
+    metrics_text_append(text, "blive_%s %llu\n", name, (unsigned long long)global->counters[counter]);
+    if (!num) {
+        return;
+    }
+
+    metrics_text_append(text, "# HELP blive_room_%s %s\n# TYPE blive_room_%s counter\n", name, metrics_counter_desc[counter].help, name);
+    for (size_t count = 0; count < num; count++) {
+        metrics_text_append(text, "blive_room_%s{room=\"%u\"} %llu\n", name, entities[count]->room_id,
+                            (unsigned long long)rooms[count].counters[counter]);
+    }
+}
+
+/**
+ * @brief 输出一个耗时直方图，le处的计数为上界不超过le的所有桶之和
+ * 
+ * @param [in|out] text 输出文本
+ * @param [in] family 指标族名
+ * @param [in] labels 额外的标签，以逗号结尾，没有时为空字符串
+ * @param [in] stage 处理阶段
+ * @param [in] hist 直方图
+ */
+static void metrics_text_hist(metrics_text* text, const char* family, const char* labels, blive_metric_stage stage,
+                              const blive_metric_hist* hist)
+{
+    uint64_t    cumulative = 0;
+    int         bucket = 0;
+
+    for (size_t le = 0; le < sizeof(metrics_text_le) / sizeof(metrics_text_le[0]); le++) {
+        while (bucket < BLIVE_METRIC_HIST_BUCKETS && blive_metric_hist_bound(bucket) <= metrics_text_le[le]) {
+            cumulative += hist->buckets[bucket++];
+        }
+        metrics_text_append(text, "%s_bucket{%sstage=\"%s\",le=\"%g\"} %llu\n", family, labels, metrics_stage_name[stage],
+                            metrics_text_le[le] / 1e9, (unsigned long long)cumulative);
+    }
+    metrics_text_append(text, "%s_bucket{%sstage=\"%s\",le=\"+Inf\"} %llu\n", family, labels, metrics_stage_name[stage],
+                        (unsigned long long)hist->count);
+    metrics_text_append(text, "%s_sum{%sstage=\"%s\"} %.9f\n", family, labels, metrics_stage_name[stage], hist->sum_ns / 1e9);
+    metrics_text_append(text, "%s_count{%sstage=\"%s\"} %llu\n", family, labels, metrics_stage_name[stage],
+                        (unsigned long long)hist->count);
+}
+
+/**
+ * @brief 输出性能剖析模式下各阶段的全局硬件计数，以及由此计算的IPC与每KB事件数；没有计数时不输出。
+ *          直播间的硬件计数通过blive_get_metrics读取，不在文本中输出
+ * 
+ * @param [in|out] text 输出文本
+ * @param [in] global 全局指标快照
+ */
+static void metrics_text_pmu(metrics_text* text, const blive_metrics* global)
+{
+    Bool    profiled = False;
+
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        profiled = profiled || global->pmu[stage].samples;
+    }
+    if (!profiled) {
+        return;
+    }
+
+    metrics_text_append(text, "# HELP blive_stage_cpu_events_total User-space hardware events counted in each stage.\n"
+                        "# TYPE blive_stage_cpu_events_total counter\n");
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        for (int event = 0; global->pmu[stage].samples && event < BLIVE_METRIC_PMU_MAX; event++) {
+            metrics_text_append(text, "blive_stage_cpu_events_total{stage=\"%s\",event=\"%s\"} %llu\n",
+                                metrics_stage_name[stage], metrics_pmu_name[event],
+                                (unsigned long long)global->pmu[stage].events[event]);
+        }
+    }
+    metrics_text_append(text, "# HELP blive_stage_profiled_bytes_total Bytes processed by each stage while profiling.\n"
+                        "# TYPE blive_stage_profiled_bytes_total counter\n");
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        if (global->pmu[stage].samples) {
+            metrics_text_append(text, "blive_stage_profiled_bytes_total{stage=\"%s\"} %llu\n",
+                                metrics_stage_name[stage], (unsigned long long)global->pmu[stage].bytes);
+        }
+    }
+    metrics_text_append(text, "# HELP blive_stage_ipc Instructions per cycle of each stage.\n# TYPE blive_stage_ipc gauge\n");
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        if (global->pmu[stage].samples) {
+            metrics_text_append(text, "blive_stage_ipc{stage=\"%s\"} %.3f\n", metrics_stage_name[stage],
+                                blive_metric_pmu_ipc(&global->pmu[stage]));
+        }
+    }
+    metrics_text_append(text, "# HELP blive_stage_misses_per_kb Cache and branch misses per KB processed by each stage.\n"
+                        "# TYPE blive_stage_misses_per_kb gauge\n");
+    for (int stage = 0; stage < BLIVE_METRIC_STAGE_MAX; stage++) {
+        if (!global->pmu[stage].samples) {
+            continue;
+        }
+        metrics_text_append(text, "blive_stage_misses_per_kb{stage=\"%s\",event=\"%s\"} %.3f\n",
+                            metrics_stage_name[stage], metrics_pmu_name[BLIVE_METRIC_PMU_CACHE_MISSES],
+                            blive_metric_pmu_per_kb(&global->pmu[stage], BLIVE_METRIC_PMU_CACHE_MISSES));
+        metrics_text_append(text, "blive_stage_misses_per_kb{stage=\"%s\",event=\"%s\"} %.3f\n",
+                            metrics_stage_name[stage], metrics_pmu_name[BLIVE_METRIC_PMU_BRANCH_MISSES],
+                            blive_metric_pmu_per_kb(&global->pmu[stage], BLIVE_METRIC_PMU_BRANCH_MISSES));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+/**
+ * @file metrics.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 指标统计的内部头文件。每次更新同时计入直播间与全局指标：直播间指标基本只有一个线程写入，
+ *          直接原子累加；全局指标被所有线程写入，按线程分片，每个线程只写自己的分片
+ * @version 0.1
+ * @date 2023-02-19
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_METRICS_H__
+#define __BLIVE_METRICS_H__
+
+#include "blive_def.h"
+
+
+#define METRICS_HIST_SUB_BITS   3       /*每个2的幂区间细分的位数*/
+#define METRICS_HIST_MAX_NS     (((uint64_t)1 << 36) - 1)   /*超出的耗时计入最后一个桶*/
+
+extern __thread blive_metrics*  blive_metrics_local;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 为调用线程分配全局指标的分片，优先复用已退出线程留下的分片
+ * 
+ * @return blive_metrics* 申请失败返回NULL，该线程的更新不计入全局指标
+ */
+blive_metrics* blive_metrics_attach(void);
+
+/**
+ * @brief 读取一个正在被更新的直方图并累加到dst上，各桶汇总得到观测次数
+ * 
+ * @param [in|out] dst 累加的结果
+ * @param [in] src 直方图
+ */
+void blive_metrics_hist_load(blive_metric_hist* dst, const blive_metric_hist* src);
+
+/**
+ * @brief 计算耗时所在的直方图桶：小于8纳秒时每纳秒一个桶，之后每个2的幂区间分为8个桶
+ * 
+ * @param [in] ns 耗时
+ * @return int 桶下标
+ */
+static inline int blive_metrics_bucket(uint64_t ns)
+{
+    int     msb = 0;
+
+    if (ns < (1 << METRICS_HIST_SUB_BITS)) {
+        return (int)ns;
+    }
+    if (ns > METRICS_HIST_MAX_NS) {
+        ns = METRICS_HIST_MAX_NS;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    return ((msb - METRICS_HIST_SUB_BITS + 1) << METRICS_HIST_SUB_BITS)
+           + (int)((ns >> (msb - METRICS_HIST_SUB_BITS)) & ((1 << METRICS_HIST_SUB_BITS) - 1));
+}
+
+/**
+ * @brief 向可能被多个线程同时写入的直方图记录一次耗时
+ * 
+ * @param [in] hist 直方图
+ * @param [in] ns 耗时
+ */
+static inline void blive_metrics_hist_add(blive_metric_hist* hist, uint64_t ns)
+{
+    __atomic_fetch_add(&hist->buckets[blive_metrics_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum_ns, ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 累加计数类指标
+ * 
+ * @param [in] room 直播间的指标
+ * @param [in] counter 指标
+ * @param [in] n 增量
+ */
+static inline void blive_metrics_count(blive_metrics* room, blive_metric_counter counter, uint64_t n)
+{
+    blive_metrics*  local = blive_metrics_local != NULL ? blive_metrics_local : blive_metrics_attach();
+
+    __atomic_fetch_add(&room->counters[counter], n, __ATOMIC_RELAXED);
+    /*分片只有本线程写入，读写分开即可，不需要加锁前缀*/
+    if (local != NULL) {
+        __atomic_store_n(&local->counters[counter], local->counters[counter] + n, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief 记录一次处理阶段的耗时。观测次数在读取时由各桶汇总，更新时不单独累加
+ * 
+ * @param [in] room 直播间的指标
+ * @param [in] stage 处理阶段
+ * @param [in] ns 耗时
+ */
+static inline void blive_metrics_observe(blive_metrics* room, blive_metric_stage stage, uint64_t ns)
+{
+    blive_metrics*      local = blive_metrics_local != NULL ? blive_metrics_local : blive_metrics_attach();
+    blive_metric_hist*  hist = NULL;
+    int                 bucket = blive_metrics_bucket(ns);
+
+    __atomic_fetch_add(&room->stages[stage].buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&room->stages[stage].sum_ns, ns, __ATOMIC_RELAXED);
+    if (local != NULL) {
+        hist = &local->stages[stage];
+        __atomic_store_n(&hist->buckets[bucket], hist->buckets[bucket] + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&hist->sum_ns, hist->sum_ns + ns, __ATOMIC_RELAXED);
+    }
+}
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -8,10 +8,13 @@
  * @copyright Copyright (c) 2023
  */
 
+#define BLIVE_LOG_SUBSYS    BLIVE_LOG_SUBSYS_MSG
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 
 #ifdef WIN32
 #include <winsock2.h>
@@ -25,10 +28,23 @@
 #include "brotli/decode.h"
 
 #include "msg.h"
+#include "coalesce.h"
+#include "filter.h"
+#include "field.h"
 #include "blive_def.h"
 #include "blive_internal.h"
 
 
+#define CMD_SLICE_STACK_NUM     64      /*单个数据包内消息数不超过该值时，切分结果使用栈上的数组*/
+#define UNZIP_MAX_SIZE          BLIVE_MSG_MAX_SIZE  /*解压后大小的上限*/
+
+/*收发、重连相关的日志归入连接子系统，解压与分包相关的日志归入解码子系统*/
+#define conn_logd(format, ...)      blive_logd_at(BLIVE_LOG_SUBSYS_CONN, format, ##__VA_ARGS__)
+#define conn_logi(format, ...)      blive_logi_at(BLIVE_LOG_SUBSYS_CONN, format, ##__VA_ARGS__)
+#define conn_loge(format, ...)      blive_loge_at(BLIVE_LOG_SUBSYS_CONN, format, ##__VA_ARGS__)
+#define decode_logi(format, ...)    blive_logi_at(BLIVE_LOG_SUBSYS_DECODE, format, ##__VA_ARGS__)
+#define decode_loge(format, ...)    blive_loge_at(BLIVE_LOG_SUBSYS_DECODE, format, ##__VA_ARGS__)
+
 static struct {
     blive_info_type     info_type;
     char*               info_str;
@@ -61,14 +77,23 @@ static struct {
 };
 
 
-static int brotli_unzip(char** dst, char* src, const blive_msg_header* header, blive* entity);
-static int cmd_body_parse(blive* entity, const char* body, int body_size, Bool compressed);
-static void call_handler(blive* entity, blive_info_type type, cJSON* json_obj);
+static int brotli_unzip(blive_buffer** dst, char* src, const blive_msg_header* header, blive* entity);
+static int cmd_body_parse(blive* entity, blive_buffer* buffer, const char* body, int body_size, Bool compressed,
+                          uint64_t recv_ns, uint64_t unzip_ns);
+static int cmd_body_split(const char* body, int body_size, Bool compressed, blive_msg_slice** slices, int* slice_num);
+static int cmd_dispatch(blive* entity, const blive_msg_slice* slice);
+static void call_handler(blive* entity, blive_info_type type, cJSON* json_obj, uint64_t recv_ns);
+static void batch_deliver(blive* entity, const blive_msg_slice* slices, int slice_num, Bool has_high);
+static void keyword_match(blive* entity, blive_msg_slice* slices, int slice_num);
+static void slice_tag(blive_event* event, const blive_msg_slice* slice);
 static int header_recv(blive* entity, blive_msg_header* header);
-static int body_recv(blive* entity, const blive_msg_header* header, char* body);
+static int body_recv(blive* entity, const blive_msg_header* header, char* body, int capacity);
+static int stream_recv(blive* entity, char* buffer, int size);
 static void header_print(const blive_msg_header* header);
 static void header_construct(char* dst, blive* entity, blive_msg_operate_type op, int data_len);
 static int runtime_auto_reconnect(blive* entity);
+static int frame_offload(blive* entity, const blive_msg_header* header, uint64_t recv_ns);
+static void frame_account(blive* entity, int body_size, uint64_t recv_ns);
 
 
 int blive_set_command_callback(blive* entity, blive_info_type info, blive_msg_handler cb, void* usr_data)
@@ -83,6 +108,132 @@ int blive_set_command_callback(blive* entity, blive_info_type info, blive_msg_ha
     return OK;
 }
 
+int blive_set_command_priority(blive* entity, blive_info_type info, blive_priority priority)
+{
+    if ((entity == NULL) || (info >= BLIVE_INFO_MAX) || (info < BLIVE_INFO_MIN)
+        || (priority < BLIVE_PRIORITY_NORMAL) || (priority >= BLIVE_PRIORITY_MAX)) {
+        return ERROR;
+    }
+
+    entity->cmd_priority[info] = priority;
+    return OK;
+}
+
+int blive_info_lookup(const char* name, int len)
+{
+    for (int count = BLIVE_INFO_MIN; count < BLIVE_INFO_MAX; count++) {
+        if (!strncmp(name, blive_info_str[count].info_str, len) && blive_info_str[count].info_str[len] == '\0') {
+            return count;
+        }
+    }
+
+    blive_logi("invalid cmd type: %.*s", len, name);
+    return BLIVE_INFO_MAX;
+}
+
+int blive_msg_unzip(blive_buffer** dst, const char* src, size_t src_size, size_t size_hint)
+{
+    BrotliDecoderState* state = NULL;
+    BrotliDecoderResult res = BROTLI_DECODER_RESULT_ERROR;
+    blive_buffer*       buffer = NULL;
+    blive_buffer*       bigger = NULL;
+    size_t              avail_in = src_size;
+    const uint8_t*      next_in = (const uint8_t*)src;
+    size_t              avail_out = 0;
+    uint8_t*            next_out = NULL;
+    size_t              decode_size = 0;
+
+    state = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    buffer = blive_buffer_alloc(size_hint + 1);
+    if (state == NULL || buffer == NULL) {
+        goto fail;
+    }
+    next_out = (uint8_t*)buffer->data;
+    avail_out = buffer->capacity - 1;   /*末尾保留一个'\0'*/
+
+    /*流式解压，输出空间不足时扩容后从断点继续，只解压一遍*/
+    while ((res = BrotliDecoderDecompressStream(state, &avail_in, &next_in, &avail_out, &next_out, NULL))
+           == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) {
+        decode_size = (char*)next_out - buffer->data;
+        if (buffer->capacity >= UNZIP_MAX_SIZE
+            || (bigger = blive_buffer_grow(buffer, decode_size, buffer->capacity * 2)) == NULL) {
+            decode_loge("decode buffer grow failed: %ld", buffer->capacity);
+            goto fail;
+        }
+        buffer = bigger;
+        next_out = (uint8_t*)buffer->data + decode_size;
+        avail_out = buffer->capacity - 1 - decode_size;
+    }
+    if (res != BROTLI_DECODER_RESULT_SUCCESS) {
+        decode_loge("brotli decode error: %s", BrotliDecoderErrorString(BrotliDecoderGetErrorCode(state)));
+        goto fail;
+    }
+    BrotliDecoderDestroyInstance(state);
+
+    decode_size = (char*)next_out - buffer->data;
+    buffer->data[decode_size] = '\0';
+    *dst = buffer;
+    return decode_size;
+
+fail:
+    if (state != NULL) {
+        BrotliDecoderDestroyInstance(state);
+    }
+    blive_buffer_release(buffer);
+    return ERROR;
+}
+
+const char* blive_msg_inner_next(const char* body, int body_size, int* offset, blive_msg_header* header)
+{
+    const blive_msg_header* wire = (const blive_msg_header*)(body + *offset);
+
+    if (body_size - *offset < (int)sizeof(blive_msg_header)) {
+        return NULL;
+    }
+    header->packet_size = ntohl(wire->packet_size);
+    header->header_size = ntohs(wire->header_size);
+    header->msg_proto = ntohs(wire->msg_proto);
+    header->msg_operate = ntohl(wire->msg_operate);
+    header->msg_seq = ntohl(wire->msg_seq);
+    if (header->header_size < sizeof(blive_msg_header) || header->packet_size < header->header_size
+        || header->packet_size > (uint32_t)(body_size - *offset)) {
+        return NULL;
+    }
+
+    *offset += header->packet_size;
+    return (const char*)wire + header->header_size;
+}
+
+int blive_msg_type_lookup(const char* data, int len)
+{
+    const char* end = data + len;
+    const char* cmd = NULL;
+    int         cmd_len = 0;
+
+    /*cmd字段一般位于开头，从前往后找*/
+    for (cmd = memchr(data, '"', len); cmd != NULL; cmd = memchr(cmd + 1, '"', end - cmd - 1)) {
+        if (end - cmd >= 5 && !memcmp(cmd, "\"cmd\"", 5)) {
+            break;
+        }
+    }
+    if (cmd == NULL) {
+        return ERROR;
+    }
+    cmd += 5;
+    while (cmd < end && (*cmd == ' ' || *cmd == ':' || *cmd == '\t' || *cmd == '\r' || *cmd == '\n')) {
+        cmd++;
+    }
+    if (cmd >= end || *cmd != '"') {
+        return ERROR;
+    }
+    cmd++;
+    while (cmd + cmd_len < end && cmd[cmd_len] != '"') {
+        cmd_len++;
+    }
+
+    return blive_info_lookup(cmd, cmd_len);
+}
+
 int blive_send_auth_msg(blive* entity)
 {
     char                auth_msg[1024] = {0};
@@ -98,12 +249,13 @@ int blive_send_auth_msg(blive* entity)
     data_len = snprintf(auth_msg + sizeof(blive_msg_header), 1024 - 1 - sizeof(blive_msg_header), 
             AUTH_SEND_PACKET_JSON_BODY, entity->usr_id, entity->room_id, entity->auth_key);
     header_construct(auth_msg, entity, BLIVE_MSG_TYPE_AUTH, data_len);
-    blive_logd("send msg: %d ---- %s", data_len, auth_msg + sizeof(blive_msg_header));
+    conn_logd("send msg: %d ---- %s", data_len, auth_msg + sizeof(blive_msg_header));
 
     /*使用循环，在连接节点失败后自动尝试连接host列表中的其他服务器*/
     for (int count = 0; count < BLIVE_HOST_NUM; count++) {
         if (entity->conn_fd) {
             shutdown(entity->conn_fd, SHUT_RDWR);
+            sock_close(entity->conn_fd);
         }
         memset(auth_body, 0, sizeof(auth_body));
         memset(&auth_header, 0, sizeof(blive_msg_header));
@@ -115,38 +267,38 @@ int blive_send_auth_msg(blive* entity)
         addr.sin_port = htons(entity->host_list[count].port);
         ret = connect(entity->conn_fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in));
         if (ret) {
-            blive_loge("count %d connect failed: connect return code: %d", count, ret);
+            conn_loge("count %d connect failed: connect return code: %d", count, ret);
             continue;
         }
 
         /*发送鉴权*/
         ret = send(entity->conn_fd, auth_msg, sizeof(blive_msg_header) + data_len, 0);
         if (!ret) {
-            blive_loge("count %d send failed", count);
+            conn_loge("count %d send failed", count);
             continue;
         }
-        blive_logd("count %d send %d byte(s)", count, ret);
+        conn_logd("count %d send %d byte(s)", count, ret);
 
         /*接收响应头*/
         ret = header_recv(entity, &auth_header);
         if (ret == ERROR) {
-            blive_loge("count %d recv header failed: remote closed", count);
+            conn_loge("count %d recv header failed: remote closed", count);
             continue;
         }
         header_print(&auth_header);
 
         /*接收响应正文*/
-        ret = body_recv(entity, &auth_header, auth_body);
+        ret = body_recv(entity, &auth_header, auth_body, sizeof(auth_body) - 1);
         if (ret == ERROR) {
-            blive_loge("count %d recv body failed: remote closed", count);
+            conn_loge("count %d recv body failed: remote closed", count);
             continue;
         }
 
         /*响应头处理*/
-        blive_logd("count %d recv %d byte(s) reply body", count, ret);
-        blive_logd("count %d reply body: %s", count, auth_body);
+        conn_logd("count %d recv %d byte(s) reply body", count, ret);
+        conn_logd("count %d reply body: %s", count, auth_body);
         if (auth_header.msg_operate != BLIVE_MSG_TYPE_AUTH_REPLY) {
-            blive_loge("count %d recv failed: remote reply error", count);
+            conn_loge("count %d recv failed: remote reply error", count);
             continue;
         }
 
@@ -155,12 +307,12 @@ int blive_send_auth_msg(blive* entity)
         json_obj = cJSON_GetObjectItem(srv_ret, "code");
         if (json_obj == NULL || json_obj->type != cJSON_Number) {
             cJSON_Delete(srv_ret);
-            blive_loge("count %d obj is null or type error", count);
+            conn_loge("count %d obj is null or type error", count);
             continue;
         }
-        if (cJSON_GetObjectItem(srv_ret, "code")->valueint != 0) {
+        if (json_obj->valueint != 0) {
+            conn_loge("count %d recv failed: remote reply code: %d", count, json_obj->valueint);
             cJSON_Delete(srv_ret);
-            blive_loge("count %d recv failed: remote reply code: %d", count, cJSON_GetObjectItem(srv_ret, "code")->valueint);
             continue;
         }
         
@@ -168,6 +320,9 @@ int blive_send_auth_msg(blive* entity)
         return OK;
     }
 
+    if (entity->conn_fd) {
+        sock_close(entity->conn_fd);
+    }
     entity->conn_fd = 0;
     return ERROR;
 }
@@ -185,16 +340,17 @@ int blive_send_heartbeat(blive* entity)
     data_len = snprintf(hb_msg + sizeof(blive_msg_header), 1024 - 1 - sizeof(blive_msg_header), 
             HRTBT_SEND_PACKET_JSON_BODY, BLIVEC_MAJOR_VERSION, BLIVEC_SECOND_VERSION);
     header_construct(hb_msg, entity, BLIVE_MSG_TYPE_HEARTBEAT, data_len);
-    blive_logd("send msg: %d ---- %s", data_len, hb_msg + sizeof(blive_msg_header));
+    conn_logd("send msg: %d ---- %s", data_len, hb_msg + sizeof(blive_msg_header));
 
     /*发送心跳包*/
     ret = send(entity->conn_fd, hb_msg, sizeof(blive_msg_header) + data_len, 0);
+    BLIVE_PROBE2(heartbeat, entity->room_id, ret);
     if (!ret) {
-        blive_loge("heartbeat send failed");
+        conn_loge("heartbeat send failed");
         pthread_mutex_unlock(&entity->conn_lock);
         return ERROR;
     }
-    blive_logd("send %d byte(s)", ret);
+    conn_logd("send %d byte(s)", ret);
 
     /**
      * @brief 说明：
@@ -209,6 +365,7 @@ int blive_send_heartbeat(blive* entity)
 
     /*在发送一个心跳包后，重注册定时器，发送下一个心跳包*/
     if (entity->sched_func(entity->sched_entity, 30 * 1000, (blive_schedule_cb)blive_send_heartbeat, entity) != OK) {
+        entity->heartbeat_armed = False;
         return ERROR;
     }
 
@@ -218,12 +375,16 @@ int blive_send_heartbeat(blive* entity)
 int blive_perform(blive* entity, int count)
 {
     int                 retval = OK;
+    int                 ret = 0;
     Bool                run = True;
-    static char         body[9192] = {0};
-    int                 body_size = sizeof(body);
+    blive_frame*        frame = NULL;
+    int                 body_size = 0;
     int32_t             fdmax = 0;
+    int                 timeout_ms = -1;
+    struct timeval      timeout = {0};
     fd_set              fds = {0};
     blive_msg_header    header = {0};
+    uint64_t            recv_ns = 0;
 
     if (entity == NULL || count < -1) {
         return ERROR;
@@ -233,7 +394,7 @@ int blive_perform(blive* entity, int count)
     }
 
     if (!entity->conn_fd) {
-        blive_loge("connection not established");
+        conn_loge("connection not established");
         return ERROR;
     }
 
@@ -242,7 +403,17 @@ int blive_perform(blive* entity, int count)
         FD_ZERO(&fds);
         FD_SET(entity->pair_fd[0], &fds);
         FD_SET(entity->conn_fd, &fds);
-        if (select(fdmax + 1, &fds, NULL, NULL, NULL) <= 0) {
+
+        /*有待分发的合并窗口时，等待到窗口到期为止；解码在解码线程内进行时由解码线程负责*/
+        timeout_ms = entity->decode_ring == NULL ? blive_coalesce_timeout(entity) : -1;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        ret = select(fdmax + 1, &fds, NULL, NULL, timeout_ms >= 0 ? &timeout : NULL);
+        blive_clock_tick();
+        if (ret <= 0) {
+            if (ret == 0) {
+                blive_packet_idle(entity);
+            }
             continue;
         }
 
@@ -250,7 +421,7 @@ int blive_perform(blive* entity, int count)
         if (FD_ISSET(entity->pair_fd[0], &fds)) {
             shutdown(entity->pair_fd[0], SHUT_RDWR);
             entity->pair_fd[0] = 0;
-            blive_loge("external call force stop");
+            conn_loge("external call force stop");
             retval = OK;
             break;
         }
@@ -258,7 +429,7 @@ int blive_perform(blive* entity, int count)
         /*与服务端的TCP连接文件描述符可读*/
         if (FD_ISSET(entity->conn_fd, &fds)) {
             if (header_recv(entity, &header) == ERROR) {
-                blive_loge("connection closed!");
+                conn_loge("connection closed!");
                 /*尝试重新连接*/
                 if (runtime_auto_reconnect(entity) != ERROR) {
                     continue;
@@ -266,103 +437,54 @@ int blive_perform(blive* entity, int count)
                 retval = ERROR;
                 break;
             }
+            recv_ns = blive_clock_now_ns();     /*以收到数据包头部的时间作为整个数据包的接收时间*/
             header_print(&header);
-            memset(body, 0, body_size);
-            if ((body_size = body_recv(entity, &header, body)) == ERROR) {
-                blive_loge("connection closed!");
-                /*尝试重新连接*/
-                if (runtime_auto_reconnect(entity) != ERROR) {
-                    continue;
-                }
-                retval = ERROR;
-                break;
-            }
-            blive_logd("body size = %d", body_size);
-
-            switch (header.msg_operate) {
-            case BLIVE_MSG_TYPE_HBREPLY_POP:    /*心跳包响应*/
-            {
-                cJSON*  json_obj = NULL;
-                char    buffer[128] = {0};
 
-                entity->pop_val = ntohl(*((uint32_t*)body));    /*获取人气值*/
-                snprintf(buffer, 127, POP_VALUE_UPDATE_JSON_BODY, 
-                         blive_info_str[BLIVE_INFO_POP_VALUE_UPDATE].info_str, entity->pop_val);
-                json_obj = cJSON_Parse(buffer);
-                call_handler(entity, BLIVE_INFO_POP_VALUE_UPDATE, json_obj);
-
-                blive_logi("pop value = %d", entity->pop_val);
-                /*释放临时资源*/
-                cJSON_Delete(json_obj);
-                json_obj = NULL;
-
-                break;
-            }
-            case BLIVE_MSG_TYPE_COMMAND:        /*普通包命令*/
-            {
-                char*               decode_buffer = NULL;
-                blive_info_type     cmd_type = BLIVE_INFO_MIN;
-                int                 decode_size = 0;
-
-                /*数据包解压*/
-                switch (header.msg_proto) {
-                case BLIVE_MSG_PROTO_CMDNOCMPRES:       /*普通包正文不使用压缩*/
-                {
-                    /*无压缩情况，直接解析（实际情况下都有压缩，没见到无压缩的情况）*/
-                    if ((cmd_type = cmd_body_parse(entity, body, body_size, False)) == ERROR) {
-                        blive_loge("invalid normal command packet!");
+            /*设置了解码线程池时，接收线程只收取完整的数据包，解压、解析与回调交给解码线程*/
+            if (entity->decode_ring != NULL) {
+                if (frame_offload(entity, &header, recv_ns) == ERROR) {
+                    conn_loge("connection closed!");
+                    if (runtime_auto_reconnect(entity) != ERROR) {
+                        continue;
                     }
+                    retval = ERROR;
                     break;
                 }
-                case BLIVE_MSG_PROTO_CMDCOMPRESZLIB:    /*普通包正文使用zlib压缩*/
-                {
-                    blive_logi("msg body use zlib encode");
-                    blive_loge("zlib not supported yet");
-                    break;
-                }
-                case BLIVE_MSG_PROTO_CMDCOMPRESBROTLI:  /*普通包正文使用brotli压缩*/
-                {
-                    blive_logi("msg body use brotli encode");
-                    if ((decode_size = brotli_unzip(&decode_buffer, body, &header, entity)) == ERROR) {
-                        blive_loge("brotli decode failed");
-                        break;
-                    }
-                    if ((cmd_type = cmd_body_parse(entity, decode_buffer, decode_size, True)) == ERROR) {
-                        blive_loge("invalid normal command packet!");
-                    }
-                    break;
-                }
-                case BLIVE_MSG_PROTO_HBAUNOCMPRES:      /*心跳及认证包正文不使用压缩*/
-                default:
-                    blive_loge("invalid protocol type %d!", header.msg_proto);
-                    break;  /*不可能出现，跳过*/
-                }
+                goto next;
+            }
 
-                /*释放临时资源*/
-                if (decode_buffer != NULL) {
-                    free(decode_buffer);
+            /*正文缓冲区按已检查过范围的数据包长度申请，长度不合法时数据流已无法继续切分，需要重新连接*/
+            if ((frame = blive_frame_alloc(&header)) == NULL
+                || (body_size = body_recv(entity, &header, frame->body,
+                                          (int)(header.packet_size - sizeof(blive_msg_header)))) == ERROR) {
+                blive_frame_free(frame);
+                conn_loge("connection closed!");
+                /*尝试重新连接*/
+                if (runtime_auto_reconnect(entity) != ERROR) {
+                    continue;
                 }
-
+                retval = ERROR;
                 break;
             }
-            default:                            /*其他报文，不应该收到*/
+            conn_logd("body size = %d", body_size);
+            if (blive_packet_feed(entity, &header, frame->body, body_size, recv_ns) == ERROR) {
                 run = False;
-                blive_loge("invalid msg_operate type %d!", header.msg_operate);
                 retval = ERROR;
-                break;
             }
+            blive_frame_free(frame);
         }
 
+next:
         if (count != -1) {
             count--;
             if (count == 0) {
                 run = False;
-                blive_logi("count == 0, break");
+                conn_logi("count == 0, break");
             }
         }
     }
 
-    blive_logi("perform finished");
+    conn_logi("perform finished");
     return retval;
 }
 
@@ -373,96 +495,526 @@ int blive_force_stop(blive* entity)
     return OK;
 }
 
+int blive_packet_process(blive* entity, const blive_msg_header* header, char* body, int body_size, uint64_t recv_ns)
+{
+    switch (header->msg_operate) {
+    case BLIVE_MSG_TYPE_HBREPLY_POP:    /*心跳包响应*/
+    {
+        blive_msg_slice slice = {0};
+        char            buffer[128] = {0};
+
+        entity->pop_val = ntohl(*((uint32_t*)body));    /*获取人气值*/
+        BLIVE_PROBE2(heartbeat_reply, entity->room_id, entity->pop_val);
+        slice.len = snprintf(buffer, 127, POP_VALUE_UPDATE_JSON_BODY, 
+                             blive_info_str[BLIVE_INFO_POP_VALUE_UPDATE].info_str, entity->pop_val);
+        slice.data = buffer;
+        slice.type = BLIVE_INFO_POP_VALUE_UPDATE;
+        slice.recv_ns = recv_ns;
+        slice.unzip_ns = slice.parse_ns = blive_clock_now_ns();
+        blive_metrics_count(&entity->metrics, BLIVE_METRIC_MSGS, 1);
+        if (entity->filter != NULL && !blive_filter_eval(entity->filter, slice.type, slice.data, slice.len)) {
+            blive_metrics_count(&entity->metrics, BLIVE_METRIC_FILTERED, 1);
+            break;
+        }
+        cmd_dispatch(entity, &slice);
+        if (entity->batch_handler.info_mask & BLIVE_INFO_BIT(BLIVE_INFO_POP_VALUE_UPDATE)) {
+            batch_deliver(entity, &slice, 1, False);
+        }
+
+        blive_logi("pop value = %d", entity->pop_val);
 
-static int cmd_body_parse(blive* entity, const char* body, int body_size, Bool compressed)
+        break;
+    }
+    case BLIVE_MSG_TYPE_COMMAND:        /*普通包命令*/
+    {
+        blive_buffer*       decode_buffer = NULL;
+        blive_info_type     cmd_type = BLIVE_INFO_MIN;
+        int                 decode_size = 0;
+        uint64_t            unzip_begin = 0;
+        uint64_t            unzip_ns = 0;
+        blive_pmu_sample    pmu = {0};
+        Bool                profiling = False;
+
+        /*数据包解压*/
+        switch (header->msg_proto) {
+        case BLIVE_MSG_PROTO_CMDNOCMPRES:       /*普通包正文不使用压缩*/
+        {
+            /*无压缩情况，直接解析（实际情况下都有压缩，没见到无压缩的情况）*/
+            unzip_ns = blive_clock_now_ns();
+            if ((cmd_type = cmd_body_parse(entity, NULL, body, body_size, False, recv_ns, unzip_ns)) == ERROR) {
+                blive_loge("invalid normal command packet!");
+            }
+            break;
+        }
+        case BLIVE_MSG_PROTO_CMDCOMPRESZLIB:    /*普通包正文使用zlib压缩*/
+        {
+            decode_logi("msg body use zlib encode");
+            decode_loge("zlib not supported yet");
+            break;
+        }
+        case BLIVE_MSG_PROTO_CMDCOMPRESBROTLI:  /*普通包正文使用brotli压缩*/
+        {
+            decode_logi("msg body use brotli encode");
+            profiling = blive_pmu_begin(&pmu);
+            unzip_begin = blive_clock_now_ns();
+            decode_size = brotli_unzip(&decode_buffer, body, header, entity);
+            unzip_ns = blive_clock_now_ns();
+            if (profiling) {
+                blive_pmu_account(&entity->metrics, BLIVE_METRIC_STAGE_UNZIP, &pmu, body_size);
+            }
+            blive_metrics_observe(&entity->metrics, BLIVE_METRIC_STAGE_UNZIP, unzip_ns - unzip_begin);
+            if (decode_size == ERROR) {
+                blive_metrics_count(&entity->metrics, BLIVE_METRIC_UNZIP_ERRORS, 1);
+                decode_loge("brotli decode failed");
+                break;
+            }
+            blive_metrics_count(&entity->metrics, BLIVE_METRIC_UNZIP_BYTES, decode_size);
+            if ((cmd_type = cmd_body_parse(entity, decode_buffer, decode_buffer->data, decode_size, True, recv_ns, unzip_ns)) == ERROR) {
+                blive_loge("invalid normal command packet!");
+            }
+            break;
+        }
+        case BLIVE_MSG_PROTO_HBAUNOCMPRES:      /*心跳及认证包正文不使用压缩*/
+        default:
+            blive_loge("invalid protocol type %d!", header->msg_proto);
+            break;  /*不可能出现，跳过*/
+        }
+
+        /*释放本函数持有的引用，事件仍在引用时缓冲区在最后一个事件释放后才回到缓冲池*/
+        if (decode_buffer != NULL) {
+            blive_buffer_release(decode_buffer);
+        }
+
+        break;
+    }
+    default:                            /*其他报文，不应该收到*/
+        blive_loge("invalid msg_operate type %d!", header->msg_operate);
+        return ERROR;
+    }
+
+    blive_packet_idle(entity);
+    return OK;
+}
+
+int blive_packet_feed(blive* entity, const blive_msg_header* header, char* body, int body_size, uint64_t recv_ns)
+{
+    blive_frame*    frame = NULL;
+
+    frame_account(entity, body_size, recv_ns);
+    blive_capture_feed(entity, header, body, body_size, recv_ns);
+
+    if (entity->decode_ring == NULL) {
+        return blive_packet_process(entity, header, body, body_size, recv_ns);
+    }
+    if (body_size > (int)header->packet_size - (int)sizeof(blive_msg_header)) {
+        return ERROR;
+    }
+    if ((frame = blive_frame_alloc(header)) == NULL) {
+        return ERROR;
+    }
+    memcpy(frame->body, body, body_size);
+    frame->body[body_size] = '\0';
+    frame->body_size = body_size;
+    frame->recv_ns = recv_ns;
+
+    return blive_decode_ring_push(entity->decode_ring, frame);
+}
+
+void blive_packet_idle(blive* entity)
+{
+    /*分发已到期的合并窗口*/
+    blive_coalesce_flush(entity, call_handler);
+}
+
+
+/**
+ * @brief 切分、过滤数据包内的消息并分发
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] buffer 正文所在的解压缓冲区，未压缩时为NULL
+ * @param [in] body 正文
+ * @param [in] body_size 正文长度
+ * @param [in] compressed 是否为解压后的数据
+ * @param [in] recv_ns 数据包的接收时间
+ * @param [in] unzip_ns 解压完成的时间，即开始切分的时间
+ * @return int 
+ */
+static int cmd_body_parse(blive* entity, blive_buffer* buffer, const char* body, int body_size, Bool compressed,
+                          uint64_t recv_ns, uint64_t unzip_ns)
+{
+    blive_msg_slice     slice_buf[CMD_SLICE_STACK_NUM];
+    blive_msg_slice*    slices = slice_buf;
+    int                 slice_num = 0;
+    int                 retval = OK;
+    Bool                has_high = False;
+    uint64_t            parse_ns = 0;
+    blive_pmu_sample    pmu = {0};
+    Bool                profiling = blive_pmu_begin(&pmu);
+
+    /*先切分出每条消息的位置与类型，不构建JSON树*/
+    retval = cmd_body_split(body, body_size, compressed, &slices, &slice_num);
+    for (int count = 0; count < slice_num; count++) {
+        slices[count].buffer = buffer;
+        slices[count].recv_ns = recv_ns;
+        slices[count].unzip_ns = unzip_ns;
+    }
+    blive_metrics_count(&entity->metrics, BLIVE_METRIC_MSGS, slice_num);
+    if (retval == ERROR) {
+        blive_metrics_count(&entity->metrics, BLIVE_METRIC_PARSE_ERRORS, 1);
+    }
+
+    /*过滤条件在构建JSON与分发之前直接在原文上求值，不满足条件的消息不会到达任何回调*/
+    if (entity->filter != NULL) {
+        int kept = 0;
+
+        for (int count = 0; count < slice_num; count++) {
+            if (blive_filter_eval(entity->filter, slices[count].type, slices[count].data, slices[count].len)) {
+                slices[kept++] = slices[count];
+            }
+        }
+        blive_metrics_count(&entity->metrics, BLIVE_METRIC_FILTERED, slice_num - kept);
+        slice_num = kept;
+    }
+    if (entity->keywords != NULL) {
+        keyword_match(entity, slices, slice_num);
+    }
+    parse_ns = blive_clock_now_ns();
+    blive_metrics_observe(&entity->metrics, BLIVE_METRIC_STAGE_PARSE, parse_ns - unzip_ns);
+    if (profiling) {
+        blive_pmu_account(&entity->metrics, BLIVE_METRIC_STAGE_PARSE, &pmu, body_size);
+    }
+    for (int count = 0; count < slice_num; count++) {
+        slices[count].parse_ns = parse_ns;
+    }
+    for (int count = 0; count < slice_num; count++) {
+        if (entity->cmd_priority[slices[count].type] == BLIVE_PRIORITY_HIGH) {
+            has_high = True;
+            break;
+        }
+    }
+
+    /*高优先级的消息先于本批次所有普通消息分发，同一优先级内保持原有顺序。执行器中的提前同样限于本数据包*/
+    if (entity->strand != NULL) {
+        blive_strand_packet(entity->strand);
+    }
+    for (int prio = has_high ? BLIVE_PRIORITY_HIGH : BLIVE_PRIORITY_NORMAL; prio >= BLIVE_PRIORITY_NORMAL; prio--) {
+        for (int count = 0; count < slice_num; count++) {
+            if (entity->cmd_priority[slices[count].type] != prio) {
+                continue;
+            }
+            if (entity->msg_handler[slices[count].type].handler == NULL
+                && entity->msg_handler[slices[count].type].event_handler == NULL) {
+                continue;   /*没有订阅的类型不需要解析*/
+            }
+
+            blive_logi("msg info type: [%s]", blive_info_str[slices[count].type].info_str_chn);
+            if (cmd_dispatch(entity, &slices[count]) == ERROR) {
+                blive_loge("dispatch failed: %d/%d", (int)(slices[count].data - body), body_size);
+                retval = ERROR;
+            }
+        }
+    }
+
+    if (entity->batch_handler.info_mask) {
+        batch_deliver(entity, slices, slice_num, has_high);
+    }
+
+    if (slices != slice_buf) {
+        free(slices);
+    }
+    return retval;
+}
+
+/**
+ * @brief 将正文切分为一条条消息，只从原始数据中识别消息类型，不解析JSON。
+ *          多个普通包可能会被压缩后一次性发送，因此body内可能不止包含一个数据包
+ * 
+ * @param [in] body 正文
+ * @param [in] body_size 正文长度
+ * @param [in] compressed 是否为解压后的数据，是则每条消息前带有一个消息头
+ * @param [in|out] slices 传入调用者提供的数组，消息数超出CMD_SLICE_STACK_NUM时传出新申请的数组
+ * @param [out] slice_num 传出识别出的消息数，未知类型的消息不计入
+ * @return int 数据不完整或消息缺少cmd字段时返回ERROR，已识别的消息仍然有效
+ */
+static int cmd_body_split(const char* body, int body_size, Bool compressed, blive_msg_slice** slices, int* slice_num)
 {
-    cJSON*              json_obj = NULL;
-    cJSON*              cmd_obj = NULL;
-    int                 count = BLIVE_INFO_MIN;
     int                 handled_size = 0;
+    int                 capacity = CMD_SLICE_STACK_NUM;
+    int                 type = BLIVE_INFO_MIN;
     blive_msg_header    msg_header = {0};
+    blive_msg_slice     slice = {0};
+    blive_msg_slice*    bigger = NULL;
 
-    /*多个普通包可能会被压缩后一次性发送，因此body内可能不止包含一个数据包，使用循环进行处理*/
+    *slice_num = 0;
     while (handled_size < body_size) {
         /*如果是经过压缩，数据正文字段中将会再含有一个消息头*/
         if (compressed) {
-            msg_header.packet_size = ntohl(((const blive_msg_header*)(body + handled_size))->packet_size);
-            msg_header.header_size = ntohs(((const blive_msg_header*)(body + handled_size))->header_size);
-            msg_header.msg_proto = ntohs(((const blive_msg_header*)(body + handled_size))->msg_proto);
-            msg_header.msg_operate = ntohl(((const blive_msg_header*)(body + handled_size))->msg_operate);
-            msg_header.msg_seq = ntohl(((const blive_msg_header*)(body + handled_size))->msg_seq);
-            handled_size += msg_header.header_size;
-        }
-        
-        json_obj = cJSON_Parse(body + handled_size);
-        if (json_obj == NULL) {
-            blive_loge("cjson parse failed: %d/%d", handled_size, body_size);
-            return ERROR;
-        }
-        if (compressed) {
-            handled_size += msg_header.packet_size - msg_header.header_size;
+            if ((slice.data = blive_msg_inner_next(body, body_size, &handled_size, &msg_header)) == NULL) {
+                decode_loge("invalid msg header: %d/%d", handled_size, body_size);
+                return ERROR;
+            }
+            slice.len = msg_header.packet_size - msg_header.header_size;
         } else {
+            slice.data = body;
+            slice.len = body_size;
             handled_size += body_size;
         }
 
         /*解析消息类型*/
-        cmd_obj = cJSON_GetObjectItem(json_obj, "cmd");
-        if (cmd_obj == NULL) {
-            blive_loge("invalid msg: no cmd field");
-            cJSON_Delete(json_obj);
+        if ((type = blive_msg_type_lookup(slice.data, slice.len)) == ERROR) {
+            decode_loge("invalid msg: no cmd field");
             return ERROR;
         }
+        if (type >= BLIVE_INFO_MAX) {
+            continue;
+        }
+        slice.type = type;
 
-        count = 0;
-        while (count < BLIVE_INFO_MAX) {
-            if (!strcmp(cmd_obj->valuestring, blive_info_str[count].info_str)) {
-                break;
+        if (*slice_num >= capacity) {
+            bigger = malloc(sizeof(blive_msg_slice) * capacity * 2);
+            if (bigger == NULL) {
+                return ERROR;
+            }
+            memcpy(bigger, *slices, sizeof(blive_msg_slice) * capacity);
+            if (capacity != CMD_SLICE_STACK_NUM) {
+                free(*slices);
             }
-            count++;
+            *slices = bigger;
+            capacity *= 2;
         }
+        (*slices)[(*slice_num)++] = slice;
+    }
 
-        if (count >= BLIVE_INFO_MAX) {
-            blive_logi("invalid cmd type: %s", cmd_obj->valuestring);
-        } else {
-            blive_logi("msg info type: [%s]", blive_info_str[count].info_str_chn);
-            call_handler(entity, count, json_obj);
+    return OK;
+}
+
+/**
+ * @brief 分发一条消息：开启了合并的类型解析后进入合并窗口；设置了执行器时创建引用解压缓冲区的事件
+ *          交给工作线程，JSON在工作线程内按需解析；否则直接以解压缓冲区中的原文调起回调
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] slice 消息在数据包中的位置与类型
+ * @return int 
+ */
+static int cmd_dispatch(blive* entity, const blive_msg_slice* slice)
+{
+    blive_event     event = {0};
+    blive_event*    copied = NULL;
+    cJSON*          json_obj = NULL;
+
+    if (blive_coalesce_enabled(entity, slice->type)) {
+        if ((json_obj = cJSON_ParseWithLength(slice->data, slice->len)) == NULL) {
+            blive_metrics_count(&entity->metrics, BLIVE_METRIC_PARSE_ERRORS, 1);
+            return ERROR;
         }
-        cJSON_Delete(json_obj);
+        blive_coalesce_push(entity, slice->type, json_obj, slice->recv_ns, call_handler);
+        return OK;
+    }
+
+    if (entity->strand != NULL
+        && (copied = blive_event_create(slice->type, slice->buffer, slice->data, slice->len, NULL)) != NULL) {
+        slice_tag(copied, slice);
+        if (blive_strand_submit(entity->strand, copied) == OK) {
+            return OK;
+        }
+        blive_event_deliver(entity, copied);
+        blive_event_release(copied);
+        return OK;
     }
 
+    event.type = slice->type;
+    event.raw = slice->data;
+    event.raw_len = slice->len;
+    event.buffer = slice->buffer;
+    slice_tag(&event, slice);
+    blive_event_deliver(entity, &event);
+    cJSON_Delete(event.json);
+
     return OK;
 }
 
-static inline void call_handler(blive* entity, blive_info_type type, cJSON* json_obj)
+/**
+ * @brief 调起合并结果的回调处理函数，json_obj的所有权转交给本函数。合并结果没有原始报文，
+ *          订阅了事件回调时由JSON序列化出原文
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] type 消息类型
+ * @param [in] json_obj 消息内容
+ * @param [in] recv_ns 窗口内最后一条消息的接收时间
+ */
+static void call_handler(blive* entity, blive_info_type type, cJSON* json_obj, uint64_t recv_ns)
 {
-    if (entity->msg_handler[type].handler) {
-        entity->msg_handler[type].handler(entity, json_obj, entity->msg_handler[type].usr_data);
+    blive_event     event = {0};
+    blive_event*    copied = NULL;
+    char*           raw = NULL;
+
+    if (entity->msg_handler[type].handler == NULL && entity->msg_handler[type].event_handler == NULL) {
+        cJSON_Delete(json_obj);
+        return;
+    }
+    if (entity->msg_handler[type].event_handler != NULL) {
+        raw = cJSON_PrintUnformatted(json_obj);
+    }
+
+    /*设置了执行器时，交给工作线程执行，接收线程立即返回继续读取socket*/
+    if (entity->strand != NULL
+        && (copied = blive_event_create(type, NULL, raw, raw != NULL ? strlen(raw) : 0, json_obj)) != NULL) {
+        cJSON_free(raw);
+        copied->recv_ns = recv_ns;
+        if (blive_strand_submit(entity->strand, copied) != OK) {
+            blive_event_deliver(entity, copied);
+            blive_event_release(copied);
+        }
+        return;
     }
+
+    event.type = type;
+    event.json = json_obj;
+    event.parsed = True;
+    event.raw = raw;
+    event.raw_len = raw != NULL ? strlen(raw) : 0;
+    event.recv_ns = recv_ns;
+    blive_event_deliver(entity, &event);
+    cJSON_Delete(json_obj);
+    cJSON_free(raw);
 }
 
-static int header_recv(blive* entity, blive_msg_header* header)
+/**
+ * @brief 将一个数据包内批量回调订阅的消息组成事件数组，调起一次批量回调，高优先级消息排在前面。
+ *          事件的JSON在回调中首次访问时才解析
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] slices 切分出的消息
+ * @param [in] slice_num 消息数
+ * @param [in] has_high 是否包含高优先级消息
+ */
+static void batch_deliver(blive* entity, const blive_msg_slice* slices, int slice_num, Bool has_high)
 {
-    int     retry_count = 3;
-    int     total_size = 0;
-    int     recv_size = 0;
-    char    buffer[sizeof(blive_msg_header)] = {0};
+    blive_event     event_buf[CMD_SLICE_STACK_NUM];
+    blive_event*    event_ptr_buf[CMD_SLICE_STACK_NUM];
+    blive_event*    events = event_buf;
+    blive_event**   event_ptrs = event_ptr_buf;
+    size_t          event_num = 0;
+
+    if (slice_num > CMD_SLICE_STACK_NUM) {
+        events = malloc(sizeof(blive_event) * slice_num);
+        event_ptrs = malloc(sizeof(blive_event*) * slice_num);
+        if (events == NULL || event_ptrs == NULL) {
+            blive_loge("alloc %d events failed", slice_num);
+            free(events);
+            free(event_ptrs);
+            return;
+        }
+    }
 
-    while (retry_count--) {
-        recv_size = recv(entity->conn_fd, buffer + total_size, sizeof(blive_msg_header), 0);
-        if (recv_size == -1) {
-            blive_loge("recv failed!");
-            return ERROR;
+    for (int prio = has_high ? BLIVE_PRIORITY_HIGH : BLIVE_PRIORITY_NORMAL; prio >= BLIVE_PRIORITY_NORMAL; prio--) {
+        for (int count = 0; count < slice_num; count++) {
+            if (entity->cmd_priority[slices[count].type] != prio
+                || !(entity->batch_handler.info_mask & BLIVE_INFO_BIT(slices[count].type))) {
+                continue;
+            }
+
+            events[event_num].type = slices[count].type;
+            events[event_num].json = NULL;
+            events[event_num].parsed = False;
+            events[event_num].raw = slices[count].data;
+            events[event_num].raw_len = slices[count].len;
+            events[event_num].buffer = slices[count].buffer;
+            events[event_num].refcount = 0;
+            slice_tag(&events[event_num], &slices[count]);
+            event_ptrs[event_num] = &events[event_num];
+            event_num++;
         }
-        total_size += recv_size;
-        if (total_size != sizeof(blive_msg_header)) {
-            blive_logd("should recv %d, actual recv %d, retry again", sizeof(blive_msg_header), total_size);
-        } else {
-            break;
+    }
+
+    if (event_num) {
+        blive_pmu_sample    pmu = {0};
+        Bool                profiling = blive_pmu_begin(&pmu);
+        uint64_t            begin = blive_clock_now_ns();
+        uint64_t            end = 0;
+        uint64_t            bytes = 0;
+
+        BLIVE_PROBE2(batch_dispatch, entity->room_id, event_num);
+        entity->batch_handler.handler(entity, event_ptrs, event_num, entity->batch_handler.usr_data);
+        end = blive_clock_now_ns();
+        if (profiling) {
+            for (size_t count = 0; count < event_num; count++) {
+                bytes += events[count].raw_len;
+            }
+            blive_pmu_account(&entity->metrics, BLIVE_METRIC_STAGE_HANDLER, &pmu, bytes);
+        }
+        BLIVE_PROBE3(batch_done, entity->room_id, event_num, end - begin);
+        blive_metrics_observe(&entity->metrics, BLIVE_METRIC_STAGE_HANDLER, end - begin);
+        for (size_t count = 0; entity->tracer != NULL && count < event_num; count++) {
+            blive_trace_record(entity, &events[count], begin, end);
         }
     }
 
-    if (total_size != sizeof(blive_msg_header)) {
-        blive_loge("should recv %d, actual recv %d, failed!", sizeof(blive_msg_header), recv_size);
+    for (size_t count = 0; count < event_num; count++) {
+        cJSON_Delete(events[count].json);
+    }
+    if (events != event_buf) {
+        free(events);
+        free(event_ptrs);
+    }
+}
+
+/**
+ * @brief 在弹幕文本上匹配关键词，命中的关键词id记录在消息上。整个数据包只获取一次关键词自动机，
+ *          处理过程中关键词集合被替换时本数据包仍使用旧的自动机
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in|out] slices 切分出的消息
+ * @param [in] slice_num 消息数
+ */
+static void keyword_match(blive* entity, blive_msg_slice* slices, int slice_num)
+{
+    blive_ac*           ac = NULL;
+    blive_field_value   text = {0};
+
+    /*没有任何回调会收到弹幕时不需要匹配*/
+    if (entity->msg_handler[BLIVE_INFO_DANMU_MSG].handler == NULL
+        && entity->msg_handler[BLIVE_INFO_DANMU_MSG].event_handler == NULL
+        && !(entity->batch_handler.info_mask & BLIVE_INFO_BIT(BLIVE_INFO_DANMU_MSG))) {
+        return;
+    }
+
+    for (int count = 0; count < slice_num; count++) {
+        if (slices[count].type != BLIVE_INFO_DANMU_MSG) {
+            continue;
+        }
+        if (ac == NULL && (ac = blive_keywords_acquire(entity->keywords)) == NULL) {
+            return;     /*关键词集合为空*/
+        }
+        if (blive_field_extract(slices[count].type, slices[count].data, slices[count].len, BLIVE_FIELD_TEXT, &text) != OK
+            || text.kind != BLIVE_FIELD_STRING) {
+            continue;
+        }
+        slices[count].keyword_num = blive_ac_match(ac, text.str, text.str_len, slices[count].keyword_ids, BLIVE_KEYWORD_TAG_MAX);
+    }
+
+    blive_ac_release(ac);
+}
+
+/**
+ * @brief 将消息上的各个时间点与命中的关键词复制到事件
+ * 
+ */
+static inline void slice_tag(blive_event* event, const blive_msg_slice* slice)
+{
+    event->recv_ns = slice->recv_ns;
+    event->unzip_ns = slice->unzip_ns;
+    event->parse_ns = slice->parse_ns;
+    event->keyword_num = slice->keyword_num;
+    memcpy(event->keyword_ids, slice->keyword_ids, sizeof(uint32_t) * slice->keyword_num);
+}
+
+static int header_recv(blive* entity, blive_msg_header* header)
+{
+    int     total_size = 0;
+    char    buffer[sizeof(blive_msg_header)] = {0};
+
+    if ((total_size = stream_recv(entity, buffer, sizeof(blive_msg_header))) == ERROR) {
         return ERROR;
     }
 
@@ -471,45 +1023,71 @@ static int header_recv(blive* entity, blive_msg_header* header)
     header->msg_proto = ntohs(((blive_msg_header*)buffer)->msg_proto);
     header->msg_operate = ntohl(((blive_msg_header*)buffer)->msg_operate);
     header->msg_seq = ntohl(((blive_msg_header*)buffer)->msg_seq);
+    BLIVE_PROBE4(frame_recv, entity->room_id, header->packet_size, header->msg_proto, header->msg_operate);
 
     return total_size;
 }
 
-static int body_recv(blive* entity, const blive_msg_header* header, char* body)
+/**
+ * @brief 收取数据包正文。正文长度来自服务端的头部，超出缓冲区容量时视为协议错误
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] header 已收取的数据包头部
+ * @param [out] body 正文缓冲区
+ * @param [in] capacity 正文缓冲区可容纳的长度
+ * @return int 收到的长度，连接断开或长度不合法时返回ERROR
+ */
+static int body_recv(blive* entity, const blive_msg_header* header, char* body, int capacity)
+{
+    int     body_size = (int)header->packet_size - (int)sizeof(blive_msg_header);
+
+    if (header->packet_size > BLIVE_MSG_MAX_SIZE || body_size < 0 || body_size > capacity) {
+        conn_loge("invalid packet size %u, capacity %d", header->packet_size, capacity);
+        return ERROR;
+    }
+    /*接收响应正文*/
+    return stream_recv(entity, body, body_size);
+}
+
+/**
+ * @brief 从连接上收满指定长度的数据。一个数据包可能在任意位置被切分为多段到达，
+ *          只有连接关闭或出错时才返回失败，不能以重试次数判断
+ * 
+ * @param [in] entity 直播间实体
+ * @param [out] buffer 接收缓冲区
+ * @param [in] size 需要接收的长度
+ * @return int 收到的长度，连接关闭或出错时返回ERROR
+ */
+static int stream_recv(blive* entity, char* buffer, int size)
 {
-    int     retry_count = 3;
     int     total_size = 0;
     int     recv_size = 0;
-    int     body_size = header->packet_size - sizeof(blive_msg_header);
 
-    /*接收响应正文*/
-    while (retry_count--) {
-        recv_size = recv(entity->conn_fd, body + total_size, body_size - recv_size, 0);
-        if (recv_size == -1) {
-            blive_loge("recv failed!");
+    while (total_size < size) {
+        recv_size = recv(entity->conn_fd, buffer + total_size, size - total_size, 0);
+        if (recv_size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (recv_size <= 0) {
+            conn_loge("should recv %d, actual recv %d, failed: %s", size, total_size,
+                      recv_size == 0 ? "remote closed" : strerror(errno));
             return ERROR;
         }
-        total_size += recv_size;
-        if (total_size != body_size) {
-            blive_logd("should recv %d, actual recv %d, retry again", body_size, total_size);
-        } else {
-            break;
+        if (total_size + recv_size < size) {
+            conn_logd("should recv %d, actual recv %d, continue", size, total_size + recv_size);
         }
-    }
-
-    if (total_size != body_size) {
-        blive_loge("should recv %d, actual recv %d, failed!", body_size, recv_size);
+        total_size += recv_size;
     }
     return total_size;
 }
 
 static inline void header_print(const blive_msg_header* header)
 {
-    blive_logd("packet_size = %d", header->packet_size);
-    blive_logd("header_size = %d", header->header_size);
-    blive_logd("msg_proto = %d", header->msg_proto);
-    blive_logd("msg_operate = %d", header->msg_operate);
-    blive_logd("msg_seq = %d", header->msg_seq);
+    conn_logd("packet_size = %d", header->packet_size);
+    conn_logd("header_size = %d", header->header_size);
+    conn_logd("msg_proto = %d", header->msg_proto);
+    conn_logd("msg_operate = %d", header->msg_operate);
+    conn_logd("msg_seq = %d", header->msg_seq);
 }
 
 static inline void header_construct(char* dst, blive* entity, blive_msg_operate_type op, int data_len)
@@ -533,39 +1111,17 @@ static inline void header_construct(char* dst, blive* entity, blive_msg_operate_
     }
 }
 
-static int brotli_unzip(char** dst, char* src, const blive_msg_header* header, blive* entity)
+static int brotli_unzip(blive_buffer** dst, char* src, const blive_msg_header* header, blive* entity)
 {
-    char*   decode_buffer = NULL;
-    size_t  decode_size = 2048;
-    Bool    is_ok = False;
-    int     err_count = 0;
-    BrotliDecoderResult res = BROTLI_DECODER_RESULT_ERROR;
-
-    while (!is_ok) {
-        decode_buffer = malloc(decode_size + 1);
-        memset(decode_buffer, 0, decode_size + 1);
+    size_t  src_size = header->packet_size - header->header_size;
+    int     decode_size = 0;
 
-        res = BrotliDecoderDecompress(header->packet_size - header->header_size, (uint8_t*)src, 
-                                      &decode_size, (uint8_t*)decode_buffer);
-        if (res == BROTLI_DECODER_RESULT_SUCCESS) {
-            is_ok = True;
-        } else {
-            /*初始大小为2048，json格式数据可能较大，在不够存储时扩容再次进行尝试*/
-            blive_logd("size %ld not enough, try double size", decode_size);
-            free(decode_buffer);
-            decode_buffer = NULL;
-            decode_size *= 4;
-
-            /*避免因为其他原因的解析失败而无限扩大内存申请，在扩容5次后强制退出*/
-            err_count++;
-            if (err_count > 2) {
-                return ERROR;
-            }
-        }
+    /*初始大小取上一个数据包解压后的大小*/
+    BLIVE_PROBE2(unzip_begin, entity->room_id, src_size);
+    if ((decode_size = blive_msg_unzip(dst, src, src_size, entity->unzip_size_hint)) != ERROR) {
+        entity->unzip_size_hint = decode_size;
     }
-
-    /*前16个字节是头部消息，也进行了压缩，因此需要去除该消息*/
-    *dst = decode_buffer;
+    BLIVE_PROBE3(unzip_end, entity->room_id, src_size, (long)decode_size);
 
     return decode_size;
 }
@@ -576,7 +1132,7 @@ static int runtime_auto_reconnect(blive* entity)
 
     /*如果没开启自动重连，或已经达到最大重连次数，直接退出*/
     if (!entity->auto_reconnect || !entity->max_reconnect) {
-        blive_loge("auto reconnect not enable! EN:%d, CNT:%d", entity->auto_reconnect, entity->max_reconnect);
+        conn_loge("auto reconnect not enable! EN:%d, CNT:%d", entity->auto_reconnect, entity->max_reconnect);
         goto out;
     }
 
@@ -585,34 +1141,79 @@ static int runtime_auto_reconnect(blive* entity)
 
     while (entity->max_reconnect) {
         entity->max_reconnect--;
+        blive_metrics_count(&entity->metrics, BLIVE_METRIC_RECONNECTS, 1);
+        BLIVE_PROBE2(reconnect, entity->room_id, entity->max_reconnect);
 
-        blive_loge("close current connection...");
+        conn_loge("close current connection...");
         retval = blive_close_connection(entity);
         if (retval != OK) {
             entity->auto_reconnect = False;
-            blive_loge("close current connection failed, unknown error!");
+            conn_loge("close current connection failed, unknown error!");
             break;
         }
 
-        blive_loge("trying to reconnect...");
+        conn_loge("trying to reconnect...");
         retval = blive_establish_connection(entity, entity->sched_func, entity->sched_entity);
         if (retval != OK) {
-            blive_loge("reconnect failed, will try again after 5 seconds...");
+            conn_loge("reconnect failed, will try again after 5 seconds...");
             sleep(5);
             continue;
         }
 
-        blive_loge("connection recovered!");
+        conn_loge("connection recovered!");
         break;
     }
 
     /*完成重连，解锁*/
     pthread_mutex_unlock(&entity->conn_lock);
+    BLIVE_PROBE2(reconnect_done, entity->room_id, retval);
 
     if (retval != OK) {
-        blive_loge("reconnect failed! You can retry after checking your network!");
+        conn_loge("reconnect failed! You can retry after checking your network!");
     }
 
 out:
     return retval;
 }
+
+/**
+ * @brief 收取数据包正文后直接交给解码线程，接收线程不做解压与解析
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] header 已收取的数据包头部
+ * @param [in] recv_ns 收到数据包头部的时间
+ * @return int 连接断开或数据包长度不合法时返回ERROR，长度不合法时数据流已无法继续切分，同样需要重新连接
+ */
+static int frame_offload(blive* entity, const blive_msg_header* header, uint64_t recv_ns)
+{
+    blive_frame*    frame = NULL;
+
+    frame = blive_frame_alloc(header);
+    if (frame == NULL) {
+        return ERROR;
+    }
+    frame->body_size = body_recv(entity, header, frame->body, (int)(header->packet_size - sizeof(blive_msg_header)));
+    if (frame->body_size == ERROR) {
+        blive_frame_free(frame);
+        return ERROR;
+    }
+    frame->recv_ns = recv_ns;
+    frame_account(entity, frame->body_size, recv_ns);
+    blive_capture_feed(entity, header, frame->body, frame->body_size, recv_ns);
+
+    return blive_decode_ring_push(entity->decode_ring, frame);
+}
+
+/**
+ * @brief 统计收到的数据包：字节数、包数，以及从收到头部到收完正文的耗时
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] body_size 实际收到的正文长度
+ * @param [in] recv_ns 收到数据包头部的时间
+ */
+static void frame_account(blive* entity, int body_size, uint64_t recv_ns)
+{
+    blive_metrics_count(&entity->metrics, BLIVE_METRIC_RECV_FRAMES, 1);
+    blive_metrics_count(&entity->metrics, BLIVE_METRIC_RECV_BYTES, sizeof(blive_msg_header) + body_size);
+    blive_metrics_observe(&entity->metrics, BLIVE_METRIC_STAGE_RECV, blive_clock_now_ns() - recv_ns);
+}
\ No newline at end of file
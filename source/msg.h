@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 #include "blive_def.h"
+#include "buffer.h"
 
 
 typedef enum {
@@ -78,14 +79,72 @@ typedef struct {
  * 
  */
 
+/**
+ * @brief 数据包正文中的一条消息，指向原始数据，不持有内存
+ * 
+ */
+typedef struct {
+    const char*         data;           /*消息JSON正文的起始位置*/
+    int                 len;            /*消息JSON正文的长度*/
+    blive_info_type     type;           /*消息类型*/
+    blive_buffer*       buffer;         /*消息所在的解压缓冲区，未压缩的数据包为NULL*/
+    uint64_t            recv_ns;        /*所在数据包的接收时间*/
+    uint64_t            unzip_ns;       /*所在数据包的解压完成时间*/
+    uint64_t            parse_ns;       /*所在数据包的切分完成时间*/
+    uint32_t            keyword_num;    /*命中的关键词数*/
+    uint32_t            keyword_ids[BLIVE_KEYWORD_TAG_MAX];    /*命中的关键词id*/
+} blive_msg_slice;
+
 #define AUTH_SEND_PACKET_JSON_BODY      "{\"uid\":%d,\"roomid\":%d,\"protover\":3,\"platform\":\"web\",\"type\":2,\"key\":\"%s\"}"
 #define HRTBT_SEND_PACKET_JSON_BODY     "{msg: \"zqn blive-c v%d.%d\"}"
 #define POP_VALUE_UPDATE_JSON_BODY      "{\"cmd\":\"%s\",\"pop_value\":%d}"
 
+#define BLIVE_MSG_MAX_SIZE              (16 * 1024 * 1024)  /*数据包与解压后大小的上限，避免异常数据包无限扩大内存申请*/
+
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
 #endif
 
+/**
+ * @brief 按cmd字段的取值查找消息类型
+ * 
+ * @param [in] name cmd字段的取值
+ * @param [in] len 长度
+ * @return int 消息类型，未知类型返回BLIVE_INFO_MAX
+ */
+int blive_info_lookup(const char* name, int len);
+
+/**
+ * @brief 直接在原始JSON中查找cmd字段的值并转换为消息类型
+ * 
+ * @param [in] data 单条消息的JSON正文
+ * @param [in] len 正文长度
+ * @return int 消息类型；未知的cmd返回BLIVE_INFO_MAX；没有cmd字段返回ERROR
+ */
+int blive_msg_type_lookup(const char* data, int len);
+
+/**
+ * @brief 流式解压brotli压缩的正文，解压后大小超过BLIVE_MSG_MAX_SIZE时视为异常数据包
+ * 
+ * @param [out] dst 传出解压缓冲区，末尾以'\0'结尾，使用完后通过blive_buffer_release释放
+ * @param [in] src 压缩的正文
+ * @param [in] src_size 压缩的正文长度
+ * @param [in] size_hint 预计的解压后大小，作为缓冲区的初始大小
+ * @return int 解压后的长度，失败返回ERROR
+ */
+int blive_msg_unzip(blive_buffer** dst, const char* src, size_t src_size, size_t size_hint);
+
+/**
+ * @brief 从解压后的正文中取出一条带头部的消息，检查头部与长度不超出剩余数据
+ * 
+ * @param [in] body 解压后的正文
+ * @param [in] body_size 正文长度
+ * @param [in|out] offset 传入消息的偏移，成功时传出下一条消息的偏移
+ * @param [out] header 传出主机字节序的消息头部
+ * @return const char* 消息正文的起始位置，正文长度为packet_size - header_size；数据不完整或头部不合法时返回NULL
+ */
+const char* blive_msg_inner_next(const char* body, int body_size, int* offset, blive_msg_header* header);
+
 /**
  * @brief 向直播间服务器发送鉴权消息
  * 
@@ -102,6 +161,39 @@ int blive_send_auth_msg(blive* entity);
  */
 int blive_send_heartbeat(blive* entity);
 
+/**
+ * @brief 处理一个完整的下行数据包：心跳回复更新人气值，普通包解压、解析后调起回调。
+ *          由blive_perform或解码线程调用
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] header 数据包头部（主机字节序）
+ * @param [in] body 数据包正文
+ * @param [in] body_size 正文长度
+ * @param [in] recv_ns 数据包的接收时间（blive_clock_now_ns），记录在该数据包产生的所有事件上
+ * @return int 数据包操作码无效时返回ERROR
+ */
+int blive_packet_process(blive* entity, const blive_msg_header* header, char* body, int body_size, uint64_t recv_ns);
+
+/**
+ * @brief 交付一个已完整收取的数据包：计入接收指标与抓取，设置了解码线程池时复制一份交给解码线程，
+ *          否则在调用线程内调用blive_packet_process。blive_perform与抓取回放共用该入口
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] header 数据包头部（主机字节序）
+ * @param [in] body 数据包正文，body[body_size]处需为'\0'
+ * @param [in] body_size 正文长度
+ * @param [in] recv_ns 数据包的接收时间（blive_clock_now_ns）
+ * @return int 
+ */
+int blive_packet_feed(blive* entity, const blive_msg_header* header, char* body, int body_size, uint64_t recv_ns);
+
+/**
+ * @brief 处理与数据包无关的定时任务（分发已到期的合并窗口）。必须与blive_packet_process在同一线程调用
+ * 
+ * @param [in] entity 直播间实体
+ */
+void blive_packet_idle(blive* entity);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
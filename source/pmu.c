@@ -0,0 +1,192 @@
+/**
+ * @file pmu.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 性能剖析模式：通过perf_event_open统计各处理阶段的周期数、指令数、缓存与分支预测未命中次数
+ * @version 0.1
+ * @date 2023-02-21
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "pmu.h"
+#include "metrics.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+typedef enum {
+    PMU_UNOPENED,
+    PMU_OPENED,
+    PMU_FAILED,                 /*本线程无法打开，之后不再尝试*/
+} pmu_state;
+
+int blive_pmu_enabled = 0;
+
+static pthread_once_t   pmu_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    pmu_key;        /*线程退出时关闭计数器*/
+static __thread int     pmu_fds[BLIVE_METRIC_PMU_MAX];
+static __thread int     pmu_thread_state = PMU_UNOPENED;
+
+#ifdef __linux__
+static const uint64_t   pmu_configs[BLIVE_METRIC_PMU_MAX] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+#endif
+
+
+static void pmu_key_create(void);
+static void pmu_close(void* arg);
+static int pmu_open(void);
+
+
+int blive_set_profiling(Bool enable)
+{
+    blive_pmu_sample    sample = {0};
+
+    if (enable && !blive_pmu_read(&sample)) {
+        blive_loge("perf_event_open unavailable, profiling not enabled");
+        return ERROR;
+    }
+    __atomic_store_n(&blive_pmu_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+    return OK;
+}
+
+double blive_metric_pmu_ipc(const blive_metric_pmu* pmu)
+{
+    if (pmu == NULL || !pmu->events[BLIVE_METRIC_PMU_CYCLES]) {
+        return 0;
+    }
+    return (double)pmu->events[BLIVE_METRIC_PMU_INSTRUCTIONS] / pmu->events[BLIVE_METRIC_PMU_CYCLES];
+}
+
+double blive_metric_pmu_per_kb(const blive_metric_pmu* pmu, blive_metric_pmu_event event)
+{
+    if (pmu == NULL || event < 0 || event >= BLIVE_METRIC_PMU_MAX || !pmu->bytes) {
+        return 0;
+    }
+    return pmu->events[event] * 1024.0 / pmu->bytes;
+}
+
+Bool blive_pmu_read(blive_pmu_sample* sample)
+{
+#ifdef __linux__
+    /*PERF_FORMAT_GROUP：一次读取整组，格式为计数器个数加各计数器的值*/
+    uint64_t    buffer[1 + BLIVE_METRIC_PMU_MAX] = {0};
+
+    if (pmu_thread_state == PMU_UNOPENED) {
+        pmu_thread_state = pmu_open() == OK ? PMU_OPENED : PMU_FAILED;
+    }
+    if (pmu_thread_state != PMU_OPENED) {
+        return False;
+    }
+    if (read(pmu_fds[0], buffer, sizeof(buffer)) != sizeof(buffer) || buffer[0] != BLIVE_METRIC_PMU_MAX) {
+        return False;
+    }
+    memcpy(sample->values, buffer + 1, sizeof(sample->values));
+    return True;
+#else
+    return False;
+#endif
+}
+
+void blive_pmu_account(blive_metrics* room, blive_metric_stage stage, const blive_pmu_sample* begin, uint64_t bytes)
+{
+    blive_metrics*      local = blive_metrics_local != NULL ? blive_metrics_local : blive_metrics_attach();
+    blive_metric_pmu*   pmu = NULL;
+    blive_pmu_sample    end = {0};
+    uint64_t            delta = 0;
+
+    if (!blive_pmu_read(&end)) {
+        return;
+    }
+
+    __atomic_fetch_add(&room->pmu[stage].samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&room->pmu[stage].bytes, bytes, __ATOMIC_RELAXED);
+    if (local != NULL) {
+        pmu = &local->pmu[stage];
+        __atomic_store_n(&pmu->samples, pmu->samples + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&pmu->bytes, pmu->bytes + bytes, __ATOMIC_RELAXED);
+    }
+    for (int event = 0; event < BLIVE_METRIC_PMU_MAX; event++) {
+        delta = end.values[event] - begin->values[event];
+        __atomic_fetch_add(&room->pmu[stage].events[event], delta, __ATOMIC_RELAXED);
+        if (local != NULL) {
+            __atomic_store_n(&pmu->events[event], pmu->events[event] + delta, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+
+static void pmu_key_create(void)
+{
+    pthread_key_create(&pmu_key, pmu_close);
+}
+
+static void pmu_close(void* arg)
+{
+    int*    fds = (int*)arg;
+
+    for (int event = BLIVE_METRIC_PMU_MAX - 1; event >= 0; event--) {
+        close(fds[event]);
+    }
+    pmu_thread_state = PMU_UNOPENED;
+}
+
+/**
+ * @brief 为调用线程打开一组硬件计数器，以周期数为组长同时启停，只计用户态，可以在perf_event_paranoid为2时使用
+ * 
+ * @return int 任一计数器打开失败返回ERROR
+ */
+static int pmu_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr  attr;
+    int                     opened = 0;
+
+    for (opened = 0; opened < BLIVE_METRIC_PMU_MAX; opened++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = pmu_configs[opened];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = opened == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        pmu_fds[opened] = syscall(SYS_perf_event_open, &attr, 0, -1, opened == 0 ? -1 : pmu_fds[0], 0);
+        if (pmu_fds[opened] == -1) {
+            blive_loge("perf_event_open %d failed: %s", opened, strerror(errno));
+            goto fail;
+        }
+    }
+    if (ioctl(pmu_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1) {
+        goto fail;
+    }
+
+    pthread_once(&pmu_key_once, pmu_key_create);
+    pthread_setspecific(pmu_key, pmu_fds);
+    return OK;
+
+fail:
+    while (opened--) {
+        close(pmu_fds[opened]);
+    }
+    return ERROR;
+#else
+    return ERROR;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+/**
+ * @file pmu.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 性能剖析模式的内部头文件：每个线程一组perf_event硬件计数器，在处理阶段前后读取
+ * @version 0.1
+ * @date 2023-02-21
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_PMU_H__
+#define __BLIVE_PMU_H__
+
+#include "blive_def.h"
+
+
+/**
+ * @brief 一次读取的各硬件计数器的值
+ * 
+ */
+typedef struct {
+    uint64_t    values[BLIVE_METRIC_PMU_MAX];
+} blive_pmu_sample;
+
+extern int  blive_pmu_enabled;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 读取调用线程的硬件计数器，第一次调用时打开
+ * 
+ * @param [out] sample 传出计数
+ * @return Bool 计数器不可用时返回False
+ */
+Bool blive_pmu_read(blive_pmu_sample* sample);
+
+/**
+ * @brief 再次读取硬件计数器，与begin的差值计入直播间与全局指标
+ * 
+ * @param [in] room 直播间的指标
+ * @param [in] stage 处理阶段
+ * @param [in] begin 阶段开始时的计数
+ * @param [in] bytes 本阶段处理的字节数
+ */
+void blive_pmu_account(blive_metrics* room, blive_metric_stage stage, const blive_pmu_sample* begin, uint64_t bytes);
+
+/**
+ * @brief 在处理阶段开始时调用，未开启性能剖析时只有一次读取
+ * 
+ * @param [out] sample 传出计数
+ * @return Bool 返回True时需要在阶段结束时调用blive_pmu_account
+ */
+static inline Bool blive_pmu_begin(blive_pmu_sample* sample)
+{
+    if (!__atomic_load_n(&blive_pmu_enabled, __ATOMIC_RELAXED)) {
+        return False;
+    }
+    return blive_pmu_read(sample);
+}
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+/**
+ * @file probe.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief USDT静态探针。开启BLIVE_API_USDT编译时每个探针只是一条nop指令，挂载bpftrace、perf等工具后才会触发；
+ *          未开启或平台没有sys/sdt.h时不产生任何代码
+ * @version 0.1
+ * @date 2023-02-21
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_PROBE_H__
+#define __BLIVE_PROBE_H__
+
+/**
+ * 探针均属于blive提供者，第一个参数都是直播间id：
+ *  frame_recv(room_id, packet_size, msg_proto, msg_operate)            收到数据包头部
+ *  unzip_begin(room_id, in_size)                                       开始解压
+ *  unzip_end(room_id, in_size, out_size)                               解压结束，失败时out_size为-1
+ *  cmd_dispatch(room_id, cmd, raw_len, recv_ns)                        开始调用消息回调，recv_ns为CLOCK_MONOTONIC
+ *  cmd_done(room_id, cmd, handler_ns)                                  消息回调结束
+ *  batch_dispatch(room_id, event_num)                                  开始调用批量回调
+ *  batch_done(room_id, event_num, handler_ns)                          批量回调结束
+ *  heartbeat(room_id, sent_size)                                       发送心跳包，失败时sent_size为-1
+ *  heartbeat_reply(room_id, pop_val)                                   收到心跳包响应
+ *  reconnect(room_id, remain)                                          开始一次重连，remain为剩余次数
+ *  reconnect_done(room_id, retval)                                     重连结束
+ */
+
+#if defined(BLIVE_API_USDT)
+#include <sys/sdt.h>
+
+#define BLIVE_PROBE2(name, a1, a2)              DTRACE_PROBE2(blive, name, a1, a2)
+#define BLIVE_PROBE3(name, a1, a2, a3)          DTRACE_PROBE3(blive, name, a1, a2, a3)
+#define BLIVE_PROBE4(name, a1, a2, a3, a4)      DTRACE_PROBE4(blive, name, a1, a2, a3, a4)
+#else
+#define BLIVE_PROBE2(name, a1, a2)              do {} while (0)
+#define BLIVE_PROBE3(name, a1, a2, a3)          do {} while (0)
+#define BLIVE_PROBE4(name, a1, a2, a3, a4)      do {} while (0)
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,628 @@
+/**
+ * @file replay.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 抓取回放：只读映射抓取的分段文件，读取各分段的索引得到每个直播间在每个时间段内的记录范围，
+ *          再由blive_replay_perform代替socket接收，把范围内的数据包逐个交给blive_packet_feed，
+ *          之后的解码线程池、解压、切分、过滤与分发与在线时完全相同。有索引的分段打开时不读取记录，
+ *          回放时只访问与时间范围重叠的记录所在的页；没有有效索引的分段在打开时扫描一遍。
+ *          每个数据包先复制到回放线程自己的缓冲区，与blive_perform把数据包收取到接收缓冲区相对应
+ * @version 0.1
+ * @date 2023-02-25
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "blive_def.h"
+#include "blive_internal.h"
+#include "msg.h"
+
+
+#define REPLAY_POLL_FRAMES      256             /*尽快回放时每交付该数量的数据包检查一次终止请求与合并窗口*/
+#define REPLAY_BUFFER_INIT      (64 * 1024)
+
+/**
+ * @brief 一个直播间在一个分段的一个时间段内的记录范围，来自索引文件或打开时扫描分段建立的索引
+ * 
+ */
+typedef struct {
+    blive_capture_index_entry   entry;
+    uint64_t                    bucket_ns;      /*所属索引的时间段长度*/
+    const char*                 base;           /*分段的映射地址*/
+} replay_span;
+
+typedef struct {
+    uint64_t        room_id;
+    replay_span*    spans;                      /*打开后按first_recv_ns排序*/
+    size_t          span_num;
+    size_t          capacity;
+} replay_room;
+
+typedef struct {
+    char*           base;
+    size_t          size;
+} replay_map;
+
+struct blive_replay {
+    replay_map*         maps;
+    uint32_t            map_num;
+    replay_room*        rooms;                  /*按room_id排序*/
+    uint32_t            room_num;
+    uint32_t            room_capacity;
+    size_t              page_size;
+    uint64_t            from_ns;                /*回放的系统时间范围[from_ns, to_ns)*/
+    uint64_t            to_ns;
+    blive_replay_stats  stats;
+};
+
+/**
+ * @brief 对范围内每条记录调用的函数
+ * 
+ * @return int 返回ERROR时停止
+ */
+typedef int (*replay_visit)(blive_replay* replay, const blive_capture_record* record, void* ctx);
+
+/**
+ * @brief blive_replay_perform交付数据包的状态
+ * 
+ */
+typedef struct {
+    blive*      entity;
+    double      speed;
+    uint64_t    start_ns;                       /*交付第一个数据包的时间*/
+    uint64_t    first_recv_ns;                  /*第一个数据包抓取时的recv_ns*/
+    uint64_t    count;
+    char*       body;                           /*回放缓冲区*/
+    int         capacity;
+    int         retval;
+    Bool        stopped;
+} replay_feed;
+
+typedef struct {
+    blive_replay_handler    handler;
+    void*                   usr_data;
+    int                     count;
+} replay_scan_ctx;
+
+
+static int replay_filter(const struct dirent* entry);
+static int replay_load(blive_replay* replay, const char* path);
+static int replay_span_add(blive_replay* replay, const blive_capture_index_entry* entry, uint64_t bucket_ns, const char* base);
+static replay_room* replay_room_get(blive_replay* replay, uint64_t room_id, Bool create);
+static int replay_span_cmp(const void* a, const void* b);
+static int replay_walk(blive_replay* replay, replay_room* room, replay_visit visit, void* ctx);
+static int replay_feed_visit(blive_replay* replay, const blive_capture_record* record, void* ctx);
+static int replay_scan_visit(blive_replay* replay, const blive_capture_record* record, void* ctx);
+static Bool replay_wait(blive* entity, uint64_t due_ns);
+
+
+int blive_replay_open(blive_replay** replay, const char* dir)
+{
+    struct dirent**     entries = NULL;
+    char                path[1024] = {0};
+    int                 num = 0;
+    uint64_t            first_ns = UINT64_MAX;
+    uint64_t            last_ns = 0;
+    replay_room*        room = NULL;
+
+    if (replay == NULL || dir == NULL) {
+        return ERROR;
+    }
+
+    *replay = malloc(sizeof(blive_replay));
+    if (*replay == NULL) {
+        return ERROR;
+    }
+    memset(*replay, 0, sizeof(blive_replay));
+    (*replay)->page_size = sysconf(_SC_PAGESIZE);
+    (*replay)->to_ns = UINT64_MAX;
+
+    /*按文件名排序，同一写入线程的分段按编号先后读取*/
+    if ((num = scandir(dir, &entries, replay_filter, alphasort)) < 0) {
+        blive_loge("scan capture dir %s failed: %s", dir, strerror(errno));
+        free(*replay);
+        *replay = NULL;
+        return ERROR;
+    }
+    for (int i = 0; i < num; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+        replay_load(*replay, path);
+        free(entries[i]);
+    }
+    free(entries);
+    if ((*replay)->map_num == 0) {
+        blive_loge("no capture segment in %s", dir);
+        blive_replay_close(*replay);
+        *replay = NULL;
+        return ERROR;
+    }
+
+    /*同一写入线程内的范围已按接收时间排列，只有跨写入线程的直播间需要排序*/
+    for (uint32_t i = 0; i < (*replay)->room_num; i++) {
+        room = &(*replay)->rooms[i];
+        for (size_t j = 1; j < room->span_num; j++) {
+            if (replay_span_cmp(&room->spans[j - 1], &room->spans[j]) > 0) {
+                qsort(room->spans, room->span_num, sizeof(replay_span), replay_span_cmp);
+                break;
+            }
+        }
+        for (size_t j = 0; j < room->span_num; j++) {
+            if (room->spans[j].entry.first_recv_ns < first_ns) {
+                first_ns = room->spans[j].entry.first_recv_ns;
+            }
+            if (room->spans[j].entry.last_recv_ns > last_ns) {
+                last_ns = room->spans[j].entry.last_recv_ns;
+            }
+        }
+    }
+    (*replay)->stats.segments = (*replay)->map_num;
+    (*replay)->stats.rooms = (*replay)->room_num;
+    (*replay)->stats.span_ns = last_ns > first_ns ? last_ns - first_ns : 0;
+
+    return OK;
+}
+
+int blive_replay_close(blive_replay* replay)
+{
+    if (replay == NULL) {
+        return ERROR;
+    }
+
+    for (uint32_t i = 0; i < replay->room_num; i++) {
+        free(replay->rooms[i].spans);
+    }
+    free(replay->rooms);
+    for (uint32_t i = 0; i < replay->map_num; i++) {
+        munmap(replay->maps[i].base, replay->maps[i].size);
+    }
+    free(replay->maps);
+    free(replay);
+    return OK;
+}
+
+int blive_replay_rooms(blive_replay* replay, uint64_t* rooms, int max)
+{
+    int     num = 0;
+
+    if (replay == NULL || rooms == NULL) {
+        return 0;
+    }
+
+    for (num = 0; num < max && num < (int)replay->room_num; num++) {
+        rooms[num] = replay->rooms[num].room_id;
+    }
+    return num;
+}
+
+int blive_get_replay_stats(blive_replay* replay, blive_replay_stats* stats)
+{
+    if (replay == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    *stats = replay->stats;
+    return OK;
+}
+
+int blive_replay_set_range(blive_replay* replay, uint64_t from_ms, uint64_t to_ms)
+{
+    if (replay == NULL || (to_ms && to_ms <= from_ms)) {
+        return ERROR;
+    }
+
+    replay->from_ns = from_ms * 1000000;
+    replay->to_ns = to_ms ? to_ms * 1000000 : UINT64_MAX;
+    return OK;
+}
+
+int blive_replay_scan(blive_replay* replay, uint64_t room_id, blive_replay_handler handler, void* usr_data)
+{
+    replay_room*        room = NULL;
+    replay_scan_ctx     ctx = {handler, usr_data, 0};
+
+    if (replay == NULL || handler == NULL || (room = replay_room_get(replay, room_id, False)) == NULL) {
+        return ERROR;
+    }
+
+    replay_walk(replay, room, replay_scan_visit, &ctx);
+    return ctx.count;
+}
+
+int blive_replay_perform(blive* entity, blive_replay* replay, double speed)
+{
+    replay_room*    room = NULL;
+    replay_feed     feed = {0};
+
+    if (entity == NULL || replay == NULL || speed < 0) {
+        return ERROR;
+    }
+    if ((room = replay_room_get(replay, entity->room_id, False)) == NULL) {
+        blive_loge("room %u not in replay", entity->room_id);
+        return ERROR;
+    }
+    feed.entity = entity;
+    feed.speed = speed;
+    feed.capacity = REPLAY_BUFFER_INIT;
+    if ((feed.body = malloc(feed.capacity + 1)) == NULL) {
+        return ERROR;
+    }
+
+    replay_walk(replay, room, replay_feed_visit, &feed);
+
+    /*最后一个合并窗口到期后再结束，避免丢失回放末尾的合并结果*/
+    while (feed.retval == OK && !feed.stopped && entity->decode_ring == NULL && blive_coalesce_timeout(entity) >= 0) {
+        if (replay_wait(entity, UINT64_MAX)) {
+            break;
+        }
+    }
+
+    free(feed.body);
+    return feed.retval;
+}
+
+/**
+ * @brief 只读取抓取分段文件
+ * 
+ * @param [in] entry 目录项
+ * @return int 非0为需要读取
+ */
+static int replay_filter(const struct dirent* entry)
+{
+    size_t  len = strlen(entry->d_name);
+    size_t  suffix_len = strlen(BLIVE_CAPTURE_SUFFIX);
+
+    return len > suffix_len && strcmp(entry->d_name + len - suffix_len, BLIVE_CAPTURE_SUFFIX) == 0;
+}
+
+/**
+ * @brief 映射一个分段文件，读取其索引文件；没有有效索引时扫描记录建立索引
+ * 
+ * @param [in] replay 回放数据
+ * @param [in] path 分段文件路径
+ * @return int
+ */
+static int replay_load(blive_replay* replay, const char* path)
+{
+    int                             fd = -1;
+    struct stat                     st = {0};
+    char*                           base = NULL;
+    const blive_capture_segment*    segment = NULL;
+    replay_map*                     maps = NULL;
+    blive_capture_indexer           indexer = {0};
+    uint64_t                        covered = 0;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        blive_loge("open capture segment %s failed: %s", path, strerror(errno));
+        return ERROR;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(blive_capture_segment)) {
+        blive_loge("invalid capture segment %s", path);
+        close(fd);
+        return ERROR;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        blive_loge("map capture segment %s failed: %s", path, strerror(errno));
+        return ERROR;
+    }
+    /*读取头部之前关闭预读，按索引读取时只访问命中的范围，由replay_walk对每个范围单独预取*/
+    madvise(base, st.st_size, MADV_RANDOM);
+
+    segment = (const blive_capture_segment*)base;
+    if (segment->magic != BLIVE_CAPTURE_MAGIC || segment->version != BLIVE_CAPTURE_VERSION
+        || segment->header_size < sizeof(blive_capture_segment)) {
+        blive_loge("invalid capture segment %s", path);
+        munmap(base, st.st_size);
+        return ERROR;
+    }
+    if ((maps = realloc(replay->maps, sizeof(replay_map) * (replay->map_num + 1))) == NULL) {
+        munmap(base, st.st_size);
+        return ERROR;
+    }
+    replay->maps = maps;
+    replay->maps[replay->map_num].base = base;
+    replay->maps[replay->map_num].size = st.st_size;
+    replay->map_num++;
+
+    /*没有有效索引时顺序扫描整个分段，扫描期间恢复预读*/
+    if (blive_capture_index_load(&indexer, path, segment) == OK) {
+        replay->stats.indexed++;
+    } else {
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+        if (blive_capture_index_scan(&indexer, base, st.st_size, &covered) != OK) {
+            blive_loge("capture segment %s is corrupt, replay the readable part", path);
+            replay->stats.corrupt++;
+        }
+        madvise(base, st.st_size, MADV_RANDOM);
+    }
+    for (uint32_t i = 0; i < indexer.entry_num; i++) {
+        if (replay_span_add(replay, &indexer.entries[i], BLIVE_CAPTURE_INDEX_BUCKET, base) != OK) {
+            break;
+        }
+    }
+    blive_capture_index_free(&indexer);
+    return OK;
+}
+
+/**
+ * @brief 把一个索引条目加入所属直播间的范围列表
+ * 
+ * @return int 
+ */
+static int replay_span_add(blive_replay* replay, const blive_capture_index_entry* entry, uint64_t bucket_ns, const char* base)
+{
+    replay_room*    room = NULL;
+    replay_span*    bigger = NULL;
+    size_t          capacity = 0;
+
+    if ((room = replay_room_get(replay, entry->room_id, True)) == NULL) {
+        return ERROR;
+    }
+    if (room->span_num == room->capacity) {
+        capacity = room->capacity ? room->capacity * 2 : 16;
+        if ((bigger = realloc(room->spans, sizeof(replay_span) * capacity)) == NULL) {
+            return ERROR;
+        }
+        room->spans = bigger;
+        room->capacity = capacity;
+    }
+    room->spans[room->span_num].entry = *entry;
+    room->spans[room->span_num].bucket_ns = bucket_ns;
+    room->spans[room->span_num].base = base;
+    room->span_num++;
+    replay->stats.frames += entry->frames;
+    replay->stats.bytes += entry->bytes;
+    if (replay->stats.first_ms == 0 || entry->bucket * bucket_ns / 1000000 < replay->stats.first_ms) {
+        replay->stats.first_ms = entry->bucket * bucket_ns / 1000000;
+    }
+    if ((entry->bucket + 1) * bucket_ns / 1000000 > replay->stats.last_ms) {
+        replay->stats.last_ms = (entry->bucket + 1) * bucket_ns / 1000000;
+    }
+    return OK;
+}
+
+/**
+ * @brief 二分查找直播间，create为True时不存在则按顺序插入
+ * 
+ * @param [in] replay 回放数据
+ * @param [in] room_id 直播间id
+ * @param [in] create 不存在时是否创建
+ * @return replay_room* 不存在且未创建时返回NULL
+ */
+static replay_room* replay_room_get(blive_replay* replay, uint64_t room_id, Bool create)
+{
+    uint32_t        low = 0;
+    uint32_t        high = replay->room_num;
+    uint32_t        mid = 0;
+    replay_room*    bigger = NULL;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (replay->rooms[mid].room_id == room_id) {
+            return &replay->rooms[mid];
+        }
+        if (replay->rooms[mid].room_id < room_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    if (replay->room_num == replay->room_capacity) {
+        bigger = realloc(replay->rooms, sizeof(replay_room) * (replay->room_capacity ? replay->room_capacity * 2 : 16));
+        if (bigger == NULL) {
+            return NULL;
+        }
+        replay->rooms = bigger;
+        replay->room_capacity = replay->room_capacity ? replay->room_capacity * 2 : 16;
+    }
+    memmove(&replay->rooms[low + 1], &replay->rooms[low], sizeof(replay_room) * (replay->room_num - low));
+    memset(&replay->rooms[low], 0, sizeof(replay_room));
+    replay->rooms[low].room_id = room_id;
+    replay->room_num++;
+    return &replay->rooms[low];
+}
+
+/**
+ * @brief 按第一条记录的接收时间排序，时间相同时保持在映射中的先后
+ * 
+ * @param [in] a 范围
+ * @param [in] b 范围
+ * @return int
+ */
+static int replay_span_cmp(const void* a, const void* b)
+{
+    const replay_span*  sa = (const replay_span*)a;
+    const replay_span*  sb = (const replay_span*)b;
+
+    if (sa->entry.first_recv_ns != sb->entry.first_recv_ns) {
+        return sa->entry.first_recv_ns < sb->entry.first_recv_ns ? -1 : 1;
+    }
+    if (sa->base + sa->entry.begin != sb->base + sb->entry.begin) {
+        return sa->base + sa->entry.begin < sb->base + sb->entry.begin ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 按接收时间顺序访问直播间在时间范围内的记录。跳过与范围不重叠的时间段，
+ *          命中的范围先预取再逐条读取，其间其他直播间的记录只读取头部
+ * 
+ * @param [in] replay 回放数据
+ * @param [in] room 直播间
+ * @param [in] visit 对每条记录调用的函数
+ * @param [in] ctx 传递给visit的状态
+ * @return int visit返回ERROR时返回ERROR
+ */
+static int replay_walk(blive_replay* replay, replay_room* room, replay_visit visit, void* ctx)
+{
+    const replay_span*              span = NULL;
+    const blive_capture_record*     record = NULL;
+    uint64_t                        offset = 0;
+    uint64_t                        aligned = 0;
+    uint32_t                        record_size = 0;
+
+    for (size_t i = 0; i < room->span_num; i++) {
+        span = &room->spans[i];
+        if ((span->entry.bucket + 1) * span->bucket_ns <= replay->from_ns || span->entry.bucket * span->bucket_ns >= replay->to_ns) {
+            continue;
+        }
+        aligned = span->entry.begin & ~(uint64_t)(replay->page_size - 1);
+        madvise((char*)span->base + aligned, span->entry.end - aligned, MADV_WILLNEED);
+
+        for (offset = span->entry.begin; offset + sizeof(blive_capture_record) <= span->entry.end; offset += record_size) {
+            record = (const blive_capture_record*)(span->base + offset);
+            if ((record_size = record->record_size) == 0) {
+                break;
+            }
+            /*索引只检查了各条目的范围，记录本身逐条检查，长度不一致时本范围内之后的记录无法定位*/
+            if (!blive_capture_record_valid(record, record_size, span->entry.end - offset)) {
+                blive_loge("corrupt capture record at offset %lu", (unsigned long)offset);
+                break;
+            }
+            if (record->room_id != room->room_id || record->wall_ns < replay->from_ns || record->wall_ns >= replay->to_ns) {
+                continue;
+            }
+            if (visit(replay, record, ctx) != OK) {
+                return ERROR;
+            }
+        }
+    }
+    return OK;
+}
+
+/**
+ * @brief 按回放速度等待后把一条记录交给处理流程
+ * 
+ * @return int 处理失败或收到终止请求时返回ERROR
+ */
+static int replay_feed_visit(blive_replay* replay, const blive_capture_record* record, void* ctx)
+{
+    replay_feed*                feed = (replay_feed*)ctx;
+    blive*                      entity = feed->entity;
+    const blive_msg_header*     wire = (const blive_msg_header*)record->frame;
+    blive_msg_header            header = {0};
+    char*                       bigger = NULL;
+    int                         body_size = record->frame_size - sizeof(blive_msg_header);
+    uint64_t                    recv_ns = 0;
+
+    /*按抓取时的间隔等待，等待期间照常分发到期的合并窗口并响应终止请求*/
+    if (feed->count == 0) {
+        feed->start_ns = blive_clock_now_ns();
+        feed->first_recv_ns = record->recv_ns;
+    }
+    if (feed->speed > 0) {
+        if (record->recv_ns > feed->first_recv_ns
+            && replay_wait(entity, feed->start_ns + (uint64_t)((record->recv_ns - feed->first_recv_ns) / feed->speed))) {
+            feed->stopped = True;
+            return ERROR;
+        }
+    } else if (feed->count % REPLAY_POLL_FRAMES == 0 && replay_wait(entity, 0)) {
+        feed->stopped = True;
+        return ERROR;
+    }
+    feed->count++;
+
+    /*与header_recv相同的头部转换，正文复制到回放缓冲区并以'\0'结尾*/
+    header.packet_size = ntohl(wire->packet_size);
+    header.header_size = ntohs(wire->header_size);
+    header.msg_proto = ntohs(wire->msg_proto);
+    header.msg_operate = ntohl(wire->msg_operate);
+    header.msg_seq = ntohl(wire->msg_seq);
+    if (body_size > feed->capacity) {
+        if ((bigger = realloc(feed->body, body_size + 1)) == NULL) {
+            feed->retval = ERROR;
+            return ERROR;
+        }
+        feed->body = bigger;
+        feed->capacity = body_size;
+    }
+    memcpy(feed->body, record->frame + sizeof(blive_msg_header), body_size);
+    feed->body[body_size] = '\0';
+
+    blive_clock_tick();
+    recv_ns = blive_clock_now_ns();
+    BLIVE_PROBE4(frame_recv, entity->room_id, header.packet_size, header.msg_proto, header.msg_operate);
+    if (blive_packet_feed(entity, &header, feed->body, body_size, recv_ns) == ERROR) {
+        feed->retval = ERROR;
+        return ERROR;
+    }
+    return OK;
+}
+
+/**
+ * @brief 把一条记录的原始数据包交给调用者
+ * 
+ * @return int 调用者要求停止时返回ERROR
+ */
+static int replay_scan_visit(blive_replay* replay, const blive_capture_record* record, void* ctx)
+{
+    replay_scan_ctx*    scan = (replay_scan_ctx*)ctx;
+
+    scan->count++;
+    return scan->handler(record->room_id, record->wall_ns, record->frame, record->frame_size, scan->usr_data);
+}
+
+/**
+ * @brief 等待到due_ns，期间分发到期的合并窗口；due_ns为0时只检查一次不等待，
+ *          为UINT64_MAX时等待到下一个合并窗口到期为止
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] due_ns 等待到的单调时间
+ * @return Bool 收到blive_force_stop的终止请求时返回True
+ */
+static Bool replay_wait(blive* entity, uint64_t due_ns)
+{
+    int             ret = 0;
+    int             timeout_ms = -1;
+    uint64_t        now_ns = 0;
+    uint64_t        wait_ns = 0;
+    struct timeval  timeout = {0};
+    fd_set          fds = {0};
+
+    do {
+        now_ns = blive_clock_now_ns();
+        wait_ns = due_ns > now_ns ? due_ns - now_ns : 0;
+        timeout_ms = entity->decode_ring == NULL ? blive_coalesce_timeout(entity) : -1;
+        if (due_ns == UINT64_MAX && timeout_ms < 0) {
+            return False;
+        }
+        if (timeout_ms >= 0 && (uint64_t)timeout_ms * 1000000 < wait_ns) {
+            wait_ns = (uint64_t)timeout_ms * 1000000;
+        }
+        timeout.tv_sec = wait_ns / 1000000000;
+        timeout.tv_usec = (wait_ns % 1000000000) / 1000;
+
+        FD_ZERO(&fds);
+        FD_SET(entity->pair_fd[0], &fds);
+        ret = select(entity->pair_fd[0] + 1, &fds, NULL, NULL, &timeout);
+        blive_clock_tick();
+        if (ret > 0 && FD_ISSET(entity->pair_fd[0], &fds)) {
+            shutdown(entity->pair_fd[0], SHUT_RDWR);
+            entity->pair_fd[0] = 0;
+            blive_loge("external call force stop");
+            return True;
+        }
+        if (ret == 0 && timeout_ms >= 0) {
+            blive_packet_idle(entity);
+        }
+    } while (due_ns != 0 && blive_clock_now_ns() < due_ns);
+
+    return False;
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+/**
+ * @file trace.c
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 链路追踪：按直播间汇总各区间、按消息类型汇总总耗时，慢事件采样写入环形缓冲区
+ * @version 0.1
+ * @date 2023-02-20
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+#include "field.h"
+#include "blive_def.h"
+#include "blive_internal.h"
+
+
+#define TRACE_SECONDS_MAX   100000000000.0  /*小于该值的服务端时间以秒为单位，否则为毫秒*/
+
+struct blive_tracer {
+    blive_trace_config  config;
+    blive_trace_stats   stats;      /*回调可能在多个线程中执行，原子累加*/
+    pthread_mutex_t     lock;       /*保护慢事件记录*/
+    blive_trace*        ring;       /*慢事件记录，不采样时为NULL*/
+    uint32_t            ring_head;  /*最早一条记录的位置*/
+    uint32_t            ring_num;   /*记录数*/
+};
+
+
+static void trace_free(blive_tracer* tracer);
+static uint64_t trace_server_ns(const blive_event* event, uint64_t* server_ms);
+static void trace_span(blive_tracer* tracer, blive_trace_span span, uint64_t begin, uint64_t end);
+static void trace_sample(blive* entity, const blive_event* event, uint64_t server_ms, uint64_t server_ns,
+                         uint64_t start_ns, uint64_t end_ns);
+
+
+int blive_set_trace(blive* entity, const blive_trace_config* config)
+{
+    blive_tracer*   tracer = NULL;
+    blive_tracer*   old = NULL;
+
+    if (entity == NULL) {
+        return ERROR;
+    }
+
+    if (config != NULL) {
+        tracer = malloc(sizeof(blive_tracer));
+        if (tracer == NULL) {
+            return ERROR;
+        }
+        memset(tracer, 0, sizeof(blive_tracer));
+        tracer->config = *config;
+        if (config->sample_every && config->ring_size
+            && (tracer->ring = malloc(sizeof(blive_trace) * config->ring_size)) == NULL) {
+            free(tracer);
+            return ERROR;
+        }
+        pthread_mutex_init(&tracer->lock, NULL);
+    }
+
+    /*执行器内已投递的回调可能仍在使用原有的追踪状态，等待执行完毕后再释放*/
+    old = entity->tracer;
+    entity->tracer = tracer;
+    if (old != NULL && entity->strand != NULL) {
+        blive_strand_drain(entity->strand);
+    }
+    trace_free(old);
+
+    return OK;
+}
+
+int blive_get_trace_stats(blive* entity, blive_trace_stats* stats)
+{
+    blive_tracer*   tracer = NULL;
+
+    if (entity == NULL || stats == NULL) {
+        return ERROR;
+    }
+
+    memset(stats, 0, sizeof(blive_trace_stats));
+    if ((tracer = entity->tracer) == NULL) {
+        return OK;
+    }
+
+    stats->traced = __atomic_load_n(&tracer->stats.traced, __ATOMIC_RELAXED);
+    stats->slow = __atomic_load_n(&tracer->stats.slow, __ATOMIC_RELAXED);
+    stats->sampled = __atomic_load_n(&tracer->stats.sampled, __ATOMIC_RELAXED);
+    for (int span = 0; span < BLIVE_TRACE_SPAN_MAX; span++) {
+        blive_metrics_hist_load(&stats->spans[span], &tracer->stats.spans[span]);
+    }
+    for (int type = BLIVE_INFO_MIN; type < BLIVE_INFO_MAX; type++) {
+        blive_metrics_hist_load(&stats->cmds[type], &tracer->stats.cmds[type]);
+    }
+
+    return OK;
+}
+
+int blive_trace_fetch(blive* entity, blive_trace* traces, int max)
+{
+    blive_tracer*   tracer = NULL;
+    int             num = 0;
+
+    if (entity == NULL || (traces == NULL && max > 0)) {
+        return ERROR;
+    }
+    if ((tracer = entity->tracer) == NULL || tracer->ring == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&tracer->lock);
+    while (num < max && tracer->ring_num) {
+        traces[num++] = tracer->ring[tracer->ring_head];
+        tracer->ring_head = (tracer->ring_head + 1) % tracer->config.ring_size;
+        tracer->ring_num--;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+
+    return num;
+}
+
+void blive_trace_record(blive* entity, const blive_event* event, uint64_t start_ns, uint64_t end_ns)
+{
+    blive_tracer*   tracer = entity->tracer;
+    uint64_t        server_ms = 0;
+    uint64_t        server_ns = trace_server_ns(event, &server_ms);
+    uint64_t        begin = server_ns ? server_ns : event->recv_ns;
+    uint64_t        total = 0;
+    uint64_t        slow_seq = 0;
+
+    trace_span(tracer, BLIVE_TRACE_SPAN_SERVER, server_ns, event->recv_ns);
+    trace_span(tracer, BLIVE_TRACE_SPAN_UNZIP, event->recv_ns, event->unzip_ns);
+    trace_span(tracer, BLIVE_TRACE_SPAN_PARSE, event->unzip_ns, event->parse_ns);
+    trace_span(tracer, BLIVE_TRACE_SPAN_QUEUE, event->parse_ns, start_ns);
+    trace_span(tracer, BLIVE_TRACE_SPAN_HANDLER, start_ns, end_ns);
+    __atomic_fetch_add(&tracer->stats.traced, 1, __ATOMIC_RELAXED);
+    if (!begin) {
+        return;     /*既没有服务端时间也没有接收时间，如调用者直接构造的事件*/
+    }
+
+    total = end_ns > begin ? end_ns - begin : 0;
+    blive_metrics_hist_add(&tracer->stats.spans[BLIVE_TRACE_SPAN_TOTAL], total);
+    blive_metrics_hist_add(&tracer->stats.cmds[event->type], total);
+    if (total < tracer->config.slow_ns) {
+        return;
+    }
+
+    slow_seq = __atomic_fetch_add(&tracer->stats.slow, 1, __ATOMIC_RELAXED);
+    if (tracer->ring != NULL && slow_seq % tracer->config.sample_every == 0) {
+        trace_sample(entity, event, server_ms, server_ns, start_ns, end_ns);
+    }
+}
+
+
+static void trace_free(blive_tracer* tracer)
+{
+    if (tracer == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&tracer->lock);
+    free(tracer->ring);
+    free(tracer);
+}
+
+/**
+ * @brief 从消息原文中读取服务端时间，并换算到blive_clock_now_ns的时间基准
+ * 
+ * @param [in] event 事件
+ * @param [out] server_ms 传出服务端时间（毫秒），没有时为0
+ * @return uint64_t 换算后的单调时间，没有服务端时间时返回0
+ */
+static uint64_t trace_server_ns(const blive_event* event, uint64_t* server_ms)
+{
+    blive_field_value   value = {0};
+    struct timespec     wall = {0};
+    uint64_t            mono_ns = 0;
+    uint64_t            wall_ns = 0;
+    uint64_t            server_wall_ns = 0;
+
+    *server_ms = 0;
+    if (event->raw == NULL
+        || blive_field_extract(event->type, event->raw, event->raw_len, BLIVE_FIELD_TIMESTAMP, &value) != OK
+        || value.kind != BLIVE_FIELD_NUMBER || value.number <= 0) {
+        return 0;
+    }
+    *server_ms = value.number < TRACE_SECONDS_MAX ? (uint64_t)value.number * 1000 : (uint64_t)value.number;
+
+    /*缓存的系统时间误差可达10毫秒，这里读取实际时间计算两个时钟之间的差值*/
+    mono_ns = blive_clock_now_ns();
+    clock_gettime(CLOCK_REALTIME, &wall);
+    wall_ns = (uint64_t)wall.tv_sec * 1000000000 + wall.tv_nsec;
+    server_wall_ns = *server_ms * 1000000;
+    if (server_wall_ns + mono_ns <= wall_ns) {
+        return 0;   /*早于单调时钟的起点，数值不可信*/
+    }
+    return server_wall_ns + mono_ns - wall_ns;
+}
+
+/**
+ * @brief 记录一个区间的耗时，任一端的时间点不存在时不记录；时钟偏差导致结束早于开始时记为0
+ * 
+ */
+static inline void trace_span(blive_tracer* tracer, blive_trace_span span, uint64_t begin, uint64_t end)
+{
+    if (begin && end) {
+        blive_metrics_hist_add(&tracer->stats.spans[span], end > begin ? end - begin : 0);
+    }
+}
+
+/**
+ * @brief 将慢事件写入环形缓冲区，写满时覆盖最早的一条
+ * 
+ */
+static void trace_sample(blive* entity, const blive_event* event, uint64_t server_ms, uint64_t server_ns,
+                         uint64_t start_ns, uint64_t end_ns)
+{
+    blive_tracer*   tracer = entity->tracer;
+    blive_trace*    trace = NULL;
+    size_t          raw_len = event->raw != NULL ? event->raw_len : 0;
+
+    if (raw_len > BLIVE_TRACE_RAW_MAX - 1) {
+        raw_len = BLIVE_TRACE_RAW_MAX - 1;
+    }
+
+    pthread_mutex_lock(&tracer->lock);
+    trace = &tracer->ring[(tracer->ring_head + tracer->ring_num) % tracer->config.ring_size];
+    if (tracer->ring_num == tracer->config.ring_size) {
+        tracer->ring_head = (tracer->ring_head + 1) % tracer->config.ring_size;
+    } else {
+        tracer->ring_num++;
+    }
+    trace->type = event->type;
+    trace->room_id = entity->room_id;
+    trace->server_ms = server_ms;
+    trace->server_ns = server_ns;
+    trace->recv_ns = event->recv_ns;
+    trace->unzip_ns = event->unzip_ns;
+    trace->parse_ns = event->parse_ns;
+    trace->handler_start_ns = start_ns;
+    trace->handler_end_ns = end_ns;
+    if (raw_len) {
+        memcpy(trace->raw, event->raw, raw_len);
+    }
+    trace->raw[raw_len] = '\0';
+    pthread_mutex_unlock(&tracer->lock);
+
+    __atomic_fetch_add(&tracer->stats.sampled, 1, __ATOMIC_RELAXED);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+/**
+ * @file trace.h
+ * @author zhongqiaoning (691365572@qq.com)
+ * @brief 链路追踪的内部头文件，记录事件从服务端时间到回调结束经过的各个时间点
+ * @version 0.1
+ * @date 2023-02-20
+ * 
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef __BLIVE_TRACE_H__
+#define __BLIVE_TRACE_H__
+
+#include "blive_def.h"
+
+
+typedef struct blive_tracer blive_tracer;
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief 回调结束后汇总一个事件的各个区间，慢事件按采样比例写入慢事件记录。只在开启了链路追踪时调用
+ * 
+ * @param [in] entity 直播间实体
+ * @param [in] event 事件
+ * @param [in] start_ns 回调开始时间
+ * @param [in] end_ns 回调结束时间
+ */
+void blive_trace_record(blive* entity, const blive_event* event, uint64_t start_ns, uint64_t end_ns);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif
\ No newline at end of file